@@ -0,0 +1,812 @@
+/* FILE art_index.c
+ *    Implementation of the art_index functions, with an adaptive radix tree:
+ *    each inner node picks its child with one byte of the word, and comes in
+ *    one of four sizes (4, 16, 48 or 256 children) so that sparse nodes stay
+ *    small.  Bytes that every word below a node shares are skipped at once
+ *    ("path compression"), and each word ends in a leaf holding its pages.
+ */
+
+/******************************************************************************
+ *  Types and Constants.                                                      *
+ ******************************************************************************/
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "art_index.h"
+#include "index_file.h"
+#include "page_list.h"
+#include "slab.h"
+#include "writer.h"
+
+/* CONSTANTS ART_NODE4, ART_NODE16, ART_NODE48, ART_NODE256, ART_LEAF
+ *    The kinds of nodes: inner nodes with room for 4, 16, 48 or 256 children,
+ *    and leaves.  The inner kinds are numbered from 0, smallest first, so
+ *    they also number the slabs the inner nodes come from.
+ */
+#define ART_NODE4 0
+#define ART_NODE16 1
+#define ART_NODE48 2
+#define ART_NODE256 3
+#define ART_LEAF 4
+
+/* CONSTANT ART_INNER_KINDS -- The number of kinds of inner nodes. */
+#define ART_INNER_KINDS 4
+
+/* CONSTANT ART_MAX_PREFIX
+ *    Largest number of skipped bytes stored in an inner node.  Longer skips
+ *    are checked against a word below the node when it matters (while
+ *    inserting); lookups only check the stored bytes, and compare the whole
+ *    word once they reach a leaf.
+ */
+#define ART_MAX_PREFIX 8U
+
+/* MACRO KEY_BYTE
+ *    The byte of a word at a given depth.  Every word is followed by an
+ *    implicit 0 byte (words never contain one), so no word is a prefix of
+ *    another one and words only ever end in leaves.
+ */
+#define KEY_BYTE(text, len, depth) \
+    ((depth) < (len) ? (unsigned char) (text)[depth] : 0)
+
+/* TYPE art_node_t
+ *    The part shared by all nodes (the first member of every kind of node).
+ *    Only kind is used in leaves.
+ */
+typedef struct art_node {
+    unsigned char kind;        /* ART_NODE4, ..., ART_NODE256 or ART_LEAF */
+    unsigned short count;      /* number of children                     */
+    unsigned prefix_len;       /* number of bytes skipped by this node   */
+    unsigned char prefix[ART_MAX_PREFIX]; /* the first of those bytes   */
+} art_node_t;
+
+/* TYPES art_node4_t, art_node16_t
+ *    Inner nodes with up to 4 or 16 children, with the byte of each child
+ *    kept in increasing order.
+ */
+typedef struct art_node4 {
+    art_node_t node;            /* the part shared by all nodes     */
+    unsigned char keys[4];      /* the bytes of the children        */
+    art_node_t *children[4];    /* the children, in order of keys   */
+} art_node4_t;
+
+typedef struct art_node16 {
+    art_node_t node;            /* the part shared by all nodes     */
+    unsigned char keys[16];     /* the bytes of the children        */
+    art_node_t *children[16];   /* the children, in order of keys   */
+} art_node16_t;
+
+/* TYPE art_node48_t
+ *    An inner node with up to 48 children, found through a table of 256
+ *    one-byte slot numbers.
+ */
+typedef struct art_node48 {
+    art_node_t node;            /* the part shared by all nodes          */
+    unsigned char slots[256];   /* for each byte, 1 + the position of its
+                                   child in children (0 if it has none) */
+    art_node_t *children[48];   /* the children, in order of insertion   */
+} art_node48_t;
+
+/* TYPE art_node256_t -- An inner node with a child pointer for every byte. */
+typedef struct art_node256 {
+    art_node_t node;            /* the part shared by all nodes      */
+    art_node_t *children[256];  /* the child of each byte, or NULL   */
+} art_node256_t;
+
+/* TYPE art_leaf_t -- A word of the index and its pages. */
+typedef struct art_leaf {
+    art_node_t node;    /* the part shared by all nodes         */
+    page_list_t pages;  /* the pages the word appears on        */
+    size_t len;         /* number of characters in the word     */
+    char word[];        /* the word (not null-terminated)       */
+} art_leaf_t;
+
+/* TYPE struct art_index -- Definition of struct art_index from art_index.h. */
+struct art_index {
+    art_node_t *root;               /* root of the tree (NULL if empty)   */
+    size_t size;                    /* number of words in the index       */
+    slab_t nodes[ART_INNER_KINDS];  /* memory for each kind of inner node */
+};
+
+/* CONSTANT art_node_size -- The size of each kind of inner node. */
+static const size_t art_node_size[ART_INNER_KINDS] = {
+    sizeof(art_node4_t), sizeof(art_node16_t),
+    sizeof(art_node48_t), sizeof(art_node256_t)
+};
+
+/******************************************************************************
+ *  Declarations of helper functions -- including full documentation.         *
+ ******************************************************************************/
+
+/* FUNCTION art_search
+ *    Find the leaf of a word.  Only the skipped bytes stored in each node are
+ *    checked on the way down; the word in the leaf reached is compared in
+ *    full at the end.
+ * Parameters and preconditions:
+ *    index != NULL: the index to search
+ *    text != NULL (unless len == 0): the characters of the word
+ *    len: the number of characters in the word
+ * Return value:
+ *    the leaf of the word; NULL if the word is not in the index
+ * Side-effects:  none
+ */
+static
+art_leaf_t *art_search(const art_index_t *index, const char *text,
+                       size_t len);
+
+/* FUNCTION art_insert
+ *    Add a new word to an index, with its first page.
+ * Parameters and preconditions:
+ *    index != NULL: the index to add to
+ *    word != NULL: a word from the tokenizer that is not in the index yet
+ * Return value:
+ *    true if the word was added; false in case of error with memory
+ *    allocation
+ * Side-effects:
+ *    a leaf for the word (and up to one inner node) has been allocated and
+ *    linked into the tree, and an inner node may have been replaced by a
+ *    bigger one; nothing has changed in case of error
+ */
+static
+bool art_insert(art_index_t *index, const word_t *word);
+
+/* FUNCTION art_find_child
+ *    Find the link to the child of an inner node for a byte.
+ * Parameters and preconditions:
+ *    node != NULL: an inner node
+ *    byte: the byte of the child
+ * Return value:
+ *    a pointer to the link to the child; NULL if node has no child for byte
+ * Side-effects:  none
+ */
+static
+art_node_t **art_find_child(art_node_t *node, unsigned char byte);
+
+/* FUNCTION art_add_child
+ *    Add a child to an inner node, replacing the node by one of the next size
+ *    up first if it is full.
+ * Parameters and preconditions:
+ *    index != NULL: the index the node belongs to
+ *    ref != NULL: the link to the node (*ref != NULL, an inner node with no
+ *                 child for byte)
+ *    byte: the byte of the new child
+ *    child != NULL: the new child
+ * Return value:
+ *    true if the child was added; false in case of error with memory
+ *    allocation
+ * Side-effects:
+ *    child has been added to *ref; *ref may now point to a bigger copy of the
+ *    node, in which case the old node has been returned to its slab; nothing
+ *    has changed in case of error
+ */
+static
+bool art_add_child(art_index_t *index, art_node_t **ref, unsigned char byte,
+                   art_node_t *child);
+
+/* FUNCTION art_grow
+ *    Copy a full inner node into a new node of the next size up.
+ * Parameters and preconditions:
+ *    index != NULL: the index the node belongs to
+ *    node != NULL: a full inner node of kind ART_NODE4, ART_NODE16 or
+ *                  ART_NODE48
+ * Return value:
+ *    the new node, with the same skipped bytes and children as node; NULL in
+ *    case of error with memory allocation
+ * Side-effects:
+ *    memory has been allocated for the new node (node is not changed)
+ */
+static
+art_node_t *art_grow(art_index_t *index, const art_node_t *node);
+
+/* FUNCTION art_next_child
+ *    Return the children of an inner node one at a time, in order of their
+ *    bytes.
+ * Parameters and preconditions:
+ *    node != NULL: an inner node
+ *    pos != NULL: the position of the pass (0 before the first call; only
+ *                 changed by art_next_child after that)
+ * Return value:
+ *    the next child of node; NULL once every child has been returned
+ * Side-effects:
+ *    *pos has been moved past the child returned
+ */
+static
+const art_node_t *art_next_child(const art_node_t *node, unsigned *pos);
+
+/* FUNCTION art_minimum
+ *    Return the leaf of the smallest word below a node.
+ * Parameters and preconditions:
+ *    node != NULL: a node
+ * Return value:
+ *    the leaf of the smallest word in the subtree of node
+ * Side-effects:  none
+ */
+static
+const art_leaf_t *art_minimum(const art_node_t *node);
+
+/* FUNCTION art_prefix_mismatch
+ *    Compare the bytes skipped by an inner node with a word, using a word
+ *    below the node for the bytes that are not stored in it.
+ * Parameters and preconditions:
+ *    node != NULL: an inner node
+ *    text != NULL (unless len == 0), len: the characters of the word
+ *    depth: the depth of the node (the position in the word of its first
+ *           skipped byte)
+ * Return value:
+ *    the number of skipped bytes that match the word (node->prefix_len if
+ *    they all do)
+ * Side-effects:  none
+ */
+static
+size_t art_prefix_mismatch(const art_node_t *node, const char *text,
+                           size_t len, size_t depth);
+
+/* FUNCTION art_set_prefix
+ *    Store the skipped bytes of an inner node, taken from a word.
+ * Parameters and preconditions:
+ *    node != NULL: an inner node
+ *    text != NULL (unless len == 0), len: the characters of the word
+ *    depth: the position in the word of the first skipped byte
+ *    prefix_len: the number of bytes skipped (all within the word)
+ * Return value:  none
+ * Side-effects:
+ *    node->prefix_len is prefix_len, and the first (up to ART_MAX_PREFIX) of
+ *    those bytes are stored in node->prefix
+ */
+static
+void art_set_prefix(art_node_t *node, const char *text, size_t len,
+                    size_t depth, size_t prefix_len);
+
+/* FUNCTION art_node_create
+ *    Create a new inner node with no children and nothing skipped.
+ * Parameters and preconditions:
+ *    index != NULL: the index whose slabs to allocate from
+ *    kind: the kind of inner node (ART_NODE4 to ART_NODE256)
+ * Return value:
+ *    pointer to the new node; NULL in case of error with memory allocation
+ * Side-effects:
+ *    memory has been allocated for the new node
+ */
+static
+art_node_t *art_node_create(art_index_t *index, int kind);
+
+/* FUNCTION art_leaf_create
+ *    Create a new leaf for a word and its first page.
+ * Parameters and preconditions:
+ *    word != NULL: a word from the tokenizer (with page > 0)
+ * Return value:
+ *    pointer to a new leaf storing a copy of word and its page number;
+ *    NULL in case of error with memory allocation
+ * Side-effects:
+ *    memory has been allocated for the new leaf
+ */
+static
+art_leaf_t *art_leaf_create(const word_t *word);
+
+/* FUNCTION art_traverse
+ *    Call a function on every leaf below a node, in order of their words.
+ *    The recursion is at most one level deeper than the longest word.
+ * Parameters and preconditions:
+ *    node != NULL: the root of the subtree to traverse
+ *    fun != NULL: the function to call on each leaf (which may destroy the
+ *                 leaf, but not change the tree otherwise)
+ *    ctx: the context to pass to fun along with each leaf
+ * Return value:  none
+ * Side-effects:
+ *    fun has been called on each leaf below node, in order
+ */
+static
+void art_traverse(const art_node_t *node,
+                  void (*fun)(const art_leaf_t *, void *), void *ctx);
+
+/* FUNCTION art_height
+ *    Return the height of the subtree below a node.
+ * Parameters and preconditions:
+ *    node != NULL: the root of the subtree
+ * Return value:
+ *    the number of nodes on the longest path from node to a leaf
+ * Side-effects:  none
+ */
+static
+size_t art_height(const art_node_t *node);
+
+/* FUNCTION art_leaf_write
+ *    Write the word of a leaf and its pages to a writer, as one line.
+ * Parameters and preconditions:
+ *    leaf != NULL: a leaf
+ *    writer != NULL: the writer to add the line to (a writer_t *)
+ * Return value:  none
+ * Side-effects:
+ *    the line "word: page, page, ..." has been added to the writer
+ */
+static
+void art_leaf_write(const art_leaf_t *leaf, void *writer);
+
+/* FUNCTION art_leaf_save
+ *    Add the word and pages of a leaf to an index file builder.
+ * Parameters and preconditions:
+ *    leaf != NULL: a leaf
+ *    builder != NULL: the builder to add to (an index_file_builder_t *)
+ * Return value:  none
+ * Side-effects:
+ *    the word and pages of leaf have been added to the builder (which
+ *    remembers if that failed)
+ */
+static
+void art_leaf_save(const art_leaf_t *leaf, void *builder);
+
+/* FUNCTION art_leaf_destroy
+ *    Free the memory allocated for a leaf.
+ * Parameters and preconditions:
+ *    leaf != NULL: a leaf
+ *    ctx: not used
+ * Return value:  none
+ * Side-effects:
+ *    the memory allocated for leaf and its pages has been freed
+ */
+static
+void art_leaf_destroy(const art_leaf_t *leaf, void *ctx);
+
+/******************************************************************************
+ *  Definitions of "public" functions -- see header file for documentation.   *
+ ******************************************************************************/
+
+art_index_t *art_index_create(tokenizer_t *input, int min_word_len)
+{
+    art_index_t *index = malloc(sizeof(art_index_t));
+    art_leaf_t *leaf;
+    word_t word;
+    int kind;
+
+    if (! index)  return NULL;
+    index->root = NULL;
+    index->size = 0;
+    for (kind = 0; kind < ART_INNER_KINDS; kind++)
+        slab_init(&index->nodes[kind], art_node_size[kind]);
+
+    // as in word_index_create, a word that cannot be added is left out
+    while (tokenizer_next(input, &word)) {
+        if (word.len < (size_t) min_word_len)  continue;
+        if ((leaf = art_search(index, word.text, word.len)))
+            page_list_add(&leaf->pages, word.page);
+        else if (art_insert(index, &word))
+            index->size++;
+    }
+    return index;
+}
+
+void art_index_print(const art_index_t *index)
+{
+    art_index_write(index, stdout);
+}
+
+bool art_index_write(const art_index_t *index, FILE *out)
+{
+    writer_t writer;
+
+    writer_init(&writer, out);
+    if (index->root)  art_traverse(index->root, art_leaf_write, &writer);
+    return writer_flush(&writer);
+}
+
+bool art_index_save(const art_index_t *index, int min_word_len,
+                    const tokenizer_state_t *state, FILE *out)
+{
+    index_file_builder_t *builder = index_file_builder_create();
+    bool saved;
+
+    if (! builder)  return false;
+    index_file_set_source(builder, min_word_len, state);
+    if (index->root)  art_traverse(index->root, art_leaf_save, builder);
+    saved = index_file_save(builder, out);
+    index_file_builder_destroy(builder);
+    return saved;
+}
+
+size_t art_index_height(const art_index_t *index)
+{
+    return index->root ? art_height(index->root) : 0;
+}
+
+void art_index_destroy(art_index_t *index)
+{
+    int kind;
+
+    // the leaves are allocated one by one; the inner nodes all live in the
+    // slabs
+    if (index->root)  art_traverse(index->root, art_leaf_destroy, NULL);
+    for (kind = 0; kind < ART_INNER_KINDS; kind++)
+        slab_release(&index->nodes[kind]);
+    free(index);
+}
+
+/******************************************************************************
+ *  Definitions of helper functions -- see above for documentation.           *
+ ******************************************************************************/
+
+art_leaf_t *art_search(const art_index_t *index, const char *text,
+                       size_t len)
+{
+    art_node_t *node = index->root, **child;
+    art_leaf_t *leaf;
+    size_t depth = 0, stored, i;
+
+    while (node) {
+        if (node->kind == ART_LEAF) {
+            leaf = (art_leaf_t *) node;
+            return leaf->len == len && memcmp(leaf->word, text, len) == 0 ?
+                   leaf : NULL;
+        }
+        if (node->prefix_len > 0) {
+            stored = node->prefix_len < ART_MAX_PREFIX ? node->prefix_len
+                                                       : ART_MAX_PREFIX;
+            for (i = 0; i < stored; i++)
+                if (node->prefix[i] != KEY_BYTE(text, len, depth + i))
+                    return NULL;
+            depth += node->prefix_len;
+        }
+        child = art_find_child(node, KEY_BYTE(text, len, depth));
+        node = child ? *child : NULL;
+        depth++;
+    }
+    return NULL;
+}
+
+/* There are three ways a new word can branch off from the words already in
+ * the tree: at a leaf (a new 4-node takes the leaf's place, with both leaves
+ * below it), inside the bytes skipped by an inner node (a new 4-node takes
+ * the node's place, and the node keeps the bytes after the branch), or at an
+ * inner node that has no child for the next byte of the word.
+ */
+bool art_insert(art_index_t *index, const word_t *word)
+{
+    art_node_t **ref = &index->root, **child, *node, *branch;
+    art_leaf_t *leaf = art_leaf_create(word), *old;
+    const art_leaf_t *below;
+    const char *text = word->text;
+    size_t len = word->len, depth = 0, same, keep;
+
+    if (! leaf)  return false;
+
+    for (;;) {
+        node = *ref;
+        if (! node) {
+            *ref = &leaf->node;
+            return true;
+        }
+
+        if (node->kind == ART_LEAF) {
+            // the two words are different, so they differ at some byte
+            old = (art_leaf_t *) node;
+            for (same = 0; KEY_BYTE(old->word, old->len, depth + same) ==
+                           KEY_BYTE(text, len, depth + same); same++)
+                ;
+            if (! (branch = art_node_create(index, ART_NODE4)))  break;
+            art_set_prefix(branch, text, len, depth, same);
+            art_add_child(index, &branch,
+                          KEY_BYTE(old->word, old->len, depth + same), node);
+            art_add_child(index, &branch, KEY_BYTE(text, len, depth + same),
+                          &leaf->node);
+            *ref = branch;
+            return true;
+        }
+
+        if (node->prefix_len > 0) {
+            same = art_prefix_mismatch(node, text, len, depth);
+            if (same < node->prefix_len) {
+                if (! (branch = art_node_create(index, ART_NODE4)))  break;
+                art_set_prefix(branch, text, len, depth, same);
+                // the node keeps the bytes after the one it branches on,
+                // taken from a word below it if they are not all stored
+                keep = node->prefix_len - same - 1;
+                if (node->prefix_len <= ART_MAX_PREFIX) {
+                    art_add_child(index, &branch, node->prefix[same], node);
+                    memmove(node->prefix, node->prefix + same + 1, keep);
+                    node->prefix_len = keep;
+                } else {
+                    below = art_minimum(node);
+                    art_add_child(index, &branch,
+                                  KEY_BYTE(below->word, below->len,
+                                           depth + same), node);
+                    art_set_prefix(node, below->word, below->len,
+                                   depth + same + 1, keep);
+                }
+                art_add_child(index, &branch,
+                              KEY_BYTE(text, len, depth + same), &leaf->node);
+                *ref = branch;
+                return true;
+            }
+            depth += node->prefix_len;
+        }
+
+        child = art_find_child(node, KEY_BYTE(text, len, depth));
+        if (! child) {
+            if (! art_add_child(index, ref, KEY_BYTE(text, len, depth),
+                                &leaf->node))
+                break;
+            return true;
+        }
+        ref = child;
+        depth++;
+    }
+
+    // out of memory: nothing has been linked to the new leaf
+    art_leaf_destroy(leaf, NULL);
+    return false;
+}
+
+art_node_t **art_find_child(art_node_t *node, unsigned char byte)
+{
+    art_node4_t *n4;
+    art_node16_t *n16;
+    art_node48_t *n48;
+    art_node256_t *n256;
+    unsigned i;
+
+    switch (node->kind) {
+    case ART_NODE4:
+        n4 = (art_node4_t *) node;
+        for (i = 0; i < node->count; i++)
+            if (n4->keys[i] == byte)  return &n4->children[i];
+        return NULL;
+    case ART_NODE16:
+        // the keys are sorted, so the scan can stop at the first larger one
+        n16 = (art_node16_t *) node;
+        for (i = 0; i < node->count && n16->keys[i] <= byte; i++)
+            if (n16->keys[i] == byte)  return &n16->children[i];
+        return NULL;
+    case ART_NODE48:
+        n48 = (art_node48_t *) node;
+        return n48->slots[byte] ? &n48->children[n48->slots[byte] - 1] : NULL;
+    default:
+        n256 = (art_node256_t *) node;
+        return n256->children[byte] ? &n256->children[byte] : NULL;
+    }
+}
+
+bool art_add_child(art_index_t *index, art_node_t **ref, unsigned char byte,
+                   art_node_t *child)
+{
+    static const unsigned capacity[ART_INNER_KINDS] = { 4, 16, 48, 256 };
+    art_node_t *node = *ref, *bigger;
+    unsigned char *keys;
+    art_node_t **children;
+    unsigned i;
+
+    if (node->count == capacity[node->kind]) {
+        if (! (bigger = art_grow(index, node)))  return false;
+        slab_free(&index->nodes[node->kind], node);
+        *ref = node = bigger;
+    }
+
+    switch (node->kind) {
+    case ART_NODE4:
+    case ART_NODE16:
+        if (node->kind == ART_NODE4) {
+            keys = ((art_node4_t *) node)->keys;
+            children = ((art_node4_t *) node)->children;
+        } else {
+            keys = ((art_node16_t *) node)->keys;
+            children = ((art_node16_t *) node)->children;
+        }
+        // shift the larger keys up to keep them in order
+        for (i = node->count; i > 0 && keys[i - 1] > byte; i--) {
+            keys[i] = keys[i - 1];
+            children[i] = children[i - 1];
+        }
+        keys[i] = byte;
+        children[i] = child;
+        break;
+    case ART_NODE48:
+        // children are never removed, so the first free slot is at count
+        ((art_node48_t *) node)->children[node->count] = child;
+        ((art_node48_t *) node)->slots[byte] =
+            (unsigned char) (node->count + 1);
+        break;
+    default:
+        ((art_node256_t *) node)->children[byte] = child;
+        break;
+    }
+    node->count++;
+    return true;
+}
+
+art_node_t *art_grow(art_index_t *index, const art_node_t *node)
+{
+    art_node_t *bigger = art_node_create(index, node->kind + 1);
+    const art_node16_t *n16;
+    const art_node48_t *n48;
+    art_node256_t *n256;
+    unsigned i;
+
+    if (! bigger)  return NULL;
+    bigger->count = node->count;
+    bigger->prefix_len = node->prefix_len;
+    memcpy(bigger->prefix, node->prefix, ART_MAX_PREFIX);
+
+    switch (node->kind) {
+    case ART_NODE4:
+        // both keep their keys in order, in arrays that start the same way
+        memcpy(((art_node16_t *) bigger)->keys,
+               ((const art_node4_t *) node)->keys, 4);
+        memcpy(((art_node16_t *) bigger)->children,
+               ((const art_node4_t *) node)->children,
+               4 * sizeof(art_node_t *));
+        break;
+    case ART_NODE16:
+        n16 = (const art_node16_t *) node;
+        for (i = 0; i < 16; i++) {
+            ((art_node48_t *) bigger)->children[i] = n16->children[i];
+            ((art_node48_t *) bigger)->slots[n16->keys[i]] =
+                (unsigned char) (i + 1);
+        }
+        break;
+    default:
+        n48 = (const art_node48_t *) node;
+        n256 = (art_node256_t *) bigger;
+        for (i = 0; i < 256; i++)
+            if (n48->slots[i])
+                n256->children[i] = n48->children[n48->slots[i] - 1];
+        break;
+    }
+    return bigger;
+}
+
+const art_node_t *art_next_child(const art_node_t *node, unsigned *pos)
+{
+    const art_node48_t *n48;
+    const art_node256_t *n256;
+
+    switch (node->kind) {
+    case ART_NODE4:
+        return *pos < node->count ?
+               ((const art_node4_t *) node)->children[(*pos)++] : NULL;
+    case ART_NODE16:
+        return *pos < node->count ?
+               ((const art_node16_t *) node)->children[(*pos)++] : NULL;
+    case ART_NODE48:
+        // the position is a byte: go through the slots in order of bytes
+        n48 = (const art_node48_t *) node;
+        for (; *pos < 256; (*pos)++)
+            if (n48->slots[*pos])
+                return n48->children[n48->slots[(*pos)++] - 1];
+        return NULL;
+    default:
+        n256 = (const art_node256_t *) node;
+        for (; *pos < 256; (*pos)++)
+            if (n256->children[*pos])  return n256->children[(*pos)++];
+        return NULL;
+    }
+}
+
+const art_leaf_t *art_minimum(const art_node_t *node)
+{
+    unsigned pos;
+
+    while (node->kind != ART_LEAF) {
+        pos = 0;
+        node = art_next_child(node, &pos);
+    }
+    return (const art_leaf_t *) node;
+}
+
+size_t art_prefix_mismatch(const art_node_t *node, const char *text,
+                           size_t len, size_t depth)
+{
+    size_t stored = node->prefix_len < ART_MAX_PREFIX ? node->prefix_len
+                                                      : ART_MAX_PREFIX;
+    const art_leaf_t *below;
+    size_t i;
+
+    for (i = 0; i < stored; i++)
+        if (node->prefix[i] != KEY_BYTE(text, len, depth + i))  return i;
+
+    // every word below the node has the same skipped bytes
+    if (node->prefix_len > ART_MAX_PREFIX) {
+        below = art_minimum(node);
+        for (; i < node->prefix_len; i++)
+            if (KEY_BYTE(below->word, below->len, depth + i) !=
+                KEY_BYTE(text, len, depth + i))
+                return i;
+    }
+    return i;
+}
+
+void art_set_prefix(art_node_t *node, const char *text, size_t len,
+                    size_t depth, size_t prefix_len)
+{
+    size_t i;
+
+    node->prefix_len = (unsigned) prefix_len;
+    for (i = 0; i < prefix_len && i < ART_MAX_PREFIX; i++)
+        node->prefix[i] = KEY_BYTE(text, len, depth + i);
+}
+
+art_node_t *art_node_create(art_index_t *index, int kind)
+{
+    art_node_t *node = slab_alloc(&index->nodes[kind]);
+
+    // zero every child pointer and slot, then fill in the shared part
+    if (node) {
+        memset(node, 0, art_node_size[kind]);
+        node->kind = (unsigned char) kind;
+    }
+    return node;
+}
+
+art_leaf_t *art_leaf_create(const word_t *word)
+{
+    // the word is stored right after the leaf, in the same block
+    art_leaf_t *leaf = malloc(sizeof(art_leaf_t) + word->len);
+
+    if (leaf) {
+        leaf->node.kind = ART_LEAF;
+        leaf->node.count = 0;
+        leaf->node.prefix_len = 0;
+        leaf->len = word->len;
+        memcpy(leaf->word, word->text, word->len);
+        page_list_init(&leaf->pages);
+        page_list_add(&leaf->pages, word->page);
+    }
+    return leaf;
+}
+
+void art_traverse(const art_node_t *node,
+                  void (*fun)(const art_leaf_t *, void *), void *ctx)
+{
+    const art_node_t *child;
+    unsigned pos = 0;
+
+    if (node->kind == ART_LEAF) {
+        (*fun)((const art_leaf_t *) node, ctx);
+        return;
+    }
+    while ((child = art_next_child(node, &pos)))
+        art_traverse(child, fun, ctx);
+}
+
+size_t art_height(const art_node_t *node)
+{
+    const art_node_t *child;
+    unsigned pos = 0;
+    size_t height = 0, h;
+
+    if (node->kind == ART_LEAF)  return 1;
+    while ((child = art_next_child(node, &pos)))
+        if ((h = art_height(child)) > height)  height = h;
+    return height + 1;
+}
+
+void art_leaf_write(const art_leaf_t *leaf, void *writer)
+{
+    page_iter_t pages;
+    unsigned page;
+
+    // the same line as entry_write in word_index.c
+    writer_put(writer, leaf->word, leaf->len);
+    writer_put(writer, ": ", 2);
+    page_list_begin(&leaf->pages, &pages);
+    if (page_list_next(&pages, &page))
+        writer_put_uint(writer, page);
+    while (page_list_next(&pages, &page)) {
+        writer_put(writer, ", ", 2);
+        writer_put_uint(writer, page);
+    }
+    writer_put_char(writer, '\n');
+}
+
+void art_leaf_save(const art_leaf_t *leaf, void *builder)
+{
+    index_file_add(builder, leaf->word, leaf->len, &leaf->pages);
+}
+
+void art_leaf_destroy(const art_leaf_t *leaf, void *ctx)
+{
+    art_leaf_t *old = (art_leaf_t *) leaf;
+
+    (void) ctx;
+    page_list_destroy(&old->pages);
+    free(old);
+}
@@ -0,0 +1,113 @@
+/* FILE art_index.h
+ *    Declarations of functions to build, print and destroy an index of the
+ *    words (and their page numbers) in a text file, stored in an adaptive
+ *    radix tree instead of a bag: the same index as word_index.h, looked up
+ *    one byte of the word at a time, without comparing whole words.
+ */
+#ifndef ART_INDEX_H
+#define ART_INDEX_H
+
+/******************************************************************************
+ *  Types and Constants.                                                      *
+ ******************************************************************************/
+
+#include <stdbool.h> /* for type bool   */
+#include <stdio.h>   /* for type FILE   */
+#include <stdlib.h>  /* for type size_t */
+
+#include "file_util.h"
+#include "index_file.h"
+
+/* CONSTANT ART_INDEX_NAME
+ *    The name that selects this index wherever a kind of bag can be named
+ *    (index --backend=art, bench --backends=...,art).
+ */
+#define ART_INDEX_NAME "art"
+
+/* TYPE art_index_t -- An index stored in an adaptive radix tree. */
+typedef struct art_index art_index_t;
+
+/******************************************************************************
+ *  Function declarations -- with full documentation.                         *
+ ******************************************************************************/
+
+/* FUNCTION art_index_create
+ *    Create and return an index of every word whose length is at least
+ *    min_word_len in file input, along with each word's page numbers.  The
+ *    file is indexed by the calling thread.
+ * Parameters and preconditions:
+ *    input != NULL: a tokenizer positioned at the start of the file
+ *    min_word_len > 0: the minimum length of words to put in the index
+ * Return value:
+ *    an index that contains every word in file input whose length is at
+ *    least min_word_length, along with the page numbers where the word
+ *    appears; NULL in case of any error with memory allocation
+ * Side-effects:
+ *    memory is allocated for the index and the file has been read to the end
+ */
+art_index_t *art_index_create(tokenizer_t *input, int min_word_len);
+
+/* FUNCTION art_index_print
+ *    Print every word of an index and its page numbers to stdout, in order,
+ *    exactly as word_index_print does.
+ * Parameters and preconditions:
+ *    index != NULL: an index created by art_index_create
+ * Return value:  none
+ * Side-effects:
+ *    one line of the form "word: page, page, ..." has been printed to stdout
+ *    for every word in the index
+ */
+void art_index_print(const art_index_t *index);
+
+/* FUNCTION art_index_write
+ *    Write every word of an index and its page numbers to a file, in order,
+ *    in the same form as art_index_print.
+ * Parameters and preconditions:
+ *    index != NULL: an index created by art_index_create
+ *    out != NULL: a file open for writing
+ * Return value:
+ *    true if the whole index was handed to out; false if a write failed
+ * Side-effects:
+ *    one line of the form "word: page, page, ..." has been written to out for
+ *    every word in the index
+ */
+bool art_index_write(const art_index_t *index, FILE *out);
+
+/* FUNCTION art_index_save
+ *    Save an index to a binary index file (see index_file.h), exactly as
+ *    word_index_save does.
+ * Parameters and preconditions:
+ *    index != NULL: an index created by art_index_create
+ *    min_word_len, state: as for word_index_save
+ *    out != NULL: a file open for writing in binary mode
+ * Return value:
+ *    true if the whole index file was handed to out; false if a write failed
+ *    or in case of error with memory allocation
+ * Side-effects:
+ *    the index file of every word in the index has been written to out
+ */
+bool art_index_save(const art_index_t *index, int min_word_len,
+                    const tokenizer_state_t *state, FILE *out);
+
+/* FUNCTION art_index_height
+ *    Return the height of an index: the most nodes visited by a lookup.
+ * Parameters and preconditions:
+ *    index != NULL: an index created by art_index_create
+ * Return value:
+ *    the number of nodes on the longest path from the root to a word (0 if
+ *    the index is empty)
+ * Side-effects:  none
+ */
+size_t art_index_height(const art_index_t *index);
+
+/* FUNCTION art_index_destroy
+ *    Free all the memory allocated for an index.
+ * Parameters and preconditions:
+ *    index != NULL: an index created by art_index_create
+ * Return value:  none
+ * Side-effects:
+ *    all memory allocated for the index and its words has been freed
+ */
+void art_index_destroy(art_index_t *index);
+
+#endif/*ART_INDEX_H*/
@@ -7,10 +7,12 @@
  *  Types and Constants.                                                      *
  ******************************************************************************/
 
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 
-#include "bag.h"
+#include "bag_impl.h"
+#include "slab.h"
 
 /* MACRO HEIGHT
  *    An expression for one more than the height of a node in an AVL tree
@@ -19,123 +21,167 @@
  */
 #define HEIGHT(node) ((node) ? (node)->height : 0)
 
+/* MACRO SIZE
+ *    An expression for the number of nodes in the subtree rooted at a node
+ *    in an AVL tree (evaluates to 0 if node == NULL).
+ * Side-effects:  evaluates its argument more than once
+ */
+#define SIZE(node) ((node) ? (node)->size : 0)
+
+/* CONSTANT AVL_MAX_HEIGHT
+ *    Upper bound on the height of any AVL tree that fits in memory (an AVL
+ *    tree of height h has more than 1.6^h nodes), used as the size of the
+ *    explicit stacks that replace recursion.
+ */
+#define AVL_MAX_HEIGHT 96
+
+/* CONSTANT AVL_MAX_SIZE
+ *    The largest number of elements an AVL bag can hold.  The size of each
+ *    subtree is kept in an unsigned (next to the height, in what would
+ *    otherwise be padding), so larger bags are refused rather than letting
+ *    the sizes wrap around.
+ */
+#define AVL_MAX_SIZE UINT_MAX
+
 /* TYPE avl_note_t -- A node in an AVL tree. */
 typedef struct avl_node {
+    bag_key_t key;          /* the key of elem (0 if bag has no key) */
     bag_elem_t elem;        /* the element stored in this node       */
     unsigned height;        /* one more than the height of this node */
+    unsigned size;          /* number of nodes in this node's subtree */
     struct avl_node *left;  /* pointer to this node's left child     */
     struct avl_node *right; /* pointer to this node's right child    */
 } avl_node_t;
 
-/* TYPE struct bag -- Definition of struct bag from the header. */
-struct bag {
+/* TYPE avl_bag_t
+ *    A bag stored in an AVL tree.
+ */
+typedef struct avl_bag {
+    bag_t base; /* the part shared by all bags (must come first) */
     size_t size; /* number of elements in this bag */
     avl_node_t *root; /* root of the AVL tree storing the elements */
     int (*cmp)(bag_elem_t, bag_elem_t); /* function to compare elements */
-};
+    bag_key_t (*key)(bag_elem_t); /* key function for cmp, or NULL */
+    slab_t nodes; /* memory for the nodes of the tree */
+#ifdef BAG_STATS
+    bag_counters_t counters; /* work done by this bag so far */
+#endif
+} avl_bag_t;
 
 /******************************************************************************
  *  Declarations of helper functions -- including full documentation.         *
  ******************************************************************************/
 
-/* FUNCTION avl_destroy
- *    Free the memory allocated for the binary tree rooted at a given node.
- * Parameters and preconditions:
- *    root: the root of the tree to free
- * Return value:  none
- * Side-effects:
- *    all the memory allocated for nodes in the subtree rooted at root has been
- *    freed
- */
-static
-void avl_destroy(avl_node_t *root);
-
 /* FUNCTION avl_traverse
- *    Call a function on every element in a BST, given its root.
+ *    Call a function on every element in a BST, given its root.  Uses an
+ *    explicit stack of AVL_MAX_HEIGHT nodes instead of recursion.
  * Parameters and preconditions:
- *    root: the root of the BST to traverse
+ *    root: the root of the AVL tree to traverse
  *    fun != NULL: a pointer to a function to apply to each element in the tree
+ *    ctx: the context to pass to fun along with each element
  * Return value:  none
  * Side-effect:
  *    function fun has been called on each element in the tree rooted at root,
  *    in order
  */
 static
-void avl_traverse(const avl_node_t *root, void (*fun)(bag_elem_t));
+void avl_traverse(const avl_node_t *root,
+                  void (*fun)(bag_elem_t, void *), void *ctx);
 
 /* FUNCTION avl_contains
- *    Return whether or not a BST contains a certain element, given the root.
+ *    Return whether or not the AVL tree of a bag contains a certain element.
  * Parameters and preconditions:
- *    root: the root of the BST to search
+ *    bag != NULL: the bag to search
  *    elem != NULL: the element to search for
- *    cmp != NULL: the comparison function to use for the search
  * Return value:
- *    elem, if the BST rooted at 'root' contains it; NULL otherwise
- * Side-effects:  none
+ *    the element of the bag equal to elem, if there is one; NULL otherwise
+ * Side-effects:  none (other than counting the work done, with BAG_STATS)
  */
 static
-bag_elem_t avl_contains(const avl_node_t *root, bag_elem_t elem,
-                        int (*cmp)(bag_elem_t, bag_elem_t));
+bag_elem_t avl_contains(avl_bag_t *bag, bag_elem_t elem);
 
 /* FUNCTION avl_insert
- *    Add an element to a BST, given a pointer to its root.
+ *    Add an element to the AVL tree of a bag.  The links followed on the way
+ *    down are kept on an explicit stack, which is then used to rebalance the
+ *    tree on the way back up.
  * Parameters and preconditions:
- *    root: a pointer to the root of the BST into which to insert
+ *    bag != NULL: the bag into which to insert
  *    elem != NULL: the element to insert
- *    cmp != NULL: the comparison function to use to find the insertion point
  * Return value:
- *    elem, if it was inserted; NULL in case of error
+ *    elem, if it was inserted; NULL in case of error (or if the bag already
+ *    holds AVL_MAX_SIZE elements)
+ * Side-effects:
+ *    a node has been allocated from the bag's slab for the new element, and
+ *    the tree structure has been adjusted accordingly
+ */
+static
+bag_elem_t avl_insert(avl_bag_t *bag, bag_elem_t elem);
+
+/* FUNCTION avl_find_or_insert
+ *    Find the element of the AVL tree of a bag equal to a probe, or add a new
+ *    one made from the probe at the empty subtree where the search ended,
+ *    then rebalance the path like avl_insert.
+ * Parameters and preconditions:
+ *    bag != NULL: the bag to search
+ *    probe, make, ctx: as for bag_find_or_insert
+ * Return value:
+ *    the element equal to probe, found or made; NULL in case of error (or if
+ *    none was found and the bag already holds AVL_MAX_SIZE elements)
  * Side-effects:
- *    memory has been allocated for the new element, and the tree structure has
- *    been adjusted accordingly
+ *    if no element was equal to probe, a node has been allocated from the
+ *    bag's slab for the element made, the tree structure has been adjusted
+ *    accordingly and bag->size has been increased
  */
 static
-bag_elem_t avl_insert(avl_node_t **root, bag_elem_t elem,
-                      int (*cmp)(bag_elem_t, bag_elem_t));
+bag_elem_t avl_find_or_insert(avl_bag_t *bag, bag_elem_t probe,
+                              bag_elem_t (*make)(bag_elem_t, void *),
+                              void *ctx);
 
 /* FUNCTION avl_remove
- *    Remove an element from a BST, given a pointer to its root.
+ *    Remove an element from the AVL tree of a bag.  Like avl_insert, uses an
+ *    explicit stack of links instead of recursion.
  * Parameters and preconditions:
- *    root: a pointer to the root of the BST into which to remove
+ *    bag != NULL: the bag from which to remove
  *    elem != NULL: the element to remove
- *    cmp != NULL: the comparison function to use to find the removal point
  * Return value:
  *    elem, if it was removed; NULL if the element was not there
  * Side-effects:
- *    memory has been freed for the element removed, and the tree structure has
- *    been adjusted accordingly
+ *    the node of the element removed has been returned to the bag's slab, and
+ *    the tree structure has been adjusted accordingly
  */
 static
-bag_elem_t avl_remove(avl_node_t **root, bag_elem_t elem,
-                      int (*cmp)(bag_elem_t, bag_elem_t));
+bag_elem_t avl_remove(avl_bag_t *bag, bag_elem_t elem);
 
-/* FUNCTION avl_remove_min
- *    Remove and return the smallest element in a BST, given a pointer to its
- *    root.
+/* FUNCTION avl_fix_path
+ *    Rebalance the nodes along a path from the root of an AVL tree, starting
+ *    from the bottom, after a node was added or removed below the path.
  * Parameters and preconditions:
- *    root: a pointer to the root of the BST
+ *    path != NULL: the links to the nodes on the path, from the root down
+ *    depth: the number of links in path
  * Return value:
- *    the smallest element in the BST rooted at 'root'
+ *    the number of rotations performed
  * Side-effects:
- *    memory has been freed for the node containing the smallest element, and
- *    the tree structure has been adjusted accordingly
+ *    every node on the path whose subtree may have changed height has been
+ *    rebalanced and had its height updated; stops as soon as the height of a
+ *    subtree is unchanged, since the nodes above cannot be affected then
  */
 static
-bag_elem_t avl_remove_min(avl_node_t **root);
+unsigned avl_fix_path(avl_node_t **path[], size_t depth);
 
-/* FUNCTION avl_remove_max
- *    Remove and return the largest element in a BST, given a pointer to its
- *    root.
+/* FUNCTION avl_rebalance
+ *    Rebalance the subtree rooted at *root if one of its subtrees is too tall,
+ *    and update its height.
  * Parameters and preconditions:
- *    root: a pointer to the root of the BST
+ *    root != NULL: a pointer to the root of the tree to rebalance
+ *                  (*root != NULL and its children are AVL trees)
  * Return value:
- *    the largest element in the BST rooted at 'root'
+ *    the number of rotations performed (0, 1 or 2)
  * Side-effects:
- *    memory has been freed for the node containing the largest element, and
- *    the tree structure has been adjusted accordingly
+ *    the subtree rooted at *root has been rebalanced, and the heights of each
+ *    node involved have been updated appropriately
  */
 static
-bag_elem_t avl_remove_max(avl_node_t **root);
+unsigned avl_rebalance(avl_node_t **root);
 
 /* FUNCTION avl_rebalance_to_the_left
  *    Rebalance the subtree rooted at *root, given that its right subtree is too
@@ -143,13 +189,14 @@ bag_elem_t avl_remove_max(avl_node_t **root);
  * Parameters and preconditions:
  *    root != NULL: a pointer to the root of the tree to rebalance
  *                  (*root != NULL and (*root)->right != NULL)
- * Return value:  none
+ * Return value:
+ *    the number of rotations performed (1 or 2)
  * Side-effects:
  *    the subtree rooted at *root has been rebalanced, and the heights of each
  *    node involved have been updated appropriately
  */
 static
-void avl_rebalance_to_the_left(avl_node_t **root);
+unsigned avl_rebalance_to_the_left(avl_node_t **root);
 
 /* FUNCTION avl_rebalance_to_the_right
  *    Rebalance the subtree rooted at *root, given that its left subtree is too
@@ -157,13 +204,14 @@ void avl_rebalance_to_the_left(avl_node_t **root);
  * Parameters and preconditions:
  *    root != NULL: a pointer to the root of the tree to rebalance
  *                  (*root != NULL and (*root)->left != NULL)
- * Return value:  none
+ * Return value:
+ *    the number of rotations performed (1 or 2)
  * Side-effects:
  *    the subtree rooted at *root has been rebalanced, and the heights of each
  *    node involved have been updated appropriately
  */
 static
-void avl_rebalance_to_the_right(avl_node_t **root);
+unsigned avl_rebalance_to_the_right(avl_node_t **root);
 
 /* FUNCTION avl_rotate_to_the_left
  *    Perform a single rotation of *parent to the left -- the tree structure
@@ -212,243 +260,537 @@ void avl_rotate_to_the_right(avl_node_t **parent);
 static
 void avl_update_height(avl_node_t *node);
 
+/* FUNCTION avl_update_size
+ *    Update the size of the subtree rooted at a node (based on the sizes of
+ *    its children).
+ * Parameters and preconditions:
+ *    node != NULL: the node to update
+ * Return value:  none
+ * Side-effects:
+ *    the size of node is updated
+ */
+static
+void avl_update_size(avl_node_t *node);
+
 /* FUNCTION avl_node_create
  *    Create a new avl_node.
  * Parameters and preconditions:
+ *    key: the key of elem
  *    elem: the element to store in the new node
+ *    nodes != NULL: the slab from which to allocate the new node
  * Return value:
- *    pointer to a new node that stores elem and whose children are both NULL;
+ *    pointer to a new node that stores key and elem and whose children are
+ *    both NULL;
  *    NULL in case of error with memory allocation
  * Side-effects:
- *    memory has been allocated for the new node
+ *    memory has been allocated from nodes for the new node (nodes created one
+ *    after the other are stored next to each other in memory)
  */
 static
-avl_node_t *avl_node_create(bag_elem_t elem);
+avl_node_t *avl_node_create(bag_key_t key, bag_elem_t elem, slab_t *nodes);
+
+/* FUNCTION avl_build
+ *    Build a perfectly balanced AVL tree from a sorted array of elements: the
+ *    middle element goes at the root, and each half of the array is built
+ *    into one of its subtrees the same way.
+ * Parameters and preconditions:
+ *    bag != NULL: the bag the tree is built for (whose slab the nodes are
+ *          allocated from, and whose key function gives their keys)
+ *    root != NULL: where to store the root of the new tree
+ *    elems != NULL (unless n == 0): the sorted elements to store
+ *    n: the number of elements in elems
+ * Return value:
+ *    true if the tree was built; false in case of error with memory
+ *    allocation (the nodes already allocated are left in the slab)
+ * Side-effects:
+ *    n nodes have been allocated from the bag's slab, in order of their
+ *    elements, and their keys, heights and sizes set; *root is the root of
+ *    the new tree (bag->root and bag->size are not changed)
+ */
+static
+bool avl_build(avl_bag_t *bag, avl_node_t **root,
+               const bag_elem_t elems[], size_t n);
 
 /******************************************************************************
- *  Definitions of "public" functions -- see header file for documentation.   *
+ *  Declarations of the bag operations -- see bag.h for documentation.        *
  ******************************************************************************/
 
-bag_t *bag_create(int (*cmp)(bag_elem_t, bag_elem_t))
+static
+bag_t *avl_bag_create(int (*cmp)(bag_elem_t, bag_elem_t),
+                      unsigned long (*hash)(bag_elem_t),
+                      bag_key_t (*key)(bag_elem_t));
+
+static
+bag_t *avl_bag_build(int (*cmp)(bag_elem_t, bag_elem_t),
+                     unsigned long (*hash)(bag_elem_t),
+                     bag_key_t (*key)(bag_elem_t),
+                     const bag_elem_t elems[], size_t n);
+
+static
+void avl_bag_destroy(bag_t *b);
+
+static
+size_t avl_bag_size(const bag_t *b);
+
+static
+bool avl_bag_traverse(const bag_t *b,
+                      void (*fun)(bag_elem_t, void *), void *ctx);
+
+static
+bag_elem_t avl_bag_contains(bag_t *b, bag_elem_t elem);
+
+static
+bag_elem_t avl_bag_insert(bag_t *b, bag_elem_t elem);
+
+static
+bag_elem_t avl_bag_find_or_insert(bag_t *b, bag_elem_t probe,
+                                  bag_elem_t (*make)(bag_elem_t, void *),
+                                  void *ctx);
+
+static
+bag_elem_t avl_bag_remove(bag_t *b, bag_elem_t elem);
+
+static
+void avl_bag_stats(const bag_t *b, bag_stats_t *stats);
+
+static
+size_t avl_bag_rank(bag_t *b, bag_elem_t elem);
+
+static
+bag_elem_t avl_bag_select(const bag_t *b, size_t k);
+
+static
+void avl_bag_range(bag_t *b, bag_elem_t lo, bag_elem_t hi,
+                   bool (*fun)(bag_elem_t, void *), void *ctx);
+
+/* CONSTANT avl_bag_ops -- See bag_impl.h for documentation. */
+const bag_ops_t avl_bag_ops = {
+    "avl",
+    avl_bag_create,
+    avl_bag_build,
+    avl_bag_destroy,
+    avl_bag_size,
+    avl_bag_traverse,
+    avl_bag_contains,
+    avl_bag_insert,
+    avl_bag_find_or_insert,
+    avl_bag_remove,
+    avl_bag_stats,
+    avl_bag_rank,
+    avl_bag_select,
+    avl_bag_range
+};
+
+/******************************************************************************
+ *  Definitions of the bag operations -- see bag.h for documentation.         *
+ ******************************************************************************/
+
+bag_t *avl_bag_create(int (*cmp)(bag_elem_t, bag_elem_t),
+                      unsigned long (*hash)(bag_elem_t),
+                      bag_key_t (*key)(bag_elem_t))
 {
-    bag_t *bag = malloc(sizeof(bag_t));
+    avl_bag_t *bag = malloc(sizeof(avl_bag_t));
+
+    /* Search trees only need the comparison function (and the keys). */
+    (void) hash;
     if (bag) {
+        bag->base.ops = &avl_bag_ops;
         bag->size = 0;
         bag->root = NULL;
         bag->cmp = cmp;
+        bag->key = key;
+        slab_init(&bag->nodes, sizeof(avl_node_t));
+        BAG_COUNTERS_INIT(bag);
+    }
+    return (bag_t *) bag;
+}
+
+bag_t *avl_bag_build(int (*cmp)(bag_elem_t, bag_elem_t),
+                     unsigned long (*hash)(bag_elem_t),
+                     bag_key_t (*key)(bag_elem_t),
+                     const bag_elem_t elems[], size_t n)
+{
+    bag_t *b;
+    avl_bag_t *bag;
+
+    if (n > AVL_MAX_SIZE || ! (b = avl_bag_create(cmp, hash, key)))
+        return NULL;
+    bag = (avl_bag_t *) b;
+    if (! avl_build(bag, &bag->root, elems, n)) {
+        avl_bag_destroy(b);
+        return NULL;
     }
-    return bag;
+    bag->size = n;
+    BAG_COUNT(bag, node_allocs, n);
+    return b;
 }
 
-void bag_destroy(bag_t *bag)
+void avl_bag_destroy(bag_t *b)
 {
-    avl_destroy(bag->root);
+    avl_bag_t *bag = (avl_bag_t *) b;
+
+    /* Every node lives in the slab, so there is no need to walk the tree. */
+    slab_release(&bag->nodes);
     free(bag);
 }
 
-size_t bag_size(const bag_t *bag)
+size_t avl_bag_size(const bag_t *b)
 {
+    const avl_bag_t *bag = (const avl_bag_t *) b;
     return bag->size;
 }
 
-void bag_traverse(const bag_t *bag, void (*fun)(bag_elem_t))
+bool avl_bag_traverse(const bag_t *b,
+                      void (*fun)(bag_elem_t, void *), void *ctx)
 {
-    avl_traverse(bag->root, fun);
+    const avl_bag_t *bag = (const avl_bag_t *) b;
+    avl_traverse(bag->root, fun, ctx);
+    return true;
 }
 
-bag_elem_t bag_contains(bag_t *bag, bag_elem_t elem)
+bag_elem_t avl_bag_contains(bag_t *b, bag_elem_t elem)
 {
-    return avl_contains(bag->root, elem, bag->cmp);
+    avl_bag_t *bag = (avl_bag_t *) b;
+    bag_elem_t e = avl_contains(bag, elem);
+    BAG_END_SEARCH(bag);
+    return e;
 }
 
-bag_elem_t bag_insert(bag_t *bag, bag_elem_t elem)
+bag_elem_t avl_bag_insert(bag_t *b, bag_elem_t elem)
 {
-    bag_elem_t e = avl_insert(&bag->root, elem, bag->cmp);
+    avl_bag_t *bag = (avl_bag_t *) b;
+    bag_elem_t e = avl_insert(bag, elem);
+    BAG_END_SEARCH(bag);
     if (e)  bag->size++;
     return e;
 }
 
-bag_elem_t bag_remove(bag_t *bag, bag_elem_t elem)
+bag_elem_t avl_bag_find_or_insert(bag_t *b, bag_elem_t probe,
+                                  bag_elem_t (*make)(bag_elem_t, void *),
+                                  void *ctx)
+{
+    avl_bag_t *bag = (avl_bag_t *) b;
+    bag_elem_t e = avl_find_or_insert(bag, probe, make, ctx);
+    BAG_END_SEARCH(bag);
+    return e;
+}
+
+bag_elem_t avl_bag_remove(bag_t *b, bag_elem_t elem)
 {
-    bag_elem_t e = avl_remove(&bag->root, elem, bag->cmp);
+    avl_bag_t *bag = (avl_bag_t *) b;
+    bag_elem_t e = avl_remove(bag, elem);
+    BAG_END_SEARCH(bag);
     if (e)  bag->size--;
     return e;
 }
 
+void avl_bag_stats(const bag_t *b, bag_stats_t *stats)
+{
+    const avl_bag_t *bag = (const avl_bag_t *) b;
+    stats->height = HEIGHT(bag->root);
+    BAG_GET_STATS(bag, stats);
+}
+
+/* Every element smaller than elem is either in the left subtree of a node
+ * that is not smaller, or is a node that is smaller along with its whole left
+ * subtree.  Elements equal to elem can be in either subtree of one another,
+ * so the search goes left at those to count only the smaller ones.
+ */
+size_t avl_bag_rank(bag_t *b, bag_elem_t elem)
+{
+    avl_bag_t *bag = (avl_bag_t *) b;
+    const avl_node_t *root = bag->root;
+    bag_key_t key = BAG_KEY(bag, elem);
+    size_t rank = 0;
+
+    while (root) {
+        BAG_VISIT(bag);
+        if (BAG_KEY_CMP(bag, key, elem, root->key, root->elem) <= 0) {
+            root = root->left;
+        } else {
+            rank += SIZE(root->left) + 1;
+            root = root->right;
+        }
+    }
+    BAG_END_SEARCH(bag);
+    return rank;
+}
+
+bag_elem_t avl_bag_select(const bag_t *b, size_t k)
+{
+    const avl_bag_t *bag = (const avl_bag_t *) b;
+    const avl_node_t *root = bag->root;
+
+    if (k >= bag->size)  return NULL;
+    /* k counts the elements of the subtree of root that come before. */
+    while (k != SIZE(root->left)) {
+        if (k < SIZE(root->left)) {
+            root = root->left;
+        } else {
+            k -= SIZE(root->left) + 1;
+            root = root->right;
+        }
+    }
+    return root->elem;
+}
+
+/* The stack holds the nodes not smaller than lo whose left subtree is being
+ * visited, as in avl_traverse.  A node smaller than lo is never pushed: its
+ * left subtree is skipped along with it, and the search goes on to its right.
+ * Everything in the right subtree of a node on the stack is at least as large
+ * as that node, so only the way down from the root compares nodes with lo.
+ */
+void avl_bag_range(bag_t *b, bag_elem_t lo, bag_elem_t hi,
+                   bool (*fun)(bag_elem_t, void *), void *ctx)
+{
+    avl_bag_t *bag = (avl_bag_t *) b;
+    const avl_node_t *stack[AVL_MAX_HEIGHT];
+    const avl_node_t *root = bag->root;
+    bag_key_t lo_key = lo ? BAG_KEY(bag, lo) : 0;
+    bag_key_t hi_key = hi ? BAG_KEY(bag, hi) : 0;
+    size_t depth = 0;
+
+    while (root) {
+        BAG_VISIT(bag);
+        if (lo && BAG_KEY_CMP(bag, root->key, root->elem, lo_key, lo) < 0) {
+            root = root->right;
+        } else {
+            stack[depth++] = root;
+            root = root->left;
+        }
+    }
+
+    while (depth > 0) {
+        root = stack[--depth];
+        if (hi && BAG_KEY_CMP(bag, root->key, root->elem, hi_key, hi) >= 0)
+            break;
+        if (! (*fun)(root->elem, ctx))
+            break;
+        for (root = root->right; root; root = root->left)
+            stack[depth++] = root;
+    }
+    BAG_END_SEARCH(bag);
+}
+
 /******************************************************************************
  *  Definitions of helper functions -- see above for documentation.           *
  ******************************************************************************/
 
-void avl_destroy(avl_node_t *root)
+void avl_traverse(const avl_node_t *root,
+                  void (*fun)(bag_elem_t, void *), void *ctx)
 {
-    if (root) {
-        avl_destroy(root->left);
-        avl_destroy(root->right);
-        free(root);
+    const avl_node_t *stack[AVL_MAX_HEIGHT];
+    size_t depth = 0;
+
+    /* The stack holds the nodes whose left subtree is being visited. */
+    while (root || depth > 0) {
+        if (root) {
+            stack[depth++] = root;
+            root = root->left;
+        } else {
+            root = stack[--depth];
+            (*fun)(root->elem, ctx);
+            root = root->right;
+        }
     }
 }
 
-void avl_traverse(const avl_node_t *root, void (*fun)(bag_elem_t))
+bag_elem_t avl_contains(avl_bag_t *bag, bag_elem_t elem)
 {
-    if (root) {
-        avl_traverse(root->left, fun);
-        (*fun)(root->elem);
-        avl_traverse(root->right, fun);
+    const avl_node_t *root = bag->root;
+    bag_key_t key = BAG_KEY(bag, elem);
+    int result;
+
+    while (root) {
+        BAG_VISIT(bag);
+        result = BAG_KEY_CMP(bag, key, elem, root->key, root->elem);
+        if (result < 0)
+            root = root->left;
+        else if (result > 0)
+            root = root->right;
+        else
+            return root->elem;
     }
+    return NULL;
 }
 
-bag_elem_t avl_contains(const avl_node_t *root, bag_elem_t elem,
-                        int (*cmp)(bag_elem_t, bag_elem_t))
+bag_elem_t avl_insert(avl_bag_t *bag, bag_elem_t elem)
 {
-    if (! root)
+    avl_node_t **root = &bag->root;
+    avl_node_t **path[AVL_MAX_HEIGHT];
+    size_t depth = 0, i;
+    bag_key_t key = BAG_KEY(bag, elem);
+    int result;
+
+    if (bag->size == AVL_MAX_SIZE)  return NULL;
+
+    /* Walk down to the empty subtree where elem belongs, remembering the
+     * link to every node on the way. */
+    while (*root) {
+        BAG_VISIT(bag);
+        path[depth++] = root;
+        result = BAG_KEY_CMP(bag, key, elem, (*root)->key, (*root)->elem);
+        if (result < 0)
+            root = &(*root)->left;
+        else if (result > 0)
+            root = &(*root)->right;
+        /* Insert duplicates into the subtree with smaller height. */
+        else if (HEIGHT((*root)->left) < HEIGHT((*root)->right))
+            root = &(*root)->left;
+        else
+            root = &(*root)->right;
+    }
+
+    if (! (*root = avl_node_create(key, elem, &bag->nodes)))
         return NULL;
-    else if ((*cmp)(elem, root->elem) < 0)
-        return avl_contains(root->left, elem, cmp);
-    else if ((*cmp)(elem, root->elem) > 0)
-        return avl_contains(root->right, elem, cmp);
-    else /* ((*cmp)(elem, root->elem) == 0) */
-        return root->elem;
+    /* Every subtree on the path grew by one, whether its height changed or
+     * not, so the sizes are updated all the way up. */
+    for (i = 0; i < depth; i++)
+        (*path[i])->size++;
+    BAG_COUNT(bag, node_allocs, 1);
+    BAG_COUNT(bag, rotations, avl_fix_path(path, depth));
+    return elem;
 }
 
-bag_elem_t avl_insert(avl_node_t **root, bag_elem_t elem,
-                      int (*cmp)(bag_elem_t, bag_elem_t))
+/* The node is allocated before the element is made, so that nothing can
+ * fail once make has been called.  The element made is equal to probe, so
+ * they have the same key.
+ */
+bag_elem_t avl_find_or_insert(avl_bag_t *bag, bag_elem_t probe,
+                              bag_elem_t (*make)(bag_elem_t, void *),
+                              void *ctx)
 {
-    bag_elem_t inserted;
-    
-    if (! *root) {
-        if ((*root = avl_node_create(elem)))
-            inserted = (*root)->elem;
-        else
-            inserted = NULL;
-    } else if ((*cmp)(elem, (*root)->elem) < 0) {
-        if ((inserted = avl_insert(&(*root)->left, elem, cmp))) {
-            /* Check if the subtree needs rebalancing; update its height. */
-            if (HEIGHT((*root)->left) > HEIGHT((*root)->right) + 1)
-                avl_rebalance_to_the_right(root);
-            else
-                avl_update_height(*root);
-        }
-    } else if ((*cmp)(elem, (*root)->elem) > 0) {
-        if ((inserted = avl_insert(&(*root)->right, elem, cmp))) {
-            /* Check if the subtree needs rebalancing; update its height. */
-            if (HEIGHT((*root)->right) > HEIGHT((*root)->left) + 1)
-                avl_rebalance_to_the_left(root);
-            else
-                avl_update_height(*root);
-        }
-    } else { /* ((*cmp)(elem, (*root)->elem) == 0) */
-        /* Insert into the subtree with smaller height. */
-        if (HEIGHT((*root)->left) < HEIGHT((*root)->right))
-            inserted = avl_insert(&(*root)->left, elem, cmp);
-        else
-            inserted = avl_insert(&(*root)->right, elem, cmp);
-        /* No rebalancing necessary, but update height. */
-        if (inserted)  avl_update_height(*root);
+    avl_node_t **root = &bag->root;
+    avl_node_t **path[AVL_MAX_HEIGHT];
+    size_t depth = 0, i;
+    bag_key_t key = BAG_KEY(bag, probe);
+    avl_node_t *node;
+    int result;
+
+    while (*root) {
+        BAG_VISIT(bag);
+        result = BAG_KEY_CMP(bag, key, probe, (*root)->key, (*root)->elem);
+        if (result == 0)
+            return (*root)->elem;
+        path[depth++] = root;
+        root = result < 0 ? &(*root)->left : &(*root)->right;
     }
-    
-    return inserted;
+
+    if (bag->size == AVL_MAX_SIZE ||
+        ! (node = avl_node_create(key, NULL, &bag->nodes)))
+        return NULL;
+    if (! (node->elem = (*make)(probe, ctx))) {
+        slab_free(&bag->nodes, node);
+        return NULL;
+    }
+    *root = node;
+    for (i = 0; i < depth; i++)
+        (*path[i])->size++;
+    bag->size++;
+    BAG_COUNT(bag, node_allocs, 1);
+    BAG_COUNT(bag, rotations, avl_fix_path(path, depth));
+    return node->elem;
 }
 
-bag_elem_t avl_remove(avl_node_t **root, bag_elem_t elem,
-                      int (*cmp)(bag_elem_t, bag_elem_t))
+bag_elem_t avl_remove(avl_bag_t *bag, bag_elem_t elem)
 {
+    avl_node_t **root = &bag->root;
+    avl_node_t **path[AVL_MAX_HEIGHT];
+    size_t depth = 0, i;
+    avl_node_t *target, *old;
     bag_elem_t removed;
-    
-    if (! *root) {
-        removed = NULL;
-    } else if ((*cmp)(elem, (*root)->elem) < 0) {
-        if ((removed = avl_remove(&(*root)->left, elem, cmp))) {
-            /* Check if the subtree needs rebalancing; update its height. */
-            if (HEIGHT((*root)->left) + 1 < HEIGHT((*root)->right))
-                avl_rebalance_to_the_left(root);
-            else
-                avl_update_height(*root);
-        }
-    } else if ((*cmp)(elem, (*root)->elem) > 0) {
-        if ((removed = avl_remove(&(*root)->right, elem, cmp))) {
-            /* Check if the subtree needs rebalancing; update its height. */
-            if (HEIGHT((*root)->right) + 1 < HEIGHT((*root)->left))
-                avl_rebalance_to_the_right(root);
-            else
-                avl_update_height(*root);
-        }
-    } else { /* ((*cmp)(elem, (*root)->elem) == 0) */
-        removed = (*root)->elem;
-        if ((*root)->left && (*root)->right) {
-            /* Remove from the subtree with larger height. */
-            if (HEIGHT((*root)->left) > HEIGHT((*root)->right))
-                (*root)->elem = avl_remove_max(&(*root)->left);
-            else
-                (*root)->elem = avl_remove_min(&(*root)->right);
-            /* No rebalancing necessary, but update height. */
-            avl_update_height(*root);
+    bag_key_t key = BAG_KEY(bag, elem);
+    int result;
+
+    /* Walk down to the node that stores elem. */
+    while (*root && (BAG_VISIT(bag),
+                     result = BAG_KEY_CMP(bag, key, elem, (*root)->key,
+                                          (*root)->elem)) != 0) {
+        path[depth++] = root;
+        root = result < 0 ? &(*root)->left : &(*root)->right;
+    }
+    if (! *root)
+        return NULL;
+    target = *root;
+    removed = target->elem;
+
+    if (target->left && target->right) {
+        /* Replace the element with its predecessor or successor, taken from
+         * the subtree with larger height, and remove that node instead. */
+        path[depth++] = root;
+        if (HEIGHT(target->left) > HEIGHT(target->right)) {
+            root = &target->left;
+            while ((*root)->right) {
+                path[depth++] = root;
+                root = &(*root)->right;
+            }
         } else {
-            /* Remove *root. */
-            avl_node_t *old = *root;
-            *root = (*root)->left ? (*root)->left : (*root)->right;
-            free(old);
+            root = &target->right;
+            while ((*root)->left) {
+                path[depth++] = root;
+                root = &(*root)->left;
+            }
         }
+        target->key = (*root)->key;
+        target->elem = (*root)->elem;
     }
-    
+
+    /* *root now has at most one child: replace it with that child. */
+    old = *root;
+    *root = old->left ? old->left : old->right;
+    slab_free(&bag->nodes, old);
+    for (i = 0; i < depth; i++)
+        (*path[i])->size--;
+    BAG_COUNT(bag, rotations, avl_fix_path(path, depth));
     return removed;
 }
 
-bag_elem_t avl_remove_min(avl_node_t **root)
+unsigned avl_fix_path(avl_node_t **path[], size_t depth)
 {
-    bag_elem_t min;
-    
-    if ((*root)->left) {
-        /* *root is not the minimum, keep going and rebalance if necessary. */
-        min = avl_remove_min(&(*root)->left);
-        if (HEIGHT((*root)->left) + 1 < HEIGHT((*root)->right))
-            avl_rebalance_to_the_left(root);
-        else
-            avl_update_height(*root);
-    } else {
-        /* Remove *root. */
-        avl_node_t *old = *root;
-        min = (*root)->elem;
-        *root = (*root)->right;
-        free(old);
+    unsigned height, rotations = 0;
+
+    while (depth > 0) {
+        --depth;
+        height = (*path[depth])->height;
+        rotations += avl_rebalance(path[depth]);
+        /* The heights above are only affected if this one changed. */
+        if ((*path[depth])->height == height)  break;
     }
-    
-    return min;
+    return rotations;
 }
 
-bag_elem_t avl_remove_max(avl_node_t **root)
+unsigned avl_rebalance(avl_node_t **root)
 {
-    bag_elem_t max;
-    
-    if ((*root)->right) {
-        /* *root is not the maximum, keep going and rebalance if necessary. */
-        max = avl_remove_max(&(*root)->right);
-        if (HEIGHT((*root)->right) + 1 < HEIGHT((*root)->left))
-            avl_rebalance_to_the_right(root);
-        else
-            avl_update_height(*root);
-    } else {
-        /* Remove *root. */
-        avl_node_t *old = *root;
-        max = (*root)->elem;
-        *root = (*root)->left;
-        free(old);
-    }
-    
-    return max;
+    if (HEIGHT((*root)->left) > HEIGHT((*root)->right) + 1)
+        return avl_rebalance_to_the_right(root);
+    if (HEIGHT((*root)->right) > HEIGHT((*root)->left) + 1)
+        return avl_rebalance_to_the_left(root);
+    avl_update_height(*root);
+    return 0;
 }
 
-void avl_rebalance_to_the_left(avl_node_t **root)
+unsigned avl_rebalance_to_the_left(avl_node_t **root)
 {
-    if (HEIGHT((*root)->right->left) > HEIGHT((*root)->right->right))
+    unsigned rotations = 1;
+
+    if (HEIGHT((*root)->right->left) > HEIGHT((*root)->right->right)) {
         avl_rotate_to_the_right(&(*root)->right);
+        rotations++;
+    }
     avl_rotate_to_the_left(root);
+    return rotations;
 }
 
-void avl_rebalance_to_the_right(avl_node_t **root)
+unsigned avl_rebalance_to_the_right(avl_node_t **root)
 {
-    if (HEIGHT((*root)->left->right) > HEIGHT((*root)->left->left))
+    unsigned rotations = 1;
+
+    if (HEIGHT((*root)->left->right) > HEIGHT((*root)->left->left)) {
         avl_rotate_to_the_left(&(*root)->left);
+        rotations++;
+    }
     avl_rotate_to_the_right(root);
+    return rotations;
 }
 
 void avl_rotate_to_the_left(avl_node_t **parent)
@@ -459,9 +801,11 @@ void avl_rotate_to_the_left(avl_node_t **parent)
     child->left = *parent;
     *parent = child;
     
-    /* Update heights. */
+    /* Update heights and sizes. */
     avl_update_height(child->left);
     avl_update_height(child);
+    avl_update_size(child->left);
+    avl_update_size(child);
 }
 
 void avl_rotate_to_the_right(avl_node_t **parent)
@@ -472,9 +816,11 @@ void avl_rotate_to_the_right(avl_node_t **parent)
     child->right = *parent;
     *parent = child;
     
-    /* Update heights. */
+    /* Update heights and sizes. */
     avl_update_height(child->right);
     avl_update_height(child);
+    avl_update_size(child->right);
+    avl_update_size(child);
 }
 
 void avl_update_height(avl_node_t *node)
@@ -483,12 +829,48 @@ void avl_update_height(avl_node_t *node)
                          HEIGHT(node->left) : HEIGHT(node->right) );
 }
 
-avl_node_t *avl_node_create(bag_elem_t elem)
+void avl_update_size(avl_node_t *node)
+{
+    node->size = 1 + SIZE(node->left) + SIZE(node->right);
+}
+
+/* The left subtree is built before its parent node and the right subtree
+ * after, so the slab hands out the nodes in order of their elements and a
+ * traversal of the new tree walks through memory sequentially.  The recursion
+ * is only as deep as the tree, which is at most about log2(n) + 1.
+ */
+bool avl_build(avl_bag_t *bag, avl_node_t **root,
+               const bag_elem_t elems[], size_t n)
+{
+    size_t mid = n / 2;
+    avl_node_t *left;
+
+    *root = NULL;
+    if (n == 0)  return true;
+
+    if (! avl_build(bag, &left, elems, mid))  return false;
+    if (! (*root = avl_node_create(BAG_KEY(bag, elems[mid]), elems[mid],
+                                   &bag->nodes)))
+        return false;
+    (*root)->left = left;
+    if (! avl_build(bag, &(*root)->right, elems + mid + 1, n - mid - 1))
+        return false;
+
+    /* Both halves differ in size by at most one, so the subtrees differ in
+     * height by at most one and no rebalancing is needed. */
+    avl_update_height(*root);
+    (*root)->size = (unsigned) n;
+    return true;
+}
+
+avl_node_t *avl_node_create(bag_key_t key, bag_elem_t elem, slab_t *nodes)
 {
-    avl_node_t *node = malloc(sizeof(avl_node_t));
+    avl_node_t *node = slab_alloc(nodes);
     if (node) {
+        node->key = key;
         node->elem = elem;
         node->height = 1;
+        node->size = 1;
         node->left = NULL;
         node->right = NULL;
     }
@@ -531,10 +913,10 @@ void avl_print(const avl_node_t *root, int depth, int indent,
     }
 }
 
-/* FUNCTION bag_print
+/* FUNCTION avl_bag_print
  *    Print every value in a bag to stdout, in a "sideways tree" layout.
  * Parameters and preconditions:
- *    bag != NULL: the bag
+ *    b != NULL: a bag created by avl_bag_ops
  *    print != NULL: the function to use to print each value in the bag
  * Return value:  none
  * Side-effects:
@@ -542,7 +924,8 @@ void avl_print(const avl_node_t *root, int depth, int indent,
  *    layout (with right subtrees above and left subtrees below, and indentation
  *    to indicate each value's depth in the tree)
  */
-void bag_print(const bag_t *bag, int indent, void (*print)(bag_elem_t))
+void avl_bag_print(const bag_t *b, int indent, void (*print)(bag_elem_t))
 {
+    const avl_bag_t *bag = (const avl_bag_t *) b;
     avl_print(bag->root, 1, indent, print);
 }
@@ -0,0 +1,200 @@
+/* FILE bag.c
+ *    Implementation of the bag functions: each call is passed on to the
+ *    operations of the bag's own kind.
+ */
+
+/******************************************************************************
+ *  Types and Constants.                                                      *
+ ******************************************************************************/
+
+#include <string.h>
+
+#include "bag_impl.h"
+
+/* CONSTANT backends
+ *    Every kind of bag, in the order they are listed by bag_backend_name.
+ *    The first one is the default kind.
+ */
+static const bag_ops_t *const backends[] = {
+    &avl_bag_ops,
+    &psb_bag_ops,
+    &splay_bag_ops,
+    &hash_bag_ops,
+    &btree_bag_ops,
+    &skiplist_bag_ops
+};
+
+/* CONSTANT NUM_BACKENDS -- The number of kinds of bags. */
+#define NUM_BACKENDS (sizeof(backends) / sizeof(backends[0]))
+
+/* TYPE plain_fun_t
+ *    A function without context, wrapped so that it can be passed as the
+ *    context of a traversal.
+ */
+typedef struct plain_fun {
+    void (*fun)(bag_elem_t); /* the function to call on each element */
+} plain_fun_t;
+
+/******************************************************************************
+ *  Declarations of helper functions -- including full documentation.         *
+ ******************************************************************************/
+
+/* FUNCTION call_plain
+ *    Call a function without context on one element of a traversal.
+ * Parameters and preconditions:
+ *    elem: the element to call the function on
+ *    ctx != NULL: a pointer to the plain_fun_t holding the function
+ * Return value:  none
+ * Side-effects:
+ *    the function in ctx has been called on elem
+ */
+static
+void call_plain(bag_elem_t elem, void *ctx);
+
+/******************************************************************************
+ *  Definitions of "public" functions -- see header file for documentation.   *
+ ******************************************************************************/
+
+const bag_ops_t *bag_backend(const char *name)
+{
+    size_t i;
+
+    for (i = 0; i < NUM_BACKENDS; i++)
+        if (strcmp(backends[i]->name, name) == 0)  return backends[i];
+    return NULL;
+}
+
+const char *bag_backend_name(size_t i)
+{
+    return i < NUM_BACKENDS ? backends[i]->name : NULL;
+}
+
+bag_t *bag_create_using(const bag_ops_t *ops,
+                        int (*cmp)(bag_elem_t, bag_elem_t),
+                        unsigned long (*hash)(bag_elem_t))
+{
+    return (*ops->create)(cmp, hash, NULL);
+}
+
+bag_t *bag_create_keyed(const bag_ops_t *ops,
+                        int (*cmp)(bag_elem_t, bag_elem_t),
+                        unsigned long (*hash)(bag_elem_t),
+                        bag_key_t (*key)(bag_elem_t))
+{
+    return (*ops->create)(cmp, hash, key);
+}
+
+bag_t *bag_create(int (*cmp)(bag_elem_t, bag_elem_t))
+{
+    return bag_create_using(backends[0], cmp, NULL);
+}
+
+bag_t *bag_create_with_hash(int (*cmp)(bag_elem_t, bag_elem_t),
+                            unsigned long (*hash)(bag_elem_t))
+{
+    return bag_create_using(backends[0], cmp, hash);
+}
+
+bag_t *bag_build_sorted(int (*cmp)(bag_elem_t, bag_elem_t),
+                        const bag_elem_t elems[], size_t n)
+{
+    return bag_build_sorted_using(backends[0], cmp, NULL, elems, n);
+}
+
+bag_t *bag_build_sorted_using(const bag_ops_t *ops,
+                              int (*cmp)(bag_elem_t, bag_elem_t),
+                              unsigned long (*hash)(bag_elem_t),
+                              const bag_elem_t elems[], size_t n)
+{
+    return (*ops->build)(cmp, hash, NULL, elems, n);
+}
+
+bag_t *bag_build_sorted_keyed(const bag_ops_t *ops,
+                              int (*cmp)(bag_elem_t, bag_elem_t),
+                              unsigned long (*hash)(bag_elem_t),
+                              bag_key_t (*key)(bag_elem_t),
+                              const bag_elem_t elems[], size_t n)
+{
+    return (*ops->build)(cmp, hash, key, elems, n);
+}
+
+void bag_destroy(bag_t *b)
+{
+    (*b->ops->destroy)(b);
+}
+
+size_t bag_size(const bag_t *b)
+{
+    return (*b->ops->size)(b);
+}
+
+bool bag_traverse(const bag_t *b, void (*f)(bag_elem_t))
+{
+    plain_fun_t plain;
+
+    plain.fun = f;
+    return (*b->ops->traverse)(b, call_plain, &plain);
+}
+
+bool bag_traverse_with(const bag_t *b, void (*f)(bag_elem_t, void *),
+                       void *ctx)
+{
+    return (*b->ops->traverse)(b, f, ctx);
+}
+
+void bag_stats(const bag_t *b, bag_stats_t *stats)
+{
+    memset(stats, 0, sizeof(bag_stats_t));
+    stats->counted = false;
+    stats->avg_search_depth = 0.0;
+    (*b->ops->stats)(b, stats);
+}
+
+bag_elem_t bag_contains(bag_t *b, bag_elem_t e)
+{
+    return (*b->ops->contains)(b, e);
+}
+
+bag_elem_t bag_insert(bag_t *b, bag_elem_t e)
+{
+    return (*b->ops->insert)(b, e);
+}
+
+bag_elem_t bag_find_or_insert(bag_t *b, bag_elem_t probe,
+                              bag_elem_t (*make)(bag_elem_t, void *),
+                              void *ctx)
+{
+    return (*b->ops->find_or_insert)(b, probe, make, ctx);
+}
+
+bag_elem_t bag_remove(bag_t *b, bag_elem_t e)
+{
+    return (*b->ops->remove)(b, e);
+}
+
+size_t bag_rank(bag_t *b, bag_elem_t e)
+{
+    return b->ops->rank ? (*b->ops->rank)(b, e) : BAG_NO_RANK;
+}
+
+bag_elem_t bag_select(const bag_t *b, size_t k)
+{
+    return b->ops->select ? (*b->ops->select)(b, k) : NULL;
+}
+
+bool bag_range(bag_t *b, bag_elem_t lo, bag_elem_t hi,
+               bool (*f)(bag_elem_t, void *), void *ctx)
+{
+    if (! b->ops->range)  return false;
+    (*b->ops->range)(b, lo, hi, f, ctx);
+    return true;
+}
+
+/******************************************************************************
+ *  Definitions of helper functions -- see above for documentation.           *
+ ******************************************************************************/
+
+void call_plain(bag_elem_t elem, void *ctx)
+{
+    (*((plain_fun_t *) ctx)->fun)(elem);
+}
@@ -10,20 +10,129 @@
  *  Types and Constants.                                                      *
  ******************************************************************************/
 
-#include <stdlib.h>  /* for type size_t */
+#include <stdbool.h> /* for type bool     */
+#include <stdint.h>  /* for type uint64_t */
+#include <stdlib.h>  /* for type size_t   */
 
 /* TYPE bag_elem_t -- The type of elements in bags. */
 typedef const void *bag_elem_t;
 
+/* TYPE bag_key_t
+ *    A summary of an element that sorts the same way as the element: a "key
+ *    function" maps every element to a key so that key(e1) <= key(e2)
+ *    whenever e1 <= e2 (equal elements have equal keys, and different
+ *    elements may share one, but a smaller key means a smaller element).
+ *    Search trees store the key of every element next to it, and only call
+ *    the comparison function when two keys are equal.  For example, the
+ *    first 8 characters of a string, packed into a number most significant
+ *    first, are a key for strcmp order.
+ */
+typedef uint64_t bag_key_t;
+
+/* CONSTANT BAG_NO_RANK
+ *    The result of bag_rank for a kind of bag that does not keep order
+ *    statistics.
+ */
+#define BAG_NO_RANK ((size_t) -1)
+
 /* TYPE bag_t -- The type of a bag. */
 typedef struct bag bag_t;
 
+/* TYPE bag_ops_t
+ *    The type of a kind of bag: one of the data structures that bags can be
+ *    stored in.  Every bag remembers its kind, so bags of different kinds can
+ *    be used side by side through the same functions.
+ */
+typedef struct bag_ops bag_ops_t;
+
+/* TYPE bag_stats_t
+ *    A summary of the shape of a bag and of the work it has done.  The height
+ *    is always filled in; the counts are only kept when the bag
+ *    implementations are compiled with BAG_STATS defined (otherwise counted
+ *    is false and they are all 0).  A "search" is the walk down the bag done
+ *    by each call to bag_contains, bag_insert, bag_find_or_insert or
+ *    bag_remove.
+ */
+typedef struct bag_stats {
+    size_t height;           /* current height of the tree (for a hash
+                                table, the longest probe sequence)      */
+    bool counted;            /* true if the fields below are filled in */
+    size_t max_search_depth; /* most nodes visited by one search so far */
+    unsigned long compares;  /* calls to the comparison function       */
+    unsigned long rotations; /* rotations of nodes                     */
+    unsigned long searches;  /* searches done                          */
+    double avg_search_depth; /* average nodes visited by one search    */
+    unsigned long node_allocs; /* nodes (or tables) allocated          */
+} bag_stats_t;
+
 /******************************************************************************
  *  Functions, with full documentation.                                       *
  ******************************************************************************/
 
+/* FUNCTION bag_backend
+ *    Find a kind of bag by name.
+ * Parameters and preconditions:
+ *    name != NULL: the name of a kind of bag ("avl", "psb", "splay", "hash",
+ *          "btree", "skiplist")
+ * Return value:
+ *    the kind of bag with that name; NULL if there is none
+ * Side-effects:  none
+ */
+const bag_ops_t *bag_backend(const char *name);
+
+/* FUNCTION bag_backend_name
+ *    Return the name of one of the kinds of bags (to list all of them).
+ * Parameters and preconditions:
+ *    i: the position of a kind of bag (starting at 0)
+ * Return value:
+ *    the name of the kind of bag at position i; NULL if i is past the last
+ *    one
+ * Side-effects:  none
+ */
+const char *bag_backend_name(size_t i);
+
+/* FUNCTION bag_create_using
+ *    Create a new empty bag of a given kind.
+ * Parameters and preconditions:
+ *    ops != NULL: the kind of bag to create (from bag_backend)
+ *    cmp != NULL: pointer to a function for comparing elements -- cmp(e1, e2)
+ *          < 0 if e1 < e2; > 0 if e1 > e2; == 0 if e1 == e2
+ *    hash: pointer to a function that returns the same value for any two
+ *          elements that are equal according to cmp, or NULL (only used by
+ *          bags stored in a hash table)
+ * Return value:
+ *    pointer to a newly-created empty bag;
+ *    NULL in case of error with memory allocation
+ * Side-effects:
+ *    memory has been allocated for the new bag
+ */
+bag_t *bag_create_using(const bag_ops_t *ops,
+                        int (*cmp)(bag_elem_t, bag_elem_t),
+                        unsigned long (*hash)(bag_elem_t));
+
+/* FUNCTION bag_create_keyed
+ *    Create a new empty bag of a given kind, with a key function for its
+ *    elements.  Search trees, B+ trees and skip lists keep the key of every
+ *    element in its node and compare keys before elements, so most
+ *    comparisons are a comparison of two numbers already in memory; only
+ *    bags stored in a hash table ignore the key function.
+ * Parameters and preconditions:
+ *    ops, cmp, hash: as for bag_create_using
+ *    key: pointer to a key function for cmp (see bag_key_t), or NULL (every
+ *          comparison then calls cmp)
+ * Return value:
+ *    pointer to a newly-created empty bag;
+ *    NULL in case of error with memory allocation
+ * Side-effects:
+ *    memory has been allocated for the new bag
+ */
+bag_t *bag_create_keyed(const bag_ops_t *ops,
+                        int (*cmp)(bag_elem_t, bag_elem_t),
+                        unsigned long (*hash)(bag_elem_t),
+                        bag_key_t (*key)(bag_elem_t));
+
 /* FUNCTION bag_create
- *    Create a new empty bag.
+ *    Create a new empty bag (of the default kind, an AVL tree).
  * Parameters and preconditions:
  *    cmp != NULL: pointer to a function for comparing elements -- cmp(e1, e2)
  *          < 0 if e1 < e2; > 0 if e1 > e2; == 0 if e1 == e2
@@ -35,6 +144,82 @@ typedef struct bag bag_t;
  */
 bag_t *bag_create(int (*cmp)(bag_elem_t, bag_elem_t));
 
+/* FUNCTION bag_create_with_hash
+ *    Create a new empty bag (of the default kind), with a hash function for
+ *    its elements.  Bags that are not implemented with a hash table ignore
+ *    the hash function.
+ * Parameters and preconditions:
+ *    cmp != NULL: pointer to a function for comparing elements -- cmp(e1, e2)
+ *          < 0 if e1 < e2; > 0 if e1 > e2; == 0 if e1 == e2
+ *    hash: pointer to a function that returns the same value for any two
+ *          elements that are equal according to cmp, or NULL
+ * Return value:
+ *    pointer to a newly-created empty bag;
+ *    NULL in case of error with memory allocation
+ * Side-effects:
+ *    memory has been allocated for the new bag
+ */
+bag_t *bag_create_with_hash(int (*cmp)(bag_elem_t, bag_elem_t),
+                            unsigned long (*hash)(bag_elem_t));
+
+/* FUNCTION bag_build_sorted
+ *    Create a new bag (of the default kind) holding the elements of an array
+ *    that is already sorted, in time proportional to their number -- instead
+ *    of inserting them one at a time.  The bag is perfectly balanced.
+ * Parameters and preconditions:
+ *    cmp != NULL: pointer to a function for comparing elements -- cmp(e1, e2)
+ *          < 0 if e1 < e2; > 0 if e1 > e2; == 0 if e1 == e2
+ *    elems != NULL (unless n == 0): the elements to store, sorted according
+ *          to cmp (each one NULL-free and no larger than the next)
+ *    n: the number of elements in elems
+ * Return value:
+ *    pointer to a newly-created bag holding the n elements;
+ *    NULL in case of error with memory allocation
+ * Side-effects:
+ *    memory has been allocated for the new bag (elems is not changed)
+ */
+bag_t *bag_build_sorted(int (*cmp)(bag_elem_t, bag_elem_t),
+                        const bag_elem_t elems[], size_t n);
+
+/* FUNCTION bag_build_sorted_using
+ *    Create a new bag of a given kind holding the elements of an array that
+ *    is already sorted, like bag_build_sorted.  Search trees are built
+ *    perfectly balanced (with every node at its final height, for an AVL
+ *    tree); a hash table is allocated at its final size.
+ * Parameters and preconditions:
+ *    ops != NULL: the kind of bag to create (from bag_backend)
+ *    cmp, hash: as for bag_create_using
+ *    elems, n: as for bag_build_sorted
+ * Return value:
+ *    pointer to a newly-created bag holding the n elements;
+ *    NULL in case of error with memory allocation
+ * Side-effects:
+ *    memory has been allocated for the new bag (elems is not changed)
+ */
+bag_t *bag_build_sorted_using(const bag_ops_t *ops,
+                              int (*cmp)(bag_elem_t, bag_elem_t),
+                              unsigned long (*hash)(bag_elem_t),
+                              const bag_elem_t elems[], size_t n);
+
+/* FUNCTION bag_build_sorted_keyed
+ *    Create a new bag of a given kind holding the elements of an array that
+ *    is already sorted, like bag_build_sorted_using, with a key function for
+ *    its elements (as for bag_create_keyed).
+ * Parameters and preconditions:
+ *    ops, cmp, hash, key: as for bag_create_keyed
+ *    elems, n: as for bag_build_sorted
+ * Return value:
+ *    pointer to a newly-created bag holding the n elements;
+ *    NULL in case of error with memory allocation
+ * Side-effects:
+ *    memory has been allocated for the new bag (elems is not changed)
+ */
+bag_t *bag_build_sorted_keyed(const bag_ops_t *ops,
+                              int (*cmp)(bag_elem_t, bag_elem_t),
+                              unsigned long (*hash)(bag_elem_t),
+                              bag_key_t (*key)(bag_elem_t),
+                              const bag_elem_t elems[], size_t n);
+
 /* FUNCTION bag_destroy
  *    Free all the memory allocated for a bag.
  * Parameters and preconditions:
@@ -60,11 +245,44 @@ size_t bag_size(const bag_t *b);
  * Parameters and preconditions:
  *    b != NULL: a bag
  *    f != NULL: a pointer to a function to apply to each element in the bag
- * Return value:  none
+ * Return value:
+ *    true if f has been called on every element in order; false in case of
+ *    error with memory allocation (some kinds of bags need memory to put their
+ *    elements in order), in which case f has been called on every element
+ *    but out of order ("hash" bags), or only on the first ones in order
+ *    ("splay" bags taller than the stack they start with)
  * Side-effect:
  *    function f has been called on each element in the bag, in order
  */
-void bag_traverse(const bag_t *b, void (*f)(bag_elem_t));
+bool bag_traverse(const bag_t *b, void (*f)(bag_elem_t));
+
+/* FUNCTION bag_traverse_with
+ *    Call a function on every element in a bag, in order, passing it the same
+ *    context every time (so the caller's state does not need to be global).
+ * Parameters and preconditions:
+ *    b != NULL: a bag
+ *    f != NULL: a pointer to a function to apply to each element in the bag
+ *    ctx: the context to pass to f along with each element
+ * Return value:
+ *    true if f has been called on every element in order; false in case of
+ *    error with memory allocation, as for bag_traverse
+ * Side-effect:
+ *    function f has been called on each element in the bag and ctx, in order
+ */
+bool bag_traverse_with(const bag_t *b, void (*f)(bag_elem_t, void *),
+                       void *ctx);
+
+/* FUNCTION bag_stats
+ *    Describe the shape of a bag and the work it has done so far.
+ * Parameters and preconditions:
+ *    b != NULL: a bag
+ *    stats != NULL: where to store the description
+ * Return value:  none
+ * Side-effects:
+ *    *stats has been filled in (see bag_stats_t); takes time proportional to
+ *    the size of b for bags that do not keep track of their height
+ */
+void bag_stats(const bag_t *b, bag_stats_t *stats);
 
 /* FUNCTION bag_contains
  *    Return whether or not a bag contains a certain element.
@@ -89,6 +307,29 @@ bag_elem_t bag_contains(bag_t *b, bag_elem_t e);
  */
 bag_elem_t bag_insert(bag_t *b, bag_elem_t e);
 
+/* FUNCTION bag_find_or_insert
+ *    Return the element of a bag equal to a probe, or add a new element made
+ *    from the probe if there is none -- with a single search of the bag,
+ *    instead of bag_contains followed by bag_insert.
+ * Parameters and preconditions:
+ *    b != NULL: a bag
+ *    probe != NULL: the element to look for (probe itself is never stored)
+ *    make != NULL: pointer to a function that returns a new element equal to
+ *          probe, given probe and ctx, or NULL in case of error
+ *    ctx: the context to pass to make
+ * Return value:
+ *    the element of b equal to probe, if there was one; otherwise the new
+ *    element returned by make; NULL in case of error
+ * Side-effects:
+ *    if no element of b was equal to probe, make has been called once and
+ *    its element added to b; everything else needed to add the element is
+ *    allocated before make is called, so in case of error b is unchanged and
+ *    no element made by make is left out of b
+ */
+bag_elem_t bag_find_or_insert(bag_t *b, bag_elem_t probe,
+                              bag_elem_t (*make)(bag_elem_t, void *),
+                              void *ctx);
+
 /* FUNCTION bag_remove
  *    Remove an element from a bag.
  * Parameters and preconditions:
@@ -101,4 +342,62 @@ bag_elem_t bag_insert(bag_t *b, bag_elem_t e);
  */
 bag_elem_t bag_remove(bag_t *b, bag_elem_t e);
 
+/* FUNCTION bag_rank
+ *    Return the position that an element has, or would have, in the order of
+ *    a bag: the number of elements of the bag smaller than it.  Takes time
+ *    proportional to the height of the tree for the kinds of bags that keep
+ *    the size of every subtree ("avl"); other kinds do not support it.  To
+ *    keep its nodes small, an "avl" bag holds at most UINT_MAX elements:
+ *    bag_insert, bag_find_or_insert and bag_build_sorted fail beyond that.
+ * Parameters and preconditions:
+ *    b != NULL: a bag
+ *    e != NULL: an element (not necessarily in b)
+ * Return value:
+ *    the number of elements of b smaller than e (so the first element of b
+ *    equal to e, if there is one, is bag_select(b, rank));
+ *    BAG_NO_RANK if the kind of b does not keep order statistics
+ * Side-effects:  none
+ */
+size_t bag_rank(bag_t *b, bag_elem_t e);
+
+/* FUNCTION bag_select
+ *    Return the element at a given position in the order of a bag -- the one
+ *    that bag_traverse would reach after k others -- in time proportional to
+ *    the height of the tree, for the same kinds of bags as bag_rank.  Evenly
+ *    spaced positions split a bag into parts of equal size.
+ * Parameters and preconditions:
+ *    b != NULL: a bag
+ *    k: a position, from 0
+ * Return value:
+ *    the element at position k of b; NULL if k >= bag_size(b) or if the kind
+ *    of b does not keep order statistics
+ * Side-effects:  none
+ */
+bag_elem_t bag_select(const bag_t *b, size_t k);
+
+/* FUNCTION bag_range
+ *    Call a function on the elements of a bag from lo up to hi, in order, for
+ *    as long as the function asks to go on.  Search trees ("avl" and "psb")
+ *    only go down into the subtrees that overlap the range, so a scan takes
+ *    time proportional to the height of the tree plus the number of elements
+ *    visited; other kinds do not support it.
+ * Parameters and preconditions:
+ *    b != NULL: a bag
+ *    lo: the smallest element to visit (included), or NULL to start from the
+ *        first element of b
+ *    hi: the element to stop at (excluded), or NULL to go on to the last
+ *        element of b
+ *    f != NULL: a pointer to a function to apply to each element in the
+ *               range, which returns true to go on or false to stop
+ *    ctx: the context to pass to f along with each element
+ * Return value:
+ *    true if the range was scanned (up to hi or until f returned false);
+ *    false if the kind of b does not support range scans
+ * Side-effects:
+ *    function f has been called on each element of b from lo up to hi, in
+ *    order, until it returned false
+ */
+bool bag_range(bag_t *b, bag_elem_t lo, bag_elem_t hi,
+               bool (*f)(bag_elem_t, void *), void *ctx);
+
 #endif/*_BAG_H*/
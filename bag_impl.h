@@ -0,0 +1,159 @@
+/* FILE bag_impl.h
+ *    Declarations shared by the implementations of the bag ADT: the table of
+ *    operations that every kind of bag provides, and the part of struct bag
+ *    that is common to all of them.  Only bag implementations should include
+ *    this file; everything else goes through bag.h.
+ */
+#ifndef BAG_IMPL_H
+#define BAG_IMPL_H
+
+/******************************************************************************
+ *  Types and Constants.                                                      *
+ ******************************************************************************/
+
+#include "bag.h"
+
+/* TYPE struct bag_ops -- Definition of struct bag_ops from bag.h.
+ *    The operations of one kind of bag.  Each operation behaves as the bag.h
+ *    function with the same name, and is only ever called on bags that were
+ *    created by the same table.  (create and build are passed the key function
+ *    of bag_create_keyed, NULL if there is none; stats is always passed a
+ *    bag_stats_t that bag_stats has already cleared; rank and select are NULL
+ *    for kinds of bags that do not keep order statistics, and range for kinds
+ *    that cannot skip the elements outside of a range.)
+ */
+struct bag_ops {
+    const char *name; /* the name used to select this kind of bag */
+    bag_t *(*create)(int (*cmp)(bag_elem_t, bag_elem_t),
+                     unsigned long (*hash)(bag_elem_t),
+                     bag_key_t (*key)(bag_elem_t));
+    bag_t *(*build)(int (*cmp)(bag_elem_t, bag_elem_t),
+                    unsigned long (*hash)(bag_elem_t),
+                    bag_key_t (*key)(bag_elem_t),
+                    const bag_elem_t elems[], size_t n);
+    void (*destroy)(bag_t *b);
+    size_t (*size)(const bag_t *b);
+    bool (*traverse)(const bag_t *b, void (*f)(bag_elem_t, void *),
+                     void *ctx);
+    bag_elem_t (*contains)(bag_t *b, bag_elem_t e);
+    bag_elem_t (*insert)(bag_t *b, bag_elem_t e);
+    bag_elem_t (*find_or_insert)(bag_t *b, bag_elem_t probe,
+                                 bag_elem_t (*make)(bag_elem_t, void *),
+                                 void *ctx);
+    bag_elem_t (*remove)(bag_t *b, bag_elem_t e);
+    void (*stats)(const bag_t *b, bag_stats_t *stats);
+    size_t (*rank)(bag_t *b, bag_elem_t e);
+    bag_elem_t (*select)(const bag_t *b, size_t k);
+    void (*range)(bag_t *b, bag_elem_t lo, bag_elem_t hi,
+                  bool (*fun)(bag_elem_t, void *), void *ctx);
+};
+
+/* TYPE struct bag -- Definition of struct bag from bag.h.
+ *    The part shared by all bags.  Every implementation stores it as the first
+ *    member of its own bag structure, so a pointer to either one can be
+ *    converted to the other.
+ */
+struct bag {
+    const bag_ops_t *ops; /* the operations of the bag's implementation */
+};
+
+/* TYPE bag_counters_t
+ *    Counts of the work done by one bag, kept only when the bag
+ *    implementations are compiled with BAG_STATS defined.  Every search for
+ *    an element (in bag_contains, bag_insert, bag_find_or_insert and
+ *    bag_remove) counts the nodes (or slots) it visits in depth, then adds
+ *    them to the totals when it is done.
+ */
+typedef struct bag_counters {
+    unsigned long compares;     /* calls to the comparison function      */
+    unsigned long rotations;    /* rotations of nodes                    */
+    unsigned long searches;     /* searches done                         */
+    unsigned long search_depth; /* nodes visited by all searches         */
+    unsigned long max_depth;    /* most nodes visited by one search      */
+    unsigned long depth;        /* nodes visited by the current search   */
+    unsigned long node_allocs;  /* nodes (or tables) allocated           */
+} bag_counters_t;
+
+/* MACROS BAG_COUNTERS_INIT, BAG_COUNT, BAG_CMP, BAG_VISIT, BAG_END_SEARCH,
+ *        BAG_GET_STATS
+ *    Count the work done by a bag (a pointer to an implementation's own bag
+ *    structure, with a member "bag_counters_t counters" when BAG_STATS is
+ *    defined).  Without BAG_STATS, they compile to nothing (the arguments of
+ *    BAG_COUNT and BAG_CMP are still evaluated exactly once), so the bags do
+ *    not pay for counts nobody asked for.
+ *    BAG_COUNTERS_INIT(bag): set every count to 0
+ *    BAG_COUNT(bag, field, n): add n to one count
+ *    BAG_CMP(bag, e1, e2): call the bag's comparison function and count it
+ *    BAG_VISIT(bag): count one node visited by the current search
+ *    BAG_END_SEARCH(bag): add the current search to the totals
+ *    BAG_GET_STATS(bag, stats): copy the counts into a bag_stats_t
+ */
+#ifdef BAG_STATS
+#include <string.h>
+#define BAG_COUNTERS_INIT(bag) \
+    memset(&(bag)->counters, 0, sizeof(bag_counters_t))
+#define BAG_COUNT(bag, field, n) ((bag)->counters.field += (n))
+#define BAG_CMP(bag, e1, e2) \
+    ((bag)->counters.compares++, (*(bag)->cmp)((e1), (e2)))
+#define BAG_VISIT(bag) ((bag)->counters.depth++)
+#define BAG_END_SEARCH(bag) \
+    ((bag)->counters.searches++, \
+     (bag)->counters.search_depth += (bag)->counters.depth, \
+     (bag)->counters.max_depth = (bag)->counters.depth > \
+         (bag)->counters.max_depth ? (bag)->counters.depth \
+                                   : (bag)->counters.max_depth, \
+     (bag)->counters.depth = 0)
+#define BAG_GET_STATS(bag, stats) \
+    ((stats)->counted = true, \
+     (stats)->max_search_depth = (bag)->counters.max_depth, \
+     (stats)->compares = (bag)->counters.compares, \
+     (stats)->rotations = (bag)->counters.rotations, \
+     (stats)->searches = (bag)->counters.searches, \
+     (stats)->avg_search_depth = (bag)->counters.searches == 0 ? 0.0 : \
+         (double) (bag)->counters.search_depth / (bag)->counters.searches, \
+     (stats)->node_allocs = (bag)->counters.node_allocs)
+#else
+#define BAG_COUNTERS_INIT(bag) ((void) 0)
+#define BAG_COUNT(bag, field, n) ((void) (n))
+#define BAG_CMP(bag, e1, e2) ((*(bag)->cmp)((e1), (e2)))
+#define BAG_VISIT(bag) ((void) 0)
+#define BAG_END_SEARCH(bag) ((void) 0)
+#define BAG_GET_STATS(bag, stats) ((void) 0)
+#endif
+
+/* MACROS BAG_KEY, BAG_KEY_CMP
+ *    Compare elements by their keys first (for a bag with a member
+ *    "bag_key_t (*key)(bag_elem_t)" holding its key function, or NULL).
+ *    BAG_KEY(bag, e): the key of e (0 for every element without a key
+ *        function, so that BAG_KEY_CMP always calls the comparison function)
+ *    BAG_KEY_CMP(bag, k1, e1, k2, e2): compare e1 and e2, whose keys are k1
+ *        and k2, calling the comparison function (through BAG_CMP, so it is
+ *        counted) only when the keys are equal
+ */
+#define BAG_KEY(bag, e) ((bag)->key ? (*(bag)->key)(e) : 0)
+#define BAG_KEY_CMP(bag, k1, e1, k2, e2) \
+    ((k1) != (k2) ? ((k1) < (k2) ? -1 : 1) : BAG_CMP(bag, e1, e2))
+
+/* CONSTANTS avl_bag_ops, psb_bag_ops, splay_bag_ops, hash_bag_ops,
+ *           btree_bag_ops, skiplist_bag_ops
+ *    The operations of the bags stored in an AVL tree (avl_bag.c), a
+ *    pseudo-self-balancing BST (psb_bag.c), a splay tree (splay_bag.c), an
+ *    open-addressing hash table (hash_bag.c), a B+ tree (btree_bag.c) and a
+ *    lock-free skip list (skiplist_bag.c), the only one that several threads
+ *    can add to and search at once.
+ */
+extern const bag_ops_t avl_bag_ops;
+extern const bag_ops_t psb_bag_ops;
+extern const bag_ops_t splay_bag_ops;
+extern const bag_ops_t hash_bag_ops;
+extern const bag_ops_t btree_bag_ops;
+extern const bag_ops_t skiplist_bag_ops;
+
+/* FUNCTION skiplist_bag_check
+ *    Check the structure of a bag created by skiplist_bag_ops: a "hidden"
+ *    function for debugging and for the checks of contend.c, defined in
+ *    skiplist_bag.c with its full documentation.
+ */
+bool skiplist_bag_check(const bag_t *b);
+
+#endif/*BAG_IMPL_H*/
@@ -0,0 +1,548 @@
+/* FILE bench.c
+ *    Measure how long each phase of indexing a text file takes (generating,
+ *    printing and destroying the index) and how much memory it needs, for
+ *    several files, kinds of bags and minimum word lengths, and report the
+ *    results as CSV or JSON.
+ */
+
+/******************************************************************************
+ *  Types and Constants.                                                      *
+ ******************************************************************************/
+
+/* Ask for the POSIX clocks and processes used to time and isolate trials. */
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#define HAVE_FORK 1
+#endif
+
+#include "art_index.h"
+#include "bag.h"
+#include "file_util.h"
+#include "word_index.h"
+
+/* CONSTANT DEFAULT_TRIALS -- Number of times each measurement is repeated. */
+#define DEFAULT_TRIALS 5
+
+/* CONSTANT MAX_LENS -- Largest number of minimum word lengths to try. */
+#define MAX_LENS 16
+
+/* CONSTANT MAX_BACKENDS -- Largest number of kinds of bags to try. */
+#define MAX_BACKENDS 16
+
+/* CONSTANT MAX_THREAD_COUNTS -- Largest number of numbers of threads to try. */
+#define MAX_THREAD_COUNTS 16
+
+/* CONSTANT NUM_PHASES -- Number of phases timed in each trial. */
+#define NUM_PHASES 3
+
+/* CONSTANT phase_names -- The name of each phase, as used in the report. */
+static const char *const phase_names[NUM_PHASES] = {
+    "generate", "print", "destroy"
+};
+
+/* TYPE trial_t -- The measurements taken during one trial. */
+typedef struct trial
+{
+    double ms[NUM_PHASES]; /* wall time of each phase, in milliseconds     */
+    long peak_rss_kb;      /* peak resident memory, in KB (0 if unknown)  */
+    bool ok;               /* false if the trial failed                   */
+} trial_t;
+
+/* TYPE settings_t -- Everything the command line asks for. */
+typedef struct settings
+{
+    int trials;                             /* trials per measurement     */
+    int threads[MAX_THREAD_COUNTS];         /* numbers of threads to try  */
+    int num_threads;                        /* number of them in threads  */
+    int shards;                             /* shards of a shared index,
+                                               0 to merge per-thread ones */
+    int lens[MAX_LENS];                     /* minimum word lengths       */
+    int num_lens;                           /* number of lengths in lens  */
+    const char *backends[MAX_BACKENDS];     /* names of the bags to try   */
+    int num_backends;                       /* number of names            */
+    bool json;                              /* JSON instead of CSV        */
+} settings_t;
+
+/******************************************************************************
+ *  Function declarations -- with full documentation.                         *
+ ******************************************************************************/
+
+/* FUNCTION main
+ *    Grab options and the names of text files from the command line, index
+ *    every file with every kind of bag and minimum word length asked for, a
+ *    number of times each, and print the median and 95th percentile of the
+ *    time taken by each phase along with the peak memory use to stdout.
+ *    Options: --trials=N (default 5), --threads=N1,N2,... (default 1),
+ *    --shards=N (default 0: the threads index their parts of the file apart),
+ *    --lens=L1,L2,... (default 1,4,8), --backends=NAME1,NAME2,... (default
+ *    every kind of bag, then the ART index) and --format=csv|json (default
+ *    csv).  A list of numbers of threads (such as 1,2,4,...,64) measures how
+ *    the building and the printing of the index scale.
+ * Parameters and preconditions:
+ *    argc > 0: number of command line arguments
+ *    argv != NULL: array of command line arguments
+ * Return value:  exit status
+ * Side-effects:  the main program is executed
+ */
+int main(int argc, char *argv[]);
+
+/* FUNCTION parse_options
+ *    Read the options from the command line into the settings, and move the
+ *    other arguments (the names of the files) to the front of argv.
+ * Parameters and preconditions:
+ *    argc > 0, argv != NULL: the command line arguments
+ *    set != NULL: the settings to fill in (already set to the defaults)
+ * Return value:
+ *    the number of file names now at argv[1..]; -1 if an option is wrong
+ * Side-effects:
+ *    *set and the order of argv[1..argc-1] have been changed
+ */
+static
+int parse_options(int argc, char *argv[], settings_t *set);
+
+/* FUNCTION run_trial
+ *    Index a file once and measure each phase.  The trial runs in a child
+ *    process when possible, so that its peak memory use can be measured on
+ *    its own and the index is printed to /dev/null without touching stdout.
+ * Parameters and preconditions:
+ *    filename != NULL: the file to index
+ *    backend: the kind of bag to use, or NULL for the ART index (art_index.h)
+ *    min_word_len > 0: the minimum length of words to index
+ *    threads > 0: the number of threads to use
+ *    shards >= 0: the number of shards of a shared index (0 for none)
+ *    trial != NULL: where to store the measurements
+ * Return value:  none
+ * Side-effects:
+ *    *trial has been filled in (trial->ok is false if the trial failed)
+ */
+static
+void run_trial(const char *filename, const bag_ops_t *backend,
+               int min_word_len, int threads, int shards, trial_t *trial);
+
+/* FUNCTION time_phases
+ *    Index a file once in the current process and time each phase.
+ * Parameters and preconditions:
+ *    same as run_trial, and out != NULL: the stream to print the index to
+ * Return value:
+ *    true if the file was indexed; false if it cannot be opened or in case of
+ *    error with memory allocation
+ * Side-effects:
+ *    trial->ms has been filled in; the index has been printed to out
+ */
+static
+bool time_phases(const char *filename, const bag_ops_t *backend,
+                 int min_word_len, int threads, int shards, trial_t *trial);
+
+/* FUNCTION now_ms
+ *    Return the current time of a monotonic clock.
+ * Parameters and preconditions:  none
+ * Return value:  the time in milliseconds (from an arbitrary starting point)
+ * Side-effects:  none
+ */
+static
+double now_ms(void);
+
+/* FUNCTION percentile
+ *    Return a percentile of some values, by the nearest-rank method (the 50th
+ *    percentile of an even number of values is the mean of the middle two).
+ * Parameters and preconditions:
+ *    values != NULL: n values
+ *    n > 0: the number of values
+ *    p: the percentile to compute, 0 < p <= 100
+ * Return value:  the p-th percentile of values
+ * Side-effects:  the values have been sorted
+ */
+static
+double percentile(double values[], int n, int p);
+
+/* FUNCTION double_cmp
+ *    Compare two doubles (for qsort).
+ * Parameters and preconditions:
+ *    a != NULL, b != NULL: pointers to the doubles to compare
+ * Return value:
+ *    < 0 if *a < *b; > 0 if *a > *b; == 0 if *a == *b
+ * Side-effects:  none
+ */
+static
+int double_cmp(const void *a, const void *b);
+
+/* FUNCTION print_result
+ *    Print the summary of the trials of one measurement as one CSV line or
+ *    one JSON object.
+ * Parameters and preconditions:
+ *    set != NULL: the settings
+ *    filename != NULL, backend != NULL, min_word_len, threads: what was
+ *    measured
+ *    trials != NULL: set->trials trials, all successful
+ *    first: true for the first measurement printed
+ * Return value:  none
+ * Side-effects:
+ *    the summary has been printed to stdout
+ */
+static
+void print_result(const settings_t *set, const char *filename,
+                  const char *backend, int min_word_len, int threads,
+                  const trial_t trials[], bool first);
+
+/* FUNCTION print_json_string
+ *    Print a string to stdout as a JSON string literal.
+ * Parameters and preconditions:
+ *    str != NULL: the string to print
+ * Return value:  none
+ * Side-effects:
+ *    str has been printed between double quotes, with escapes as needed
+ */
+static
+void print_json_string(const char *str);
+
+/******************************************************************************
+ *  Function definitions -- see above for documentation.                      *
+ ******************************************************************************/
+
+int main(int argc, char *argv[])
+{
+    settings_t set;
+    trial_t *trials;
+    int files, f, l, b, n, t;
+    bool first = true, failed = false;
+
+    set.trials = DEFAULT_TRIALS;
+    set.threads[0] = 1;
+    set.num_threads = 1;
+    set.shards = 0;
+    set.lens[0] = 1;
+    set.lens[1] = 4;
+    set.lens[2] = 8;
+    set.num_lens = 3;
+    for (set.num_backends = 0;
+         set.num_backends < MAX_BACKENDS - 1 &&
+         (set.backends[set.num_backends] = bag_backend_name(set.num_backends));
+         set.num_backends++)
+        ;
+    set.backends[set.num_backends++] = ART_INDEX_NAME;
+    set.json = false;
+
+    if ((files = parse_options(argc, argv, &set)) <= 0) {
+        fprintf(stderr,
+                "ERROR: missing or incorrect argument!\n"
+                "USAGE: %s [options] <filename>...\n"
+                "  . <filename> is the name of a text file to index\n"
+                "  . --trials=N is the number of times to repeat each"
+                " measurement (default %d)\n"
+                "  . --threads=N1,N2,... are the numbers of threads to index"
+                " with, from 1 to %d (default 1)\n"
+                "  . --shards=N splits a shared index into N locked ranges"
+                " of words, up to %d (default 0: no shared index)\n"
+                "  . --lens=L1,L2,... are the minimum word lengths to try"
+                " (default 1,4,8)\n"
+                "  . --backends=NAME1,NAME2,... are the kinds of bags to try,"
+                " or " ART_INDEX_NAME " for the ART index (default all)\n"
+                "  . --format=csv|json is the format of the report"
+                " (default csv)\n",
+                argv[0], DEFAULT_TRIALS, WORD_INDEX_MAX_THREADS,
+                WORD_INDEX_MAX_SHARDS);
+        exit(EXIT_FAILURE);
+    }
+
+    if (! (trials = malloc(set.trials * sizeof(trial_t)))) {
+        fprintf(stderr, "ERROR: out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (set.json) {
+        printf("[");
+    } else {
+        printf("corpus,backend,min_word_len,threads,shards,trials");
+        for (t = 0; t < NUM_PHASES; t++)
+            printf(",%s_median_ms,%s_p95_ms", phase_names[t], phase_names[t]);
+        printf(",peak_rss_kb\n");
+    }
+
+    for (f = 1; f <= files; f++) {
+        for (l = 0; l < set.num_lens; l++) {
+            for (b = 0; b < set.num_backends; b++) {
+                for (n = 0; n < set.num_threads; n++) {
+                    for (t = 0; t < set.trials; t++) {
+                        run_trial(argv[f], bag_backend(set.backends[b]),
+                                  set.lens[l], set.threads[n], set.shards,
+                                  &trials[t]);
+                        if (! trials[t].ok)  break;
+                    }
+                    if (t < set.trials) {
+                        fprintf(stderr, "ERROR: cannot index %s with %s\n",
+                                argv[f], set.backends[b]);
+                        failed = true;
+                        continue;
+                    }
+                    print_result(&set, argv[f], set.backends[b], set.lens[l],
+                                 set.threads[n], trials, first);
+                    first = false;
+                    fflush(stdout);
+                }
+            }
+        }
+    }
+
+    if (set.json)  printf("\n]\n");
+    free(trials);
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+int parse_options(int argc, char *argv[], settings_t *set)
+{
+    int arg, files = 0;
+    char *item, *end;
+
+    for (arg = 1; arg < argc; arg++) {
+        if (strncmp(argv[arg], "--trials=", 9) == 0) {
+            if ((set->trials = (int) strtol(argv[arg] + 9, NULL, 10)) <= 0)
+                return -1;
+        } else if (strncmp(argv[arg], "--threads=", 10) == 0) {
+            // a comma-separated list of numbers of threads
+            set->num_threads = 0;
+            for (item = argv[arg] + 10; *item; item = end + (*end == ',')) {
+                if (set->num_threads == MAX_THREAD_COUNTS)  return -1;
+                set->threads[set->num_threads] = (int) strtol(item, &end, 10);
+                if (end == item || set->threads[set->num_threads] <= 0 ||
+                    set->threads[set->num_threads] > WORD_INDEX_MAX_THREADS)
+                    return -1;
+                set->num_threads++;
+            }
+            if (set->num_threads == 0)  return -1;
+        } else if (strncmp(argv[arg], "--shards=", 9) == 0) {
+            set->shards = (int) strtol(argv[arg] + 9, &end, 10);
+            if (end == argv[arg] + 9 || set->shards < 0 ||
+                set->shards > WORD_INDEX_MAX_SHARDS)
+                return -1;
+        } else if (strncmp(argv[arg], "--lens=", 7) == 0) {
+            // a comma-separated list of positive lengths
+            set->num_lens = 0;
+            for (item = argv[arg] + 7; *item; item = end + (*end == ',')) {
+                if (set->num_lens == MAX_LENS)  return -1;
+                set->lens[set->num_lens] = (int) strtol(item, &end, 10);
+                if (end == item || set->lens[set->num_lens] <= 0)  return -1;
+                set->num_lens++;
+            }
+            if (set->num_lens == 0)  return -1;
+        } else if (strncmp(argv[arg], "--backends=", 11) == 0) {
+            // a comma-separated list of names, cut up in place
+            set->num_backends = 0;
+            for (item = strtok(argv[arg] + 11, ","); item;
+                 item = strtok(NULL, ",")) {
+                if (set->num_backends == MAX_BACKENDS ||
+                    (! bag_backend(item) && strcmp(item, ART_INDEX_NAME) != 0))
+                    return -1;
+                set->backends[set->num_backends++] = item;
+            }
+            if (set->num_backends == 0)  return -1;
+        } else if (strcmp(argv[arg], "--format=csv") == 0) {
+            set->json = false;
+        } else if (strcmp(argv[arg], "--format=json") == 0) {
+            set->json = true;
+        } else if (strncmp(argv[arg], "--", 2) == 0) {
+            return -1;
+        } else {
+            argv[++files] = argv[arg];
+        }
+    }
+    return files;
+}
+
+void run_trial(const char *filename, const bag_ops_t *backend,
+               int min_word_len, int threads, int shards, trial_t *trial)
+{
+#ifdef HAVE_FORK
+    int fds[2], status;
+    pid_t child;
+    struct rusage usage;
+
+    trial->ok = false;
+    trial->peak_rss_kb = 0;
+    if (pipe(fds) != 0)  return;
+
+    // anything still buffered would otherwise be written twice
+    fflush(stdout);
+    child = fork();
+    if (child == 0) {
+        // child: send the timings back through the pipe, or nothing at all
+        close(fds[0]);
+        if (freopen("/dev/null", "w", stdout) &&
+            time_phases(filename, backend, min_word_len, threads, shards,
+                        trial)) {
+            getrusage(RUSAGE_SELF, &usage);
+            trial->peak_rss_kb = usage.ru_maxrss;
+#ifdef __APPLE__
+            trial->peak_rss_kb /= 1024; /* reported in bytes, not KB */
+#endif
+            trial->ok = true;
+            if (write(fds[1], trial, sizeof(trial_t)) != sizeof(trial_t))
+                _exit(EXIT_FAILURE);
+        }
+        _exit(EXIT_SUCCESS);
+    }
+
+    close(fds[1]);
+    if (child > 0) {
+        if (read(fds[0], trial, sizeof(trial_t)) != sizeof(trial_t))
+            trial->ok = false;
+        waitpid(child, &status, 0);
+    }
+    close(fds[0]);
+#else
+    // no way to isolate the trial: run it here and print to nowhere useful
+    FILE *out = freopen("/dev/null", "w", stdout);
+    trial->peak_rss_kb = 0;
+    trial->ok = out && time_phases(filename, backend, min_word_len, threads,
+                                   shards, trial);
+#endif
+}
+
+bool time_phases(const char *filename, const bag_ops_t *backend,
+                 int min_word_len, int threads, int shards, trial_t *trial)
+{
+    tokenizer_t *input = tokenizer_open(filename);
+    bag_t *index = NULL;
+    art_index_t *art = NULL;
+    double start;
+
+    if (! input)  return false;
+
+    // the same three phases that index times
+    start = now_ms();
+    if (backend && shards > 0)
+        index = word_index_create_sharded(input, min_word_len, backend,
+                                          threads, shards);
+    else if (backend)
+        index = word_index_create(input, min_word_len, backend, threads);
+    else
+        art = art_index_create(input, min_word_len);
+    trial->ms[0] = now_ms() - start;
+    tokenizer_close(input);
+    if (! index && ! art)  return false;
+
+    start = now_ms();
+    if (art)
+        art_index_print(art);
+    else if (threads > 1)
+        word_index_write_parallel(index, threads, stdout);
+    else
+        word_index_print(index);
+    fflush(stdout);
+    trial->ms[1] = now_ms() - start;
+
+    start = now_ms();
+    if (art)
+        art_index_destroy(art);
+    else
+        word_index_destroy(index);
+    trial->ms[2] = now_ms() - start;
+    return true;
+}
+
+double now_ms(void)
+{
+#ifdef CLOCK_MONOTONIC
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return 1000.0 * now.tv_sec + now.tv_nsec / 1000000.0;
+#else
+    return 1000.0 * clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+double percentile(double values[], int n, int p)
+{
+    int rank;
+
+    qsort(values, n, sizeof(double), double_cmp);
+    if (p == 50 && n % 2 == 0)
+        return (values[n / 2 - 1] + values[n / 2]) / 2;
+
+    // the smallest value with at least p% of the values at or below it
+    rank = (p * n + 99) / 100;
+    return values[rank > 0 ? rank - 1 : 0];
+}
+
+int double_cmp(const void *a, const void *b)
+{
+    double x = *(const double *) a, y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+void print_result(const settings_t *set, const char *filename,
+                  const char *backend, int min_word_len, int threads,
+                  const trial_t trials[], bool first)
+{
+    double values[NUM_PHASES][2];
+    double *times = malloc(set->trials * sizeof(double));
+    long peak = 0;
+    int phase, t;
+
+    for (phase = 0; phase < NUM_PHASES; phase++) {
+        for (t = 0; times && t < set->trials; t++)
+            times[t] = trials[t].ms[phase];
+        values[phase][0] = times ? percentile(times, set->trials, 50) : 0;
+        values[phase][1] = times ? percentile(times, set->trials, 95) : 0;
+    }
+    for (t = 0; t < set->trials; t++)
+        if (trials[t].peak_rss_kb > peak)  peak = trials[t].peak_rss_kb;
+    free(times);
+
+    if (set->json) {
+        printf("%s\n  {\"corpus\": ", first ? "" : ",");
+        print_json_string(filename);
+        printf(", \"backend\": ");
+        print_json_string(backend);
+        printf(", \"min_word_len\": %d, \"threads\": %d, \"shards\": %d,"
+               " \"trials\": %d", min_word_len, threads, set->shards,
+               set->trials);
+        for (phase = 0; phase < NUM_PHASES; phase++)
+            printf(", \"%s_median_ms\": %.3f, \"%s_p95_ms\": %.3f",
+                   phase_names[phase], values[phase][0],
+                   phase_names[phase], values[phase][1]);
+        printf(", \"peak_rss_kb\": %ld}", peak);
+    } else {
+        // file names with commas or quotes are quoted the CSV way
+        if (strpbrk(filename, ",\"\n")) {
+            putchar('"');
+            for (; *filename; filename++) {
+                if (*filename == '"')  putchar('"');
+                putchar(*filename);
+            }
+            putchar('"');
+        } else {
+            fputs(filename, stdout);
+        }
+        printf(",%s,%d,%d,%d,%d", backend, min_word_len, threads, set->shards,
+               set->trials);
+        for (phase = 0; phase < NUM_PHASES; phase++)
+            printf(",%.3f,%.3f", values[phase][0], values[phase][1]);
+        printf(",%ld\n", peak);
+    }
+}
+
+void print_json_string(const char *str)
+{
+    putchar('"');
+    for (; *str; str++) {
+        if (*str == '"' || *str == '\\')
+            printf("\\%c", *str);
+        else if ((unsigned char) *str < 0x20)
+            printf("\\u%04x", (unsigned) (unsigned char) *str);
+        else
+            putchar(*str);
+    }
+    putchar('"');
+}
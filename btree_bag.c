@@ -0,0 +1,1060 @@
+/* FILE btree_bag.c
+ *    Implementation of the bag ADT using a B+ tree: wide nodes searched with a
+ *    binary search, every element stored in the leaves, and the leaves chained
+ *    together in order.
+ */
+
+/******************************************************************************
+ *  Types and Constants.                                                      *
+ ******************************************************************************/
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bag_impl.h"
+#include "slab.h"
+
+/* CONSTANTS BTREE_LEAF_MAX, BTREE_INNER_MAX
+ *    Largest number of elements in a leaf and of keys in an inner node (which
+ *    has one more child than keys).  With 8-byte pointers and keys, a leaf
+ *    takes 496 bytes and an inner node 376: a few cache lines, which a search
+ *    reads one after the other instead of following a pointer to a new node
+ *    for every comparison.
+ */
+#define BTREE_LEAF_MAX 30U
+#define BTREE_INNER_MAX 15U
+
+/* CONSTANTS BTREE_LEAF_MIN, BTREE_INNER_MIN
+ *    Smallest number of elements in a leaf and of keys in an inner node, other
+ *    than the root.  Removals that leave a node with fewer borrow from one of
+ *    its neighbours, or merge the node with one.
+ */
+#define BTREE_LEAF_MIN (BTREE_LEAF_MAX / 2)
+#define BTREE_INNER_MIN (BTREE_INNER_MAX / 2)
+
+/* CONSTANT BTREE_MAX_HEIGHT
+ *    Upper bound on the number of levels of any B+ tree that fits in memory
+ *    (every inner node but the root has at least BTREE_INNER_MIN + 1 = 8
+ *    children), used as the size of the paths kept on the way down.
+ */
+#define BTREE_MAX_HEIGHT 32
+
+/* TYPE btree_item_t
+ *    An element of a B+ tree and its key, kept side by side so that a binary
+ *    search in a node compares the keys without following the elements.
+ */
+typedef struct btree_item {
+    bag_key_t key;   /* the key of elem (0 if bag has no key) */
+    bag_elem_t elem; /* the element                           */
+} btree_item_t;
+
+/* TYPE btree_leaf_t -- A leaf of a B+ tree. */
+typedef struct btree_leaf {
+    unsigned count;           /* number of elements in this leaf          */
+    struct btree_leaf *next;  /* the next leaf, in order (NULL if last)   */
+    btree_item_t items[BTREE_LEAF_MAX]; /* the elements, in order         */
+} btree_leaf_t;
+
+/* TYPE btree_inner_t
+ *    An inner node of a B+ tree.  Every element in children[i] is no larger
+ *    than keys[i], which is no larger than every element in children[i + 1].
+ *    Each key is a copy of an element in the leaves, with its key (see
+ *    bag_key_t).  The children are leaves on the level just above the leaves
+ *    and inner nodes everywhere else (all the leaves of a B+ tree are on the
+ *    same level).
+ */
+typedef struct btree_inner {
+    unsigned count;                        /* number of keys in this node  */
+    void *children[BTREE_INNER_MAX + 1];   /* the count + 1 children       */
+    btree_item_t keys[BTREE_INNER_MAX];    /* the keys between children    */
+} btree_inner_t;
+
+/* TYPE btree_step_t
+ *    One step on the path from the root of a B+ tree down to a leaf: an inner
+ *    node and the index of the child the path goes to.
+ */
+typedef struct btree_step {
+    btree_inner_t *node; /* the inner node     */
+    unsigned child;      /* the child taken    */
+} btree_step_t;
+
+/* TYPE btree_bag_t
+ *    A bag stored in a B+ tree.
+ */
+typedef struct btree_bag {
+    bag_t base; /* the part shared by all bags (must come first) */
+    size_t size; /* number of elements in this bag */
+    void *root; /* root of the B+ tree (a leaf if height == 1; NULL if empty) */
+    size_t height; /* number of levels in the tree (0 if empty) */
+    int (*cmp)(bag_elem_t, bag_elem_t); /* function to compare elements */
+    bag_key_t (*key)(bag_elem_t); /* key function for cmp, or NULL */
+    slab_t leaves; /* memory for the leaves of the tree */
+    slab_t inners; /* memory for the inner nodes of the tree */
+#ifdef BAG_STATS
+    bag_counters_t counters; /* work done by this bag so far */
+#endif
+} btree_bag_t;
+
+/******************************************************************************
+ *  Declarations of helper functions -- including full documentation.         *
+ ******************************************************************************/
+
+/* FUNCTION btree_bound
+ *    Find where an element belongs in a sorted array of elements, with a
+ *    binary search that compares keys first.
+ * Parameters and preconditions:
+ *    bag != NULL: the bag the array belongs to
+ *    items != NULL: the sorted array
+ *    n: the number of elements in items
+ *    key: the key of elem
+ *    elem != NULL: the element to search for
+ *    after: true to go after the elements equal to elem, false to go before
+ * Return value:
+ *    the index of the first element of items that is larger than elem (if
+ *    after) or no smaller than elem (otherwise); n if there is none
+ * Side-effects:  none (other than counting the work done, with BAG_STATS)
+ */
+static
+unsigned btree_bound(btree_bag_t *bag, const btree_item_t items[], unsigned n,
+                     bag_key_t key, bag_elem_t elem, bool after);
+
+/* FUNCTION btree_descend
+ *    Walk down a non-empty B+ tree to the leaf where an element belongs.
+ * Parameters and preconditions:
+ *    bag != NULL: the bag to search (bag->root != NULL)
+ *    key: the key of elem
+ *    elem != NULL: the element to search for
+ *    after: as for btree_bound, at every inner node
+ *    path != NULL: where to store the bag->height - 1 steps taken
+ * Return value:
+ *    the leaf reached
+ * Side-effects:
+ *    the steps from the root to the leaf have been stored in path
+ */
+static
+btree_leaf_t *btree_descend(btree_bag_t *bag, bag_key_t key, bag_elem_t elem,
+                            bool after, btree_step_t path[]);
+
+/* FUNCTION btree_next_leaf
+ *    Move a path to the leaf that comes after the one it leads to.
+ * Parameters and preconditions:
+ *    path != NULL: the steps down to a leaf
+ *    depth: the number of steps in path
+ * Return value:
+ *    the next leaf, or NULL if the path leads to the last leaf
+ * Side-effects:
+ *    path leads to the next leaf if there is one (unchanged otherwise)
+ */
+static
+btree_leaf_t *btree_next_leaf(btree_step_t path[], size_t depth);
+
+/* FUNCTION btree_first
+ *    Return the smallest element in a subtree, skipping the leaf that a
+ *    removal has just left empty.
+ * Parameters and preconditions:
+ *    node != NULL: the root of the subtree (with at least one element)
+ *    levels: the number of levels of inner nodes in the subtree
+ * Return value:
+ *    the first element (and its key) of the leftmost non-empty leaf of the
+ *    subtree
+ * Side-effects:  none
+ */
+static
+btree_item_t btree_first(void *node, size_t levels);
+
+/* FUNCTION btree_reserve
+ *    Allocate the nodes needed to insert an element into a leaf, before
+ *    changing anything, so that an insertion either works or leaves the tree
+ *    as it was.
+ * Parameters and preconditions:
+ *    bag != NULL: the bag into which to insert (bag->root != NULL)
+ *    leaf != NULL: the leaf reached by the path
+ *    path != NULL: the bag->height - 1 steps down to leaf
+ *    spare != NULL: where to store the new leaf (NULL if leaf is not full)
+ *    inners != NULL: where to store the new inner nodes, one for each full
+ *                    inner node on the path just above leaf, and one more for
+ *                    a new root if they are all full, followed by NULL
+ * Return value:
+ *    true if every node needed was allocated; false in case of error with
+ *    memory allocation (nothing is allocated then)
+ * Side-effects:
+ *    memory has been allocated for the new nodes
+ */
+static
+bool btree_reserve(btree_bag_t *bag, const btree_leaf_t *leaf,
+                   const btree_step_t path[], btree_leaf_t **spare,
+                   btree_inner_t *inners[]);
+
+/* FUNCTION btree_unreserve
+ *    Return the nodes allocated by btree_reserve, when they are not needed
+ *    after all.
+ * Parameters and preconditions:
+ *    bag != NULL: the bag the nodes were allocated for
+ *    spare: the new leaf (or NULL)
+ *    inners != NULL: the new inner nodes, followed by NULL
+ * Return value:  none
+ * Side-effects:
+ *    the nodes have been returned to the bag's slabs
+ */
+static
+void btree_unreserve(btree_bag_t *bag, btree_leaf_t *spare,
+                     btree_inner_t *inners[]);
+
+/* FUNCTION btree_put
+ *    Insert an element into a leaf at a given position, using the nodes from
+ *    btree_reserve to split the leaf and the inner nodes above it if they are
+ *    full.
+ * Parameters and preconditions:
+ *    bag != NULL: the bag into which to insert
+ *    path != NULL: the bag->height - 1 steps down to leaf
+ *    leaf != NULL: the leaf where elem belongs
+ *    pos: the position in leaf where item belongs (0 <= pos <= leaf->count)
+ *    item: the element to insert and its key
+ *    right, inners: the nodes allocated by btree_reserve for leaf and path
+ * Return value:  none
+ * Side-effects:
+ *    item has been added to the tree, the nodes given have been linked into
+ *    it, and bag->size has been increased
+ */
+static
+void btree_put(btree_bag_t *bag, btree_step_t path[], btree_leaf_t *leaf,
+               unsigned pos, btree_item_t item, btree_leaf_t *right,
+               btree_inner_t *inners[]);
+
+/* FUNCTION btree_add_child
+ *    Add a new child (and the key before it) to the inner node at the end of
+ *    a path, right after the child the path goes to, splitting full nodes on
+ *    the way up as needed.
+ * Parameters and preconditions:
+ *    bag != NULL: the bag the tree belongs to
+ *    path != NULL: the steps down to the node that was split in two
+ *    depth: the number of steps in path
+ *    key: the smallest element in child (and its key)
+ *    child != NULL: the new right half of the node that was split
+ *    inners != NULL: the new inner nodes allocated by btree_reserve
+ * Return value:  none
+ * Side-effects:
+ *    child has been added to the tree, possibly with a new root
+ */
+static
+void btree_add_child(btree_bag_t *bag, btree_step_t path[], size_t depth,
+                     btree_item_t key, void *child, btree_inner_t *inners[]);
+
+/* FUNCTION btree_fix_leaf
+ *    Restore the minimum number of elements in a leaf (other than the root),
+ *    by borrowing one from a neighbour or by merging with one.
+ * Parameters and preconditions:
+ *    bag != NULL: the bag the tree belongs to
+ *    step != NULL: the step from the parent of the leaf down to the leaf
+ * Return value:
+ *    true if two leaves were merged (so that the parent lost a child); false
+ *    otherwise
+ * Side-effects:
+ *    the leaf and a neighbour have been rebalanced or merged, and the key
+ *    between them (and the key before the leaf) updated
+ */
+static
+bool btree_fix_leaf(btree_bag_t *bag, const btree_step_t *step);
+
+/* FUNCTION btree_fix_inner
+ *    Restore the minimum number of keys in an inner node (other than the
+ *    root), by borrowing a child from a neighbour or by merging with one.
+ * Parameters and preconditions:
+ *    bag != NULL: the bag the tree belongs to
+ *    step != NULL: the step from the parent of the node down to the node
+ * Return value:
+ *    true if two nodes were merged (so that the parent lost a child); false
+ *    otherwise
+ * Side-effects:
+ *    the node and a neighbour have been rebalanced or merged, through the
+ *    key between them in the parent
+ */
+static
+bool btree_fix_inner(btree_bag_t *bag, const btree_step_t *step);
+
+/* FUNCTION btree_drop
+ *    Remove a key, and the child right after it, from an inner node.
+ * Parameters and preconditions:
+ *    node != NULL: the inner node
+ *    i < node->count: the index of the key to remove
+ * Return value:  none
+ * Side-effects:
+ *    keys[i] and children[i + 1] have been removed from node
+ */
+static
+void btree_drop(btree_inner_t *node, unsigned i);
+
+/* FUNCTION btree_leaf_create
+ *    Create a new, empty leaf.
+ * Parameters and preconditions:
+ *    bag != NULL: the bag the leaf belongs to
+ * Return value:
+ *    pointer to a new leaf with no elements and no next leaf;
+ *    NULL in case of error with memory allocation
+ * Side-effects:
+ *    memory has been allocated from the bag's slab of leaves for the new leaf
+ */
+static
+btree_leaf_t *btree_leaf_create(btree_bag_t *bag);
+
+/* FUNCTION btree_inner_create
+ *    Create a new, empty inner node.
+ * Parameters and preconditions:
+ *    bag != NULL: the bag the node belongs to
+ * Return value:
+ *    pointer to a new inner node with no keys;
+ *    NULL in case of error with memory allocation
+ * Side-effects:
+ *    memory has been allocated from the bag's slab of inner nodes for the new
+ *    node
+ */
+static
+btree_inner_t *btree_inner_create(btree_bag_t *bag);
+
+/* FUNCTION btree_build
+ *    Build the levels of a B+ tree from a sorted array of elements: the
+ *    leaves are filled as evenly as possible, then each level of inner nodes
+ *    is built over the level below in the same way.
+ * Parameters and preconditions:
+ *    bag != NULL: an empty bag (whose key function gives the keys)
+ *    elems != NULL: the sorted elements to store
+ *    n > 0: the number of elements in elems
+ * Return value:
+ *    true if the tree was built; false in case of error with memory
+ *    allocation (the nodes already allocated are left in the bag's slabs)
+ * Side-effects:
+ *    the bag holds the n elements
+ */
+static
+bool btree_build(btree_bag_t *bag, const bag_elem_t elems[], size_t n);
+
+/******************************************************************************
+ *  Declarations of the bag operations -- see bag.h for documentation.        *
+ ******************************************************************************/
+
+static
+bag_t *btree_bag_create(int (*cmp)(bag_elem_t, bag_elem_t),
+                        unsigned long (*hash)(bag_elem_t),
+                        bag_key_t (*key)(bag_elem_t));
+
+static
+bag_t *btree_bag_build(int (*cmp)(bag_elem_t, bag_elem_t),
+                       unsigned long (*hash)(bag_elem_t),
+                       bag_key_t (*key)(bag_elem_t),
+                       const bag_elem_t elems[], size_t n);
+
+static
+void btree_bag_destroy(bag_t *b);
+
+static
+size_t btree_bag_size(const bag_t *b);
+
+static
+bool btree_bag_traverse(const bag_t *b,
+                        void (*fun)(bag_elem_t, void *), void *ctx);
+
+static
+bag_elem_t btree_bag_contains(bag_t *b, bag_elem_t elem);
+
+static
+bag_elem_t btree_bag_insert(bag_t *b, bag_elem_t elem);
+
+static
+bag_elem_t btree_bag_find_or_insert(bag_t *b, bag_elem_t probe,
+                                    bag_elem_t (*make)(bag_elem_t, void *),
+                                    void *ctx);
+
+static
+bag_elem_t btree_bag_remove(bag_t *b, bag_elem_t elem);
+
+static
+void btree_bag_stats(const bag_t *b, bag_stats_t *stats);
+
+/* CONSTANT btree_bag_ops -- See bag_impl.h for documentation. */
+const bag_ops_t btree_bag_ops = {
+    "btree",
+    btree_bag_create,
+    btree_bag_build,
+    btree_bag_destroy,
+    btree_bag_size,
+    btree_bag_traverse,
+    btree_bag_contains,
+    btree_bag_insert,
+    btree_bag_find_or_insert,
+    btree_bag_remove,
+    btree_bag_stats,
+    NULL,
+    NULL,
+    NULL
+};
+
+/******************************************************************************
+ *  Definitions of the bag operations -- see bag.h for documentation.         *
+ ******************************************************************************/
+
+bag_t *btree_bag_create(int (*cmp)(bag_elem_t, bag_elem_t),
+                        unsigned long (*hash)(bag_elem_t),
+                        bag_key_t (*key)(bag_elem_t))
+{
+    btree_bag_t *bag = malloc(sizeof(btree_bag_t));
+
+    /* Search trees only need the comparison function (and the keys). */
+    (void) hash;
+    if (bag) {
+        bag->base.ops = &btree_bag_ops;
+        bag->size = 0;
+        bag->root = NULL;
+        bag->height = 0;
+        bag->cmp = cmp;
+        bag->key = key;
+        slab_init(&bag->leaves, sizeof(btree_leaf_t));
+        slab_init(&bag->inners, sizeof(btree_inner_t));
+        BAG_COUNTERS_INIT(bag);
+    }
+    return (bag_t *) bag;
+}
+
+bag_t *btree_bag_build(int (*cmp)(bag_elem_t, bag_elem_t),
+                       unsigned long (*hash)(bag_elem_t),
+                       bag_key_t (*key)(bag_elem_t),
+                       const bag_elem_t elems[], size_t n)
+{
+    bag_t *b = btree_bag_create(cmp, hash, key);
+    btree_bag_t *bag = (btree_bag_t *) b;
+
+    if (! bag || n == 0)  return b;
+    if (! btree_build(bag, elems, n)) {
+        btree_bag_destroy(b);
+        return NULL;
+    }
+    return b;
+}
+
+void btree_bag_destroy(bag_t *b)
+{
+    btree_bag_t *bag = (btree_bag_t *) b;
+
+    /* Every node lives in a slab, so there is no need to walk the tree. */
+    slab_release(&bag->leaves);
+    slab_release(&bag->inners);
+    free(bag);
+}
+
+size_t btree_bag_size(const bag_t *b)
+{
+    const btree_bag_t *bag = (const btree_bag_t *) b;
+    return bag->size;
+}
+
+/* The leaves are chained in order, so the traversal goes down to the first
+ * leaf once, then reads the leaves one after the other.
+ */
+bool btree_bag_traverse(const bag_t *b,
+                        void (*fun)(bag_elem_t, void *), void *ctx)
+{
+    const btree_bag_t *bag = (const btree_bag_t *) b;
+    const btree_leaf_t *leaf;
+    void *node = bag->root;
+    size_t level;
+    unsigned i;
+
+    if (! node)  return true;
+    for (level = 1; level < bag->height; level++)
+        node = ((btree_inner_t *) node)->children[0];
+
+    for (leaf = node; leaf; leaf = leaf->next)
+        for (i = 0; i < leaf->count; i++)
+            (*fun)(leaf->items[i].elem, ctx);
+    return true;
+}
+
+/* The search goes to the left of every key equal to elem, so it reaches the
+ * first element equal to elem -- unless that element is the first one of the
+ * next leaf, since the keys are the smallest elements of their subtrees.
+ */
+bag_elem_t btree_bag_contains(bag_t *b, bag_elem_t elem)
+{
+    btree_bag_t *bag = (btree_bag_t *) b;
+    btree_step_t path[BTREE_MAX_HEIGHT];
+    btree_leaf_t *leaf;
+    bag_elem_t found = NULL;
+    bag_key_t key;
+    unsigned pos;
+
+    if (! bag->root)  return NULL;
+    key = BAG_KEY(bag, elem);
+    leaf = btree_descend(bag, key, elem, false, path);
+    pos = btree_bound(bag, leaf->items, leaf->count, key, elem, false);
+    if (pos == leaf->count) {
+        leaf = leaf->next;
+        pos = 0;
+        if (leaf)  BAG_VISIT(bag);
+    }
+    if (leaf && BAG_KEY_CMP(bag, key, elem, leaf->items[pos].key,
+                            leaf->items[pos].elem) == 0)
+        found = leaf->items[pos].elem;
+    BAG_END_SEARCH(bag);
+    return found;
+}
+
+bag_elem_t btree_bag_insert(bag_t *b, bag_elem_t elem)
+{
+    btree_bag_t *bag = (btree_bag_t *) b;
+    btree_step_t path[BTREE_MAX_HEIGHT];
+    btree_inner_t *inners[BTREE_MAX_HEIGHT + 2];
+    btree_leaf_t *leaf, *right;
+    btree_item_t item;
+    unsigned pos;
+
+    if (! bag->root) {
+        if (! (bag->root = btree_leaf_create(bag)))  return NULL;
+        bag->height = 1;
+    }
+
+    item.key = BAG_KEY(bag, elem);
+    item.elem = elem;
+    leaf = btree_descend(bag, item.key, elem, true, path);
+    pos = btree_bound(bag, leaf->items, leaf->count, item.key, elem, true);
+    BAG_END_SEARCH(bag);
+    if (! btree_reserve(bag, leaf, path, &right, inners))  return NULL;
+    btree_put(bag, path, leaf, pos, item, right, inners);
+    return elem;
+}
+
+/* The search goes to the first element no smaller than probe, as in
+ * btree_bag_contains.  If that element is not equal to probe, probe belongs
+ * right before it -- or at the end of the leaf reached, if the element is the
+ * first one of the next leaf, since the key in front of that leaf is larger
+ * than probe.  Every node needed is allocated before the element is made, so
+ * that nothing can fail once make has been called.
+ */
+bag_elem_t btree_bag_find_or_insert(bag_t *b, bag_elem_t probe,
+                                    bag_elem_t (*make)(bag_elem_t, void *),
+                                    void *ctx)
+{
+    btree_bag_t *bag = (btree_bag_t *) b;
+    btree_step_t path[BTREE_MAX_HEIGHT];
+    btree_inner_t *inners[BTREE_MAX_HEIGHT + 2];
+    btree_leaf_t *leaf, *right;
+    btree_item_t item;
+    bag_key_t key = BAG_KEY(bag, probe);
+    unsigned pos;
+
+    if (! bag->root) {
+        if (! (leaf = btree_leaf_create(bag)))  return NULL;
+        if (! (item.elem = (*make)(probe, ctx))) {
+            slab_free(&bag->leaves, leaf);
+            return NULL;
+        }
+        item.key = key;
+        leaf->items[0] = item;
+        leaf->count = 1;
+        bag->root = leaf;
+        bag->height = 1;
+        bag->size = 1;
+        return item.elem;
+    }
+
+    leaf = btree_descend(bag, key, probe, false, path);
+    pos = btree_bound(bag, leaf->items, leaf->count, key, probe, false);
+    if (pos < leaf->count) {
+        if (BAG_KEY_CMP(bag, key, probe, leaf->items[pos].key,
+                        leaf->items[pos].elem) == 0) {
+            BAG_END_SEARCH(bag);
+            return leaf->items[pos].elem;
+        }
+    } else if (leaf->next) {
+        BAG_VISIT(bag);
+        if (BAG_KEY_CMP(bag, key, probe, leaf->next->items[0].key,
+                        leaf->next->items[0].elem) == 0) {
+            BAG_END_SEARCH(bag);
+            return leaf->next->items[0].elem;
+        }
+    }
+    BAG_END_SEARCH(bag);
+
+    if (! btree_reserve(bag, leaf, path, &right, inners))  return NULL;
+    if (! (item.elem = (*make)(probe, ctx))) {
+        btree_unreserve(bag, right, inners);
+        return NULL;
+    }
+    item.key = key;
+    btree_put(bag, path, leaf, pos, item, right, inners);
+    return item.elem;
+}
+
+/* The keys are elements of the bag, so the element removed may still be used
+ * as a key -- always in a node on its path, right before the child the path
+ * goes to (it went up as the smallest element of that child).  Such keys are
+ * replaced by the new smallest element of the child before the nodes that are
+ * now too small are rebalanced from the bottom up.
+ */
+bag_elem_t btree_bag_remove(bag_t *b, bag_elem_t elem)
+{
+    btree_bag_t *bag = (btree_bag_t *) b;
+    btree_step_t path[BTREE_MAX_HEIGHT];
+    btree_leaf_t *leaf;
+    btree_inner_t *root;
+    bag_elem_t removed;
+    bag_key_t key;
+    size_t depth, d;
+    unsigned pos;
+
+    if (! bag->root)  return NULL;
+    depth = bag->height - 1;
+    key = BAG_KEY(bag, elem);
+    leaf = btree_descend(bag, key, elem, false, path);
+    pos = btree_bound(bag, leaf->items, leaf->count, key, elem, false);
+    if (pos == leaf->count) {
+        leaf = btree_next_leaf(path, depth);
+        pos = 0;
+        if (leaf)  BAG_VISIT(bag);
+    }
+    BAG_END_SEARCH(bag);
+    if (! leaf || BAG_KEY_CMP(bag, key, elem, leaf->items[pos].key,
+                              leaf->items[pos].elem) != 0)
+        return NULL;
+
+    removed = leaf->items[pos].elem;
+    leaf->count--;
+    memmove(leaf->items + pos, leaf->items + pos + 1,
+            (leaf->count - pos) * sizeof(btree_item_t));
+    bag->size--;
+
+    /* Replace the keys that refer to the element removed (the parent's key is
+     * fixed by btree_fix_leaf if the leaf is now empty). */
+    for (d = 0; d < depth; d++) {
+        btree_step_t *step = &path[d];
+        if (step->child > 0 &&
+            step->node->keys[step->child - 1].elem == removed &&
+            (d + 1 < depth || leaf->count > 0))
+            step->node->keys[step->child - 1] =
+                btree_first(step->node->children[step->child], depth - d - 1);
+    }
+
+    /* Rebalance from the bottom up, as long as merges make parents too
+     * small; then drop the root if it has a single child left. */
+    if (depth == 0) {
+        if (leaf->count == 0) {
+            slab_free(&bag->leaves, leaf);
+            bag->root = NULL;
+            bag->height = 0;
+        }
+        return removed;
+    }
+    if (leaf->count < BTREE_LEAF_MIN && btree_fix_leaf(bag, &path[depth - 1]))
+        for (d = depth - 1; d > 0; d--)
+            if (path[d].node->count >= BTREE_INNER_MIN ||
+                ! btree_fix_inner(bag, &path[d - 1]))
+                break;
+    root = bag->root;
+    if (root->count == 0) {
+        bag->root = root->children[0];
+        bag->height--;
+        slab_free(&bag->inners, root);
+    }
+    return removed;
+}
+
+void btree_bag_stats(const bag_t *b, bag_stats_t *stats)
+{
+    const btree_bag_t *bag = (const btree_bag_t *) b;
+    stats->height = bag->height;
+    BAG_GET_STATS(bag, stats);
+}
+
+/******************************************************************************
+ *  Definitions of helper functions -- see above for documentation.           *
+ ******************************************************************************/
+
+unsigned btree_bound(btree_bag_t *bag, const btree_item_t items[], unsigned n,
+                     bag_key_t key, bag_elem_t elem, bool after)
+{
+    unsigned lo = 0, hi = n, mid;
+    int result;
+
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        result = BAG_KEY_CMP(bag, key, elem, items[mid].key, items[mid].elem);
+        if (result > 0 || (after && result == 0))
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+btree_leaf_t *btree_descend(btree_bag_t *bag, bag_key_t key, bag_elem_t elem,
+                            bool after, btree_step_t path[])
+{
+    void *node = bag->root;
+    btree_inner_t *inner;
+    size_t level;
+
+    for (level = 0; level + 1 < bag->height; level++) {
+        BAG_VISIT(bag);
+        inner = node;
+        path[level].node = inner;
+        path[level].child = btree_bound(bag, inner->keys, inner->count, key,
+                                        elem, after);
+        node = inner->children[path[level].child];
+    }
+    BAG_VISIT(bag);
+    return node;
+}
+
+btree_leaf_t *btree_next_leaf(btree_step_t path[], size_t depth)
+{
+    size_t d = depth;
+    void *node;
+
+    /* Go up to the lowest node where the path can move right... */
+    while (d > 0 && path[d - 1].child == path[d - 1].node->count)  d--;
+    if (d == 0)  return NULL;
+    path[d - 1].child++;
+    node = path[d - 1].node->children[path[d - 1].child];
+
+    /* ...then down its leftmost children. */
+    for (; d < depth; d++) {
+        path[d].node = node;
+        path[d].child = 0;
+        node = path[d].node->children[0];
+    }
+    return node;
+}
+
+btree_item_t btree_first(void *node, size_t levels)
+{
+    btree_leaf_t *leaf;
+
+    while (levels-- > 0)  node = ((btree_inner_t *) node)->children[0];
+    leaf = node;
+    if (leaf->count == 0)  leaf = leaf->next;
+    return leaf->items[0];
+}
+
+bool btree_reserve(btree_bag_t *bag, const btree_leaf_t *leaf,
+                   const btree_step_t path[], btree_leaf_t **spare,
+                   btree_inner_t *inners[])
+{
+    size_t d = bag->height - 1, n = 0;
+
+    *spare = NULL;
+    inners[0] = NULL;
+    if (leaf->count < BTREE_LEAF_MAX)  return true;
+    if (! (*spare = btree_leaf_create(bag)))  return false;
+
+    /* One new node for every full node above, plus a new root if the split
+     * goes all the way up. */
+    while (d > 0 && path[d - 1].node->count == BTREE_INNER_MAX) {
+        d--;
+        n++;
+    }
+    if (d == 0)  n++;
+    for (d = 0; d < n; d++) {
+        if (! (inners[d] = btree_inner_create(bag))) {
+            btree_unreserve(bag, *spare, inners);
+            return false;
+        }
+        inners[d + 1] = NULL;
+    }
+    return true;
+}
+
+void btree_unreserve(btree_bag_t *bag, btree_leaf_t *spare,
+                     btree_inner_t *inners[])
+{
+    if (spare)  slab_free(&bag->leaves, spare);
+    for (; *inners; inners++)  slab_free(&bag->inners, *inners);
+}
+
+/* Duplicates go after the elements equal to them.  A full leaf is split in
+ * two halves, and the first element of the right half goes up to the parent
+ * as the key between them; full inner nodes are split the same way, up to the
+ * root if need be.
+ */
+void btree_put(btree_bag_t *bag, btree_step_t path[], btree_leaf_t *leaf,
+               unsigned pos, btree_item_t item, btree_leaf_t *right,
+               btree_inner_t *inners[])
+{
+    if (right) {
+        /* Move the upper half over to the new leaf, then insert into the
+         * half where item belongs. */
+        right->count = BTREE_LEAF_MAX - BTREE_LEAF_MAX / 2;
+        memcpy(right->items, leaf->items + BTREE_LEAF_MAX / 2,
+               right->count * sizeof(btree_item_t));
+        leaf->count = BTREE_LEAF_MAX / 2;
+        right->next = leaf->next;
+        leaf->next = right;
+        if (pos > leaf->count) {
+            pos -= leaf->count;
+            leaf = right;
+        }
+    }
+
+    memmove(leaf->items + pos + 1, leaf->items + pos,
+            (leaf->count - pos) * sizeof(btree_item_t));
+    leaf->items[pos] = item;
+    leaf->count++;
+
+    if (right)
+        btree_add_child(bag, path, bag->height - 1, right->items[0], right,
+                        inners);
+    bag->size++;
+}
+
+/* When a full node is split, its keys and the new one are gathered in order
+ * (on the stack); the lower half stays in the node, the middle key goes up to
+ * the parent and the upper half moves to the new node.
+ */
+void btree_add_child(btree_bag_t *bag, btree_step_t path[], size_t depth,
+                     btree_item_t key, void *child, btree_inner_t *inners[])
+{
+    btree_item_t keys[BTREE_INNER_MAX + 1];
+    void *children[BTREE_INNER_MAX + 2];
+    btree_inner_t *node, *right;
+    unsigned i, half = (BTREE_INNER_MAX + 1) / 2;
+
+    while (depth > 0) {
+        node = path[--depth].node;
+        i = path[depth].child;
+
+        if (node->count < BTREE_INNER_MAX) {
+            memmove(node->keys + i + 1, node->keys + i,
+                    (node->count - i) * sizeof(btree_item_t));
+            memmove(node->children + i + 2, node->children + i + 1,
+                    (node->count - i) * sizeof(void *));
+            node->keys[i] = key;
+            node->children[i + 1] = child;
+            node->count++;
+            return;
+        }
+
+        memcpy(keys, node->keys, i * sizeof(btree_item_t));
+        keys[i] = key;
+        memcpy(keys + i + 1, node->keys + i,
+               (BTREE_INNER_MAX - i) * sizeof(btree_item_t));
+        memcpy(children, node->children, (i + 1) * sizeof(void *));
+        children[i + 1] = child;
+        memcpy(children + i + 2, node->children + i + 1,
+               (BTREE_INNER_MAX - i) * sizeof(void *));
+
+        right = *inners++;
+        node->count = half;
+        memcpy(node->keys, keys, half * sizeof(btree_item_t));
+        memcpy(node->children, children, (half + 1) * sizeof(void *));
+        right->count = BTREE_INNER_MAX - half;
+        memcpy(right->keys, keys + half + 1,
+               right->count * sizeof(btree_item_t));
+        memcpy(right->children, children + half + 1,
+               (right->count + 1) * sizeof(void *));
+
+        key = keys[half];
+        child = right;
+    }
+
+    /* The root was split: the tree grows by one level. */
+    node = *inners;
+    node->count = 1;
+    node->keys[0] = key;
+    node->children[0] = bag->root;
+    node->children[1] = child;
+    bag->root = node;
+    bag->height++;
+}
+
+/* Borrowing is preferred over merging, and the left neighbour over the right
+ * one.  Whatever happens, the key before the leaf ends up as its new first
+ * element (or goes away with it), which also takes care of a key left behind
+ * by btree_bag_remove.
+ */
+bool btree_fix_leaf(btree_bag_t *bag, const btree_step_t *step)
+{
+    btree_inner_t *parent = step->node;
+    unsigned i = step->child;
+    btree_leaf_t *leaf = parent->children[i];
+    btree_leaf_t *left = i > 0 ? parent->children[i - 1] : NULL;
+    btree_leaf_t *right = i < parent->count ? parent->children[i + 1] : NULL;
+
+    if (left && left->count > BTREE_LEAF_MIN) {
+        memmove(leaf->items + 1, leaf->items,
+                leaf->count * sizeof(btree_item_t));
+        leaf->items[0] = left->items[--left->count];
+        leaf->count++;
+        parent->keys[i - 1] = leaf->items[0];
+        BAG_COUNT(bag, rotations, 1);
+        return false;
+    }
+    if (right && right->count > BTREE_LEAF_MIN) {
+        leaf->items[leaf->count++] = right->items[0];
+        right->count--;
+        memmove(right->items, right->items + 1,
+                right->count * sizeof(btree_item_t));
+        parent->keys[i] = right->items[0];
+        if (i > 0)  parent->keys[i - 1] = leaf->items[0];
+        BAG_COUNT(bag, rotations, 1);
+        return false;
+    }
+
+    /* Merge the leaf into its left neighbour, or its right neighbour into
+     * it. */
+    if (left) {
+        right = leaf;
+        leaf = left;
+        i--;
+    }
+    memcpy(leaf->items + leaf->count, right->items,
+           right->count * sizeof(btree_item_t));
+    leaf->count += right->count;
+    leaf->next = right->next;
+    slab_free(&bag->leaves, right);
+    btree_drop(parent, i);
+    return true;
+}
+
+bool btree_fix_inner(btree_bag_t *bag, const btree_step_t *step)
+{
+    btree_inner_t *parent = step->node;
+    unsigned i = step->child;
+    btree_inner_t *node = parent->children[i];
+    btree_inner_t *left = i > 0 ? parent->children[i - 1] : NULL;
+    btree_inner_t *right = i < parent->count ? parent->children[i + 1] : NULL;
+
+    if (left && left->count > BTREE_INNER_MIN) {
+        /* Rotate through the parent: the parent's key comes down in front of
+         * the node, and the left neighbour's last key goes up. */
+        memmove(node->keys + 1, node->keys, node->count * sizeof(btree_item_t));
+        memmove(node->children + 1, node->children,
+                (node->count + 1) * sizeof(void *));
+        node->keys[0] = parent->keys[i - 1];
+        node->children[0] = left->children[left->count];
+        node->count++;
+        parent->keys[i - 1] = left->keys[--left->count];
+        BAG_COUNT(bag, rotations, 1);
+        return false;
+    }
+    if (right && right->count > BTREE_INNER_MIN) {
+        node->keys[node->count] = parent->keys[i];
+        node->children[++node->count] = right->children[0];
+        parent->keys[i] = right->keys[0];
+        right->count--;
+        memmove(right->keys, right->keys + 1,
+                right->count * sizeof(btree_item_t));
+        memmove(right->children, right->children + 1,
+                (right->count + 1) * sizeof(void *));
+        BAG_COUNT(bag, rotations, 1);
+        return false;
+    }
+
+    /* Merge the node into its left neighbour, or its right neighbour into it,
+     * bringing the key between them down from the parent. */
+    if (left) {
+        right = node;
+        node = left;
+        i--;
+    }
+    node->keys[node->count] = parent->keys[i];
+    memcpy(node->keys + node->count + 1, right->keys,
+           right->count * sizeof(btree_item_t));
+    memcpy(node->children + node->count + 1, right->children,
+           (right->count + 1) * sizeof(void *));
+    node->count += right->count + 1;
+    slab_free(&bag->inners, right);
+    btree_drop(parent, i);
+    return true;
+}
+
+void btree_drop(btree_inner_t *node, unsigned i)
+{
+    node->count--;
+    memmove(node->keys + i, node->keys + i + 1,
+            (node->count - i) * sizeof(btree_item_t));
+    memmove(node->children + i + 1, node->children + i + 2,
+            (node->count - i) * sizeof(void *));
+}
+
+btree_leaf_t *btree_leaf_create(btree_bag_t *bag)
+{
+    btree_leaf_t *leaf = slab_alloc(&bag->leaves);
+    if (leaf) {
+        leaf->count = 0;
+        leaf->next = NULL;
+        BAG_COUNT(bag, node_allocs, 1);
+    }
+    return leaf;
+}
+
+btree_inner_t *btree_inner_create(btree_bag_t *bag)
+{
+    btree_inner_t *node = slab_alloc(&bag->inners);
+    if (node) {
+        node->count = 0;
+        BAG_COUNT(bag, node_allocs, 1);
+    }
+    return node;
+}
+
+/* Spreading the elements (or children) evenly means that every node gets at
+ * least half of its capacity as soon as there are two nodes on a level.  The
+ * nodes of each level and their smallest elements are kept in two arrays,
+ * which are overwritten in place by the level above.
+ */
+bool btree_build(btree_bag_t *bag, const bag_elem_t elems[], size_t n)
+{
+    size_t count = (n + BTREE_LEAF_MAX - 1) / BTREE_LEAF_MAX;
+    void **nodes = malloc(count * sizeof(void *));
+    btree_item_t *firsts = malloc(count * sizeof(btree_item_t));
+    btree_leaf_t *leaf, *prev = NULL;
+    btree_inner_t *inner;
+    size_t i, j, k, take, parents;
+    bool built = nodes && firsts;
+
+    for (i = 0, k = 0; built && i < count; i++) {
+        if (! (leaf = btree_leaf_create(bag))) {
+            built = false;
+            break;
+        }
+        take = n / count + (i < n % count);
+        for (j = 0; j < take; j++) {
+            leaf->items[j].key = BAG_KEY(bag, elems[k + j]);
+            leaf->items[j].elem = elems[k + j];
+        }
+        leaf->count = take;
+        if (prev)  prev->next = leaf;
+        prev = leaf;
+        nodes[i] = leaf;
+        firsts[i] = leaf->items[0];
+        k += take;
+    }
+    bag->height = 1;
+
+    while (built && count > 1) {
+        parents = (count + BTREE_INNER_MAX) / (BTREE_INNER_MAX + 1);
+        for (i = 0, k = 0; i < parents; i++) {
+            if (! (inner = btree_inner_create(bag))) {
+                built = false;
+                break;
+            }
+            take = count / parents + (i < count % parents);
+            for (j = 0; j < take; j++) {
+                inner->children[j] = nodes[k + j];
+                if (j > 0)  inner->keys[j - 1] = firsts[k + j];
+            }
+            inner->count = take - 1;
+            nodes[i] = inner;
+            firsts[i] = firsts[k];
+            k += take;
+        }
+        count = parents;
+        bag->height++;
+    }
+
+    if (built) {
+        bag->root = nodes[0];
+        bag->size = n;
+    }
+    free(nodes);
+    free(firsts);
+    return built;
+}
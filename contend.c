@@ -0,0 +1,555 @@
+/* FILE contend.c
+ *    Measure how one bag holds up when several threads use it at once: the
+ *    words of a text file are added to a shared bag by every thread (each one
+ *    taking every n-th word, so the threads keep running into the same words)
+ *    then looked up again, once in a lock-free skip list and once in another
+ *    kind of bag behind a mutex.  The results are printed as CSV.  With
+ *    --check, the skip list is checked instead of timed: after the threads
+ *    have added the words, and while one thread removes them again, every
+ *    level of the list must stay in order.
+ */
+
+/******************************************************************************
+ *  Types and Constants.                                                      *
+ ******************************************************************************/
+
+/* Ask for the POSIX clocks used to time the trials. */
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <pthread.h>
+#define HAVE_PTHREADS 1
+#endif
+
+#include "bag.h"
+#include "bag_impl.h" /* for skiplist_bag_check */
+#include "file_util.h"
+
+/* CONSTANT DEFAULT_TRIALS -- Number of times each measurement is repeated. */
+#define DEFAULT_TRIALS 5
+
+/* CONSTANT MAX_THREADS -- Largest number of threads sharing one bag. */
+#define MAX_THREADS 64
+
+/* CONSTANT MAX_THREAD_COUNTS -- Largest number of numbers of threads to try. */
+#define MAX_THREAD_COUNTS 16
+
+/* CONSTANT LOCK_FREE_NAME -- The kind of bag used without a lock. */
+#define LOCK_FREE_NAME "skiplist"
+
+/* CONSTANT NUM_PHASES -- Number of phases timed in each trial. */
+#define NUM_PHASES 2
+
+/* CONSTANT CHECK_STEPS
+ *    Number of times the skip list is checked while its words are removed.
+ */
+#define CHECK_STEPS 16
+
+/* TYPE words_t -- The words of a text file, in order. */
+typedef struct words
+{
+    char **list;  /* each word, null-terminated   */
+    size_t count; /* number of words in list      */
+    char *chars;  /* the memory of all the words  */
+} words_t;
+
+/* TYPE shared_t -- The bag shared by the threads of one trial. */
+typedef struct shared
+{
+    bag_t *bag;              /* the bag                             */
+    bool locked;             /* true to use the bag behind the lock */
+#ifdef HAVE_PTHREADS
+    pthread_mutex_t lock;    /* the lock                            */
+#endif
+    const words_t *words;    /* the words to add and look up        */
+    int threads;             /* number of threads using the bag     */
+    bool failed;             /* set if a word could not be added    */
+} shared_t;
+
+/* TYPE contender_t -- The work given to one thread. */
+typedef struct contender
+{
+    shared_t *shared; /* the bag and the words                  */
+    int first;        /* the first word of this thread          */
+    bool lookup;      /* true to look the words up, not add them */
+} contender_t;
+
+/******************************************************************************
+ *  Function declarations -- with full documentation.                         *
+ ******************************************************************************/
+
+/* FUNCTION main
+ *    Grab options, the name of a text file and an optional minimum word
+ *    length from the command line, and for each number of threads asked for,
+ *    time adding the words of the file to a shared bag and looking them up
+ *    again, for the skip list without a lock and for another kind of bag with
+ *    one.  The median time of each phase is printed to stdout, one line per
+ *    bag and number of threads.  Options: --trials=N (default 5),
+ *    --threads=N1,N2,... (default 1,2,4,8), --backend=NAME, the kind of
+ *    bag to use behind a lock (default the default kind of bag), and --check
+ *    to check the skip list after each trial instead of timing it (see
+ *    run_check).
+ * Parameters and preconditions:
+ *    argc > 0: number of command line arguments
+ *    argv != NULL: array of command line arguments
+ * Return value:  exit status
+ * Side-effects:  the main program is executed
+ */
+int main(int argc, char *argv[]);
+
+/* FUNCTION read_words
+ *    Read the words of a text file that are long enough into memory.
+ * Parameters and preconditions:
+ *    filename != NULL: the file to read
+ *    min_word_len > 0: the minimum length of words to keep
+ *    words != NULL: where to store the words
+ * Return value:
+ *    true if the words were read; false if the file cannot be opened or in
+ *    case of error with memory allocation
+ * Side-effects:
+ *    *words has been filled in (free its list and chars when done)
+ */
+static
+bool read_words(const char *filename, int min_word_len, words_t *words);
+
+/* FUNCTION run_trial
+ *    Time adding every word to a new shared bag, by several threads, then
+ *    looking every word up in it.
+ * Parameters and preconditions:
+ *    backend != NULL: the kind of bag to share
+ *    locked: true to use the bag behind a lock
+ *    words != NULL: the words
+ *    0 < threads <= MAX_THREADS: the number of threads
+ *    ms != NULL: where to store the time taken by each phase
+ *    distinct != NULL: where to store the number of different words added
+ * Return value:
+ *    true if the trial ran; false in case of error with memory allocation
+ *    or threads
+ * Side-effects:
+ *    ms[0..NUM_PHASES-1] and *distinct have been set
+ */
+static
+bool run_trial(const bag_ops_t *backend, bool locked, const words_t *words,
+               int threads, double ms[], size_t *distinct);
+
+/* FUNCTION run_check
+ *    Add every word to a new skip list by several threads, then remove every
+ *    word again by one thread, checking the structure of the list (with
+ *    skiplist_bag_check) once the words are added and CHECK_STEPS times as
+ *    they are removed.
+ * Parameters and preconditions:
+ *    words != NULL: the words
+ *    0 < threads <= MAX_THREADS: the number of threads
+ *    distinct != NULL: where to store the number of different words added
+ * Return value:
+ *    true if the words were added, every check passed and every word added
+ *    was removed exactly once; false otherwise
+ * Side-effects:
+ *    *distinct has been set
+ */
+static
+bool run_check(const words_t *words, int threads, size_t *distinct);
+
+/* FUNCTION run_phase
+ *    Run one phase of a trial on every thread, and wait for all of them.
+ * Parameters and preconditions:
+ *    shared != NULL: the bag and the words, with shared->threads threads
+ *    lookup: true to look the words up; false to add them
+ * Return value:
+ *    true if every thread ran; false if one could not be started
+ * Side-effects:
+ *    every word has been added to (or looked up in) shared->bag
+ */
+static
+bool run_phase(shared_t *shared, bool lookup);
+
+/* FUNCTION contend
+ *    The work of one thread: add every n-th word to the shared bag, or look
+ *    it up, starting from the thread's first word.  (Matches the prototype
+ *    of a thread's start function.)
+ * Parameters and preconditions:
+ *    arg != NULL: a pointer to the thread's contender_t
+ * Return value:  NULL
+ * Side-effects:
+ *    the thread's words have been added to the bag or looked up;
+ *    shared->failed has been set if one could not be added
+ */
+static
+void *contend(void *arg);
+
+/* FUNCTION word_cmp
+ *    Compare two words in alphabetical order (they are their own elements).
+ * Parameters and preconditions:
+ *    a, b != NULL: two null-terminated words
+ * Return value:  < 0, 0 or > 0 as a comes before, with or after b
+ * Side-effects:  none
+ */
+static
+int word_cmp(bag_elem_t a, bag_elem_t b);
+
+/* FUNCTION word_key
+ *    Return the first 8 characters of a word, packed into a key for word_cmp.
+ * Parameters and preconditions:
+ *    e != NULL: a null-terminated word
+ * Return value:  the key of the word
+ * Side-effects:  none
+ */
+static
+bag_key_t word_key(bag_elem_t e);
+
+/* FUNCTION word_make
+ *    The element added for a word that is not in the bag yet: the word itself,
+ *    which stays in memory for the whole trial.
+ * Parameters and preconditions:
+ *    probe != NULL: the word
+ *    ctx: unused
+ * Return value:  probe
+ * Side-effects:  none
+ */
+static
+bag_elem_t word_make(bag_elem_t probe, void *ctx);
+
+/* FUNCTION now_ms
+ *    Return the current time in milliseconds, from a monotonic clock when
+ *    there is one.
+ * Parameters and preconditions:  none
+ * Return value:  the time, in milliseconds since some fixed point
+ * Side-effects:  none
+ */
+static
+double now_ms(void);
+
+/* FUNCTION double_cmp
+ *    Compare two doubles, for qsort.
+ * Parameters and preconditions:
+ *    a, b != NULL: pointers to the doubles
+ * Return value:  < 0, 0 or > 0 as *a is smaller than, equal to or larger
+ *                than *b
+ * Side-effects:  none
+ */
+static
+int double_cmp(const void *a, const void *b);
+
+/******************************************************************************
+ *  Function definitions -- see above for documentation.                      *
+ ******************************************************************************/
+
+int main(int argc, char *argv[])
+{
+    const char *names[2] = { LOCK_FREE_NAME, NULL };
+    int counts[MAX_THREAD_COUNTS] = { 1, 2, 4, 8 };
+    int num_counts = 4, trials = DEFAULT_TRIALS, min_word_len = 1;
+    int arg, args = 0, k, n, t, p;
+    char *arg_list[2] = { NULL, NULL }, *item, *end;
+    double ms[NUM_PHASES] = { 0.0, 0.0 }, *times[NUM_PHASES] = { NULL, NULL };
+    size_t distinct = 0;
+    words_t words;
+    bool ok = true, check = false;
+
+    names[1] = bag_backend_name(0);
+    for (arg = 1; arg < argc && ok; arg++) {
+        if (strncmp(argv[arg], "--trials=", 9) == 0) {
+            ok = (trials = (int) strtol(argv[arg] + 9, NULL, 10)) > 0;
+        } else if (strncmp(argv[arg], "--threads=", 10) == 0) {
+            // a comma-separated list of numbers of threads
+            num_counts = 0;
+            for (item = argv[arg] + 10; *item && ok;
+                 item = end + (*end == ',')) {
+                ok = num_counts < MAX_THREAD_COUNTS;
+                if (ok)  counts[num_counts] = (int) strtol(item, &end, 10);
+                ok = ok && end != item && counts[num_counts] > 0 &&
+                     counts[num_counts] <= MAX_THREADS;
+                num_counts++;
+            }
+            ok = ok && num_counts > 0;
+        } else if (strncmp(argv[arg], "--backend=", 10) == 0) {
+            ok = bag_backend(names[1] = argv[arg] + 10) != NULL;
+        } else if (strcmp(argv[arg], "--check") == 0) {
+            check = true;
+        } else if (strncmp(argv[arg], "--", 2) == 0 || args == 2) {
+            ok = false;
+        } else {
+            arg_list[args++] = argv[arg];
+        }
+    }
+    if (arg_list[1] &&
+        (min_word_len = (int) strtol(arg_list[1], NULL, 10)) <= 0)
+        ok = false;
+
+    if (! ok || ! arg_list[0]) {
+        fprintf(stderr,
+                "ERROR: missing or incorrect argument!\n"
+                "USAGE: %s [options] <filename> [minimum_word_length]\n"
+                "  . <filename> is the name of a text file whose words are"
+                " added to a shared bag\n"
+                "  . --trials=N is the number of times to repeat each"
+                " measurement (default %d)\n"
+                "  . --threads=N1,N2,... are the numbers of threads sharing"
+                " the bag, from 1 to %d (default 1,2,4,8)\n"
+                "  . --backend=NAME is the kind of bag used behind a lock,"
+                " to compare with the lock-free %s (default %s)\n"
+                "  . --check checks the order of every level of the %s"
+                " after each trial, instead of timing it\n",
+                argv[0], DEFAULT_TRIALS, MAX_THREADS, LOCK_FREE_NAME,
+                bag_backend_name(0), LOCK_FREE_NAME);
+        exit(EXIT_FAILURE);
+    }
+    if (! read_words(arg_list[0], min_word_len, &words)) {
+        fprintf(stderr, "ERROR: cannot read the words of %s\n", arg_list[0]);
+        exit(EXIT_FAILURE);
+    }
+    for (p = 0; p < NUM_PHASES; p++) {
+        if (! (times[p] = malloc(trials * sizeof(double)))) {
+            fprintf(stderr, "ERROR: out of memory\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (check) {
+        // one line per number of threads, once every trial has passed
+        printf("backend,threads,words,distinct,trials,checked\n");
+        for (n = 0; n < num_counts; n++) {
+            for (t = 0; t < trials && ok; t++)
+                ok = run_check(&words, counts[n], &distinct);
+            printf("%s,%d,%lu,%lu,%d,%s\n", LOCK_FREE_NAME, counts[n],
+                   (unsigned long) words.count, (unsigned long) distinct,
+                   t, ok ? "ok" : "FAILED");
+            fflush(stdout);
+            if (! ok)  break;
+        }
+        num_counts = 0;
+    } else {
+        printf("backend,locked,threads,words,distinct,insert_median_ms,"
+               "lookup_median_ms\n");
+    }
+    for (n = 0; n < num_counts; n++) {
+        for (k = 0; k < 2; k++) {
+            for (t = 0; t < trials && ok; t++) {
+                ok = run_trial(bag_backend(names[k]), k == 1, &words,
+                               counts[n], ms, &distinct);
+                for (p = 0; p < NUM_PHASES; p++)  times[p][t] = ms[p];
+            }
+            if (! ok) {
+                fprintf(stderr, "ERROR: cannot share a %s bag between %d"
+                                " threads\n", names[k], counts[n]);
+                break;
+            }
+            printf("%s,%s,%d,%lu,%lu", names[k], k == 1 ? "yes" : "no",
+                   counts[n], (unsigned long) words.count,
+                   (unsigned long) distinct);
+            for (p = 0; p < NUM_PHASES; p++) {
+                qsort(times[p], trials, sizeof(double), double_cmp);
+                printf(",%.3f", trials % 2 ? times[p][trials / 2] :
+                       (times[p][trials / 2 - 1] + times[p][trials / 2]) / 2);
+            }
+            printf("\n");
+            fflush(stdout);
+        }
+    }
+
+    for (p = 0; p < NUM_PHASES; p++)  free(times[p]);
+    free(words.list);
+    free(words.chars);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* The file is read twice: once to count the words and their characters, and
+ * once to copy them, so that each array is allocated only once.
+ */
+bool read_words(const char *filename, int min_word_len, words_t *words)
+{
+    tokenizer_t *input;
+    word_t word;
+    size_t chars = 0, pass, i = 0, used = 0;
+
+    words->count = 0;
+    words->list = NULL;
+    words->chars = NULL;
+    for (pass = 0; pass < 2; pass++) {
+        if (! (input = tokenizer_open(filename)))  return false;
+        while (tokenizer_next(input, &word)) {
+            if (word.len < (size_t) min_word_len)  continue;
+            if (pass == 0) {
+                words->count++;
+                chars += word.len + 1;
+                continue;
+            }
+            words->list[i++] = memcpy(words->chars + used, word.text,
+                                      word.len);
+            words->chars[used + word.len] = '\0';
+            used += word.len + 1;
+        }
+        tokenizer_close(input);
+        if (pass == 0 &&
+            (! (words->list = malloc((words->count + 1) * sizeof(char *))) ||
+             ! (words->chars = malloc(chars + 1)))) {
+            free(words->list);
+            return false;
+        }
+    }
+    return true;
+}
+
+bool run_trial(const bag_ops_t *backend, bool locked, const words_t *words,
+               int threads, double ms[], size_t *distinct)
+{
+    shared_t shared;
+    double start;
+    bool ok;
+
+    shared.bag = bag_create_keyed(backend, word_cmp, NULL, word_key);
+    if (! shared.bag)  return false;
+    shared.locked = locked;
+    shared.words = words;
+    shared.threads = threads;
+    shared.failed = false;
+#ifdef HAVE_PTHREADS
+    pthread_mutex_init(&shared.lock, NULL);
+#endif
+
+    start = now_ms();
+    ok = run_phase(&shared, false);
+    ms[0] = now_ms() - start;
+    start = now_ms();
+    ok = ok && run_phase(&shared, true);
+    ms[1] = now_ms() - start;
+    *distinct = bag_size(shared.bag);
+
+#ifdef HAVE_PTHREADS
+    pthread_mutex_destroy(&shared.lock);
+#endif
+    bag_destroy(shared.bag);
+    return ok && ! shared.failed;
+}
+
+/* Words that appear more than once are removed by their first appearance
+ * only: a later one finds nothing to remove.
+ */
+bool run_check(const words_t *words, int threads, size_t *distinct)
+{
+    shared_t shared;
+    size_t i, removed = 0, step = words->count / CHECK_STEPS + 1;
+    bool ok;
+
+    shared.bag = bag_create_keyed(bag_backend(LOCK_FREE_NAME), word_cmp, NULL,
+                                  word_key);
+    if (! shared.bag)  return false;
+    shared.locked = false;
+    shared.words = words;
+    shared.threads = threads;
+    shared.failed = false;
+
+    ok = run_phase(&shared, false) && ! shared.failed &&
+         skiplist_bag_check(shared.bag);
+    *distinct = bag_size(shared.bag);
+    for (i = 0; i < words->count && ok; i++) {
+        if (bag_remove(shared.bag, words->list[i]))  removed++;
+        if ((i + 1) % step == 0)  ok = skiplist_bag_check(shared.bag);
+    }
+    ok = ok && removed == *distinct && bag_size(shared.bag) == 0 &&
+         skiplist_bag_check(shared.bag);
+
+    bag_destroy(shared.bag);
+    return ok;
+}
+
+bool run_phase(shared_t *shared, bool lookup)
+{
+    contender_t work[MAX_THREADS];
+    int t, started;
+#ifdef HAVE_PTHREADS
+    pthread_t ids[MAX_THREADS];
+#endif
+
+    for (t = 0; t < shared->threads; t++) {
+        work[t].shared = shared;
+        work[t].first = t;
+        work[t].lookup = lookup;
+    }
+#ifdef HAVE_PTHREADS
+    for (started = 0; started < shared->threads; started++)
+        if (pthread_create(&ids[started], NULL, contend, &work[started]) != 0)
+            break;
+    for (t = 0; t < started; t++)
+        pthread_join(ids[t], NULL);
+#else
+    // no threads: the same work, one part after the other
+    for (started = 0; started < shared->threads; started++)
+        contend(&work[started]);
+#endif
+    return started == shared->threads;
+}
+
+void *contend(void *arg)
+{
+    contender_t *work = arg;
+    shared_t *shared = work->shared;
+    const words_t *words = shared->words;
+    size_t i;
+    bag_elem_t found;
+
+    for (i = work->first; i < words->count; i += shared->threads) {
+#ifdef HAVE_PTHREADS
+        if (shared->locked)  pthread_mutex_lock(&shared->lock);
+#endif
+        if (work->lookup)
+            found = bag_contains(shared->bag, words->list[i]);
+        else
+            found = bag_find_or_insert(shared->bag, words->list[i],
+                                       word_make, NULL);
+#ifdef HAVE_PTHREADS
+        if (shared->locked)  pthread_mutex_unlock(&shared->lock);
+#endif
+        // every word is added by the first phase, so both always find it
+        if (! found)  shared->failed = true;
+    }
+    return NULL;
+}
+
+int word_cmp(bag_elem_t a, bag_elem_t b)
+{
+    return strcmp(a, b);
+}
+
+bag_key_t word_key(bag_elem_t e)
+{
+    const unsigned char *c = e;
+    bag_key_t key = 0;
+    size_t i;
+
+    for (i = 0; i < 8; i++) {
+        key = key << 8 | *c;
+        if (*c)  c++;
+    }
+    return key;
+}
+
+bag_elem_t word_make(bag_elem_t probe, void *ctx)
+{
+    (void) ctx;
+    return probe;
+}
+
+double now_ms(void)
+{
+#ifdef CLOCK_MONOTONIC
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return 1000.0 * now.tv_sec + now.tv_nsec / 1000000.0;
+#else
+    return 1000.0 * clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+int double_cmp(const void *a, const void *b)
+{
+    double x = *(const double *) a, y = *(const double *) b;
+    return (x > y) - (x < y);
+}
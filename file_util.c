@@ -7,44 +7,508 @@
  *  Types and Constants.                                                      *
  ******************************************************************************/
 
+/* Ask for the POSIX functions used to map files into memory. */
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
 #include <string.h>
-#include <ctype.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define HAVE_MMAP 1
+#endif
+
+/* Classify characters 32 at a time with AVX2 or 16 at a time with SSE2 when
+ * the compiler targets them (-mavx2, -march=native, or any x86-64 for SSE2),
+ * and 16 at a time one by one otherwise. */
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SCAN_CHUNK 32
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define HAVE_SSE2 1
+#define SCAN_CHUNK 16
+#else
+#define SCAN_CHUNK 16
+#endif
 
 #include "file_util.h"
 
+/* MACRO IS_WORD_CHAR
+ *    An expression that is true if the character c is part of a word: an
+ *    ASCII letter or digit (what isalnum accepts in the "C" locale, the only
+ *    one the programs use).
+ */
+#define IS_WORD_CHAR(c) (((c) >= '0' && (c) <= '9') || \
+                         (((c) | 0x20) >= 'a' && ((c) | 0x20) <= 'z'))
+
+/* CONSTANT CHECK_LENGTH
+ *    Number of characters at the end of a file hashed into a tokenizer state,
+ *    to notice when the file was changed instead of only appended to.
+ */
+#define CHECK_LENGTH 4096U
+
+/* TYPE struct tokenizer -- Definition of struct tokenizer from the header. */
+struct tokenizer {
+    const char *text;     /* contents of the file                         */
+    size_t size;          /* number of characters in the file             */
+    bool mapped;          /* true if text is mapped rather than allocated */
+    bool owner;           /* false if text belongs to another tokenizer   */
+    const char *next;     /* next character to look at                    */
+    const char *line_end; /* one past the last character of the line      */
+    const char *end;      /* one past the last character of the file      */
+    unsigned line_no;     /* number of the current line (0 before any)    */
+    const char *line;     /* first character of the current line          */
+    uint64_t words[2];    /* bit i is set if character i of the line is
+                             part of a word (LINE_LENGTH + 1 <= 128)      */
+    const char *start;    /* where the pass started (a line start)        */
+    unsigned start_line;  /* number of lines before start                 */
+};
+
+/******************************************************************************
+ *  Declarations of helper functions -- including full documentation.         *
+ ******************************************************************************/
+
+/* FUNCTION tokenizer_load
+ *    Read the contents of a file into a tokenizer.
+ * Parameters and preconditions:
+ *    tok != NULL: the tokenizer to load the file into
+ *    filename != NULL: the name of the file to read
+ * Return value:
+ *    true if the contents of the file are in tok->text and tok->size;
+ *    false if the file cannot be read or in case of error with memory
+ *    allocation
+ * Side-effects:
+ *    the file has been mapped into memory, or memory has been allocated for
+ *    its contents
+ */
+static
+bool tokenizer_load(tokenizer_t *tok, const char *filename);
+
+/* FUNCTION count_lines
+ *    Count the lines in a stretch of text that starts at the beginning of a
+ *    line and ends right after a newline (or is empty), splitting long lines
+ *    the same way as tokenizer_next.
+ * Parameters and preconditions:
+ *    start != NULL: the first character of the text
+ *    stop >= start: one past the last character of the text
+ * Return value:
+ *    the number of lines that tokenizer_next would find between start and
+ *    stop
+ * Side-effects:  none
+ */
+static
+unsigned count_lines(const char *start, const char *stop);
+
+/* FUNCTION scan_line
+ *    Start the next line of a pass: find where it ends and which of its
+ *    characters are part of words, looking at SCAN_CHUNK characters at a time
+ *    with the same loads for both.
+ * Parameters and preconditions:
+ *    tok != NULL: a tokenizer at the end of a line (tok->next ==
+ *                 tok->line_end), before the end of its text
+ * Return value:  none
+ * Side-effects:
+ *    tok->line, tok->line_end and tok->words describe the next line, which
+ *    ends after a newline or after LINE_LENGTH + 1 characters, whichever
+ *    comes first (the way fgets splits long lines into a buffer of that size)
+ */
+static
+void scan_line(tokenizer_t *tok);
+
+/* FUNCTION scan_chunk
+ *    Classify SCAN_CHUNK characters.
+ * Parameters and preconditions:
+ *    chunk != NULL: SCAN_CHUNK characters
+ *    newlines != NULL: where to store the newlines found
+ * Return value:
+ *    a mask with bit i set if character i of chunk is part of a word
+ * Side-effects:
+ *    *newlines is set to a mask with bit i set if character i is a newline
+ */
+static
+uint64_t scan_chunk(const char *chunk, uint64_t *newlines);
+
+/* FUNCTION next_bit
+ *    Find the first bit of a 128-bit mask from a position on that is set (or
+ *    clear).
+ * Parameters and preconditions:
+ *    mask != NULL: the mask, bits 0 to 63 then 64 to 127
+ *    from < 128: the first position to look at
+ *    set: true to look for a bit that is set; false for one that is clear
+ * Return value:
+ *    the position of the bit found; 128 if there is none
+ * Side-effects:  none
+ */
+static
+unsigned next_bit(const uint64_t mask[2], unsigned from, bool set);
+
+/* FUNCTION lowest_bit
+ *    Find the lowest bit of a mask that is set.
+ * Parameters and preconditions:
+ *    mask != 0: the mask
+ * Return value:
+ *    the position of the lowest bit of mask that is set (0 to 63)
+ * Side-effects:  none
+ */
+static
+unsigned lowest_bit(uint64_t mask);
+
+/* FUNCTION check_end
+ *    Hash the last characters of a stretch of text (FNV-1a).
+ * Parameters and preconditions:
+ *    text != NULL: the first character of the text
+ *    size: the number of characters in the text
+ * Return value:
+ *    the hash of the last CHECK_LENGTH characters of text (or all of them,
+ *    if there are fewer)
+ * Side-effects:  none
+ */
+static
+uint64_t check_end(const char *text, size_t size);
+
 /******************************************************************************
  *  Function definitions -- see header file for documentation.                *
  ******************************************************************************/
 
-bool get_word(FILE *file, char *word, unsigned *page)
-{
-    static char line[LINE_LENGTH + 2] = ""; /* last line read from file */
-    static char *next_word = line; /* first character of the next word */
-    static unsigned line_no = 0; /* number of the last line read */
-    
-    /* Reset the line and character information if file == NULL. */
-    if (! file) {
-        line[0] = '\0';
-        next_word = line;
-        line_no = 0;
-        return false;
-    }
-    
-    /* Check if we need to read another line from file.  Based on the fact that
-     * line[] contains a null character to mark the end of the line. */
-    if (! *next_word) {
-        if (! fgets(line, LINE_LENGTH + 2, file))  return false;
-        /* Reset the next_word pointer and increment the line number. */
-        next_word = line;
-        ++line_no;
-    }
-    
-    /* Set the next word and mark its end in the input array. */
-    while (isalnum(*next_word))  *word++ = *next_word++;
-    *word++ = *next_word++ = '\0';
-    
-    /* Set the page number. */
-    *page = 1U + line_no / PAGE_LENGTH;
-    
+tokenizer_t *tokenizer_open(const char *filename)
+{
+    tokenizer_t *tok = malloc(sizeof(tokenizer_t));
+
+    if (tok && ! tokenizer_load(tok, filename)) {
+        free(tok);
+        tok = NULL;
+    }
+    if (tok) {
+        tok->start = tok->next = tok->line_end = tok->text;
+        tok->end = tok->text + tok->size;
+        tok->line_no = tok->start_line = 0;
+        tok->owner = true;
+    }
+    return tok;
+}
+
+/* The parts are cut right after a newline, where tokenizer_next always starts
+ * a new line, so each part only needs to know how many lines come before it
+ * to number its own pages exactly as a single pass would.
+ */
+bool tokenizer_split(tokenizer_t *tok, tokenizer_t *parts[], size_t n)
+{
+    const char *start = tok->line_end, *cut = start, *next_cut;
+    unsigned line_no = tok->line_no;
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        if (! (parts[i] = malloc(sizeof(tokenizer_t)))) {
+            while (i > 0)  free(parts[--i]);
+            return false;
+        }
+    }
+
+    for (i = 0; i < n; i++) {
+        /* Aim for parts of equal size, then move to the next line. */
+        if (i + 1 < n) {
+            next_cut = start + (size_t) (tok->end - start) * (i + 1) / n;
+            if (next_cut < cut)  next_cut = cut;
+            next_cut = next_cut < tok->end ?
+                       memchr(next_cut, '\n', tok->end - next_cut) : NULL;
+            next_cut = next_cut ? next_cut + 1 : tok->end;
+        } else {
+            next_cut = tok->end;
+        }
+
+        /* The first part picks up where tok is, even in the middle of a
+         * line; the others start at the beginning of a line. */
+        *parts[i] = *tok;
+        parts[i]->owner = false;
+        if (i > 0) {
+            parts[i]->next = parts[i]->line_end = cut;
+            parts[i]->line_no = line_no;
+        }
+        parts[i]->end = next_cut;
+
+        if (next_cut < tok->end)  line_no += count_lines(cut, next_cut);
+        cut = next_cut;
+    }
+
+    tok->next = tok->line_end = tok->end;
+    return true;
+}
+
+bool tokenizer_next(tokenizer_t *tok, word_t *word)
+{
+    unsigned start, stop;
+
+    for (;;) {
+        /* Start a new line when the current one is used up. */
+        if (tok->next == tok->line_end) {
+            if (tok->next == tok->end)  return false;
+            scan_line(tok);
+            tok->line_no++;
+        }
+
+        /* Skip to the start of the next word on this line, if any (the bits
+         * past the end of the line are clear). */
+        start = next_bit(tok->words, (unsigned) (tok->next - tok->line), true);
+        if (start < 128)  break;
+        tok->next = tok->line_end;
+    }
+
+    /* The word runs to the next non-word character or the end of the line. */
+    stop = next_bit(tok->words, start, false);
+
+    word->text = tok->line + start;
+    word->len = stop - start;
+    word->page = 1U + tok->line_no / PAGE_LENGTH;
+    tok->next = tok->line + stop;
     return true;
 }
+
+/* Text appended to a file can only change its last line, and only if that
+ * line does not end with a newline and is not yet LINE_LENGTH + 1 characters
+ * long (the pieces of a longer line before it never change).  So the pass is
+ * picked up at the start of that line, which finds its words again on the
+ * same page -- where page_list_add does not add them twice.
+ */
+void tokenizer_save(const tokenizer_t *tok, tokenizer_state_t *state)
+{
+    const char *line = tok->end;
+    size_t pieces;
+
+    while (line > tok->start && line[-1] != '\n')  line--;
+    pieces = (size_t) (tok->end - line) / (LINE_LENGTH + 1);
+
+    state->offset = (line - tok->text) + pieces * (LINE_LENGTH + 1);
+    state->line_no = tok->start_line + count_lines(tok->start, line) +
+                     (unsigned) pieces;
+    state->size = tok->size;
+    state->check = check_end(tok->text, tok->size);
+}
+
+tokenizer_t *tokenizer_resume(const char *filename,
+                              const tokenizer_state_t *state, bool *resumed)
+{
+    tokenizer_t *tok = tokenizer_open(filename);
+
+    if (! tok)  return NULL;
+
+    /* The old end must be unchanged, and a word must not run across it (the
+     * first part of the word would already be in the index). */
+    *resumed = state->size <= tok->size && state->offset <= state->size &&
+               check_end(tok->text, state->size) == state->check &&
+               ! (state->offset < state->size && state->size < tok->size &&
+                  IS_WORD_CHAR(tok->text[state->size - 1]) &&
+                  IS_WORD_CHAR(tok->text[state->size]));
+    if (*resumed) {
+        tok->start = tok->next = tok->line_end = tok->text + state->offset;
+        tok->line_no = tok->start_line = state->line_no;
+    }
+    return tok;
+}
+
+void tokenizer_close(tokenizer_t *tok)
+{
+    if (! tok->owner) {
+        free(tok);
+        return;
+    }
+#ifdef HAVE_MMAP
+    if (tok->mapped) {
+        munmap((void *) tok->text, tok->size);
+        free(tok);
+        return;
+    }
+#endif
+    free((void *) tok->text);
+    free(tok);
+}
+
+/******************************************************************************
+ *  Definitions of helper functions -- see above for documentation.           *
+ ******************************************************************************/
+
+bool tokenizer_load(tokenizer_t *tok, const char *filename)
+{
+    FILE *file;
+    char *text = NULL;
+    size_t size = 0, cap = 0, got;
+
+#ifdef HAVE_MMAP
+    /* Map regular, non-empty files directly; anything else (empty files,
+     * pipes, systems where mapping fails) falls through to reading. */
+    int fd = open(filename, O_RDONLY);
+    struct stat info;
+
+    if (fd < 0)  return false;
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+        void *map = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            close(fd);
+            posix_madvise(map, info.st_size, POSIX_MADV_SEQUENTIAL);
+            tok->text = map;
+            tok->size = info.st_size;
+            tok->mapped = true;
+            return true;
+        }
+    }
+    close(fd);
+#endif
+
+    /* Read the whole file into memory, doubling the buffer as needed. */
+    if (! (file = fopen(filename, "rb")))  return false;
+    do {
+        if (size == cap) {
+            char *bigger = realloc(text, cap = cap ? 2 * cap : 65536);
+            if (! bigger) {
+                free(text);
+                fclose(file);
+                return false;
+            }
+            text = bigger;
+        }
+        got = fread(text + size, 1, cap - size, file);
+        size += got;
+    } while (got > 0);
+    fclose(file);
+
+    tok->text = text;
+    tok->size = size;
+    tok->mapped = false;
+    return true;
+}
+
+unsigned count_lines(const char *start, const char *stop)
+{
+    const char *newline;
+    unsigned lines = 0;
+
+    /* A line of len characters (newline included) counts as that many
+     * characters divided by LINE_LENGTH + 1, rounded up. */
+    while (start < stop) {
+        newline = memchr(start, '\n', stop - start);
+        lines += (unsigned) ((newline + 1 - start + LINE_LENGTH) /
+                             (LINE_LENGTH + 1));
+        start = newline + 1;
+    }
+    return lines;
+}
+
+void scan_line(tokenizer_t *tok)
+{
+    const char *line = tok->next, *chunk;
+    char pad[SCAN_CHUNK];
+    size_t len = tok->end - line, pos;
+    uint64_t words, newlines;
+
+    if (len > LINE_LENGTH + 1)  len = LINE_LENGTH + 1;
+    tok->words[0] = tok->words[1] = 0;
+    for (pos = 0; pos < len; pos += SCAN_CHUNK) {
+        // the last chunk of the text is copied, so as not to read past it
+        chunk = line + pos;
+        if ((size_t) (tok->end - chunk) < SCAN_CHUNK) {
+            memset(pad, 0, SCAN_CHUNK);
+            memcpy(pad, chunk, tok->end - chunk);
+            chunk = pad;
+        }
+        words = scan_chunk(chunk, &newlines);
+        tok->words[pos / 64] |= words << pos % 64;
+
+        // the line ends after its first newline (which ends the loop)
+        if (newlines && pos + lowest_bit(newlines) < len)
+            len = pos + lowest_bit(newlines) + 1;
+    }
+
+    /* Clear the bits of the characters after the end of the line. */
+    if (len < 64) {
+        tok->words[0] &= ((uint64_t) 1 << len) - 1;
+        tok->words[1] = 0;
+    } else {
+        tok->words[1] &= ((uint64_t) 1 << (len - 64)) - 1;
+    }
+    tok->line = line;
+    tok->line_end = line + len;
+}
+
+/* A character c is a digit when c - '0' is below 10 and a letter when
+ * (c | 0x20) - 'a' is below 26, as unsigned bytes.  The vector instructions
+ * only compare signed bytes, so both sides are shifted by 0x80 first.
+ */
+uint64_t scan_chunk(const char *chunk, uint64_t *newlines)
+{
+#if defined(__AVX2__)
+    __m256i c = _mm256_loadu_si256((const __m256i *) chunk);
+    __m256i digit = _mm256_sub_epi8(c, _mm256_set1_epi8((char) 0xB0));
+    __m256i letter = _mm256_sub_epi8(_mm256_or_si256(c,
+                                                     _mm256_set1_epi8(0x20)),
+                                     _mm256_set1_epi8((char) 0xE1));
+
+    digit = _mm256_cmpgt_epi8(_mm256_set1_epi8((char) (10 - 0x80)), digit);
+    letter = _mm256_cmpgt_epi8(_mm256_set1_epi8((char) (26 - 0x80)), letter);
+    *newlines = (uint32_t) _mm256_movemask_epi8(
+                    _mm256_cmpeq_epi8(c, _mm256_set1_epi8('\n')));
+    return (uint32_t) _mm256_movemask_epi8(_mm256_or_si256(digit, letter));
+#elif defined(HAVE_SSE2)
+    __m128i c = _mm_loadu_si128((const __m128i *) chunk);
+    __m128i digit = _mm_sub_epi8(c, _mm_set1_epi8((char) 0xB0));
+    __m128i letter = _mm_sub_epi8(_mm_or_si128(c, _mm_set1_epi8(0x20)),
+                                  _mm_set1_epi8((char) 0xE1));
+
+    digit = _mm_cmplt_epi8(digit, _mm_set1_epi8((char) (10 - 0x80)));
+    letter = _mm_cmplt_epi8(letter, _mm_set1_epi8((char) (26 - 0x80)));
+    *newlines = (unsigned) _mm_movemask_epi8(
+                    _mm_cmpeq_epi8(c, _mm_set1_epi8('\n')));
+    return (unsigned) _mm_movemask_epi8(_mm_or_si128(digit, letter));
+#else
+    uint64_t words = 0;
+    unsigned i;
+
+    *newlines = 0;
+    for (i = 0; i < SCAN_CHUNK; i++) {
+        words |= (uint64_t) (IS_WORD_CHAR(chunk[i]) != 0) << i;
+        *newlines |= (uint64_t) (chunk[i] == '\n') << i;
+    }
+    return words;
+#endif
+}
+
+unsigned next_bit(const uint64_t mask[2], unsigned from, bool set)
+{
+    unsigned i = from / 64;
+    uint64_t bits;
+
+    for (; i < 2; i++, from = 64 * i) {
+        bits = set ? mask[i] : ~mask[i];
+        bits &= ~(uint64_t) 0 << from % 64;
+        if (bits)  return 64 * i + lowest_bit(bits);
+    }
+    return 128;
+}
+
+unsigned lowest_bit(uint64_t mask)
+{
+#if defined(__GNUC__)
+    return (unsigned) __builtin_ctzll(mask);
+#else
+    unsigned bit = 0;
+
+    while (! (mask & 1)) {
+        mask >>= 1;
+        bit++;
+    }
+    return bit;
+#endif
+}
+
+uint64_t check_end(const char *text, size_t size)
+{
+    const unsigned char *next = (const unsigned char *) text + size;
+    uint64_t hash = 14695981039346656037ULL;
+
+    if (size > CHECK_LENGTH)  size = CHECK_LENGTH;
+    for (next -= size; size > 0; size--)
+        hash = (hash ^ *next++) * 1099511628211ULL;
+    return hash;
+}
@@ -9,34 +9,147 @@
  *  Types and Constants.                                                      *
  ******************************************************************************/
 
-#include <stdbool.h> /* for type bool   */
-#include <stdio.h>   /* for type FILE   */
+#include <stdbool.h> /* for type bool     */
+#include <stdint.h>  /* for type uint64_t */
+#include <stdlib.h>  /* for type size_t   */
 
 /* Constants for pagination. */
 #define LINE_LENGTH 80U /* maximum number of characters on one line */
 #define PAGE_LENGTH 66U /* maximum number of lines on one page      */
 
+/* TYPE word_t
+ *    One word of a text file, as a view into the tokenizer's copy of the file
+ *    (the characters are not null-terminated and are only valid until the
+ *    tokenizer is closed).
+ */
+typedef struct word {
+    const char *text; /* first character of the word     */
+    size_t len;       /* number of characters in the word */
+    unsigned page;    /* page number where the word is    */
+} word_t;
+
+/* TYPE tokenizer_t
+ *    The state of a pass over the words of one text file.  All the state lives
+ *    in this object, so any number of files can be processed at the same time.
+ */
+typedef struct tokenizer tokenizer_t;
+
+/* TYPE tokenizer_state_t
+ *    Where a pass over a file can be picked up again once more text has been
+ *    appended to it: the start of the last line that may still grow (or the
+ *    end of the file if its last line is complete), with the number of lines
+ *    before it, and the size and a hash of the end of the file, to tell
+ *    whether it was only appended to since (a change far enough back from the
+ *    old end, without changing its size, is not noticed: the file is meant
+ *    to be a log that only grows).
+ */
+typedef struct tokenizer_state {
+    uint64_t offset;  /* where to pick up the pass, from the start of file */
+    unsigned line_no; /* number of lines before offset                     */
+    uint64_t size;    /* number of characters in the file                  */
+    uint64_t check;   /* hash of the last characters of the file           */
+} tokenizer_state_t;
+
 /******************************************************************************
  *  Function declarations -- with full documentation.                         *
  ******************************************************************************/
 
-/* FUNCTION get_word
- *    Read the next word from file f and store it in w; store the page number in
- *    *p.  w must point to a location in memory large enough for at least
- *    LINE_LENGTH characters.  The function keeps track of the file position and
- *    page number internally.
+/* FUNCTION tokenizer_open
+ *    Open a text file for processing word-by-word.  The file is mapped into
+ *    memory when possible (and read into memory otherwise), so that words can
+ *    be handed out without copying them.
  * Parameters and preconditions:
- *    f: a file already opened for reading, or NULL
- *    w: where to store the next word (must be large enough for at least
- *       LINE_LENGTH many characters)
- *    p: where to store the page number
+ *    filename != NULL: the name of the file to process
  * Return value:
- *    true if a new word and its page number were stored in *w and *p;
- *    false otherwise (such as at the end of file)
+ *    a new tokenizer positioned at the start of the file;
+ *    NULL if the file cannot be opened or read, or in case of error with
+ *    memory allocation
+ * Side-effects:
+ *    memory has been allocated (or mapped) for the contents of the file
+ */
+tokenizer_t *tokenizer_open(const char *filename);
+
+/* FUNCTION tokenizer_next
+ *    Find the next word in a file and its page number.  A word is a maximal
+ *    run of ASCII letters and digits on one line; lines are at most
+ *    LINE_LENGTH + 1 characters long (longer lines count as several lines),
+ *    and pages are PAGE_LENGTH lines long.
+ * Parameters and preconditions:
+ *    tok != NULL: a tokenizer
+ *    word != NULL: where to store the next word
+ * Return value:
+ *    true if a new word and its page number were stored in *word;
+ *    false otherwise (at the end of the file)
+ * Side-effects:
+ *    *word has been changed and tok has moved past the word
+ */
+bool tokenizer_next(tokenizer_t *tok, word_t *word);
+
+/* FUNCTION tokenizer_split
+ *    Split the rest of a file into parts that can be processed independently
+ *    (for example, by different threads).  The parts are cut at line
+ *    boundaries and are about the same size; each one knows how many lines
+ *    come before it, so it finds the same words with the same page numbers as
+ *    tok would have.
+ * Parameters and preconditions:
+ *    tok != NULL: a tokenizer
+ *    parts != NULL: an array with room for n tokenizers
+ *    n > 0: the number of parts to make
+ * Return value:
+ *    true if the parts were stored in parts[0..n-1] (some of them may be
+ *    empty); false in case of error with memory allocation (tok is unchanged)
+ * Side-effects:
+ *    tok has been moved to the end of the file; the parts share tok's copy of
+ *    the file, so they must all be closed before tok is
+ */
+bool tokenizer_split(tokenizer_t *tok, tokenizer_t *parts[], size_t n);
+
+/* FUNCTION tokenizer_save
+ *    Find where a pass over a file could be picked up again after text is
+ *    appended to it, so that it finds the same words on the same pages as a
+ *    pass over the whole, longer file.  Takes time proportional to the text
+ *    tok was opened (or resumed) on, not to the whole file.
+ * Parameters and preconditions:
+ *    tok != NULL: a tokenizer opened by tokenizer_open or tokenizer_resume
+ *                 (wherever it is in the file)
+ *    state != NULL: where to store the state
+ * Return value:  none
+ * Side-effects:
+ *    *state is set to the state of the end of the file
+ */
+void tokenizer_save(const tokenizer_t *tok, tokenizer_state_t *state);
+
+/* FUNCTION tokenizer_resume
+ *    Open a text file for processing word-by-word from where an earlier pass
+ *    left off, if the file has only been appended to since -- or from the
+ *    start, if it is shorter than it was or its old end has changed, or if
+ *    text was appended right in the middle of the file's last word.
+ * Parameters and preconditions:
+ *    filename != NULL: the name of the file to process
+ *    state != NULL: a state stored by tokenizer_save for the same file
+ *    resumed != NULL: where to store how the file was opened
+ * Return value:
+ *    a new tokenizer, as for tokenizer_open;
+ *    NULL if the file cannot be opened or read, or in case of error with
+ *    memory allocation
+ * Side-effects:
+ *    *resumed is set to true if the tokenizer starts where state says, with
+ *    the words before it left out, and to false if it starts at the start of
+ *    the file; memory has been allocated (or mapped) for the contents of the
+ *    file
+ */
+tokenizer_t *tokenizer_resume(const char *filename,
+                              const tokenizer_state_t *state, bool *resumed);
+
+/* FUNCTION tokenizer_close
+ *    Free all the memory allocated for a tokenizer and its copy of the file.
+ * Parameters and preconditions:
+ *    tok != NULL: a tokenizer
+ * Return value:  none
  * Side-effects:
- *    if f != NULL, the contents of *w and *p are changed and the file pointer
- *    for f is advanced; otherwise, the page number is reset to 0
+ *    the memory for tok has been freed (or unmapped); words returned by it are
+ *    no longer valid
  */
-bool get_word(FILE *f, char *w, unsigned *p);
+void tokenizer_close(tokenizer_t *tok);
 
 #endif/*FILE_UTIL_H*/
@@ -0,0 +1,479 @@
+/* FILE hash_bag.c
+ *    Implementation of the bag ADT using an open-addressing hash table, with
+ *    the elements sorted only when the bag is traversed.
+ */
+
+/******************************************************************************
+ *  Types and Constants.                                                      *
+ ******************************************************************************/
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "bag_impl.h"
+
+/* CONSTANT HASH_FIRST_CAPACITY
+ *    Number of slots allocated for the first element inserted in a bag (must
+ *    be a power of 2).
+ */
+#define HASH_FIRST_CAPACITY 8U
+
+/* MACRO HASH_TOO_FULL
+ *    An expression that is true if a table with cap slots holding size
+ *    elements is more than 3/4 full (at which point linear probing starts
+ *    to slow down noticeably).
+ */
+#define HASH_TOO_FULL(size, cap) (4 * (size) > 3 * (cap))
+
+/* TYPE hash_slot_t -- One slot in the hash table. */
+typedef struct hash_slot {
+    bag_elem_t elem;    /* the element stored in this slot (NULL if empty) */
+    unsigned long hash; /* the mixed hash value of elem                    */
+} hash_slot_t;
+
+/* TYPE hash_bag_t
+ *    A bag stored in an open-addressing hash table.
+ */
+typedef struct hash_bag {
+    bag_t base; /* the part shared by all bags (must come first) */
+    size_t size; /* number of elements in this bag */
+    size_t cap; /* number of slots in the table (0 or a power of 2) */
+    hash_slot_t *slots; /* the hash table storing the elements */
+    int (*cmp)(bag_elem_t, bag_elem_t); /* function to compare elements */
+    unsigned long (*hash)(bag_elem_t); /* function to hash elements */
+#ifdef BAG_STATS
+    bag_counters_t counters; /* work done by this bag so far */
+#endif
+} hash_bag_t;
+
+/******************************************************************************
+ *  Declarations of helper functions -- including full documentation.         *
+ ******************************************************************************/
+
+/* FUNCTION hash_of
+ *    Return the hash value of an element, mixed so that every bit of the
+ *    original value affects the low bits used to pick a slot.
+ * Parameters and preconditions:
+ *    bag != NULL: the bag the element belongs to
+ *    elem != NULL: the element to hash
+ * Return value:
+ *    the mixed hash value of elem (always 0 if bag has no hash function, in
+ *    which case every element ends up in the same cluster of slots and the
+ *    bag still works, only in linear time)
+ * Side-effects:  none
+ */
+static
+unsigned long hash_of(const hash_bag_t *bag, bag_elem_t elem);
+
+/* FUNCTION hash_find
+ *    Return the slot of the first element equal to a given one in a bag.
+ * Parameters and preconditions:
+ *    bag != NULL: the bag to search
+ *    elem != NULL: the element to search for
+ *    hash: the mixed hash value of elem
+ * Return value:
+ *    index of the slot storing an element equal to elem; bag->cap if there is
+ *    no such element
+ * Side-effects:  none (other than counting the work done, with BAG_STATS)
+ */
+static
+size_t hash_find(hash_bag_t *bag, bag_elem_t elem, unsigned long hash);
+
+/* FUNCTION hash_place
+ *    Store an element in the first empty slot of its probe sequence.
+ * Parameters and preconditions:
+ *    slots != NULL: a table with at least one empty slot
+ *    mask: one less than the number of slots in the table
+ *    elem != NULL: the element to store
+ *    hash: the mixed hash value of elem
+ * Return value:
+ *    the number of slots looked at (including the one where elem was stored)
+ * Side-effects:
+ *    elem and its hash value have been stored in an empty slot of slots
+ */
+static
+size_t hash_place(hash_slot_t *slots, size_t mask,
+                  bag_elem_t elem, unsigned long hash);
+
+/* FUNCTION hash_grow
+ *    Double the number of slots in a bag's table and move every element over.
+ * Parameters and preconditions:
+ *    bag != NULL: the bag to grow
+ * Return value:
+ *    true if the table was grown; false in case of error with memory
+ *    allocation (the bag is unchanged)
+ * Side-effects:
+ *    memory has been allocated for the new table and freed for the old one
+ *    (and counted as one node allocation, with BAG_STATS)
+ */
+static
+bool hash_grow(hash_bag_t *bag);
+
+/* FUNCTION hash_sort
+ *    Sort an array of elements with a bottom-up merge sort.
+ * Parameters and preconditions:
+ *    elems != NULL: the array of n elements to sort
+ *    tmp != NULL: an array with room for n elements, used while merging
+ *    n: the number of elements
+ *    cmp != NULL: the comparison function to use for sorting
+ * Return value:
+ *    elems or tmp, whichever one holds the sorted elements at the end
+ * Side-effects:
+ *    the contents of both arrays have been rearranged
+ */
+static
+bag_elem_t *hash_sort(bag_elem_t *elems, bag_elem_t *tmp, size_t n,
+                      int (*cmp)(bag_elem_t, bag_elem_t));
+
+/******************************************************************************
+ *  Declarations of the bag operations -- see bag.h for documentation.        *
+ ******************************************************************************/
+
+static
+bag_t *hash_bag_create(int (*cmp)(bag_elem_t, bag_elem_t),
+                       unsigned long (*hash)(bag_elem_t),
+                       bag_key_t (*key)(bag_elem_t));
+
+static
+bag_t *hash_bag_build(int (*cmp)(bag_elem_t, bag_elem_t),
+                      unsigned long (*hash)(bag_elem_t),
+                      bag_key_t (*key)(bag_elem_t),
+                      const bag_elem_t elems[], size_t n);
+
+static
+void hash_bag_destroy(bag_t *b);
+
+static
+size_t hash_bag_size(const bag_t *b);
+
+static
+bool hash_bag_traverse(const bag_t *b,
+                       void (*fun)(bag_elem_t, void *), void *ctx);
+
+static
+bag_elem_t hash_bag_contains(bag_t *b, bag_elem_t elem);
+
+static
+bag_elem_t hash_bag_insert(bag_t *b, bag_elem_t elem);
+
+static
+bag_elem_t hash_bag_find_or_insert(bag_t *b, bag_elem_t probe,
+                                   bag_elem_t (*make)(bag_elem_t, void *),
+                                   void *ctx);
+
+static
+bag_elem_t hash_bag_remove(bag_t *b, bag_elem_t elem);
+
+static
+void hash_bag_stats(const bag_t *b, bag_stats_t *stats);
+
+/* CONSTANT hash_bag_ops -- See bag_impl.h for documentation. */
+const bag_ops_t hash_bag_ops = {
+    "hash",
+    hash_bag_create,
+    hash_bag_build,
+    hash_bag_destroy,
+    hash_bag_size,
+    hash_bag_traverse,
+    hash_bag_contains,
+    hash_bag_insert,
+    hash_bag_find_or_insert,
+    hash_bag_remove,
+    hash_bag_stats,
+    NULL,
+    NULL,
+    NULL
+};
+
+/******************************************************************************
+ *  Definitions of the bag operations -- see bag.h for documentation.         *
+ ******************************************************************************/
+
+bag_t *hash_bag_create(int (*cmp)(bag_elem_t, bag_elem_t),
+                       unsigned long (*hash)(bag_elem_t),
+                       bag_key_t (*key)(bag_elem_t))
+{
+    hash_bag_t *bag = malloc(sizeof(hash_bag_t));
+
+    /* Slots already keep the hash value of their element, which plays the
+     * same part as a key. */
+    (void) key;
+    if (bag) {
+        /* The table is only allocated when the first element is inserted. */
+        bag->base.ops = &hash_bag_ops;
+        bag->size = 0;
+        bag->cap = 0;
+        bag->slots = NULL;
+        bag->cmp = cmp;
+        bag->hash = hash;
+        BAG_COUNTERS_INIT(bag);
+    }
+    return (bag_t *) bag;
+}
+
+/* The order of the elements does not matter to a hash table, but knowing how
+ * many there are does: the table is allocated at its final size right away,
+ * instead of being grown (and every element moved) step by step.
+ */
+bag_t *hash_bag_build(int (*cmp)(bag_elem_t, bag_elem_t),
+                      unsigned long (*hash)(bag_elem_t),
+                      bag_key_t (*key)(bag_elem_t),
+                      const bag_elem_t elems[], size_t n)
+{
+    bag_t *b = hash_bag_create(cmp, hash, key);
+    hash_bag_t *bag = (hash_bag_t *) b;
+    size_t cap = HASH_FIRST_CAPACITY, i;
+
+    if (! bag || n == 0)  return b;
+
+    while (HASH_TOO_FULL(n, cap))  cap *= 2;
+    if (! (bag->slots = calloc(cap, sizeof(hash_slot_t)))) {
+        free(bag);
+        return NULL;
+    }
+    bag->cap = cap;
+    BAG_COUNT(bag, node_allocs, 1);
+
+    for (i = 0; i < n; i++)
+        hash_place(bag->slots, cap - 1, elems[i], hash_of(bag, elems[i]));
+    bag->size = n;
+    return b;
+}
+
+void hash_bag_destroy(bag_t *b)
+{
+    hash_bag_t *bag = (hash_bag_t *) b;
+    free(bag->slots);
+    free(bag);
+}
+
+size_t hash_bag_size(const bag_t *b)
+{
+    const hash_bag_t *bag = (const hash_bag_t *) b;
+    return bag->size;
+}
+
+/* The elements are only put in order here: they are gathered from the table
+ * into a temporary array and merge sorted.  If there isn't enough memory for
+ * the two arrays needed by the sort, fun is still called on every element,
+ * straight from the table and so out of order, and the traversal fails: that
+ * way a bag can always be emptied (as by word_index_destroy), while callers
+ * that need the order can tell that they did not get it.
+ */
+bool hash_bag_traverse(const bag_t *b,
+                       void (*fun)(bag_elem_t, void *), void *ctx)
+{
+    const hash_bag_t *bag = (const hash_bag_t *) b;
+    bag_elem_t *elems, *sorted;
+    size_t slot, n = 0;
+
+    if (bag->size == 0)  return true;
+    elems = malloc(2 * bag->size * sizeof(bag_elem_t));
+    if (! elems) {
+        for (slot = 0; slot < bag->cap; slot++)
+            if (bag->slots[slot].elem)  (*fun)(bag->slots[slot].elem, ctx);
+        return false;
+    }
+
+    for (slot = 0; slot < bag->cap; slot++)
+        if (bag->slots[slot].elem)  elems[n++] = bag->slots[slot].elem;
+
+    sorted = hash_sort(elems, elems + n, n, bag->cmp);
+    for (slot = 0; slot < n; slot++)
+        (*fun)(sorted[slot], ctx);
+
+    free(elems);
+    return true;
+}
+
+bag_elem_t hash_bag_contains(bag_t *b, bag_elem_t elem)
+{
+    hash_bag_t *bag = (hash_bag_t *) b;
+    size_t slot = hash_find(bag, elem, hash_of(bag, elem));
+    BAG_END_SEARCH(bag);
+    return slot < bag->cap ? bag->slots[slot].elem : NULL;
+}
+
+bag_elem_t hash_bag_insert(bag_t *b, bag_elem_t elem)
+{
+    hash_bag_t *bag = (hash_bag_t *) b;
+    if (HASH_TOO_FULL(bag->size + 1, bag->cap) && ! hash_grow(bag))
+        return NULL;
+    BAG_COUNT(bag, depth,
+              hash_place(bag->slots, bag->cap - 1, elem, hash_of(bag, elem)));
+    BAG_END_SEARCH(bag);
+    bag->size++;
+    return elem;
+}
+
+/* The table is grown, if need be, before the element is made, so that nothing
+ * can fail once make has been called.  The search that did not find probe
+ * ends at an empty slot, where hash_place puts the new element (unless the
+ * table has grown in between) without comparing any elements.
+ */
+bag_elem_t hash_bag_find_or_insert(bag_t *b, bag_elem_t probe,
+                                   bag_elem_t (*make)(bag_elem_t, void *),
+                                   void *ctx)
+{
+    hash_bag_t *bag = (hash_bag_t *) b;
+    unsigned long hash = hash_of(bag, probe);
+    size_t slot = hash_find(bag, probe, hash);
+    bag_elem_t elem;
+
+    BAG_END_SEARCH(bag);
+    if (slot < bag->cap)  return bag->slots[slot].elem;
+    if (HASH_TOO_FULL(bag->size + 1, bag->cap) && ! hash_grow(bag))
+        return NULL;
+    if (! (elem = (*make)(probe, ctx)))  return NULL;
+    hash_place(bag->slots, bag->cap - 1, elem, hash);
+    bag->size++;
+    return elem;
+}
+
+/* Removal uses backward shifting instead of "deleted" markers: every element
+ * after the removed one in the same cluster is moved back into the hole if its
+ * own probe sequence passes over the hole.  This keeps lookups from having to
+ * skip over markers left behind by old removals.
+ */
+bag_elem_t hash_bag_remove(bag_t *b, bag_elem_t elem)
+{
+    hash_bag_t *bag = (hash_bag_t *) b;
+    size_t mask = bag->cap - 1;
+    size_t hole = hash_find(bag, elem, hash_of(bag, elem));
+    size_t next, home;
+    bag_elem_t removed;
+
+    BAG_END_SEARCH(bag);
+    if (hole == bag->cap)  return NULL;
+    removed = bag->slots[hole].elem;
+
+    for (next = (hole + 1) & mask; bag->slots[next].elem;
+         next = (next + 1) & mask) {
+        /* The element in slot next can move back only if its home slot is
+         * not (cyclically) between the hole and next. */
+        home = bag->slots[next].hash & mask;
+        if (((next - home) & mask) >= ((next - hole) & mask)) {
+            bag->slots[hole] = bag->slots[next];
+            hole = next;
+        }
+    }
+    bag->slots[hole].elem = NULL;
+    bag->size--;
+    return removed;
+}
+
+/* The height of a hash table is the length of its longest probe sequence:
+ * the most slots a search for an element in the table has to look at.
+ */
+void hash_bag_stats(const bag_t *b, bag_stats_t *stats)
+{
+    const hash_bag_t *bag = (const hash_bag_t *) b;
+    size_t mask = bag->cap - 1;
+    size_t slot, probes;
+
+    for (slot = 0; slot < bag->cap; slot++) {
+        if (! bag->slots[slot].elem)  continue;
+        probes = ((slot - bag->slots[slot].hash) & mask) + 1;
+        if (probes > stats->height)  stats->height = probes;
+    }
+    BAG_GET_STATS(bag, stats);
+}
+
+/******************************************************************************
+ *  Definitions of helper functions -- see above for documentation.           *
+ ******************************************************************************/
+
+unsigned long hash_of(const hash_bag_t *bag, bag_elem_t elem)
+{
+    unsigned long hash;
+
+    if (! bag->hash)  return 0;
+
+    /* Spread the high bits of the value into the low bits (the mixing steps
+     * only depend on the low 32 bits being present). */
+    hash = (*bag->hash)(elem);
+    hash ^= hash >> 16;
+    hash *= 0x45D9F3BUL;
+    hash ^= hash >> 16;
+    return hash;
+}
+
+size_t hash_find(hash_bag_t *bag, bag_elem_t elem, unsigned long hash)
+{
+    size_t mask = bag->cap - 1;
+    size_t slot;
+
+    if (bag->cap == 0)  return 0;
+
+    /* Follow the probe sequence until an empty slot; the stored hash values
+     * let most mismatches be skipped without calling cmp. */
+    for (slot = hash & mask; bag->slots[slot].elem; slot = (slot + 1) & mask) {
+        BAG_VISIT(bag);
+        if (bag->slots[slot].hash == hash &&
+            BAG_CMP(bag, elem, bag->slots[slot].elem) == 0)
+            return slot;
+    }
+    BAG_VISIT(bag);
+    return bag->cap;
+}
+
+size_t hash_place(hash_slot_t *slots, size_t mask,
+                  bag_elem_t elem, unsigned long hash)
+{
+    size_t slot = hash & mask;
+    size_t probes = 1;
+
+    while (slots[slot].elem) {
+        slot = (slot + 1) & mask;
+        probes++;
+    }
+    slots[slot].elem = elem;
+    slots[slot].hash = hash;
+    return probes;
+}
+
+bool hash_grow(hash_bag_t *bag)
+{
+    size_t cap = bag->cap ? 2 * bag->cap : HASH_FIRST_CAPACITY;
+    hash_slot_t *slots = calloc(cap, sizeof(hash_slot_t));
+    size_t slot;
+
+    if (! slots)  return false;
+
+    /* The stored hash values make rehashing free of calls to the hash
+     * function. */
+    for (slot = 0; slot < bag->cap; slot++)
+        if (bag->slots[slot].elem)
+            hash_place(slots, cap - 1, bag->slots[slot].elem,
+                       bag->slots[slot].hash);
+
+    free(bag->slots);
+    bag->slots = slots;
+    bag->cap = cap;
+    BAG_COUNT(bag, node_allocs, 1);
+    return true;
+}
+
+bag_elem_t *hash_sort(bag_elem_t *elems, bag_elem_t *tmp, size_t n,
+                      int (*cmp)(bag_elem_t, bag_elem_t))
+{
+    size_t width, lo, mid, hi, i, j, k;
+    bag_elem_t *swap;
+
+    /* Merge runs of width elements from elems into tmp, then swap roles. */
+    for (width = 1; width < n; width *= 2) {
+        for (lo = 0; lo < n; lo += 2 * width) {
+            mid = lo + width < n ? lo + width : n;
+            hi = mid + width < n ? mid + width : n;
+            for (i = lo, j = mid, k = lo; k < hi; k++)
+                if (i < mid && (j == hi || (*cmp)(elems[i], elems[j]) <= 0))
+                    tmp[k] = elems[i++];
+                else
+                    tmp[k] = elems[j++];
+        }
+        swap = elems;
+        elems = tmp;
+        tmp = swap;
+    }
+    return elems;
+}
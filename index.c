@@ -15,6 +15,8 @@
 
 #include "file_util.h"
 #include "bag.h"
+#include "word_index.h"
+#include "art_index.h"
 
 /* CONSTANT MIN_WORD_LEN
  *    Default minimum word length for the index.  Can be overriden by providing
@@ -22,33 +24,32 @@
  */
 #define MIN_WORD_LEN  8
 
-/* TYPE entry_t
- *    The type of one word in the word index.
- */
-typedef struct entry
-{
-    char  *entry_word;
-    bag_t *page_index;
-} entry_t;
-
-/* Type page entry
- *    The type of one page in the page index.
- */
-typedef int page_entry;
-
-// A number to keep track of the number of pages printed in a line so
-// the formating is correct.
-size_t i = 0;
-
 /******************************************************************************
  *  Function declarations -- with full documentation.                         *
  ******************************************************************************/
 
 /* FUNCTION main
- *    Grab the name of a text file and an optional minimum word length from the
- *    command line and generate an index of all the words in the text file that
- *    are long enough, along with their page number.  The index is printed to
- *    stdout.
+ *    Grab the name of a text file, an optional minimum word length and an
+ *    optional number of threads (--threads=N) and kind of bag (--backend=NAME)
+ *    from the command line and generate an index of all the words in the text
+ *    file that are long enough, along with their page number.  The index is
+ *    printed to stdout, or saved to a binary index file (index_file.h) for
+ *    the lookup program with --save=FILE.  --update=FILE brings such a file
+ *    up to date instead: if the text file has only been appended to since,
+ *    only the new text is read and its words are added to the saved index
+ *    (by one thread); otherwise the index is built again from scratch, as it
+ *    is if FILE is not an index file yet.  --backend=art stores the index in
+ *    an adaptive radix tree (art_index.h) instead of a bag, always built by
+ *    one thread.  --budget=MB keeps memory bounded on texts too large for a
+ *    whole index in memory: the index is printed by spilling it to sorted
+ *    runs on disk whenever its words and pages take up about MB megabytes,
+ *    and merging the runs at the end (by one thread, into the printed index
+ *    only).  --shards=N makes the threads add their words to one index split
+ *    into N ranges of words with a lock each, instead of indexing their parts
+ *    of the text apart and merging the indexes.  With more than one thread,
+ *    the threads also format the printed index, each its own range of words.
+ *    --prefix=WORD only prints the words of the index that start with WORD,
+ *    found with a range scan of the bag where the kind of bag allows it.
  * Parameters and preconditions:
  *    argc > 0: number of command line arguments
  *    argv != NULL: array of command line arguments
@@ -57,120 +58,23 @@ size_t i = 0;
  */
 int main(int argc, char *argv[]);
 
-/* FUNCTION generate_index
- *    Create and return an index of every word whose length is at least
- *    min_word_len in file input, along with each word's page numbers.
+/* FUNCTION save_index
+ *    Save an index to a binary index file, through a temporary file that only
+ *    replaces it once it is complete, so that a failed save leaves an index
+ *    file that was already there as it was.
  * Parameters and preconditions:
- *    input != NULL: a file already opened for reading
- *    min_word_len > 0: the minimum length of words to put in the index
+ *    filename != NULL: the name of the index file
+ *    index != NULL or art != NULL: the index to save (a bag or a radix tree)
+ *    min_word_len, state: as for word_index_save
  * Return value:
- *    a bag that contains every word in file input whose length is at least
- *    min_word_length, along with the page numbers where the word appears;
- *    NULL in case of any error with memory allocation
- * Side-effects:
- *    memory is allocated for the bag and the file has been read to the end
- */
-static
-bag_t *generate_index(FILE *input, int min_word_len);
-
-/* FUNCTION entry_create
- *    Create and return a new index entry given a word and page number.
- * Parameters and preconditions:
- *    word != NULL: pointer to a word
- *    page > 0: a page number
- * Return value:
- *    a new index entry storing a copy of word and its page number;
- *    NULL in case of any error with memory allocation
- * Side-effects:
- *    memory has been allocated for the new entry and to make a copy of word
- */
-static
-bag_elem_t entry_create(const char *word, unsigned page);
-
-/* FUNCTION page_destroy
- *    Release the memory allocated for an page index entry (passed in as type
- *    bag_elem_t).
- * Parameters and preconditions:
- *    e != NULL: an index entry
- *    e is a pointer to the type page_entry
- * Return value:  none
+ *    true if the index file was saved; false otherwise
  * Side-effects:
- *    the memory allocated for e is freed
+ *    the index file has been written (or left as it was)
  */
 static
-void page_destroy(bag_elem_t e);
-
-/* FUNCTION entry_destroy
- *    Release the memory allocated for an word index entry (passed in as type
- *    bag_elem_t).
- * Parameters and preconditions:
- *    e != NULL: an index entry
- *    e is a pointer to the type entry_t
- * Return value:  none
- * Side-effects:
- *    the memory allocated for e is freed
- */
-static
-void entry_destroy(bag_elem_t e);
-
-/* Function page_print
- *    print an page index entry (passed in as type bag_elem_t) to stdout.
- * Parameters and preconditions:
- *    e != NULL: an word index entry
- *    e is a pointer to the page_entry type.
- * Return value:  none
- * Side-effects:
- *    the entry is printed to stdout
- */
-static
-void page_print(bag_elem_t e);
-
-/* FUNCTION entry_print
- *    Print an word index entry (passed in as type bag_elem_t) to stdout.
- * Parameters and preconditions:
- *    e != NULL: an word index entry
- *    e is a pointer to the entry_t type.
- * Return value:  none
- * Side-effects:
- *    the entry is printed to stdout
- */
-static
-void entry_print(bag_elem_t e);
-
-/* FUNCTION entry_cmp
- *    Compare two word index entries (passed in as type bag_elem_t).
- * Parameters and preconditions:
- *    e1 != NULL: the first entry to compare
- *    e2 != NULL: the second entry to compare
- * Return value:
- *    < 0 if e1 < e2; > 0 if e1 > e2; == 0 if e1 == e2
- * Side-effects:  none
- */
-static
-int entry_cmp(bag_elem_t e1, bag_elem_t e2);
-
-/* Function entry_add
- *      add the page number to the entry
- * Parameters and preconditions:
- *      entry != NULL: a point the the word entry to be modified
- *      page > 0: a page number to be added to the entry
- * Side-effects: none
- */
-static
-void entry_add(bag_elem_t *element, unsigned page);
-
-/* Function page_cmp
- *    Compare two page entries (passed in as type bag_elem_t).
- * Parameters and preconditions:
- *    e1 != NULL: the first page to compare
- *    e2 != NULL: the second page to compare
- *    e1 and e2 pointers to the page_entry type
- * Return value:
- *    < 0 if e1 < e2; > 0 if e1 > e2; == 0 if e1 == e2
- * Side-effects:  none
- */
-static
-int page_cmp(bag_elem_t e1, bag_elem_t e2);
+bool save_index(const char *filename, const bag_t *index,
+                const art_index_t *art, int min_word_len,
+                const tokenizer_state_t *state);
 
 /******************************************************************************
  *  Function definitions -- see above for documentation.                      *
@@ -178,61 +82,204 @@ int page_cmp(bag_elem_t e1, bag_elem_t e2);
 
 int main(int argc, char *argv[])
 {
-    FILE *input, *log;
-    int min_word_len = 0;
-    bag_t *index;
+    FILE *log;
+    tokenizer_t *input;
+    int min_word_len = 0, saved_len, threads = 1, shards = 0, args = 0, arg;
+    long budget = 0;
+    char *arg_list[2] = { NULL, NULL };
+    const char *save_name = NULL, *update_name = NULL, *prefix = NULL;
+    index_file_t *old = NULL;
+    tokenizer_state_t state;
+    const bag_ops_t *backend = bag_backend(bag_backend_name(0));
+    const char *name;
+    size_t b;
+    bag_t *index = NULL;
+    art_index_t *art = NULL;
+    bool use_art = false, saved = true, resumed = false;
+    bag_stats_t stats;
     clock_t ticks;
 
-    /* First, check that there is a first command line argument and
-     * that it is the name of a file that can be opened for reading. */
-    if (argc <= 1 || ! (input = fopen(argv[1], "r"))) {
-        fprintf(stderr,
-                "ERROR: missing or incorrect argument!\n"
-                "USAGE: %s <filename> [minimum_word_length]\n"
-                "  . <filename> is the name of a text file (required)\n"
-                "  . [minimum_word_length] is a positive integer (optional)\n",
-                argv[0]);
-        exit(EXIT_FAILURE);
+    /* First, separate the options from the other arguments (the file name and
+     * the minimum word length, in that order). */
+    for (arg = 1; arg < argc; arg++) {
+        if (strncmp(argv[arg], "--threads=", 10) == 0)
+            threads = (int) strtol(argv[arg] + 10, NULL, 10);
+        else if (strncmp(argv[arg], "--shards=", 9) == 0)
+            shards = (int) strtol(argv[arg] + 9, NULL, 10);
+        else if (strncmp(argv[arg], "--backend=", 10) == 0) {
+            use_art = strcmp(argv[arg] + 10, ART_INDEX_NAME) == 0;
+            backend = use_art ? NULL : bag_backend(argv[arg] + 10);
+        }
+        else if (strncmp(argv[arg], "--save=", 7) == 0)
+            save_name = argv[arg] + 7;
+        else if (strncmp(argv[arg], "--update=", 9) == 0)
+            save_name = update_name = argv[arg] + 9;
+        else if (strncmp(argv[arg], "--budget=", 9) == 0)
+            budget = strtol(argv[arg] + 9, NULL, 10);
+        else if (strncmp(argv[arg], "--prefix=", 9) == 0)
+            prefix = argv[arg] + 9;
+        else if (args < 2)
+            arg_list[args++] = argv[arg];
     }
-    /* If we get here, the file has been opened for reading. */
-
 
     /* Next, check if there is a second command line argument to specify
      * a minimum word length. */
-    if (argc < 3 || (min_word_len = (int) strtol(argv[2], NULL, 10)) <= 0)
+    if (! arg_list[1] ||
+        (min_word_len = (int) strtol(arg_list[1], NULL, 10)) <= 0)
         min_word_len = MIN_WORD_LEN;
     /* If we get here, the minimum word length has a positive value. */
 
+    /* With --update, the saved index is only picked up if its words are as
+     * long as asked (or no length was asked for). */
+    if (update_name && ! use_art && (old = index_file_open(update_name))) {
+        saved_len = index_file_source(old, &state);
+        if (saved_len > 0 && (! arg_list[1] || saved_len == min_word_len)) {
+            min_word_len = saved_len;
+        } else {
+            index_file_close(old);
+            old = NULL;
+        }
+    }
+
+    /* Next, check that there is a file name argument, that it is the name of a
+     * file that can be opened for reading and that the options make sense. */
+    if (threads <= 0 || threads > WORD_INDEX_MAX_THREADS ||
+        shards < 0 || shards > WORD_INDEX_MAX_SHARDS ||
+        (shards > 0 && (use_art || budget != 0)) ||
+        (! backend && ! use_art) || (save_name && ! *save_name) ||
+        (update_name && use_art) || budget < 0 ||
+        (prefix && (save_name || use_art || budget != 0)) ||
+        (budget > 0 && (save_name || use_art || threads > 1 ||
+                        (unsigned long) budget > (size_t) -1 >> 20)) ||
+        ! arg_list[0] ||
+        ! (input = old ? tokenizer_resume(arg_list[0], &state, &resumed)
+                       : tokenizer_open(arg_list[0]))) {
+        fprintf(stderr,
+                "ERROR: missing or incorrect argument!\n"
+                "USAGE: %s [--threads=N] [--shards=N] [--backend=NAME]"
+                " [--save=FILE |"
+                " --update=FILE | --budget=MB | --prefix=WORD] <filename>"
+                " [minimum_word_length]\n"
+                "  . <filename> is the name of a text file (required)\n"
+                "  . [minimum_word_length] is a positive integer (optional)\n"
+                "  . [--threads=N] is the number of threads to use, from 1 to"
+                " %d (optional)\n"
+                "  . [--shards=N] makes the threads share one index split"
+                " into N locked ranges, from 1 to %d (optional, not with %s"
+                " or --budget)\n"
+                "  . [--backend=NAME] is the kind of bag to store the index in,"
+                " one of",
+                argv[0], WORD_INDEX_MAX_THREADS, WORD_INDEX_MAX_SHARDS,
+                ART_INDEX_NAME);
+        for (b = 0; (name = bag_backend_name(b)); b++)
+            fprintf(stderr, " %s", name);
+        fprintf(stderr, " %s (optional, %s by default)\n", ART_INDEX_NAME,
+                bag_backend_name(0));
+        fprintf(stderr, "  . [--save=FILE] saves the index to a binary index"
+                        " file for lookup instead of printing it"
+                        " (optional)\n"
+                        "  . [--update=FILE] adds the text appended since"
+                        " FILE was saved to it, or saves it again (optional,"
+                        " not with %s)\n"
+                        "  . [--budget=MB] prints the index through sorted"
+                        " runs on disk, with about MB megabytes of words in"
+                        " memory (optional, one thread, not with %s)\n"
+                        "  . [--prefix=WORD] only prints the words that start"
+                        " with WORD (optional, not with %s)\n",
+                ART_INDEX_NAME, ART_INDEX_NAME, ART_INDEX_NAME);
+        exit(EXIT_FAILURE);
+    }
+    /* If we get here, the file has been opened for reading. */
+
     //creat or append to a runtime log file
     log = fopen("runtime_log.txt", "a");
-    fprintf(log, "For %s and word %d characters and larger:\n", argv[1], min_word_len);
+    fprintf(log, "For %s and word %d characters and larger:\n", arg_list[0], min_word_len);
 
     /* Next, generate the index, close the input file (because we're done with
      * it at this point), and print timing data. */
     ticks = clock();
-    index = generate_index(input, min_word_len);
+    if (budget > 0) {
+        // the index is printed as it is generated, one part at a time
+        saved = word_index_write_spilled(input, min_word_len, backend,
+                                         (size_t) budget << 20, stdout);
+        if (! saved)
+            fprintf(stderr, "ERROR: could not print the index through"
+                            " temporary files\n");
+    } else if (use_art) {
+        art = art_index_create(input, min_word_len);
+    } else if (resumed) {
+        // only the text appended since the index was saved is read
+        if ((index = word_index_load(old, backend)))
+            word_index_extend(index, input, min_word_len);
+    } else if (shards > 0) {
+        index = word_index_create_sharded(input, min_word_len, backend,
+                                          threads, shards);
+    } else {
+        index = word_index_create(input, min_word_len, backend, threads);
+    }
     ticks = clock() - ticks;
-    fclose(input);
-    fprintf(log, "Elapsed time for generating the index: %gms\n",
+    tokenizer_save(input, &state);
+    tokenizer_close(input);
+    if (old)  index_file_close(old);
+    if (update_name)
+        fprintf(log, "%s %s\n", resumed ? "Updated" : "Rebuilt", update_name);
+    fprintf(log, "Elapsed time for generating the index%s: %gms\n",
+                    budget > 0 ? " (and printing it)" : "",
                     1000.0 * ticks / CLOCKS_PER_SEC);
     /* Timing data is printed on stderr so we can isolate it from the rest of
      * the output below, if desired. */
 
-    /* Finally, print the index on stdout and clean up: free the memory
-     * allocated for each index entry, then the memory for the index itself. */
-    if (index) {
+    /* Finally, print the index on stdout and clean up. */
+    if (index || art) {
 
-        // timing how long it takes to print the index
+        // timing how long it takes to print (or save) the index
         ticks = clock();
-        bag_traverse(index, entry_print);
+        if (save_name) {
+            saved = save_index(save_name, index, art, min_word_len, &state);
+        } else if (art) {
+            art_index_print(art);
+        } else if (prefix) {
+            // only the part of the index that starts with the prefix
+            saved = word_index_write_prefix(index, prefix, stdout);
+        } else if (threads > 1) {
+            // each thread formats its own range of the words
+            saved = word_index_write_parallel(index, threads, stdout);
+        } else {
+            saved = word_index_write(index, stdout);
+        }
         ticks = clock() - ticks;
-        fprintf(log, "Elapsed time for printing the index: %gms\n",
+        fprintf(log, "Elapsed time for %s the index: %gms\n",
+                        save_name ? "saving" : "printing",
                         1000.0 * ticks / CLOCKS_PER_SEC);
+        if (! saved && save_name)
+            fprintf(stderr, "ERROR: could not save the index to %s\n",
+                            save_name);
+        else if (! saved)
+            fprintf(stderr, "ERROR: could not print the index\n");
+
+        // the shape of the index (and the work it took, if it was counted)
+        if (art) {
+            stats.height = art_index_height(art);
+            stats.counted = false;
+        } else {
+            bag_stats(index, &stats);
+        }
+        fprintf(log, "Height of the index: %lu\n",
+                        (unsigned long) stats.height);
+        if (stats.counted)
+            fprintf(log, "Work done by the index: %lu searches (average"
+                         " depth %.2f, maximum %lu), %lu comparisons,"
+                         " %lu rotations, %lu allocations\n",
+                    stats.searches, stats.avg_search_depth,
+                    (unsigned long) stats.max_search_depth, stats.compares,
+                    stats.rotations, stats.node_allocs);
 
         // timing how long it takes to destroy the index
         ticks = clock();
-        bag_traverse(index, entry_destroy);
-        bag_destroy(index);
+        if (art)
+            art_index_destroy(art);
+        else
+            word_index_destroy(index);
         ticks = clock() - ticks;
         fprintf(log, "Elapsed time for destroy the index: %gms\n\n",
                         1000.0 * ticks / CLOCKS_PER_SEC);
@@ -240,122 +287,27 @@ int main(int argc, char *argv[])
 
     fclose(log);
 
-    return EXIT_SUCCESS;
-}
-
-bag_t *generate_index(FILE *input, int min_word_len)
-{
-    bag_t *index = bag_create(entry_cmp);
-
-    if (index) {
-        char word[LINE_LENGTH] = "";
-        entry_t new_word, *existing_entry;
-        bag_elem_t new_entry;
-        unsigned page = 0;
-        while (get_word(input, word, &page))
-        {
-            new_word.entry_word = word;
-            // check if the length of the word is long enough
-            if(strlen(word) >= min_word_len)
-            {
-                existing_entry = bag_contains(index, &new_word);
-                if(existing_entry != NULL) // if the word is already in index
-                {
-                    entry_add(existing_entry, page); // add the location to the list of locations for that word
-                }
-                else // if the word isn't in the index
-                {
-                    new_entry = entry_create(word, page); // create the entry
-                    bag_insert(index, new_entry); // add the location
-                }
-            }
-        }
-    }
-    return index;
-}
-
-bag_elem_t entry_create(const char *word, unsigned page)
-{
-    // Allocate the memory for the new entry
-    entry_t *new_entry = malloc(sizeof(entry_t));
-    
-    // Copy the word into a new string and put it in the entry.
-    new_entry -> entry_word = malloc((strlen(word) + 1) * sizeof(char));
-    strcpy(new_entry -> entry_word, word);
-
-    // Create the page index bag to hold the page numbers.
-    new_entry->page_index = bag_create(page_cmp);
-    page_entry *new_page = malloc(sizeof(page_entry));
-    *new_page = page;
-    
-    // add the page to the page index.
-    bag_insert(new_entry->page_index, new_page);
-    return new_entry;
-}
-
-void page_destroy(bag_elem_t e)
-{
-    free(e);
-}
-
-void entry_destroy(bag_elem_t e)
-{
-    entry_t *old_entry = e;
-    free(old_entry -> entry_word);
-
-    // empty and free the page index
-    bag_traverse(old_entry->page_index, page_destroy);
-    bag_destroy(old_entry->page_index);
-
-    free(old_entry);
-}
-
-void page_print(bag_elem_t e)
-{
-    page_entry *page = e;
-    fprintf(stdout, "%d", *page);
-
-    // only print the comma and space if it's not the last
-    // page in the list.
-    if(i != 1)
-    {
-        fprintf(stdout, ", ");
-        i--;
-    }
-}
-
-void entry_print(bag_elem_t e)
-{
-    // Print the word
-    entry_t *this_entry = e;
-    fprintf(stdout, "%s: ", this_entry -> entry_word);
-
-    // Print the page index for that word
-    i = bag_size(this_entry->page_index);
-    bag_traverse(this_entry->page_index, page_print);
-
-    fprintf(stdout,"\n");
-}
-
-int entry_cmp(bag_elem_t e1, bag_elem_t e2)
-{
-    entry_t *entry1 = e1, *entry2 = e2;
-    return strcmp(entry1->entry_word, entry2->entry_word);
-}
-
-void entry_add(bag_elem_t *element, unsigned page)
-{
-    entry_t *mod = element;
-
-    page_entry *new_page = malloc(sizeof(page_entry));
-    *new_page = page;
-
-    // check if page is already in the index
-    if(!bag_contains(mod->page_index, new_page))
-    bag_insert(mod->page_index, new_page);
+    return saved ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
-int page_cmp(bag_elem_t e1, bag_elem_t e2)
+bool save_index(const char *filename, const bag_t *index,
+                const art_index_t *art, int min_word_len,
+                const tokenizer_state_t *state)
 {
-    return *(page_entry*)e1 - *(page_entry*)e2;
+    char *temp = malloc(strlen(filename) + 5);
+    FILE *out;
+    bool saved;
+
+    if (! temp)  return false;
+    strcpy(temp, filename);
+    strcat(temp, ".tmp");
+
+    saved = (out = fopen(temp, "wb")) &&
+            (art ? art_index_save(art, min_word_len, state, out)
+                 : word_index_save(index, min_word_len, state, out));
+    if (out && fclose(out) != 0)  saved = false;
+    if (saved && rename(temp, filename) != 0)  saved = false;
+    if (! saved && out)  remove(temp);
+    free(temp);
+    return saved;
 }
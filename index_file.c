@@ -0,0 +1,421 @@
+/* FILE index_file.c
+ *    Implementation of the index_file functions.  A builder keeps each part
+ *    of the file in its own growing buffer, since the sizes of the parts are
+ *    only known once every word has been added; an opened file is used in
+ *    place, straight from the memory it was mapped (or read) into.
+ */
+
+/******************************************************************************
+ *  Types and Constants.                                                      *
+ ******************************************************************************/
+
+/* Ask for the POSIX functions used to map files into memory. */
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define HAVE_MMAP 1
+#endif
+
+#include "index_file.h"
+
+/* TYPE index_header_t
+ *    The header at the start of an index file (48 bytes, without padding).
+ */
+typedef struct index_header {
+    uint32_t magic;         /* INDEX_FILE_MAGIC                         */
+    uint32_t count;         /* number of words                          */
+    uint32_t words_size;    /* number of bytes in the word table        */
+    uint32_t pages_size;    /* number of bytes in the page table        */
+    uint32_t min_word_len;  /* minimum length of the words (0: unknown) */
+    uint32_t line_no;       /* lines before offset in the text file     */
+    uint64_t offset;        /* where to pick up the text file again     */
+    uint64_t size;          /* number of characters in the text file    */
+    uint64_t check;         /* hash of the end of the text file         */
+} index_header_t;
+
+/* TYPE buffer_t -- Bytes that grow at the end, doubling their memory. */
+typedef struct buffer {
+    unsigned char *data;    /* the bytes (NULL until the first one)  */
+    size_t len;             /* number of bytes used                  */
+    size_t cap;             /* number of bytes allocated             */
+} buffer_t;
+
+/* TYPE struct index_file_builder -- Definition of index_file_builder_t. */
+struct index_file_builder {
+    buffer_t word_offsets;      /* the offsets into words, as uint32_t   */
+    buffer_t page_offsets;      /* the offsets into pages, as uint32_t   */
+    buffer_t words;             /* the word table                        */
+    buffer_t pages;             /* the page table                        */
+    size_t count;               /* number of words added                 */
+    bool failed;                /* true once index_file_add has failed   */
+    int min_word_len;           /* minimum length of the words (0 if not
+                                   recorded)                            */
+    tokenizer_state_t state;    /* the state of the text file at the end */
+};
+
+/* TYPE struct index_file -- Definition of index_file_t from index_file.h. */
+struct index_file {
+    const unsigned char *data;      /* the whole file                     */
+    size_t size;                    /* number of bytes in the file        */
+    const index_header_t *header;   /* the header, at the start of data   */
+    bool mapped;                    /* true if data is mapped, not read   */
+    size_t count;                   /* number of words                    */
+    const uint32_t *word_offsets;   /* count + 1 offsets into words       */
+    const uint32_t *page_offsets;   /* count + 1 offsets into pages       */
+    const char *words;              /* the word table                     */
+    const unsigned char *pages;     /* the page table                     */
+};
+
+/******************************************************************************
+ *  Declarations of helper functions -- including full documentation.         *
+ ******************************************************************************/
+
+/* FUNCTION buffer_append
+ *    Add bytes at the end of a buffer.
+ * Parameters and preconditions:
+ *    buf != NULL: the buffer to add to
+ *    bytes != NULL: the bytes to add
+ *    len: the number of bytes to add
+ * Return value:
+ *    true if the bytes were added; false in case of error with memory
+ *    allocation
+ * Side-effects:
+ *    the bytes have been copied at the end of buf, whose memory may have been
+ *    reallocated
+ */
+static
+bool buffer_append(buffer_t *buf, const void *bytes, size_t len);
+
+/* FUNCTION buffer_append_offset
+ *    Add a 32-bit offset at the end of a buffer, if it fits.
+ * Parameters and preconditions:
+ *    buf != NULL: the buffer to add to
+ *    offset: the offset to add
+ * Return value:
+ *    true if the offset was added; false if it does not fit in 32 bits or in
+ *    case of error with memory allocation
+ * Side-effects:
+ *    the offset has been copied at the end of buf
+ */
+static
+bool buffer_append_offset(buffer_t *buf, size_t offset);
+
+/* FUNCTION index_file_load
+ *    Map a file into memory where possible, or read it into memory.
+ * Parameters and preconditions:
+ *    file != NULL: where to store the contents of the file
+ *    filename != NULL: the name of the file
+ * Return value:
+ *    true if the file is in memory; false if it cannot be read or in case of
+ *    error with memory allocation
+ * Side-effects:
+ *    file->data, file->size and file->mapped have been set
+ */
+static
+bool index_file_load(index_file_t *file, const char *filename);
+
+/* FUNCTION index_file_check
+ *    Check that the contents of a file make up an index file, and find its
+ *    parts.
+ * Parameters and preconditions:
+ *    file != NULL: a file loaded by index_file_load
+ * Return value:
+ *    true if file is an index file with consistent offsets; false otherwise
+ * Side-effects:
+ *    the other members of file have been set to the parts of the index file
+ */
+static
+bool index_file_check(index_file_t *file);
+
+/******************************************************************************
+ *  Definitions of "public" functions -- see header file for documentation.   *
+ ******************************************************************************/
+
+index_file_builder_t *index_file_builder_create(void)
+{
+    index_file_builder_t *builder = calloc(1, sizeof(index_file_builder_t));
+
+    if (! builder)  return NULL;
+    // the offset tables start with the offset of the first word
+    if (! buffer_append_offset(&builder->word_offsets, 0) ||
+        ! buffer_append_offset(&builder->page_offsets, 0)) {
+        index_file_builder_destroy(builder);
+        return NULL;
+    }
+    return builder;
+}
+
+bool index_file_add(index_file_builder_t *builder, const char *word,
+                    size_t len, const page_list_t *pages)
+{
+    const unsigned char *bytes;
+    size_t pages_len;
+
+    if (builder->failed)  return false;
+    bytes = page_list_bytes(pages, &pages_len);
+
+    // Check that the new offsets fit in 32 bits before copying anything; a
+    // builder that failed once is never saved, so a partly added word does
+    // not matter.
+    builder->failed =
+        builder->count + 1 >= UINT32_MAX ||
+        len > UINT32_MAX - builder->words.len ||
+        pages_len > UINT32_MAX - builder->pages.len ||
+        ! buffer_append(&builder->words, word, len) ||
+        ! buffer_append(&builder->pages, bytes, pages_len) ||
+        ! buffer_append_offset(&builder->word_offsets, builder->words.len) ||
+        ! buffer_append_offset(&builder->page_offsets, builder->pages.len);
+    if (! builder->failed)  builder->count++;
+    return ! builder->failed;
+}
+
+void index_file_set_source(index_file_builder_t *builder, int min_word_len,
+                           const tokenizer_state_t *state)
+{
+    builder->min_word_len = min_word_len;
+    builder->state = *state;
+}
+
+bool index_file_save(const index_file_builder_t *builder, FILE *out)
+{
+    index_header_t header;
+    const buffer_t *parts[4];
+    size_t i;
+
+    if (builder->failed)  return false;
+    header.magic = INDEX_FILE_MAGIC;
+    header.count = builder->count;
+    header.words_size = builder->words.len;
+    header.pages_size = builder->pages.len;
+    header.min_word_len = builder->min_word_len;
+    header.line_no = builder->state.line_no;
+    header.offset = builder->state.offset;
+    header.size = builder->state.size;
+    header.check = builder->state.check;
+    if (fwrite(&header, sizeof(header), 1, out) != 1)  return false;
+
+    parts[0] = &builder->word_offsets;
+    parts[1] = &builder->page_offsets;
+    parts[2] = &builder->words;
+    parts[3] = &builder->pages;
+    for (i = 0; i < 4; i++)
+        if (parts[i]->len > 0 &&
+            fwrite(parts[i]->data, parts[i]->len, 1, out) != 1)
+            return false;
+    return fflush(out) == 0;
+}
+
+void index_file_builder_destroy(index_file_builder_t *builder)
+{
+    free(builder->word_offsets.data);
+    free(builder->page_offsets.data);
+    free(builder->words.data);
+    free(builder->pages.data);
+    free(builder);
+}
+
+index_file_t *index_file_open(const char *filename)
+{
+    index_file_t *file = malloc(sizeof(index_file_t));
+
+    if (! file)  return NULL;
+    if (! index_file_load(file, filename)) {
+        free(file);
+        return NULL;
+    }
+    if (! index_file_check(file)) {
+        index_file_close(file);
+        return NULL;
+    }
+    return file;
+}
+
+size_t index_file_size(const index_file_t *file)
+{
+    return file->count;
+}
+
+int index_file_source(const index_file_t *file, tokenizer_state_t *state)
+{
+    state->offset = file->header->offset;
+    state->line_no = file->header->line_no;
+    state->size = file->header->size;
+    state->check = file->header->check;
+    return (int) file->header->min_word_len;
+}
+
+bool index_file_find(const index_file_t *file, const char *word, size_t len,
+                     size_t *i)
+{
+    size_t low = 0, high = file->count, mid, mid_len;
+    const char *mid_word;
+    int result;
+
+    // Words are in the order of entry_cmp (word_index.c): by their bytes,
+    // then the shorter one first when one is a prefix of the other.
+    while (low < high) {
+        mid = low + (high - low) / 2;
+        mid_word = index_file_word(file, mid, &mid_len);
+        result = memcmp(word, mid_word, len < mid_len ? len : mid_len);
+        if (result == 0 && len != mid_len)
+            result = len < mid_len ? -1 : 1;
+        if (result == 0) {
+            *i = mid;
+            return true;
+        }
+        if (result < 0)
+            high = mid;
+        else
+            low = mid + 1;
+    }
+    return false;
+}
+
+const char *index_file_word(const index_file_t *file, size_t i, size_t *len)
+{
+    *len = file->word_offsets[i + 1] - file->word_offsets[i];
+    return file->words + file->word_offsets[i];
+}
+
+void index_file_pages(const index_file_t *file, size_t i, page_iter_t *iter)
+{
+    page_list_begin_bytes(file->pages + file->page_offsets[i],
+                          file->page_offsets[i + 1] - file->page_offsets[i],
+                          iter);
+}
+
+void index_file_close(index_file_t *file)
+{
+#ifdef HAVE_MMAP
+    if (file->mapped)
+        munmap((void *) file->data, file->size);
+    else
+#endif
+        free((void *) file->data);
+    free(file);
+}
+
+/******************************************************************************
+ *  Definitions of helper functions -- see above for documentation.           *
+ ******************************************************************************/
+
+bool buffer_append(buffer_t *buf, const void *bytes, size_t len)
+{
+    unsigned char *bigger;
+    size_t cap = buf->cap ? buf->cap : 4096;
+
+    if (len > buf->cap - buf->len) {
+        while (len > cap - buf->len)  cap *= 2;
+        if (! (bigger = realloc(buf->data, cap)))  return false;
+        buf->data = bigger;
+        buf->cap = cap;
+    }
+    memcpy(buf->data + buf->len, bytes, len);
+    buf->len += len;
+    return true;
+}
+
+bool buffer_append_offset(buffer_t *buf, size_t offset)
+{
+    uint32_t value = offset;
+
+    return offset <= UINT32_MAX && buffer_append(buf, &value, sizeof(value));
+}
+
+bool index_file_load(index_file_t *file, const char *filename)
+{
+    FILE *in;
+    unsigned char *data = NULL, *bigger;
+    size_t size = 0, cap = 0, got;
+
+#ifdef HAVE_MMAP
+    /* Map regular, non-empty files directly; anything else falls through to
+     * reading, as in tokenizer_load (file_util.c). */
+    int fd = open(filename, O_RDONLY);
+    struct stat info;
+
+    if (fd < 0)  return false;
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+        void *map = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            close(fd);
+            file->data = map;
+            file->size = info.st_size;
+            file->mapped = true;
+            return true;
+        }
+    }
+    close(fd);
+#endif
+
+    /* Read the whole file into memory, doubling the buffer as needed. */
+    if (! (in = fopen(filename, "rb")))  return false;
+    do {
+        if (size == cap) {
+            if (! (bigger = realloc(data, cap = cap ? 2 * cap : 65536))) {
+                free(data);
+                fclose(in);
+                return false;
+            }
+            data = bigger;
+        }
+        got = fread(data + size, 1, cap - size, in);
+        size += got;
+    } while (got > 0);
+    fclose(in);
+
+    file->data = data;
+    file->size = size;
+    file->mapped = false;
+    return true;
+}
+
+bool index_file_check(index_file_t *file)
+{
+    const index_header_t *header = (const index_header_t *) file->data;
+    size_t rest, i;
+
+    if (file->size < sizeof(index_header_t) ||
+        header->magic != INDEX_FILE_MAGIC || header->count >= UINT32_MAX ||
+        header->min_word_len > INT32_MAX)
+        return false;
+
+    // The parts must add up to the size of the file exactly (checked so that
+    // nothing can overflow).
+    file->header = header;
+    file->count = header->count;
+    rest = file->size - sizeof(index_header_t);
+    if (rest / (2 * sizeof(uint32_t)) < file->count + 1)  return false;
+    rest -= 2 * sizeof(uint32_t) * (file->count + 1);
+    if (rest < header->words_size || rest - header->words_size !=
+                                     header->pages_size)
+        return false;
+
+    file->word_offsets = (const uint32_t *) (header + 1);
+    file->page_offsets = file->word_offsets + file->count + 1;
+    file->words = (const char *) (file->page_offsets + file->count + 1);
+    file->pages = (const unsigned char *) file->words + header->words_size;
+
+    // Every word has at least one character and one page, whose encoding
+    // ends with a byte without the high bit, and the offsets must end at the
+    // end of each table, so no lookup can go outside the file.
+    if (file->word_offsets[0] != 0 || file->page_offsets[0] != 0 ||
+        file->word_offsets[file->count] != header->words_size ||
+        file->page_offsets[file->count] != header->pages_size)
+        return false;
+    for (i = 0; i < file->count; i++)
+        if (file->word_offsets[i] >= file->word_offsets[i + 1] ||
+            file->page_offsets[i] >= file->page_offsets[i + 1] ||
+            file->page_offsets[i + 1] > header->pages_size ||
+            file->pages[file->page_offsets[i + 1] - 1] & 0x80U)
+            return false;
+    return true;
+}
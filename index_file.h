@@ -0,0 +1,206 @@
+/* FILE index_file.h
+ *    Declarations of types and functions to save a finished word index to a
+ *    compact binary file, and to look words up in such a file by mapping it
+ *    into memory, without reading or parsing the text it was made from.
+ *
+ *    An index file holds, in the byte order of the machine that wrote it:
+ *      - a header: INDEX_FILE_MAGIC, the number of words n, the size of the
+ *        word table and the size of the page table, then the minimum word
+ *        length and the tokenizer state of the text the index was made from
+ *        (see tokenizer_save), so that it can be brought up to date when
+ *        text is appended;
+ *      - n + 1 32-bit offsets into the word table, in increasing order (word
+ *        i is the bytes from offset i up to offset i + 1);
+ *      - n + 1 32-bit offsets into the page table, in the same way;
+ *      - the word table: every word, in increasing order, with nothing
+ *        between them;
+ *      - the page table: the pages of every word, in the same order, encoded
+ *        as in a page list (page_list.h).
+ */
+#ifndef INDEX_FILE_H
+#define INDEX_FILE_H
+
+/******************************************************************************
+ *  Types and Constants.                                                      *
+ ******************************************************************************/
+
+#include <stdbool.h> /* for type bool   */
+#include <stdio.h>   /* for type FILE   */
+#include <stdlib.h>  /* for type size_t */
+
+#include "file_util.h"
+#include "page_list.h"
+
+/* CONSTANT INDEX_FILE_MAGIC
+ *    The first number of every index file ("WIX2" on a little-endian
+ *    machine); a file written with the other byte order does not match it,
+ *    and neither does one from before the header held a tokenizer state.
+ */
+#define INDEX_FILE_MAGIC 0x32584957UL
+
+/* TYPE index_file_builder_t -- An index file being put together in memory. */
+typedef struct index_file_builder index_file_builder_t;
+
+/* TYPE index_file_t -- An index file opened for lookups. */
+typedef struct index_file index_file_t;
+
+/******************************************************************************
+ *  Function declarations -- with full documentation.                         *
+ ******************************************************************************/
+
+/* FUNCTION index_file_builder_create
+ *    Create and return an empty index file builder.
+ * Parameters and preconditions:  none
+ * Return value:
+ *    a new builder with no words; NULL in case of error with memory
+ *    allocation
+ * Side-effects:
+ *    memory has been allocated for the builder
+ */
+index_file_builder_t *index_file_builder_create(void);
+
+/* FUNCTION index_file_add
+ *    Add a word and its pages at the end of an index file builder.
+ * Parameters and preconditions:
+ *    builder != NULL: a builder
+ *    word != NULL: the word to add (not necessarily null-terminated), which
+ *                  comes after every word already added to builder
+ *    len > 0: the number of characters in word
+ *    pages != NULL: the pages of word
+ * Return value:
+ *    true if the word was added; false in case of error with memory
+ *    allocation, or if the file would grow past 32-bit offsets
+ * Side-effects:
+ *    copies of word and of its encoded pages have been added to builder
+ */
+bool index_file_add(index_file_builder_t *builder, const char *word,
+                    size_t len, const page_list_t *pages);
+
+/* FUNCTION index_file_set_source
+ *    Record what an index file builder was made from, so that the index can
+ *    be brought up to date later.
+ * Parameters and preconditions:
+ *    builder != NULL: a builder
+ *    min_word_len > 0: the minimum length of the words in the index
+ *    state != NULL: the state of the text file at the end of the index
+ * Return value:  none
+ * Side-effects:
+ *    min_word_len and state will be saved in the header of the index file
+ *    (both are 0 until this is called)
+ */
+void index_file_set_source(index_file_builder_t *builder, int min_word_len,
+                           const tokenizer_state_t *state);
+
+/* FUNCTION index_file_save
+ *    Write the index file of a builder.
+ * Parameters and preconditions:
+ *    builder != NULL: a builder
+ *    out != NULL: a file open for writing in binary mode
+ * Return value:
+ *    true if the whole index file was handed to out; false if a write failed
+ *    or an earlier call to index_file_add failed
+ * Side-effects:
+ *    the index file of every word added to builder has been written to out
+ */
+bool index_file_save(const index_file_builder_t *builder, FILE *out);
+
+/* FUNCTION index_file_builder_destroy
+ *    Free all the memory allocated for an index file builder.
+ * Parameters and preconditions:
+ *    builder != NULL: a builder
+ * Return value:  none
+ * Side-effects:
+ *    all memory allocated for builder has been freed
+ */
+void index_file_builder_destroy(index_file_builder_t *builder);
+
+/* FUNCTION index_file_open
+ *    Open an index file for lookups, mapping it into memory where possible
+ *    (reading it into memory otherwise).
+ * Parameters and preconditions:
+ *    filename != NULL: the name of an index file
+ * Return value:
+ *    the opened index file; NULL if the file cannot be read, is not an index
+ *    file (or comes from a machine with the other byte order) or is damaged,
+ *    or in case of error with memory allocation
+ * Side-effects:
+ *    the file has been mapped (or read) into memory
+ */
+index_file_t *index_file_open(const char *filename);
+
+/* FUNCTION index_file_size
+ *    Return the number of words in an index file.
+ * Parameters and preconditions:
+ *    file != NULL: an opened index file
+ * Return value:
+ *    the number of words in file
+ * Side-effects:  none
+ */
+size_t index_file_size(const index_file_t *file);
+
+/* FUNCTION index_file_source
+ *    Return what an index file was made from.
+ * Parameters and preconditions:
+ *    file != NULL: an opened index file
+ *    state != NULL: where to store the state of the text file
+ * Return value:
+ *    the minimum length of the words in the index (0 if it was not recorded)
+ * Side-effects:
+ *    *state is set to the state of the text file at the end of the index
+ */
+int index_file_source(const index_file_t *file, tokenizer_state_t *state);
+
+/* FUNCTION index_file_find
+ *    Look a word up in an index file, with a binary search of its word table.
+ * Parameters and preconditions:
+ *    file != NULL: an opened index file
+ *    word != NULL: the word to look up (not necessarily null-terminated)
+ *    len: the number of characters in word
+ *    i != NULL: where to store the position of the word
+ * Return value:
+ *    true if word is in file; false otherwise
+ * Side-effects:
+ *    *i is set to the position of word in file (from 0 to
+ *    index_file_size(file) - 1) if it is there
+ */
+bool index_file_find(const index_file_t *file, const char *word, size_t len,
+                     size_t *i);
+
+/* FUNCTION index_file_word
+ *    Return a word of an index file.
+ * Parameters and preconditions:
+ *    file != NULL: an opened index file
+ *    i < index_file_size(file): the position of the word
+ *    len != NULL: where to store the length of the word
+ * Return value:
+ *    the characters of word i (not null-terminated), inside the file
+ * Side-effects:
+ *    *len is set to the number of characters of word i
+ */
+const char *index_file_word(const index_file_t *file, size_t i, size_t *len);
+
+/* FUNCTION index_file_pages
+ *    Start a sequential pass over the pages of a word of an index file, to
+ *    continue with page_list_next.
+ * Parameters and preconditions:
+ *    file != NULL: an opened index file
+ *    i < index_file_size(file): the position of the word
+ *    iter != NULL: where to store the position of the pass
+ * Return value:  none
+ * Side-effects:
+ *    *iter is set to the position before the first page of word i
+ */
+void index_file_pages(const index_file_t *file, size_t i, page_iter_t *iter);
+
+/* FUNCTION index_file_close
+ *    Unmap (or free) an index file and free all the memory allocated for it.
+ * Parameters and preconditions:
+ *    file != NULL: an opened index file
+ * Return value:  none
+ * Side-effects:
+ *    all memory allocated for file has been released; the words returned by
+ *    index_file_word are no longer valid
+ */
+void index_file_close(index_file_t *file);
+
+#endif/*INDEX_FILE_H*/
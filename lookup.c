@@ -0,0 +1,194 @@
+/* FILE lookup.c
+ *    Answer questions about a text file from the binary index file saved by
+ *    "index --save=FILE": the pages of some words, or the words on a page.
+ *    The index file is mapped into memory and used as is, so nothing needs to
+ *    be read, tokenized or sorted again.
+ */
+
+/******************************************************************************
+ *  Constants and types.                                                      *
+ ******************************************************************************/
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "index_file.h"
+#include "writer.h"
+
+/* CONSTANT MAX_QUERY_LEN
+ *    Longest word read from stdin, one per line; the rest of a longer line is
+ *    skipped.
+ */
+#define MAX_QUERY_LEN 1024
+
+/******************************************************************************
+ *  Function declarations -- with full documentation.                         *
+ ******************************************************************************/
+
+/* FUNCTION lookup_word
+ *    Look a word up in an index file and write its line of the index.
+ * Parameters and preconditions:
+ *    file != NULL: an opened index file
+ *    word != NULL: the word to look up
+ *    len: the number of characters in word
+ *    out != NULL: the writer to add the line to
+ * Return value:
+ *    true if the word is in the index; false otherwise
+ * Side-effects:
+ *    the line "word: page, page, ..." has been added to out if the word is in
+ *    the index; a message has been printed on stderr otherwise
+ */
+static
+bool lookup_word(const index_file_t *file, const char *word, size_t len,
+                 writer_t *out);
+
+/* FUNCTION lookup_page
+ *    Write every word of an index file that appears on a page, in order, one
+ *    per line.
+ * Parameters and preconditions:
+ *    file != NULL: an opened index file
+ *    page > 0: the page to look for
+ *    out != NULL: the writer to add the words to
+ * Return value:
+ *    true if at least one word appears on page; false otherwise
+ * Side-effects:
+ *    the words on page have been added to out
+ */
+static
+bool lookup_page(const index_file_t *file, unsigned page, writer_t *out);
+
+/* FUNCTION main
+ *    Grab the name of an index file and either the words to look up or an
+ *    option --page=N from the command line, and print the line of the index
+ *    of each word (in the same form as the index program) or the words on
+ *    page N.  With neither, the words are read from stdin, one per line.
+ * Parameters and preconditions:
+ *    argc > 0: number of command line arguments
+ *    argv != NULL: array of command line arguments
+ * Return value:
+ *    exit status: EXIT_SUCCESS if every word (or the page) was found
+ * Side-effects:  the main program is executed
+ */
+int main(int argc, char *argv[]);
+
+/******************************************************************************
+ *  Function definitions -- see above for documentation.                      *
+ ******************************************************************************/
+
+bool lookup_word(const index_file_t *file, const char *word, size_t len,
+                 writer_t *out)
+{
+    page_iter_t pages;
+    unsigned page;
+    size_t i;
+
+    if (! index_file_find(file, word, len, &i)) {
+        fprintf(stderr, "%.*s: not in the index\n", (int) len, word);
+        return false;
+    }
+
+    // the same line as entry_write in word_index.c
+    writer_put(out, word, len);
+    writer_put(out, ": ", 2);
+    index_file_pages(file, i, &pages);
+    if (page_list_next(&pages, &page))
+        writer_put_uint(out, page);
+    while (page_list_next(&pages, &page)) {
+        writer_put(out, ", ", 2);
+        writer_put_uint(out, page);
+    }
+    writer_put_char(out, '\n');
+    return true;
+}
+
+bool lookup_page(const index_file_t *file, unsigned page, writer_t *out)
+{
+    page_iter_t pages;
+    unsigned next = 0;
+    const char *word;
+    size_t i, len;
+    bool found = false;
+
+    // Pages are in increasing order, so each list is only decoded up to the
+    // first page that is not before the one we want.
+    for (i = 0; i < index_file_size(file); i++) {
+        index_file_pages(file, i, &pages);
+        while (page_list_next(&pages, &next) && next < page)
+            ;
+        if (next == page) {
+            word = index_file_word(file, i, &len);
+            writer_put(out, word, len);
+            writer_put_char(out, '\n');
+            found = true;
+        }
+    }
+    return found;
+}
+
+int main(int argc, char *argv[])
+{
+    index_file_t *file;
+    writer_t out;
+    char line[MAX_QUERY_LEN + 2];
+    unsigned page = 0;
+    int words = 0, arg, c;
+    const char *name = NULL;
+    size_t len;
+    bool by_page = false, found = true;
+
+    /* First, separate the option from the other arguments (the name of the
+     * index file, then the words). */
+    for (arg = 1; arg < argc; arg++) {
+        if (strncmp(argv[arg], "--page=", 7) == 0) {
+            page = (unsigned) strtoul(argv[arg] + 7, NULL, 10);
+            by_page = true;
+        }
+        else if (! name)
+            name = argv[arg];
+        else
+            words++;
+    }
+
+    /* Next, check that the arguments make sense and open the index file. */
+    if (! name || (by_page && (page == 0 || words > 0))) {
+        fprintf(stderr,
+                "ERROR: missing or incorrect argument!\n"
+                "USAGE: %s <indexfile> [--page=N | word...]\n"
+                "  . <indexfile> is a file saved by index --save (required)\n"
+                "  . [--page=N] prints the words on page N, N > 0 (optional)\n"
+                "  . [word...] are the words to look up; without them or"
+                " --page, words are read from stdin, one per line\n",
+                argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    if (! (file = index_file_open(name))) {
+        fprintf(stderr, "ERROR: not a valid index file: %s\n", name);
+        exit(EXIT_FAILURE);
+    }
+
+    /* Finally, answer the questions. */
+    writer_init(&out, stdout);
+    if (by_page) {
+        found = lookup_page(file, page, &out);
+    } else if (words > 0) {
+        for (arg = 1; arg < argc; arg++)
+            if (argv[arg] != name && strncmp(argv[arg], "--page=", 7) != 0)
+                found &= lookup_word(file, argv[arg], strlen(argv[arg]),
+                                     &out);
+    } else {
+        while (fgets(line, sizeof(line), stdin)) {
+            len = strcspn(line, "\r\n");
+            if (! line[len])  // the line is too long: skip the rest of it
+                while ((c = getchar()) != EOF && c != '\n')
+                    ;
+            if (len > 0)
+                found &= lookup_word(file, line, len, &out);
+        }
+    }
+    if (! writer_flush(&out))  found = false;
+    index_file_close(file);
+
+    return found ? EXIT_SUCCESS : EXIT_FAILURE;
+}
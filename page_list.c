@@ -0,0 +1,222 @@
+/* FILE page_list.c
+ *    Implementation of the page_list functions.
+ */
+
+/******************************************************************************
+ *  Types and Constants.                                                      *
+ ******************************************************************************/
+
+#include <string.h>
+
+#include "page_list.h"
+
+/* CONSTANT VARINT_MAX
+ *    Largest number of bytes needed to encode one unsigned page difference
+ *    with 7 bits per byte.
+ */
+#define VARINT_MAX ((sizeof(unsigned) * 8 + 6) / 7)
+
+/* MACRO BYTES
+ *    An expression for the array that stores the encoded pages of a list.
+ */
+#define BYTES(list) \
+    ((list)->cap > PAGE_LIST_LOCAL ? (list)->bytes.heap : (list)->bytes.local)
+
+/******************************************************************************
+ *  Declarations of helper functions -- including full documentation.         *
+ ******************************************************************************/
+
+/* FUNCTION page_list_reserve
+ *    Make sure there is room for a number of extra bytes at the end of a page
+ *    list.
+ * Parameters and preconditions:
+ *    list != NULL: a page list
+ *    extra: the number of bytes needed after the encoded pages
+ * Return value:
+ *    true if there is enough room; false in case of error with memory
+ *    allocation
+ * Side-effects:
+ *    the capacity of list may have been doubled as many times as needed
+ *    (moving the encoded pages to newly allocated memory)
+ */
+static
+bool page_list_reserve(page_list_t *list, size_t extra);
+
+/******************************************************************************
+ *  Function definitions -- see header file for documentation.                *
+ ******************************************************************************/
+
+void page_list_init(page_list_t *list)
+{
+    list->len = 0;
+    list->cap = PAGE_LIST_LOCAL;
+    list->count = 0;
+    list->last = 0;
+}
+
+void page_list_destroy(page_list_t *list)
+{
+    if (list->cap > PAGE_LIST_LOCAL)  free(list->bytes.heap);
+    page_list_init(list);
+}
+
+bool page_list_add(page_list_t *list, unsigned page)
+{
+    unsigned delta = page - list->last;
+    unsigned char *out;
+
+    /* Pages arrive in order, so a duplicate can only be the last page. */
+    if (list->count > 0 && delta == 0)  return true;
+    if (! page_list_reserve(list, VARINT_MAX))  return false;
+
+    /* Write the difference 7 bits at a time, lowest bits first. */
+    out = BYTES(list) + list->len;
+    while (delta >= 0x80U) {
+        *out++ = (unsigned char) (delta | 0x80U);
+        delta >>= 7;
+    }
+    *out++ = (unsigned char) delta;
+
+    list->len = out - BYTES(list);
+    list->count++;
+    list->last = page;
+    return true;
+}
+
+/* Every page of later is at least as large as the last page of list, so only
+ * the first page of later has to be re-encoded (as a difference from the last
+ * page of list); the differences after it are the same in both lists and
+ * their bytes are copied as they are.
+ */
+bool page_list_merge(page_list_t *list, const page_list_t *later)
+{
+    page_iter_t pages;
+    unsigned first;
+    size_t rest;
+
+    page_list_begin(later, &pages);
+    if (! page_list_next(&pages, &first))  return true;
+    if (! page_list_add(list, first))  return false;
+
+    rest = pages.end - pages.next;
+    if (rest > 0) {
+        if (! page_list_reserve(list, rest))  return false;
+        memcpy(BYTES(list) + list->len, pages.next, rest);
+        list->len += rest;
+        list->count += later->count - 1;
+        list->last = later->last;
+    }
+    return true;
+}
+
+/* Both sides are in order, so they are merged into a new list in one pass,
+ * which replaces the old one only once it is complete.
+ */
+bool page_list_union(page_list_t *list, const unsigned pages[], size_t n)
+{
+    page_list_t merged;
+    page_iter_t old;
+    unsigned page;
+    bool more;
+    size_t i = 0;
+
+    page_list_init(&merged);
+    page_list_begin(list, &old);
+    more = page_list_next(&old, &page);
+    while (more || i < n) {
+        if (more && (i == n || page <= pages[i])) {
+            if (! page_list_add(&merged, page))  break;
+            more = page_list_next(&old, &page);
+        } else if (! page_list_add(&merged, pages[i++])) {
+            break;
+        }
+    }
+    if (more || i < n) {
+        page_list_destroy(&merged);
+        return false;
+    }
+    page_list_destroy(list);
+    *list = merged;
+    return true;
+}
+
+size_t page_list_size(const page_list_t *list)
+{
+    return list->count;
+}
+
+unsigned page_list_last(const page_list_t *list)
+{
+    return list->last;
+}
+
+size_t page_list_memory(const page_list_t *list)
+{
+    return list->cap > PAGE_LIST_LOCAL ? list->cap : 0;
+}
+
+void page_list_begin(const page_list_t *list, page_iter_t *iter)
+{
+    iter->next = BYTES(list);
+    iter->end = iter->next + list->len;
+    iter->page = 0;
+}
+
+const unsigned char *page_list_bytes(const page_list_t *list, size_t *len)
+{
+    *len = list->len;
+    return BYTES(list);
+}
+
+void page_list_begin_bytes(const unsigned char *bytes, size_t len,
+                           page_iter_t *iter)
+{
+    iter->next = bytes;
+    iter->end = bytes + len;
+    iter->page = 0;
+}
+
+bool page_list_next(page_iter_t *iter, unsigned *page)
+{
+    unsigned delta = 0;
+    unsigned shift = 0;
+
+    if (iter->next == iter->end)  return false;
+
+    /* Read bytes until one without the high bit set. */
+    while (*iter->next & 0x80U) {
+        delta |= (unsigned) (*iter->next++ & 0x7FU) << shift;
+        shift += 7;
+    }
+    delta |= (unsigned) *iter->next++ << shift;
+
+    *page = iter->page += delta;
+    return true;
+}
+
+/******************************************************************************
+ *  Definitions of helper functions -- see above for documentation.           *
+ ******************************************************************************/
+
+bool page_list_reserve(page_list_t *list, size_t extra)
+{
+    size_t cap;
+    unsigned char *bytes;
+
+    if (list->len + extra <= list->cap)  return true;
+
+    /* Double the capacity and move the encoded pages over. */
+    cap = 2 * list->cap;
+    while (cap < list->len + extra)  cap *= 2;
+    if (list->cap > PAGE_LIST_LOCAL) {
+        bytes = realloc(list->bytes.heap, cap);
+        if (! bytes)  return false;
+    } else {
+        bytes = malloc(cap);
+        if (! bytes)  return false;
+        memcpy(bytes, list->bytes.local, list->len);
+    }
+    list->bytes.heap = bytes;
+    list->cap = cap;
+    return true;
+}
@@ -0,0 +1,203 @@
+/* FILE page_list.h
+ *    Declarations of types and functions to work with "page lists" -- compact
+ *    lists of distinct page numbers in increasing order, stored as
+ *    variable-length differences between consecutive pages.
+ */
+#ifndef PAGE_LIST_H
+#define PAGE_LIST_H
+
+/******************************************************************************
+ *  Types and Constants.                                                      *
+ ******************************************************************************/
+
+#include <stdbool.h> /* for type bool   */
+#include <stdlib.h>  /* for type size_t */
+
+/* CONSTANT PAGE_LIST_LOCAL
+ *    Number of bytes of encoded pages that are stored directly inside a page
+ *    list before memory is allocated for them.  Most words only appear on a
+ *    handful of pages, and each page usually takes a single byte.
+ */
+#define PAGE_LIST_LOCAL 16U
+
+/* TYPE page_list_t
+ *    A list of page numbers.  Each page is stored as the difference from the
+ *    page before it (the first page as the difference from 0), written with 7
+ *    bits per byte and the high bit of each byte set when more bytes follow.
+ *    Page lists are meant to be embedded directly in the structure that owns
+ *    them, so the definition is public -- but its fields should only be
+ *    accessed through the functions below.
+ */
+typedef struct page_list {
+    union {
+        unsigned char local[PAGE_LIST_LOCAL]; /* used when cap is the default */
+        unsigned char *heap; /* used once the encoding outgrows local[]      */
+    } bytes;
+    size_t len;    /* number of bytes used by the encoded pages        */
+    size_t cap;    /* number of bytes available for the encoded pages */
+    size_t count;  /* number of pages in the list                     */
+    unsigned last; /* last page added to the list (0 if none)         */
+} page_list_t;
+
+/* TYPE page_iter_t
+ *    The position of a sequential pass over the pages in a page list.
+ */
+typedef struct page_iter {
+    const unsigned char *next; /* next encoded byte to decode      */
+    const unsigned char *end;  /* one past the last encoded byte   */
+    unsigned page;             /* last page returned by the pass   */
+} page_iter_t;
+
+/******************************************************************************
+ *  Function declarations -- with full documentation.                         *
+ ******************************************************************************/
+
+/* FUNCTION page_list_init
+ *    Initialize an empty page list.
+ * Parameters and preconditions:
+ *    list != NULL: the page list to initialize
+ * Return value:  none
+ * Side-effects:
+ *    *list is initialized to an empty page list (no memory is allocated)
+ */
+void page_list_init(page_list_t *list);
+
+/* FUNCTION page_list_destroy
+ *    Free all the memory allocated for a page list.
+ * Parameters and preconditions:
+ *    list != NULL: a page list
+ * Return value:  none
+ * Side-effects:
+ *    all memory allocated for the pages of list has been freed
+ */
+void page_list_destroy(page_list_t *list);
+
+/* FUNCTION page_list_add
+ *    Add a page at the end of a page list, unless it is already the last page
+ *    in the list.  Takes constant (amortized) time.
+ * Parameters and preconditions:
+ *    list != NULL: a page list
+ *    page > 0 and page >= the last page in list: the page to add
+ * Return value:
+ *    true if page is in the list; false in case of error with memory
+ *    allocation
+ * Side-effects:
+ *    page has been added at the end of list if it was not already there;
+ *    memory may have been allocated for the list
+ */
+bool page_list_add(page_list_t *list, unsigned page);
+
+/* FUNCTION page_list_merge
+ *    Add the pages of one page list at the end of another, where every page
+ *    in the second list comes no earlier than the last page of the first one
+ *    (for example, when the lists come from consecutive parts of a file).
+ * Parameters and preconditions:
+ *    list != NULL: the page list to add to
+ *    later != NULL: a page list whose first page is >= the last page in list
+ * Return value:
+ *    true if every page of later is in list; false in case of error with
+ *    memory allocation
+ * Side-effects:
+ *    the pages of later have been added at the end of list (the first one is
+ *    only added if it is not already the last page in list); later is
+ *    unchanged
+ */
+bool page_list_merge(page_list_t *list, const page_list_t *later);
+
+/* FUNCTION page_list_union
+ *    Add pages to a page list that do not all come after its last page.
+ * Parameters and preconditions:
+ *    list != NULL: a page list
+ *    pages != NULL: n pages in nondecreasing order
+ *    n: the number of pages
+ * Return value:
+ *    true if the pages were added; false in case of error with memory
+ *    allocation (list is then left as it was)
+ * Side-effects:
+ *    list holds every page it held before and every page of pages, once each
+ *    and in order (it has been encoded again)
+ */
+bool page_list_union(page_list_t *list, const unsigned pages[], size_t n);
+
+/* FUNCTION page_list_size
+ *    Return the number of pages in a page list.
+ * Parameters and preconditions:
+ *    list != NULL: a page list
+ * Return value:
+ *    the number of distinct pages in list
+ * Side-effects:  none
+ */
+size_t page_list_size(const page_list_t *list);
+
+/* FUNCTION page_list_last
+ *    Return the last page in a page list.
+ * Parameters and preconditions:
+ *    list != NULL: a page list
+ * Return value:
+ *    the largest page in list; 0 if list is empty
+ * Side-effects:  none
+ */
+unsigned page_list_last(const page_list_t *list);
+
+/* FUNCTION page_list_memory
+ *    Return the memory allocated for a page list, apart from the list itself.
+ * Parameters and preconditions:
+ *    list != NULL: a page list
+ * Return value:
+ *    the number of bytes allocated for the encoded pages of list (0 while
+ *    they fit inside the list)
+ * Side-effects:  none
+ */
+size_t page_list_memory(const page_list_t *list);
+
+/* FUNCTION page_list_begin
+ *    Start a sequential pass over the pages in a page list.
+ * Parameters and preconditions:
+ *    list != NULL: a page list (that must not change during the pass)
+ *    iter != NULL: where to store the position of the pass
+ * Return value:  none
+ * Side-effects:
+ *    *iter is set to the position before the first page of list
+ */
+void page_list_begin(const page_list_t *list, page_iter_t *iter);
+
+/* FUNCTION page_list_bytes
+ *    Return the encoded pages of a page list, for storing them elsewhere.
+ * Parameters and preconditions:
+ *    list != NULL: a page list
+ *    len != NULL: where to store the number of encoded bytes
+ * Return value:
+ *    a pointer to the encoded pages of list (valid until list changes)
+ * Side-effects:
+ *    *len is set to the number of bytes of the encoded pages
+ */
+const unsigned char *page_list_bytes(const page_list_t *list, size_t *len);
+
+/* FUNCTION page_list_begin_bytes
+ *    Start a sequential pass over pages encoded as in a page list but stored
+ *    elsewhere (for example, bytes returned by page_list_bytes and saved to a
+ *    file).
+ * Parameters and preconditions:
+ *    bytes != NULL: the encoded pages
+ *    len: the number of bytes of the encoded pages
+ *    iter != NULL: where to store the position of the pass
+ * Return value:  none
+ * Side-effects:
+ *    *iter is set to the position before the first page in bytes
+ */
+void page_list_begin_bytes(const unsigned char *bytes, size_t len,
+                           page_iter_t *iter);
+
+/* FUNCTION page_list_next
+ *    Decode the next page in a sequential pass over a page list.
+ * Parameters and preconditions:
+ *    iter != NULL: a position set by page_list_begin
+ *    page != NULL: where to store the next page
+ * Return value:
+ *    true if the next page was stored in *page; false at the end of the list
+ * Side-effects:
+ *    *iter is moved past the page stored in *page
+ */
+bool page_list_next(page_iter_t *iter, unsigned *page);
+
+#endif/*PAGE_LIST_H*/
@@ -10,138 +10,157 @@
 #include <stdio.h>
 #include <stdlib.h>
 
-#include "bag.h"
-
-#define RIGHT_CHILD 1
-#define LEFT_CHILD 0
-#define NO_ANCESTOR 2
-
+#include "bag_impl.h"
+#include "slab.h"
 
 /* TYPE psb_node_t -- A node in an psb tree. */
 typedef struct psb_node {
+    bag_key_t key;          /* the key of elem (0 if bag has no key) */
     bag_elem_t elem;        /* the element stored in this node       */
     struct psb_node *left;  /* pointer to this node's left child     */
     struct psb_node *right; /* pointer to this node's right child    */
+    struct psb_node *parent; /* pointer to this node's parent        */
 } psb_node_t;
 
-/* TYPE struct bag -- Definition of struct bag from the header. */
-struct bag {
+/* TYPE psb_bag_t
+ *    A bag stored in a pseudo-self-balancing BST.
+ */
+typedef struct psb_bag {
+    bag_t base; /* the part shared by all bags (must come first) */
     size_t size; /* number of elements in this bag */
     psb_node_t *root; /* root of the psb tree storing the elements */
     int (*cmp)(bag_elem_t, bag_elem_t); /* function to compare elements */
-};
+    bag_key_t (*key)(bag_elem_t); /* key function for cmp, or NULL */
+    slab_t nodes; /* memory for the nodes of the tree */
+#ifdef BAG_STATS
+    bag_counters_t counters; /* work done by this bag so far */
+#endif
+} psb_bag_t;
 
 /******************************************************************************
  *  Declarations of helper functions -- including full documentation.         *
  ******************************************************************************/
 
-/* FUNCTION psb_destroy
- *    Free the memory allocated for the binary tree rooted at a given node.
- * Parameters and preconditions:
- *    root: the root of the tree to free
- * Return value:  none
- * Side-effects:
- *    all the memory allocated for nodes in the subtree rooted at root has been
- *    freed
- */
-static
-void psb_destroy(psb_node_t *root);
-
 /* FUNCTION psb_traverse
- *    Call a function on every element in a BST, given its root.
+ *    Call a function on every element in a BST, given its root.  Moves from
+ *    each node to its successor with the parent links, so it needs neither
+ *    recursion nor a stack, no matter how tall the tree is.
  * Parameters and preconditions:
  *    root: the root of the BST to traverse
  *    fun != NULL: a pointer to a function to apply to each element in the tree
+ *    ctx: the context to pass to fun along with each element
  * Return value:  none
  * Side-effect:
  *    function fun has been called on each element in the tree rooted at root,
  *    in order
  */
 static
-void psb_traverse(const psb_node_t *root, void (*fun)(bag_elem_t));
+void psb_traverse(const psb_node_t *root,
+                  void (*fun)(bag_elem_t, void *), void *ctx);
 
 /* FUNCTION psb_contains
- *    Return whether or not a BST contains a certain element, given the root.
+ *    Return whether or not the BST of a bag contains a certain element.
  * Parameters and preconditions:
- *    root: the root of the BST to search
+ *    bag != NULL: the bag to search
  *    elem != NULL: the element to search for
- *    cmp != NULL: the comparison function to use for the search
- *    is_right == NO_ANCESTOR (!=1 && !=0): a variable used in the recursive calls
- *    parent == NULL: a variable used in the recursive calls
- *    is_parent_right == NO_ANCESTOR (!=1 && !=0):
- *        a variable used in the recursive calls
- *    grandparent == NULL: a variable used in the recursive calls
- *    bag != NULL: a pointer to the bag being searched
  * Return value:
- *    elem, if the BST rooted at 'root' contains it; NULL otherwise
+ *    the element of the bag equal to elem, if there is one; NULL otherwise
  * Side-effects:  If the element is found, a rotation is done about its parent
  *    so that the the element moves closer to the root
  */
 static
-bag_elem_t psb_contains(const psb_node_t *root, bag_elem_t elem,
-                        int (*cmp)(bag_elem_t, bag_elem_t),
-                        int is_right, psb_node_t *parent,
-                        int is_parent_right,
-                        psb_node_t *grandparent,
-                        struct bag *bag);
+bag_elem_t psb_contains(psb_bag_t *bag, bag_elem_t elem);
 
 /* FUNCTION psb_insert
- *    Add an element to a BST, given a pointer to its root.
+ *    Add an element to the BST of a bag.
  * Parameters and preconditions:
- *    root: a pointer to the root of the BST into which to insert
+ *    bag != NULL: the bag into which to insert
  *    elem != NULL: the element to insert
- *    cmp != NULL: the comparison function to use to find the insertion point
  * Return value:
  *    elem, if it was inserted; NULL in case of error
  * Side-effects:
- *    memory has been allocated for the new element, and the element has been
- *    added at the bottom
+ *    a node has been allocated from the bag's slab for the new element, and
+ *    the element has been added at the bottom
+ */
+static
+bag_elem_t psb_insert(psb_bag_t *bag, bag_elem_t elem);
+
+/* FUNCTION psb_find_or_insert
+ *    Find the element of the BST of a bag equal to a probe and move it one
+ *    level up, like psb_contains, or add a new one made from the probe at
+ *    the bottom, where the search ended, like psb_insert.
+ * Parameters and preconditions:
+ *    bag != NULL: the bag to search
+ *    probe, make, ctx: as for bag_find_or_insert
+ * Return value:
+ *    the element equal to probe, found or made; NULL in case of error
+ * Side-effects:
+ *    the element found has been rotated with its parent (if any); or a node
+ *    has been allocated from the bag's slab for the element made and
+ *    bag->size has been increased
  */
 static
-bag_elem_t psb_insert(psb_node_t **root, bag_elem_t elem,
-                      int (*cmp)(bag_elem_t, bag_elem_t));
+bag_elem_t psb_find_or_insert(psb_bag_t *bag, bag_elem_t probe,
+                              bag_elem_t (*make)(bag_elem_t, void *),
+                              void *ctx);
 
 /* FUNCTION psb_remove
- *    Remove an element from a BST, given a pointer to its root.
+ *    Remove an element from the BST of a bag.
  * Parameters and preconditions:
- *    root: a pointer to the root of the BST into which to remove
+ *    bag != NULL: the bag from which to remove
  *    elem != NULL: the element to remove
- *    cmp != NULL: the comparison function to use to find the removal point
  * Return value:
  *    elem, if it was removed; NULL if the element was not there
  * Side-effects:
- *    memory has been freed for the element removed, and the tree structure has
- *    been adjusted accordingly
+ *    the node of the element removed has been returned to the bag's slab, and
+ *    the tree structure has been adjusted accordingly
  */
 static
-bag_elem_t psb_remove(psb_node_t **root, bag_elem_t elem,
-                      int (*cmp)(bag_elem_t, bag_elem_t));
+bag_elem_t psb_remove(psb_bag_t *bag, bag_elem_t elem);
 
-/* FUNCTION psb_remove_min
- *    Remove and return the smallest element in a BST, given a pointer to its
- *    root.
+/* FUNCTION psb_height
+ *    Return the height of a BST, given its root.  Walks the tree with the
+ *    parent links, like psb_traverse, since the tree can be far too tall for
+ *    recursion.
  * Parameters and preconditions:
- *    root: a pointer to the root of the BST
+ *    root: the root of the BST
  * Return value:
- *    the smallest element in the BST rooted at 'root'
- * Side-effects:
- *    memory has been freed for the node containing the smallest element
+ *    the number of nodes on the longest path down from root (0 if root is
+ *    NULL)
+ * Side-effects:  none
  */
 static
-bag_elem_t psb_remove_min(psb_node_t **root);
+size_t psb_height(const psb_node_t *root);
 
 /* FUNCTION psb_remove_max
- *    Remove and return the largest element in a BST, given a pointer to its
- *    root.
+ *    Remove the largest element in a BST, given a pointer to its root, and
+ *    move it (with its key) into another node.
  * Parameters and preconditions:
- *    root: a pointer to the root of the BST
- * Return value:
- *    the largest element in the BST rooted at 'root'
+ *    root: a pointer to the root of the BST (*root != NULL)
+ *    dest != NULL: the node to move the largest element into (not in the BST)
+ *    nodes != NULL: the slab to which to return the removed node
+ * Return value:  none
  * Side-effects:
- *    memory has been freed for the node containing the largest element
+ *    dest holds the largest element in the BST rooted at 'root' and its key;
+ *    the node that contained them has been returned to nodes
  */
 static
-bag_elem_t psb_remove_max(psb_node_t **root);
+void psb_remove_max(psb_node_t **root, psb_node_t *dest, slab_t *nodes);
+
+/* FUNCTION psb_unlink
+ *    Remove a node that has at most one child from a BST, given the link that
+ *    points to it, and put its child (if any) in its place.
+ * Parameters and preconditions:
+ *    link != NULL: the link to the node to remove (*link != NULL, and at least
+ *                  one of its children is NULL)
+ *    nodes != NULL: the slab to which to return the removed node
+ * Return value:  none
+ * Side-effects:
+ *    the node has been returned to nodes, and *link and the parent of its child
+ *    have been updated
+ */
+static
+void psb_unlink(psb_node_t **link, slab_t *nodes);
 
 /* FUNCTION psb_rotate_to_the_left
  *    Perform a single rotation of *parent to the left -- the tree structure
@@ -182,217 +201,455 @@ void psb_rotate_to_the_right(psb_node_t **parent);
 /* FUNCTION psb_node_create
  *    Create a new psb_node.
  * Parameters and preconditions:
+ *    key: the key of elem
  *    elem: the element to store in the new node
+ *    parent: the node that will point to the new node (NULL for the root)
+ *    nodes != NULL: the slab from which to allocate the new node
  * Return value:
- *    pointer to a new node that stores elem and whose children are both NULL;
+ *    pointer to a new node that stores key and elem and whose children are
+ *    both NULL;
  *    NULL in case of error with memory allocation
  * Side-effects:
- *    memory has been allocated for the new node
+ *    memory has been allocated from nodes for the new node (nodes created one
+ *    after the other are stored next to each other in memory)
  */
 static
-psb_node_t *psb_node_create(bag_elem_t elem);
+psb_node_t *psb_node_create(bag_key_t key, bag_elem_t elem,
+                            psb_node_t *parent, slab_t *nodes);
+
+/* FUNCTION psb_build
+ *    Build a perfectly balanced BST from a sorted array of elements: the
+ *    middle element goes at the root, and each half of the array is built
+ *    into one of its subtrees the same way.
+ * Parameters and preconditions:
+ *    bag != NULL: the bag the tree is built for (whose slab the nodes are
+ *          allocated from, and whose key function gives their keys)
+ *    root != NULL: where to store the root of the new tree
+ *    parent: the node that will point to the new tree (NULL for the root)
+ *    elems != NULL (unless n == 0): the sorted elements to store
+ *    n: the number of elements in elems
+ * Return value:
+ *    true if the tree was built; false in case of error with memory
+ *    allocation (the nodes already allocated are left in the slab)
+ * Side-effects:
+ *    n nodes have been allocated from the bag's slab, in order of their
+ *    elements; *root is the root of the new tree (bag->root and bag->size
+ *    are not changed)
+ */
+static
+bool psb_build(psb_bag_t *bag, psb_node_t **root, psb_node_t *parent,
+               const bag_elem_t elems[], size_t n);
 
 /******************************************************************************
- *  Definitions of "public" functions -- see header file for documentation.   *
+ *  Declarations of the bag operations -- see bag.h for documentation.        *
  ******************************************************************************/
 
-bag_t *bag_create(int (*cmp)(bag_elem_t, bag_elem_t))
+static
+bag_t *psb_bag_create(int (*cmp)(bag_elem_t, bag_elem_t),
+                      unsigned long (*hash)(bag_elem_t),
+                      bag_key_t (*key)(bag_elem_t));
+
+static
+bag_t *psb_bag_build(int (*cmp)(bag_elem_t, bag_elem_t),
+                     unsigned long (*hash)(bag_elem_t),
+                     bag_key_t (*key)(bag_elem_t),
+                     const bag_elem_t elems[], size_t n);
+
+static
+void psb_bag_destroy(bag_t *b);
+
+static
+size_t psb_bag_size(const bag_t *b);
+
+static
+bool psb_bag_traverse(const bag_t *b,
+                      void (*fun)(bag_elem_t, void *), void *ctx);
+
+static
+bag_elem_t psb_bag_contains(bag_t *b, bag_elem_t elem);
+
+static
+bag_elem_t psb_bag_insert(bag_t *b, bag_elem_t elem);
+
+static
+bag_elem_t psb_bag_find_or_insert(bag_t *b, bag_elem_t probe,
+                                  bag_elem_t (*make)(bag_elem_t, void *),
+                                  void *ctx);
+
+static
+bag_elem_t psb_bag_remove(bag_t *b, bag_elem_t elem);
+
+static
+void psb_bag_stats(const bag_t *b, bag_stats_t *stats);
+
+static
+void psb_bag_range(bag_t *b, bag_elem_t lo, bag_elem_t hi,
+                   bool (*fun)(bag_elem_t, void *), void *ctx);
+
+/* CONSTANT psb_bag_ops -- See bag_impl.h for documentation. */
+const bag_ops_t psb_bag_ops = {
+    "psb",
+    psb_bag_create,
+    psb_bag_build,
+    psb_bag_destroy,
+    psb_bag_size,
+    psb_bag_traverse,
+    psb_bag_contains,
+    psb_bag_insert,
+    psb_bag_find_or_insert,
+    psb_bag_remove,
+    psb_bag_stats,
+    NULL,
+    NULL,
+    psb_bag_range
+};
+
+/******************************************************************************
+ *  Definitions of the bag operations -- see bag.h for documentation.         *
+ ******************************************************************************/
+
+bag_t *psb_bag_create(int (*cmp)(bag_elem_t, bag_elem_t),
+                      unsigned long (*hash)(bag_elem_t),
+                      bag_key_t (*key)(bag_elem_t))
 {
-    bag_t *bag = malloc(sizeof(bag_t));
+    psb_bag_t *bag = malloc(sizeof(psb_bag_t));
+
+    /* Search trees only need the comparison function (and the keys). */
+    (void) hash;
     if (bag) {
+        bag->base.ops = &psb_bag_ops;
         bag->size = 0;
         bag->root = NULL;
         bag->cmp = cmp;
+        bag->key = key;
+        slab_init(&bag->nodes, sizeof(psb_node_t));
+        BAG_COUNTERS_INIT(bag);
     }
-    return bag;
+    return (bag_t *) bag;
 }
 
-void bag_destroy(bag_t *bag)
+bag_t *psb_bag_build(int (*cmp)(bag_elem_t, bag_elem_t),
+                     unsigned long (*hash)(bag_elem_t),
+                     bag_key_t (*key)(bag_elem_t),
+                     const bag_elem_t elems[], size_t n)
 {
-    psb_destroy(bag->root);
+    bag_t *b = psb_bag_create(cmp, hash, key);
+    psb_bag_t *bag = (psb_bag_t *) b;
+
+    if (! bag)  return NULL;
+    if (! psb_build(bag, &bag->root, NULL, elems, n)) {
+        psb_bag_destroy(b);
+        return NULL;
+    }
+    bag->size = n;
+    BAG_COUNT(bag, node_allocs, n);
+    return b;
+}
+
+void psb_bag_destroy(bag_t *b)
+{
+    psb_bag_t *bag = (psb_bag_t *) b;
+
+    /* Every node lives in the slab, so there is no need to walk the tree. */
+    slab_release(&bag->nodes);
     free(bag);
 }
 
-size_t bag_size(const bag_t *bag)
+size_t psb_bag_size(const bag_t *b)
 {
+    const psb_bag_t *bag = (const psb_bag_t *) b;
     return bag->size;
 }
 
-void bag_traverse(const bag_t *bag, void (*fun)(bag_elem_t))
+bool psb_bag_traverse(const bag_t *b,
+                      void (*fun)(bag_elem_t, void *), void *ctx)
 {
-    psb_traverse(bag->root, fun);
+    const psb_bag_t *bag = (const psb_bag_t *) b;
+    psb_traverse(bag->root, fun, ctx);
+    return true;
 }
 
-bag_elem_t bag_contains(bag_t *bag, bag_elem_t elem)
+bag_elem_t psb_bag_contains(bag_t *b, bag_elem_t elem)
 {
-    return psb_contains(bag->root, elem, bag->cmp, NO_ANCESTOR,
-                        NULL, NO_ANCESTOR, NULL, bag);
+    psb_bag_t *bag = (psb_bag_t *) b;
+    bag_elem_t e = psb_contains(bag, elem);
+    BAG_END_SEARCH(bag);
+    return e;
 }
 
-bag_elem_t bag_insert(bag_t *bag, bag_elem_t elem)
+bag_elem_t psb_bag_insert(bag_t *b, bag_elem_t elem)
 {
-    bag_elem_t e = psb_insert(&bag->root, elem, bag->cmp);
+    psb_bag_t *bag = (psb_bag_t *) b;
+    bag_elem_t e = psb_insert(bag, elem);
+    BAG_END_SEARCH(bag);
     if (e)  bag->size++;
     return e;
 }
 
-bag_elem_t bag_remove(bag_t *bag, bag_elem_t elem)
+bag_elem_t psb_bag_find_or_insert(bag_t *b, bag_elem_t probe,
+                                  bag_elem_t (*make)(bag_elem_t, void *),
+                                  void *ctx)
 {
-    bag_elem_t e = psb_remove(&bag->root, elem, bag->cmp);
+    psb_bag_t *bag = (psb_bag_t *) b;
+    bag_elem_t e = psb_find_or_insert(bag, probe, make, ctx);
+    BAG_END_SEARCH(bag);
+    return e;
+}
+
+bag_elem_t psb_bag_remove(bag_t *b, bag_elem_t elem)
+{
+    psb_bag_t *bag = (psb_bag_t *) b;
+    bag_elem_t e = psb_remove(bag, elem);
+    BAG_END_SEARCH(bag);
     if (e)  bag->size--;
     return e;
 }
 
+void psb_bag_stats(const bag_t *b, bag_stats_t *stats)
+{
+    const psb_bag_t *bag = (const psb_bag_t *) b;
+    stats->height = psb_height(bag->root);
+    BAG_GET_STATS(bag, stats);
+}
+
+/* The first node of the range is the last node not smaller than lo on the
+ * way down from the root; the scan then moves from each node to its successor
+ * with the parent links, as in psb_traverse, so the tree can be of any height.
+ * Unlike bag_contains, a scan does not rotate the nodes it finds.
+ */
+void psb_bag_range(bag_t *b, bag_elem_t lo, bag_elem_t hi,
+                   bool (*fun)(bag_elem_t, void *), void *ctx)
+{
+    psb_bag_t *bag = (psb_bag_t *) b;
+    const psb_node_t *root = bag->root, *node = NULL;
+    bag_key_t lo_key = lo ? BAG_KEY(bag, lo) : 0;
+    bag_key_t hi_key = hi ? BAG_KEY(bag, hi) : 0;
+
+    while (root) {
+        BAG_VISIT(bag);
+        if (lo && BAG_KEY_CMP(bag, root->key, root->elem, lo_key, lo) < 0) {
+            root = root->right;
+        } else {
+            node = root;
+            root = root->left;
+        }
+    }
+
+    while (node) {
+        if (hi && BAG_KEY_CMP(bag, node->key, node->elem, hi_key, hi) >= 0)
+            break;
+        if (! (*fun)(node->elem, ctx))
+            break;
+        if (node->right) {
+            node = node->right;
+            while (node->left)  node = node->left;
+        } else {
+            while (node->parent && node == node->parent->right)
+                node = node->parent;
+            node = node->parent;
+        }
+    }
+    BAG_END_SEARCH(bag);
+}
+
 /******************************************************************************
  *  Definitions of helper functions -- see above for documentation.           *
  ******************************************************************************/
 
-void psb_destroy(psb_node_t *root)
+void psb_traverse(const psb_node_t *root,
+                  void (*fun)(bag_elem_t, void *), void *ctx)
 {
-    if (root) {
-        psb_destroy(root->left);
-        psb_destroy(root->right);
-        free(root);
+    const psb_node_t *node = root;
+
+    if (! node)  return;
+    while (node->left)  node = node->left;
+
+    while (node) {
+        (*fun)(node->elem, ctx);
+        if (node->right) {
+            /* The successor is the smallest node in the right subtree. */
+            node = node->right;
+            while (node->left)  node = node->left;
+        } else {
+            /* Otherwise, it is the first ancestor reached from its left
+             * subtree (stopping at the root of the traversal). */
+            while (node != root && node == node->parent->right)
+                node = node->parent;
+            node = node == root ? NULL : node->parent;
+        }
     }
 }
 
-void psb_traverse(const psb_node_t *root, void (*fun)(bag_elem_t))
+/* In order to perform a rotation once the element is found, the link that
+ * points to its parent is remembered on the way down: rotating through that
+ * link updates the grandparent (or the root of the bag) automatically.
+ */
+bag_elem_t psb_contains(psb_bag_t *bag, bag_elem_t elem)
 {
-    if (root) {
-        psb_traverse(root->left, fun);
-        (*fun)(root->elem);
-        psb_traverse(root->right, fun);
+    psb_node_t **root = &bag->root;
+    psb_node_t **parent = NULL;
+    bag_key_t key = BAG_KEY(bag, elem);
+    int result;
+
+    while (*root) {
+        BAG_VISIT(bag);
+        result = BAG_KEY_CMP(bag, key, elem, (*root)->key, (*root)->elem);
+        if (result == 0) {
+            bag_elem_t found = (*root)->elem;
+            /* Perform a rotation to move the element found closer to the
+             * root (unless it is already the root). */
+            if (parent && root == &(*parent)->right)
+                psb_rotate_to_the_left(parent);
+            else if (parent)
+                psb_rotate_to_the_right(parent);
+            if (parent)  BAG_COUNT(bag, rotations, 1);
+            return found;
+        }
+        parent = root;
+        root = result < 0 ? &(*root)->left : &(*root)->right;
     }
+    return NULL;
 }
 
-/* In order to perform a rotation within the contains function,
- * information on the parent, and which child (left or right),
- * need to be passed into the function. In order to 'catch' the
- * rotation properly, information on the grandparent and which
- * child the element is found in also need to be passed recursively.
- * In the event that the element is at the second level, the rotation
- * needs to be 'caught' by the root of the bag, which is why the bag
- * is passed in as a parameter.
- */
-bag_elem_t psb_contains(const psb_node_t *root, bag_elem_t elem,
-                        int (*cmp)(bag_elem_t, bag_elem_t),
-                        int is_right, psb_node_t *parent,
-                        int is_parent_right,
-                        psb_node_t *grandparent,
-                        struct bag *bag)
+bag_elem_t psb_insert(psb_bag_t *bag, bag_elem_t elem)
 {
-    if (! root)
+    psb_node_t **root = &bag->root;
+    psb_node_t *parent = NULL;
+    bag_key_t key = BAG_KEY(bag, elem);
+
+    /* Walk down to the empty subtree where elem belongs; duplicates go into
+     * the left subtree.  The tree does not get rebalanced at this point. */
+    while (*root) {
+        BAG_VISIT(bag);
+        parent = *root;
+        if (BAG_KEY_CMP(bag, key, elem, parent->key, parent->elem) > 0)
+            root = &parent->right;
+        else
+            root = &parent->left;
+    }
+
+    if (! (*root = psb_node_create(key, elem, parent, &bag->nodes)))
         return NULL;
-    else if ((*cmp)(elem, root->elem) < 0)
-        return psb_contains(root->left, elem, cmp, LEFT_CHILD,
-                            root, is_right, parent, bag);
-    else if ((*cmp)(elem, root->elem) > 0)
-        return psb_contains(root->right, elem, cmp, RIGHT_CHILD,
-                            root, is_right, parent, bag);
-    else /* ((*cmp)(elem, root->elem) == 0) */
-        // Have the grandparent point to the root
-        if (is_parent_right == RIGHT_CHILD){
-            grandparent->right = root;
-        }else if(! is_parent_right){ //parent is a left child
-            grandparent->left = root;
-        /* The root is at the second level and has no grandparent.
-           the element must become the root of the entire tree.
-           Also handles the case of the element being at the root*/
-        }else bag->root = root;
-        /* Perform a rotation to move the element found closer
-           to the root */
-        if (is_right == RIGHT_CHILD) psb_rotate_to_the_left(&parent);
-        // If root is a left child
-        else if (! is_right) psb_rotate_to_the_right(&parent);
-        return root->elem;
+    BAG_COUNT(bag, node_allocs, 1);
+    return elem;
 }
 
-bag_elem_t psb_insert(psb_node_t **root, bag_elem_t elem,
-                      int (*cmp)(bag_elem_t, bag_elem_t))
+/* A search that does not find the probe follows the same links that
+ * psb_insert would (no element is equal to it), so the new node goes where
+ * the search ended.  It is allocated before the element is made, so that
+ * nothing can fail once make has been called.
+ */
+bag_elem_t psb_find_or_insert(psb_bag_t *bag, bag_elem_t probe,
+                              bag_elem_t (*make)(bag_elem_t, void *),
+                              void *ctx)
 {
-    bag_elem_t inserted;
+    psb_node_t **root = &bag->root;
+    psb_node_t **parent = NULL;
+    psb_node_t *node;
+    bag_key_t key = BAG_KEY(bag, probe);
+    bag_elem_t found;
+    int result;
+
+    while (*root) {
+        BAG_VISIT(bag);
+        result = BAG_KEY_CMP(bag, key, probe, (*root)->key, (*root)->elem);
+        if (result == 0) {
+            found = (*root)->elem;
+            if (parent && root == &(*parent)->right)
+                psb_rotate_to_the_left(parent);
+            else if (parent)
+                psb_rotate_to_the_right(parent);
+            if (parent)  BAG_COUNT(bag, rotations, 1);
+            return found;
+        }
+        parent = root;
+        root = result < 0 ? &(*root)->left : &(*root)->right;
+    }
 
-    if (! *root) {
-        if ((*root = psb_node_create(elem)))
-            inserted = (*root)->elem;
-        else
-            inserted = NULL;
-    } else if ((*cmp)(elem, (*root)->elem) < 0) {
-        (inserted = psb_insert(&(*root)->left, elem, cmp));
-            /* The tree does not get rebalanced at this point */
-    } else if ((*cmp)(elem, (*root)->elem) > 0) {
-        (inserted = psb_insert(&(*root)->right, elem, cmp));
-    } else { /* ((*cmp)(elem, (*root)->elem) == 0) */
-        /* Insert into the left subtree */
-        inserted = psb_insert(&(*root)->left, elem, cmp);
+    if (! (node = psb_node_create(key, NULL, parent ? *parent : NULL,
+                                  &bag->nodes)))
+        return NULL;
+    if (! (node->elem = (*make)(probe, ctx))) {
+        slab_free(&bag->nodes, node);
+        return NULL;
     }
-    return inserted;
+    *root = node;
+    bag->size++;
+    BAG_COUNT(bag, node_allocs, 1);
+    return node->elem;
 }
 
-bag_elem_t psb_remove(psb_node_t **root, bag_elem_t elem,
-                      int (*cmp)(bag_elem_t, bag_elem_t))
+bag_elem_t psb_remove(psb_bag_t *bag, bag_elem_t elem)
 {
+    psb_node_t **root = &bag->root;
     bag_elem_t removed;
+    bag_key_t key = BAG_KEY(bag, elem);
+    int result;
+
+    /* Walk down to the node that stores elem; the subtrees do not get
+     * rebalanced. */
+    while (*root && (BAG_VISIT(bag),
+                     result = BAG_KEY_CMP(bag, key, elem, (*root)->key,
+                                          (*root)->elem)) != 0)
+        root = result < 0 ? &(*root)->left : &(*root)->right;
+    if (! *root)
+        return NULL;
 
-    if (! *root) {
-        removed = NULL;
-    } else if ((*cmp)(elem, (*root)->elem) < 0) {
-        (removed = psb_remove(&(*root)->left, elem, cmp));
-            /* The subtree does not get rebalanced */
-    } else if ((*cmp)(elem, (*root)->elem) > 0) {
-        (removed = psb_remove(&(*root)->right, elem, cmp));
-            /* The subtree does not get rebalanced */
-    } else { /* ((*cmp)(elem, (*root)->elem) == 0) */
-        removed = (*root)->elem;
-        if ((*root)->left && (*root)->right) {
-            /* Remove from the left subtree */
-            (*root)->elem = psb_remove_max(&(*root)->left);
-        } else {
-            /* Remove *root. */
-            psb_node_t *old = *root;
-            *root = (*root)->left ? (*root)->left : (*root)->right;
-            free(old);
-        }
-    }
-
+    removed = (*root)->elem;
+    if ((*root)->left && (*root)->right)
+        /* Replace the element with the largest one in the left subtree. */
+        psb_remove_max(&(*root)->left, *root, &bag->nodes);
+    else
+        psb_unlink(root, &bag->nodes);
     return removed;
 }
 
-bag_elem_t psb_remove_min(psb_node_t **root)
+size_t psb_height(const psb_node_t *root)
 {
-    bag_elem_t min;
-
-    if ((*root)->left) {
-        /* *root is not the minimum, keep going */
-        min = psb_remove_min(&(*root)->left);
-    } else {
-        /* Remove *root. */
-        psb_node_t *old = *root;
-        min = (*root)->elem;
-        *root = (*root)->right;
-        free(old);
+    const psb_node_t *node = root;
+    size_t depth = 1, height = 0;
+
+    if (! node)  return 0;
+
+    /* Visit the nodes in preorder, keeping track of the depth. */
+    for (;;) {
+        if (depth > height)  height = depth;
+        if (node->left) {
+            node = node->left;
+            depth++;
+        } else if (node->right) {
+            node = node->right;
+            depth++;
+        } else {
+            /* Climb until an ancestor reached from its left subtree has a
+             * right subtree (stopping at the root of the walk). */
+            while (node != root &&
+                   (node == node->parent->right || ! node->parent->right)) {
+                node = node->parent;
+                depth--;
+            }
+            if (node == root)  return height;
+            node = node->parent->right;
+        }
     }
+}
 
-    return min;
+void psb_remove_max(psb_node_t **root, psb_node_t *dest, slab_t *nodes)
+{
+    while ((*root)->right)  root = &(*root)->right;
+    dest->key = (*root)->key;
+    dest->elem = (*root)->elem;
+    psb_unlink(root, nodes);
 }
 
-bag_elem_t psb_remove_max(psb_node_t **root)
+void psb_unlink(psb_node_t **link, slab_t *nodes)
 {
-    bag_elem_t max;
-
-    if ((*root)->right) {
-        /* *root is not the maximum, keep going and rebalance if necessary. */
-        max = psb_remove_max(&(*root)->right);
-
-    } else {
-        /* Remove *root. */
-        psb_node_t *old = *root;
-        max = (*root)->elem;
-        *root = (*root)->left;
-        free(old);
-    }
+    psb_node_t *old = *link;
+    psb_node_t *child = old->left ? old->left : old->right;
 
-    return max;
+    if (child)  child->parent = old->parent;
+    *link = child;
+    slab_free(nodes, old);
 }
 
 void psb_rotate_to_the_left(psb_node_t **parent)
@@ -402,6 +659,11 @@ void psb_rotate_to_the_left(psb_node_t **parent)
     (*parent)->right = child->left;
     child->left = *parent;
     *parent = child;
+
+    /* Update parent links. */
+    child->parent = child->left->parent;
+    child->left->parent = child;
+    if (child->left->right)  child->left->right->parent = child->left;
 }
 
 void psb_rotate_to_the_right(psb_node_t **parent)
@@ -411,16 +673,46 @@ void psb_rotate_to_the_right(psb_node_t **parent)
     (*parent)->left = child->right;
     child->right = *parent;
     *parent = child;
+
+    /* Update parent links. */
+    child->parent = child->right->parent;
+    child->right->parent = child;
+    if (child->right->left)  child->right->left->parent = child->right;
 }
 
+/* As in avl_build, the nodes are allocated in order of their elements, and the
+ * recursion is only as deep as the (balanced) tree.  Sorted input is the worst
+ * case for psb_insert, which would build a path n nodes long instead.
+ */
+bool psb_build(psb_bag_t *bag, psb_node_t **root, psb_node_t *parent,
+               const bag_elem_t elems[], size_t n)
+{
+    size_t mid = n / 2;
+    psb_node_t *left;
+
+    *root = NULL;
+    if (n == 0)  return true;
+
+    if (! psb_build(bag, &left, NULL, elems, mid))  return false;
+    if (! (*root = psb_node_create(BAG_KEY(bag, elems[mid]), elems[mid],
+                                   parent, &bag->nodes)))
+        return false;
+    (*root)->left = left;
+    if (left)  left->parent = *root;
+    return psb_build(bag, &(*root)->right, *root, elems + mid + 1,
+                     n - mid - 1);
+}
 
-psb_node_t *psb_node_create(bag_elem_t elem)
+psb_node_t *psb_node_create(bag_key_t key, bag_elem_t elem,
+                            psb_node_t *parent, slab_t *nodes)
 {
-    psb_node_t *node = malloc(sizeof(psb_node_t));
+    psb_node_t *node = slab_alloc(nodes);
     if (node) {
+        node->key = key;
         node->elem = elem;
         node->left = NULL;
         node->right = NULL;
+        node->parent = parent;
     }
     return node;
 }
@@ -459,10 +751,10 @@ void psb_print(const psb_node_t *root, int depth, int indent,
     }
 }
 
-/* FUNCTION bag_print
+/* FUNCTION psb_bag_print
  *    Print every value in a bag to stdout, in a "sideways tree" layout.
  * Parameters and preconditions:
- *    bag != NULL: the bag
+ *    b != NULL: a bag created by psb_bag_ops
  *    print != NULL: the function to use to print each value in the bag
  * Return value:  none
  * Side-effects:
@@ -470,8 +762,9 @@ void psb_print(const psb_node_t *root, int depth, int indent,
  *    layout (with right subtrees above and left subtrees below, and indentation
  *    to indicate each value's depth in the tree)
  */
-void bag_print(const bag_t *bag, int indent, void (*print)(bag_elem_t))
+void psb_bag_print(const bag_t *b, int indent, void (*print)(bag_elem_t))
 {
+    const psb_bag_t *bag = (const psb_bag_t *) b;
     psb_print(bag->root, 1, indent, print);
 }
 
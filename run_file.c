@@ -0,0 +1,326 @@
+/* FILE run_file.c
+ *    Implementation of the run_file functions.  Each run being merged is read
+ *    through its own buffer, one word at a time; the pages of the smallest
+ *    word are copied out of every run that has it, in the order of the runs,
+ *    without ever holding a whole page list in memory.
+ */
+
+/******************************************************************************
+ *  Types and Constants.                                                      *
+ ******************************************************************************/
+
+#include <string.h>
+
+#include "run_file.h"
+#include "file_util.h"
+
+/* CONSTANT RUN_MAX_WORD
+ *    Longest word in a run: a word never runs past the end of a line.
+ */
+#define RUN_MAX_WORD (LINE_LENGTH + 1)
+
+/* TYPE run_reader_t -- A run being read for a merge. */
+typedef struct run_reader {
+    FILE *file;                 /* the run                                */
+    size_t pos;                 /* next byte of buf to read               */
+    size_t len;                 /* number of bytes read into buf          */
+    bool failed;                /* true if the run could not be read      */
+    size_t word_len;            /* length of the current word (0 at end)  */
+    char word[RUN_MAX_WORD];    /* the current word (its pages are next)  */
+    unsigned char buf[RUN_BUFFER_SIZE]; /* the bytes read from the run    */
+} run_reader_t;
+
+/******************************************************************************
+ *  Declarations of helper functions -- including full documentation.         *
+ ******************************************************************************/
+
+/* FUNCTION run_put_number
+ *    Add a number to a run, with 7 bits per byte and the high bit of each
+ *    byte set when more bytes follow.
+ * Parameters and preconditions:
+ *    run != NULL: a writer for the run
+ *    n: the number to add
+ * Return value:  none
+ * Side-effects:
+ *    the bytes of n have been added to the writer
+ */
+static
+void run_put_number(writer_t *run, size_t n);
+
+/* FUNCTION run_read_byte
+ *    Read the next byte of a run, refilling the buffer of its reader when it
+ *    is used up.
+ * Parameters and preconditions:
+ *    reader != NULL: a reader
+ *    byte != NULL: where to store the byte
+ * Return value:
+ *    true if a byte was read; false at the end of the run or if the run
+ *    cannot be read (which sets reader->failed)
+ * Side-effects:
+ *    *byte is set to the byte read; the reader has moved past it
+ */
+static
+bool run_read_byte(run_reader_t *reader, unsigned char *byte);
+
+/* FUNCTION run_read_number
+ *    Read a number written by run_put_number.
+ * Parameters and preconditions:
+ *    reader != NULL: a reader
+ *    n != NULL: where to store the number
+ * Return value:
+ *    true if a number was read; false at the end of the run (or if the run
+ *    cannot be read, which sets reader->failed)
+ * Side-effects:
+ *    *n is set to the number read; the reader has moved past it
+ */
+static
+bool run_read_number(run_reader_t *reader, size_t *n);
+
+/* FUNCTION run_read_word
+ *    Move a reader to the next word of its run.
+ * Parameters and preconditions:
+ *    reader != NULL: a reader at the start of a word (or of the run)
+ * Return value:  none
+ * Side-effects:
+ *    the next word of the run has been read into reader->word and its length
+ *    stored in reader->word_len -- or 0 at the end of the run (or if the run
+ *    cannot be read or is damaged, which also sets reader->failed)
+ */
+static
+void run_read_word(run_reader_t *reader);
+
+/* FUNCTION run_merge_group
+ *    Merge runs, either into a longer run or into the lines of an index.
+ * Parameters and preconditions:
+ *    runs != NULL: n runs, in the order of the text they come from
+ *    0 < n <= RUN_MERGE_WAYS: the number of runs
+ *    out != NULL: the writer to add the merged words and pages to
+ *    as_run: true to write a run; false to write lines of an index
+ * Return value:
+ *    true if every run was read to the end; false in case of error with
+ *    reading or memory allocation
+ * Side-effects:
+ *    the merged words have been added to out; the runs have been closed
+ */
+static
+bool run_merge_group(FILE *runs[], size_t n, writer_t *out, bool as_run);
+
+/******************************************************************************
+ *  Definitions of "public" functions -- see header file for documentation.   *
+ ******************************************************************************/
+
+void run_put(writer_t *run, const char *word, size_t len,
+             const page_list_t *pages)
+{
+    const unsigned char *bytes;
+    size_t pages_len;
+
+    run_put_number(run, len);
+    writer_put(run, word, len);
+    bytes = page_list_bytes(pages, &pages_len);
+    writer_put(run, (const char *) bytes, pages_len);
+    writer_put_char(run, 0);
+}
+
+FILE *run_combine(FILE *runs[], size_t n)
+{
+    writer_t writer;
+    FILE *merged = tmpfile();
+    size_t i;
+    bool ok;
+
+    if (! merged) {
+        for (i = 0; i < n; i++)  fclose(runs[i]);
+        return NULL;
+    }
+    writer_init(&writer, merged);
+    ok = run_merge_group(runs, n, &writer, true);
+    if (! writer_flush(&writer) || ! ok) {
+        fclose(merged);
+        return NULL;
+    }
+    return merged;
+}
+
+/* Runs are merged in groups of consecutive runs, so a merged run still comes
+ * from one part of the text, after the parts of the runs before it.
+ */
+bool run_merge(FILE *runs[], size_t n, FILE *out)
+{
+    writer_t writer;
+    size_t i, j, m, group;
+    bool ok = true;
+
+    while (n > RUN_MERGE_WAYS) {
+        for (i = m = 0; i < n; i += group) {
+            group = n - i < RUN_MERGE_WAYS ? n - i : RUN_MERGE_WAYS;
+            if (! ok) {
+                for (j = 0; j < group; j++)  fclose(runs[i + j]);
+            } else if (group == 1) {
+                runs[m++] = runs[i];
+            } else if (! (runs[m] = run_combine(runs + i, group))) {
+                ok = false;
+            } else {
+                m++;
+            }
+        }
+        if (! ok) {
+            while (m > 0)  fclose(runs[--m]);
+            return false;
+        }
+        n = m;
+    }
+
+    writer_init(&writer, out);
+    ok = run_merge_group(runs, n, &writer, false);
+    return writer_flush(&writer) && ok;
+}
+
+/******************************************************************************
+ *  Definitions of helper functions -- see above for documentation.           *
+ ******************************************************************************/
+
+void run_put_number(writer_t *run, size_t n)
+{
+    while (n >= 0x80U) {
+        writer_put_char(run, (char) ((n & 0x7FU) | 0x80U));
+        n >>= 7;
+    }
+    writer_put_char(run, (char) n);
+}
+
+bool run_read_byte(run_reader_t *reader, unsigned char *byte)
+{
+    if (reader->pos == reader->len) {
+        reader->pos = 0;
+        reader->len = fread(reader->buf, 1, RUN_BUFFER_SIZE, reader->file);
+        if (reader->len == 0) {
+            if (ferror(reader->file))  reader->failed = true;
+            return false;
+        }
+    }
+    *byte = reader->buf[reader->pos++];
+    return true;
+}
+
+bool run_read_number(run_reader_t *reader, size_t *n)
+{
+    unsigned shift = 0;
+    unsigned char byte;
+
+    *n = 0;
+    do {
+        if (! run_read_byte(reader, &byte)) {
+            // the end of a run can only come between two words
+            if (shift > 0)  reader->failed = true;
+            return false;
+        }
+        if (shift < sizeof(size_t) * 8)
+            *n |= (size_t) (byte & 0x7FU) << shift;
+        shift += 7;
+    } while (byte & 0x80U);
+    return true;
+}
+
+void run_read_word(run_reader_t *reader)
+{
+    size_t len, i;
+    unsigned char c;
+
+    reader->word_len = 0;
+    if (! run_read_number(reader, &len))  return;
+    if (len == 0 || len > RUN_MAX_WORD) {
+        reader->failed = true;
+        return;
+    }
+    for (i = 0; i < len; i++) {
+        if (! run_read_byte(reader, &c)) {
+            reader->failed = true;
+            return;
+        }
+        reader->word[i] = (char) c;
+    }
+    reader->word_len = len;
+}
+
+bool run_merge_group(FILE *runs[], size_t n, writer_t *out, bool as_run)
+{
+    run_reader_t *readers[RUN_MERGE_WAYS];
+    run_reader_t *first;
+    size_t i, j, delta;
+    unsigned page, last;
+    bool ok = true;
+    int result;
+
+    for (i = 0; i < n; i++) {
+        if (! (readers[i] = malloc(sizeof(run_reader_t)))) {
+            while (i > 0)  free(readers[--i]);
+            for (i = 0; i < n; i++)  fclose(runs[i]);
+            return false;
+        }
+        readers[i]->file = runs[i];
+        readers[i]->pos = readers[i]->len = 0;
+        readers[i]->failed = false;
+        rewind(runs[i]);
+        run_read_word(readers[i]);
+    }
+
+    for (;;) {
+        /* Find the smallest word, in the earliest run that has it. */
+        first = NULL;
+        for (i = 0; i < n; i++) {
+            if (readers[i]->word_len == 0)  continue;
+            if (first) {
+                result = memcmp(readers[i]->word, first->word,
+                                readers[i]->word_len < first->word_len ?
+                                readers[i]->word_len : first->word_len);
+                if (result == 0)
+                    result = readers[i]->word_len < first->word_len ? -1 :
+                             readers[i]->word_len > first->word_len;
+            }
+            if (! first || result < 0) {
+                first = readers[i];
+                j = i;
+            }
+        }
+        if (! first)  break;
+
+        if (as_run)
+            run_put_number(out, first->word_len);
+        writer_put(out, first->word, first->word_len);
+        if (! as_run)
+            writer_put(out, ": ", 2);
+
+        /* Copy the pages of the word from every run that has it, in order,
+         * and move those runs on to their next word. */
+        last = 0;
+        for (i = j; i < n; i++) {
+            if (readers[i] != first &&
+                (readers[i]->word_len != first->word_len ||
+                 memcmp(readers[i]->word, first->word, first->word_len)))
+                continue;
+            page = 0;
+            while (run_read_number(readers[i], &delta) && delta > 0) {
+                page += (unsigned) delta;
+                if (page <= last)  continue;
+                if (as_run) {
+                    run_put_number(out, page - last);
+                } else {
+                    if (last > 0)  writer_put(out, ", ", 2);
+                    writer_put_uint(out, page);
+                }
+                last = page;
+            }
+            if (readers[i] != first)  run_read_word(readers[i]);
+        }
+        writer_put_char(out, as_run ? 0 : '\n');
+        run_read_word(first);
+    }
+
+    for (i = 0; i < n; i++) {
+        if (readers[i]->failed)  ok = false;
+        fclose(readers[i]->file);
+        free(readers[i]);
+    }
+    return ok;
+}
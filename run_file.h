@@ -0,0 +1,93 @@
+/* FILE run_file.h
+ *    Declarations of functions to spill words and their pages to "runs" --
+ *    temporary files of words in increasing order -- and to merge the runs
+ *    of a whole text file into its index, streaming through them so that the
+ *    memory used does not depend on the size of the runs or their number.
+ *
+ *    In a run, each word is stored as its length (7 bits per byte, as in a
+ *    page list), its characters, its pages encoded as in a page list, then a
+ *    0 byte (the difference between two pages is never 0).
+ */
+#ifndef RUN_FILE_H
+#define RUN_FILE_H
+
+/******************************************************************************
+ *  Types and Constants.                                                      *
+ ******************************************************************************/
+
+#include <stdbool.h> /* for type bool   */
+#include <stdio.h>   /* for type FILE   */
+#include <stdlib.h>  /* for type size_t */
+
+#include "page_list.h"
+#include "writer.h"
+
+/* CONSTANT RUN_MERGE_WAYS
+ *    Largest number of runs merged at once.  More runs are first merged in
+ *    groups of this many into longer runs, so that only this many read
+ *    buffers are ever needed.
+ */
+#define RUN_MERGE_WAYS 16
+
+/* CONSTANT RUN_BUFFER_SIZE -- Size of the read buffer of each run merged. */
+#define RUN_BUFFER_SIZE 65536U
+
+/******************************************************************************
+ *  Function declarations -- with full documentation.                         *
+ ******************************************************************************/
+
+/* FUNCTION run_put
+ *    Add a word and its pages at the end of a run.
+ * Parameters and preconditions:
+ *    run != NULL: a writer for the run (a temporary file open for reading and
+ *                 writing in binary mode)
+ *    word != NULL: the word (not necessarily null-terminated), which comes
+ *                  after every word already in the run
+ *    0 < len <= LINE_LENGTH + 1: the number of characters in word (no word
+ *                                of a text file is longer)
+ *    pages != NULL: the pages of word
+ * Return value:  none
+ * Side-effects:
+ *    the word and its pages have been added to the writer
+ */
+void run_put(writer_t *run, const char *word, size_t len,
+             const page_list_t *pages);
+
+/* FUNCTION run_combine
+ *    Merge runs into one longer run, in the same way as run_merge, so that
+ *    fewer runs need to be kept open.
+ * Parameters and preconditions:
+ *    runs != NULL: n runs, each written to the end and flushed, from
+ *                  consecutive parts of a text file, in order
+ *    0 < n <= RUN_MERGE_WAYS: the number of runs
+ * Return value:
+ *    the merged run, written to the end and flushed (a temporary file,
+ *    deleted when it is closed); NULL if the temporary file could not be
+ *    created, or in case of error with reading, writing or memory allocation
+ * Side-effects:
+ *    the runs have been closed
+ */
+FILE *run_combine(FILE *runs[], size_t n);
+
+/* FUNCTION run_merge
+ *    Merge runs into an index and write it in the same form as
+ *    word_index_write.  The runs must come from consecutive parts of a text
+ *    file, in order, so that every page of a word in one run comes no earlier
+ *    than its pages in the runs before it; the pages of a word in several
+ *    runs are joined (without repeating a page where two runs meet).
+ * Parameters and preconditions:
+ *    runs != NULL: n runs, each written to the end and flushed
+ *    n > 0: the number of runs
+ *    out != NULL: a file open for writing
+ * Return value:
+ *    true if the whole index was handed to out; false if a temporary file
+ *    could not be created, or in case of error with reading, writing or
+ *    memory allocation
+ * Side-effects:
+ *    one line of the form "word: page, page, ..." has been written to out for
+ *    every word in the runs; every run has been closed (and the runs[] entries
+ *    have been changed)
+ */
+bool run_merge(FILE *runs[], size_t n, FILE *out);
+
+#endif/*RUN_FILE_H*/
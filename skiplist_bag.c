@@ -0,0 +1,655 @@
+/* FILE skiplist_bag.c
+ *    Implementation of the bag ADT using a lock-free skip list, so that
+ *    several threads can add elements to one bag and search it at the same
+ *    time without any lock.
+ *
+ *    Every element is in the list at level 0, in order; each node is also in
+ *    the lists of the levels above, up to a random height (each level holds
+ *    about half the nodes of the level below), so a search skips most of the
+ *    nodes.  A node is linked into each level with one compare-and-swap on the
+ *    link of its predecessor, retried after a new search if another thread
+ *    changed that link first; a node is in the bag once it is linked at level
+ *    0, and the levels above only speed up the searches.  Nodes are never
+ *    unlinked while other threads may be using the bag, so a thread that
+ *    holds a node can always follow its links.
+ *
+ *    bag_contains, bag_insert, bag_find_or_insert, bag_traverse and bag_size
+ *    may be called by any number of threads at once.  bag_contains and
+ *    bag_traverse never wait: an element is seen once it has been added, and
+ *    bag_traverse sees the elements added before it passes their place.
+ *    bag_find_or_insert links a node for the new element before it calls
+ *    make (so that two threads can never both make an element equal to the
+ *    same probe); until make returns, that node is "pending" and invisible to
+ *    searches, and only an insertion that has to compare another element
+ *    with it waits for it.  bag_remove, bag_stats and bag_destroy must not be
+ *    called while another thread uses the bag (and the counts kept with
+ *    BAG_STATS are only exact for a bag used by one thread).
+ */
+
+/******************************************************************************
+ *  Types and Constants.                                                      *
+ ******************************************************************************/
+
+/* Ask for sched_yield, to give up the processor while waiting. */
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sched.h>
+#define HAVE_SCHED_YIELD 1
+#endif
+
+#include "bag_impl.h"
+
+/* MACROS SKIP_LOAD, SKIP_STORE, SKIP_CAS, SKIP_ADD
+ *    Atomic operations on the links, elements and counts of a skip list (with
+ *    the GCC builtins, also provided by clang).  Without them, they are plain
+ *    loads and stores, and a bag must only be used by one thread at a time.
+ *    SKIP_LOAD(p): the value of *p, seeing everything written before it was
+ *        stored
+ *    SKIP_STORE(p, v): store v in *p, after everything written before
+ *    SKIP_CAS(p, old, v): if *p is old, store v in *p and return true;
+ *        otherwise set old (an lvalue) to *p and return false
+ *    SKIP_ADD(p, n): add n to *p and return the old value of *p
+ */
+#if defined(__GNUC__)
+#define SKIP_LOAD(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define SKIP_STORE(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define SKIP_CAS(p, old, v) \
+    __atomic_compare_exchange_n((p), &(old), (v), false, \
+                                __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+#define SKIP_ADD(p, n) __atomic_fetch_add((p), (n), __ATOMIC_RELAXED)
+#else
+#define SKIP_LOAD(p) (*(p))
+#define SKIP_STORE(p, v) (*(p) = (v))
+#define SKIP_CAS(p, old, v) \
+    (*(p) == (old) ? (*(p) = (v), true) : ((old) = *(p), false))
+#define SKIP_ADD(p, n) ((*(p) += (n)) - (n))
+#endif
+
+/* CONSTANT SKIP_MAX_LEVEL
+ *    Largest number of levels a node can be in -- enough for about 2^32
+ *    elements before the top level holds more than a few nodes.
+ */
+#define SKIP_MAX_LEVEL 32
+
+/* CONSTANT SKIP_ABSENT
+ *    Result of skip_compare for a node without an element to compare with.
+ */
+#define SKIP_ABSENT 2
+
+/* MACRO SKIP_ABANDONED
+ *    The element of a node whose make failed in bag_find_or_insert: the node
+ *    stays linked at level 0 (it cannot be unlinked safely) but is not in the
+ *    bag, and searches step over it.
+ */
+#define SKIP_ABANDONED ((bag_elem_t) &skip_abandoned)
+
+/* TYPE skip_node_t
+ *    A node in a skip list.  Its element is NULL while the node is pending.
+ */
+typedef struct skip_node {
+    bag_key_t key;               /* the key of elem (0 if bag has no key) */
+    bag_elem_t elem;             /* the element stored in this node       */
+    int height;                  /* number of levels this node is in      */
+    struct skip_node *next[];    /* next node at each level, or NULL      */
+} skip_node_t;
+
+/* TYPE skip_bag_t
+ *    A bag stored in a skip list.
+ */
+typedef struct skip_bag {
+    bag_t base; /* the part shared by all bags (must come first) */
+    size_t size; /* number of elements in this bag */
+    int levels; /* number of levels any node has been linked into (only
+                 * for bag_stats: it is raised after the node is linked) */
+    uint64_t seed; /* state of the random heights of new nodes */
+    skip_node_t *head; /* node before the first one of every level */
+    int (*cmp)(bag_elem_t, bag_elem_t); /* function to compare elements */
+    bag_key_t (*key)(bag_elem_t); /* key function for cmp, or NULL */
+#ifdef BAG_STATS
+    bag_counters_t counters; /* work done by this bag so far */
+#endif
+} skip_bag_t;
+
+/* CONSTANT skip_abandoned -- The object that SKIP_ABANDONED points to. */
+static const char skip_abandoned = 0;
+
+/******************************************************************************
+ *  Declarations of helper functions -- including full documentation.         *
+ ******************************************************************************/
+
+/* FUNCTION skip_search
+ *    Find where an element goes in a skip list: at each level, the last node
+ *    whose element is smaller and the node after it.  Nodes without an
+ *    element (pending, unless wait is true, or abandoned) are stepped over as
+ *    if they were not there.
+ * Parameters and preconditions:
+ *    bag != NULL: the bag to search
+ *    key: the key of elem
+ *    elem != NULL: the element to look for
+ *    wait: true to wait for pending nodes that elem has to be compared with
+ *          (for insertions); false to step over them (for searches)
+ *    preds != NULL: where to store the last node before elem at each level
+ *          (bag->head if there is none), for all SKIP_MAX_LEVEL levels
+ *    succs != NULL: where to store the node after preds[i] at each level i
+ *          (NULL at the end of the level)
+ * Return value:
+ *    true if succs[0] stores an element equal to elem; false otherwise
+ * Side-effects:
+ *    preds and succs have been filled in
+ */
+static
+bool skip_search(skip_bag_t *bag, bag_key_t key, bag_elem_t elem, bool wait,
+                 skip_node_t *preds[], skip_node_t *succs[]);
+
+/* FUNCTION skip_compare
+ *    Compare an element with the element of a node.
+ * Parameters and preconditions:
+ *    bag != NULL: the bag the node belongs to
+ *    key: the key of elem
+ *    elem != NULL: the element to compare
+ *    node != NULL: a node of bag (not its head)
+ *    wait: true to wait until a pending node has its element, when the keys
+ *          do not settle the comparison
+ * Return value:
+ *    < 0, 0 or > 0 depending on how elem compares to the node's element;
+ *    SKIP_ABSENT if the node was abandoned, or is pending and wait is false
+ *    (and the keys are equal)
+ * Side-effects:  none
+ */
+static
+int skip_compare(skip_bag_t *bag, bag_key_t key, bag_elem_t elem,
+                 const skip_node_t *node, bool wait);
+
+/* FUNCTION skip_link
+ *    Link a node that is already in the list at level 0 into the levels above,
+ *    up to its height.
+ * Parameters and preconditions:
+ *    bag != NULL: the bag the node belongs to
+ *    node != NULL: a node linked at level 0, whose element is set
+ *    preds, succs != NULL: the result of a search for node's element, done
+ *          before node was linked at level 0
+ * Return value:  none
+ * Side-effects:
+ *    node is in every level below its height; bag->levels has been raised to
+ *    node's height if it was lower; preds and succs have been changed
+ */
+static
+void skip_link(skip_bag_t *bag, skip_node_t *node,
+               skip_node_t *preds[], skip_node_t *succs[]);
+
+/* FUNCTION skip_unlink
+ *    Take a node out of one level of a skip list (by one thread, with no other
+ *    thread using the bag).
+ * Parameters and preconditions:
+ *    bag != NULL: the bag the node belongs to
+ *    pred != NULL: the last node before node's element at this level, found
+ *          by skip_search (node itself or other nodes with equal elements
+ *          come after it)
+ *    node != NULL: the node to take out
+ *    level < node->height: the level to take it out of
+ * Return value:  none
+ * Side-effects:
+ *    the link of the node before node at this level skips node
+ */
+static
+void skip_unlink(skip_bag_t *bag, skip_node_t *pred, skip_node_t *node,
+                 int level);
+
+/* FUNCTION skip_height
+ *    Pick the height of a new node: 1, 2, 3, ... with probability 1/2, 1/4,
+ *    1/8, ..., from the next number of a random sequence shared by the
+ *    threads (a "splitmix" generator, whose state only needs one atomic add).
+ * Parameters and preconditions:
+ *    bag != NULL: the bag the node is for
+ * Return value:
+ *    a number of levels, from 1 to SKIP_MAX_LEVEL
+ * Side-effects:
+ *    the state of the sequence has moved on
+ */
+static
+int skip_height(skip_bag_t *bag);
+
+/* FUNCTION skip_wait
+ *    Give up the processor for a while, to let a thread with a pending node
+ *    finish it.
+ * Parameters and preconditions:  none
+ * Return value:  none
+ * Side-effects:  the calling thread may have been descheduled
+ */
+static
+void skip_wait(void);
+
+/* FUNCTION skip_node_create
+ *    Create a new skip_node.
+ * Parameters and preconditions:
+ *    key: the key of elem
+ *    elem: the element to store in the new node (NULL for a pending node)
+ *    height: the number of levels the node is to be in, from 1 to
+ *            SKIP_MAX_LEVEL
+ * Return value:
+ *    pointer to a new node that stores key and elem and whose links are all
+ *    NULL;
+ *    NULL in case of error with memory allocation
+ * Side-effects:
+ *    memory has been allocated for the new node
+ */
+static
+skip_node_t *skip_node_create(bag_key_t key, bag_elem_t elem, int height);
+
+/******************************************************************************
+ *  Declarations of the bag operations -- see bag.h for documentation.        *
+ ******************************************************************************/
+
+static
+bag_t *skip_bag_create(int (*cmp)(bag_elem_t, bag_elem_t),
+                       unsigned long (*hash)(bag_elem_t),
+                       bag_key_t (*key)(bag_elem_t));
+
+static
+bag_t *skip_bag_build(int (*cmp)(bag_elem_t, bag_elem_t),
+                      unsigned long (*hash)(bag_elem_t),
+                      bag_key_t (*key)(bag_elem_t),
+                      const bag_elem_t elems[], size_t n);
+
+static
+void skip_bag_destroy(bag_t *b);
+
+static
+size_t skip_bag_size(const bag_t *b);
+
+static
+bool skip_bag_traverse(const bag_t *b,
+                       void (*fun)(bag_elem_t, void *), void *ctx);
+
+static
+bag_elem_t skip_bag_contains(bag_t *b, bag_elem_t elem);
+
+static
+bag_elem_t skip_bag_insert(bag_t *b, bag_elem_t elem);
+
+static
+bag_elem_t skip_bag_find_or_insert(bag_t *b, bag_elem_t probe,
+                                   bag_elem_t (*make)(bag_elem_t, void *),
+                                   void *ctx);
+
+static
+bag_elem_t skip_bag_remove(bag_t *b, bag_elem_t elem);
+
+static
+void skip_bag_stats(const bag_t *b, bag_stats_t *stats);
+
+/* CONSTANT skiplist_bag_ops -- See bag_impl.h for documentation. */
+const bag_ops_t skiplist_bag_ops = {
+    "skiplist",
+    skip_bag_create,
+    skip_bag_build,
+    skip_bag_destroy,
+    skip_bag_size,
+    skip_bag_traverse,
+    skip_bag_contains,
+    skip_bag_insert,
+    skip_bag_find_or_insert,
+    skip_bag_remove,
+    skip_bag_stats,
+    NULL,
+    NULL,
+    NULL
+};
+
+/******************************************************************************
+ *  Definitions of the bag operations -- see bag.h for documentation.         *
+ ******************************************************************************/
+
+bag_t *skip_bag_create(int (*cmp)(bag_elem_t, bag_elem_t),
+                       unsigned long (*hash)(bag_elem_t),
+                       bag_key_t (*key)(bag_elem_t))
+{
+    skip_bag_t *bag = malloc(sizeof(skip_bag_t));
+
+    /* Skip lists only need the comparison function (and the keys). */
+    (void) hash;
+    if (! bag)  return NULL;
+    if (! (bag->head = skip_node_create(0, NULL, SKIP_MAX_LEVEL))) {
+        free(bag);
+        return NULL;
+    }
+    bag->base.ops = &skiplist_bag_ops;
+    bag->size = 0;
+    bag->levels = 1;
+    bag->seed = 0;
+    bag->cmp = cmp;
+    bag->key = key;
+    BAG_COUNTERS_INIT(bag);
+    return (bag_t *) bag;
+}
+
+/* The nodes are appended to each level in order, remembering the last node
+ * of every level, so no search is needed.
+ */
+bag_t *skip_bag_build(int (*cmp)(bag_elem_t, bag_elem_t),
+                      unsigned long (*hash)(bag_elem_t),
+                      bag_key_t (*key)(bag_elem_t),
+                      const bag_elem_t elems[], size_t n)
+{
+    bag_t *b = skip_bag_create(cmp, hash, key);
+    skip_bag_t *bag = (skip_bag_t *) b;
+    skip_node_t *last[SKIP_MAX_LEVEL];
+    skip_node_t *node;
+    size_t i;
+    int level;
+
+    if (! bag)  return NULL;
+    for (level = 0; level < SKIP_MAX_LEVEL; level++)
+        last[level] = bag->head;
+    for (i = 0; i < n; i++) {
+        node = skip_node_create(BAG_KEY(bag, elems[i]), elems[i],
+                                skip_height(bag));
+        if (! node) {
+            skip_bag_destroy(b);
+            return NULL;
+        }
+        for (level = 0; level < node->height; level++) {
+            last[level]->next[level] = node;
+            last[level] = node;
+        }
+        if (node->height > bag->levels)  bag->levels = node->height;
+        bag->size++;
+    }
+    BAG_COUNT(bag, node_allocs, n);
+    return b;
+}
+
+void skip_bag_destroy(bag_t *b)
+{
+    skip_bag_t *bag = (skip_bag_t *) b;
+    skip_node_t *node = bag->head, *next;
+
+    /* Every node is at level 0 (the head and abandoned nodes too). */
+    while (node) {
+        next = node->next[0];
+        free(node);
+        node = next;
+    }
+    free(bag);
+}
+
+size_t skip_bag_size(const bag_t *b)
+{
+    const skip_bag_t *bag = (const skip_bag_t *) b;
+    return SKIP_LOAD(&bag->size);
+}
+
+bool skip_bag_traverse(const bag_t *b,
+                       void (*fun)(bag_elem_t, void *), void *ctx)
+{
+    const skip_bag_t *bag = (const skip_bag_t *) b;
+    skip_node_t *node = SKIP_LOAD(&bag->head->next[0]);
+    bag_elem_t elem;
+
+    for (; node; node = SKIP_LOAD(&node->next[0])) {
+        elem = SKIP_LOAD(&node->elem);
+        if (elem && elem != SKIP_ABANDONED)  (*fun)(elem, ctx);
+    }
+    return true;
+}
+
+bag_elem_t skip_bag_contains(bag_t *b, bag_elem_t elem)
+{
+    skip_bag_t *bag = (skip_bag_t *) b;
+    skip_node_t *preds[SKIP_MAX_LEVEL], *succs[SKIP_MAX_LEVEL];
+
+    if (! skip_search(bag, BAG_KEY(bag, elem), elem, false, preds, succs))
+        return NULL;
+    return SKIP_LOAD(&succs[0]->elem);
+}
+
+/* The new node goes before the elements equal to elem, if there are any. */
+bag_elem_t skip_bag_insert(bag_t *b, bag_elem_t elem)
+{
+    skip_bag_t *bag = (skip_bag_t *) b;
+    skip_node_t *preds[SKIP_MAX_LEVEL], *succs[SKIP_MAX_LEVEL];
+    skip_node_t *node = skip_node_create(BAG_KEY(bag, elem), elem,
+                                         skip_height(bag));
+
+    if (! node)  return NULL;
+    BAG_COUNT(bag, node_allocs, 1);
+    do {
+        skip_search(bag, node->key, elem, true, preds, succs);
+        SKIP_STORE(&node->next[0], succs[0]);
+    } while (! SKIP_CAS(&preds[0]->next[0], succs[0], node));
+    SKIP_ADD(&bag->size, 1);
+    skip_link(bag, node, preds, succs);
+    return elem;
+}
+
+/* The node is linked at level 0 while it is still pending, so that a thread
+ * looking for an equal element at the same time finds it (and waits for its
+ * element) instead of making one of its own; the element is only made once
+ * the node is in place.
+ */
+bag_elem_t skip_bag_find_or_insert(bag_t *b, bag_elem_t probe,
+                                   bag_elem_t (*make)(bag_elem_t, void *),
+                                   void *ctx)
+{
+    skip_bag_t *bag = (skip_bag_t *) b;
+    skip_node_t *preds[SKIP_MAX_LEVEL], *succs[SKIP_MAX_LEVEL];
+    skip_node_t *node = NULL;
+    bag_key_t key = BAG_KEY(bag, probe);
+    bag_elem_t elem;
+
+    for (;;) {
+        if (skip_search(bag, key, probe, true, preds, succs)) {
+            free(node);
+            return SKIP_LOAD(&succs[0]->elem);
+        }
+        if (! node && ! (node = skip_node_create(key, NULL,
+                                                 skip_height(bag))))
+            return NULL;
+        SKIP_STORE(&node->next[0], succs[0]);
+        if (SKIP_CAS(&preds[0]->next[0], succs[0], node))  break;
+    }
+
+    BAG_COUNT(bag, node_allocs, 1);
+    elem = (*make)(probe, ctx);
+    SKIP_STORE(&node->elem, elem ? elem : SKIP_ABANDONED);
+    if (! elem)  return NULL;
+    SKIP_ADD(&bag->size, 1);
+    skip_link(bag, node, preds, succs);
+    return elem;
+}
+
+bag_elem_t skip_bag_remove(bag_t *b, bag_elem_t elem)
+{
+    skip_bag_t *bag = (skip_bag_t *) b;
+    skip_node_t *preds[SKIP_MAX_LEVEL], *succs[SKIP_MAX_LEVEL];
+    skip_node_t *node;
+    bag_elem_t removed;
+    int level;
+
+    if (! skip_search(bag, BAG_KEY(bag, elem), elem, true, preds, succs))
+        return NULL;
+    node = succs[0];
+    removed = node->elem;
+    for (level = 0; level < node->height; level++)
+        skip_unlink(bag, preds[level], node, level);
+    free(node);
+    bag->size--;
+    return removed;
+}
+
+void skip_bag_stats(const bag_t *b, bag_stats_t *stats)
+{
+    const skip_bag_t *bag = (const skip_bag_t *) b;
+    stats->height = (size_t) bag->levels;
+    BAG_GET_STATS(bag, stats);
+}
+
+/******************************************************************************
+ *  Definitions of helper functions -- see above for documentation.           *
+ ******************************************************************************/
+
+bool skip_search(skip_bag_t *bag, bag_key_t key, bag_elem_t elem, bool wait,
+                 skip_node_t *preds[], skip_node_t *succs[])
+{
+    skip_node_t *pred = bag->head, *next = NULL, *bound = NULL;
+    int level, result = 1, stop = 1;
+
+    /* Every level is searched, even above bag->levels: a node is linked into
+     * its levels before bag->levels is raised, and a level that already has
+     * nodes must be compared with like any other.  An empty level costs one
+     * load of a NULL link from the head. */
+    for (level = SKIP_MAX_LEVEL - 1; level >= 0; level--) {
+        for (;;) {
+            next = SKIP_LOAD(&pred->next[level]);
+            if (! next)  break;
+            // the node that stopped the level above needs no new comparison
+            if (next == bound) {
+                result = stop;
+                break;
+            }
+            BAG_VISIT(bag);
+            result = skip_compare(bag, key, elem, next, wait);
+            if (result != SKIP_ABSENT && result <= 0)  break;
+            pred = next;
+        }
+        preds[level] = pred;
+        succs[level] = bound = next;
+        stop = result;
+    }
+    BAG_END_SEARCH(bag);
+    return next && result == 0;
+}
+
+int skip_compare(skip_bag_t *bag, bag_key_t key, bag_elem_t elem,
+                 const skip_node_t *node, bool wait)
+{
+    bag_elem_t other;
+    int result;
+
+    if (key != node->key)  return key < node->key ? -1 : 1;
+    while (! (other = SKIP_LOAD(&node->elem)) && wait)  skip_wait();
+    if (! other || other == SKIP_ABANDONED)  return SKIP_ABSENT;
+    result = BAG_CMP(bag, elem, other);
+    return result < 0 ? -1 : result > 0;
+}
+
+/* A failed link means another node went in just before node at that level,
+ * so the level is searched again from the top (the search also steps past
+ * any node that went in since).
+ */
+void skip_link(skip_bag_t *bag, skip_node_t *node,
+               skip_node_t *preds[], skip_node_t *succs[])
+{
+    int level, top;
+
+    for (level = 1; level < node->height; level++) {
+        for (;;) {
+            SKIP_STORE(&node->next[level], succs[level]);
+            if (SKIP_CAS(&preds[level]->next[level], succs[level], node))
+                break;
+            skip_search(bag, node->key, node->elem, true, preds, succs);
+        }
+    }
+
+    top = SKIP_LOAD(&bag->levels);
+    while (top < node->height &&
+           ! SKIP_CAS(&bag->levels, top, node->height))
+        ;
+}
+
+void skip_unlink(skip_bag_t *bag, skip_node_t *pred, skip_node_t *node,
+                 int level)
+{
+    /* Nodes with equal elements are not always in the same order at every
+     * level, so node may come after some of them (or after abandoned nodes).
+     */
+    while (pred->next[level] && pred->next[level] != node &&
+           skip_compare(bag, node->key, node->elem, pred->next[level],
+                        false) >= 0)
+        pred = pred->next[level];
+    if (pred->next[level] == node)
+        pred->next[level] = node->next[level];
+}
+
+int skip_height(skip_bag_t *bag)
+{
+    uint64_t bits = SKIP_ADD(&bag->seed, UINT64_C(0x9E3779B97F4A7C15)) +
+                    UINT64_C(0x9E3779B97F4A7C15);
+    int height = 1;
+
+    bits = (bits ^ (bits >> 30)) * UINT64_C(0xBF58476D1CE4E5B9);
+    bits = (bits ^ (bits >> 27)) * UINT64_C(0x94D049BB133111EB);
+    bits ^= bits >> 31;
+    while ((bits & 1) && height < SKIP_MAX_LEVEL) {
+        height++;
+        bits >>= 1;
+    }
+    return height;
+}
+
+void skip_wait(void)
+{
+#ifdef HAVE_SCHED_YIELD
+    sched_yield();
+#endif
+}
+
+skip_node_t *skip_node_create(bag_key_t key, bag_elem_t elem, int height)
+{
+    skip_node_t *node = malloc(sizeof(skip_node_t) +
+                               (size_t) height * sizeof(skip_node_t *));
+    int level;
+
+    if (node) {
+        node->key = key;
+        node->elem = elem;
+        node->height = height;
+        for (level = 0; level < height; level++)
+            node->next[level] = NULL;
+    }
+    return node;
+}
+
+/******************************************************************************
+ *  Additional "hidden" functions, for debugging purposes.                    *
+ ******************************************************************************/
+
+/* FUNCTION skiplist_bag_check
+ *    Check that every level of a skip list is in order, that each node is
+ *    only in the levels below its height, and that the nodes of level 0 with
+ *    an element are as many as the elements of the bag (by one thread, with
+ *    no other thread using the bag).
+ * Parameters and preconditions:
+ *    b != NULL: a bag created by skiplist_bag_ops
+ * Return value:
+ *    true if the skip list is sound; false otherwise
+ * Side-effects:  none
+ */
+bool skiplist_bag_check(const bag_t *b)
+{
+    const skip_bag_t *bag = (const skip_bag_t *) b;
+    const skip_node_t *node, *last;
+    size_t count = 0;
+    int level;
+
+    for (level = 0; level < SKIP_MAX_LEVEL; level++) {
+        last = NULL;
+        for (node = bag->head->next[level]; node; node = node->next[level]) {
+            if (node->height <= level)  return false;
+            // pending and abandoned nodes have no element to compare
+            if (! node->elem || node->elem == SKIP_ABANDONED)  continue;
+            if (last && (last->key > node->key ||
+                         (last->key == node->key &&
+                          (*bag->cmp)(last->elem, node->elem) > 0)))
+                return false;
+            last = node;
+            if (level == 0)  count++;
+        }
+    }
+    return count == bag->size;
+}
@@ -0,0 +1,130 @@
+/* FILE slab.c
+ *    Implementation of the slab functions.
+ */
+
+/******************************************************************************
+ *  Types and Constants.                                                      *
+ ******************************************************************************/
+
+#include <stdbool.h>
+
+#include "slab.h"
+
+/* TYPE slab_align_t
+ *    A type with the strictest alignment that objects in a slab may need.
+ *    Object sizes and the chunk headers are rounded up to a multiple of its
+ *    size so that every object in a chunk is properly aligned.
+ */
+typedef union slab_align {
+    void *ptr;
+    long num;
+    double real;
+} slab_align_t;
+
+/* TYPE struct slab_chunk -- Definition of struct slab_chunk from the header.
+ *    The objects of the chunk are stored right after this header in memory.
+ */
+struct slab_chunk {
+    slab_chunk_t *next; /* the chunk allocated before this one */
+    slab_align_t pad;   /* forces the objects that follow to be aligned */
+};
+
+/* MACRO ROUND_UP
+ *    An expression for size rounded up to the next multiple of the alignment
+ *    of objects in a slab.
+ */
+#define ROUND_UP(size) \
+    (((size) + sizeof(slab_align_t) - 1) / sizeof(slab_align_t) \
+                                         * sizeof(slab_align_t))
+
+/******************************************************************************
+ *  Declarations of helper functions -- including full documentation.         *
+ ******************************************************************************/
+
+/* FUNCTION slab_grow
+ *    Allocate a new chunk for a slab and make it the current chunk.
+ * Parameters and preconditions:
+ *    slab != NULL: an initialized slab
+ * Return value:
+ *    true if a new chunk was allocated; false in case of error with memory
+ *    allocation
+ * Side-effects:
+ *    memory has been allocated for a new chunk, twice as large as the previous
+ *    one (up to SLAB_MAX_CHUNK objects)
+ */
+static
+bool slab_grow(slab_t *slab);
+
+/******************************************************************************
+ *  Function definitions -- see header file for documentation.                *
+ ******************************************************************************/
+
+void slab_init(slab_t *slab, size_t obj_size)
+{
+    /* Every free object stores the link to the next one, so objects must be
+     * large enough to hold a pointer. */
+    if (obj_size < sizeof(void *))  obj_size = sizeof(void *);
+    slab->obj_size = ROUND_UP(obj_size);
+    slab->chunks = NULL;
+    slab->next_free = NULL;
+    slab->chunk_end = NULL;
+    slab->chunk_objs = 0;
+    slab->free_list = NULL;
+    slab->allocated = 0;
+}
+
+void *slab_alloc(slab_t *slab)
+{
+    void *obj;
+
+    if (slab->free_list) {
+        /* Reuse the object that was freed most recently. */
+        obj = slab->free_list;
+        slab->free_list = *(void **) obj;
+    } else {
+        if (slab->next_free == slab->chunk_end && ! slab_grow(slab))
+            return NULL;
+        obj = slab->next_free;
+        slab->next_free += slab->obj_size;
+    }
+    return obj;
+}
+
+void slab_free(slab_t *slab, void *obj)
+{
+    *(void **) obj = slab->free_list;
+    slab->free_list = obj;
+}
+
+void slab_release(slab_t *slab)
+{
+    while (slab->chunks) {
+        slab_chunk_t *old = slab->chunks;
+        slab->chunks = old->next;
+        free(old);
+    }
+    slab_init(slab, slab->obj_size);
+}
+
+/******************************************************************************
+ *  Definitions of helper functions -- see above for documentation.           *
+ ******************************************************************************/
+
+bool slab_grow(slab_t *slab)
+{
+    size_t objs = slab->chunk_objs ? 2 * slab->chunk_objs : SLAB_FIRST_CHUNK;
+    slab_chunk_t *chunk;
+
+    if (objs > SLAB_MAX_CHUNK)  objs = SLAB_MAX_CHUNK;
+    chunk = malloc(sizeof(slab_chunk_t) + objs * slab->obj_size);
+    if (! chunk)  return false;
+
+    /* Link the new chunk in front of the others and hand out its objects. */
+    chunk->next = slab->chunks;
+    slab->chunks = chunk;
+    slab->next_free = (char *) (chunk + 1);
+    slab->chunk_end = slab->next_free + objs * slab->obj_size;
+    slab->chunk_objs = objs;
+    slab->allocated++;
+    return true;
+}
@@ -0,0 +1,103 @@
+/* FILE slab.h
+ *    Declarations of types and functions for "slabs" -- pools of fixed-size
+ *    objects carved out of a few large chunks of memory, so that many small
+ *    objects can be allocated cheaply and released all at once.
+ */
+#ifndef SLAB_H
+#define SLAB_H
+
+/******************************************************************************
+ *  Types and Constants.                                                      *
+ ******************************************************************************/
+
+#include <stdlib.h>  /* for type size_t */
+
+/* CONSTANT SLAB_FIRST_CHUNK
+ *    Number of objects in the first chunk of a slab.  Every following chunk
+ *    holds twice as many objects as the one before it, up to SLAB_MAX_CHUNK.
+ *    Starting small keeps the overhead of slabs that only ever hold a few
+ *    objects low.
+ */
+#define SLAB_FIRST_CHUNK 8U
+
+/* CONSTANT SLAB_MAX_CHUNK
+ *    Largest number of objects in a single chunk of a slab.
+ */
+#define SLAB_MAX_CHUNK 4096U
+
+/* TYPE slab_chunk_t -- One chunk of memory in a slab (objects follow it). */
+typedef struct slab_chunk slab_chunk_t;
+
+/* TYPE slab_t
+ *    A slab of objects that all have the same size.  Slabs are meant to be
+ *    embedded directly in the structure that owns them, so the definition is
+ *    public -- but its fields should only be accessed through the functions
+ *    below.
+ */
+typedef struct slab {
+    size_t obj_size;      /* size of each object (rounded up for alignment) */
+    slab_chunk_t *chunks; /* most recently allocated chunk (first in list)  */
+    char *next_free;      /* next never-used object in the current chunk    */
+    char *chunk_end;      /* one past the last object in the current chunk  */
+    size_t chunk_objs;    /* number of objects in the current chunk         */
+    void *free_list;      /* objects returned with slab_free, for reuse     */
+    size_t allocated;     /* number of chunks allocated so far              */
+} slab_t;
+
+/******************************************************************************
+ *  Function declarations -- with full documentation.                         *
+ ******************************************************************************/
+
+/* FUNCTION slab_init
+ *    Initialize an empty slab for objects of a given size.  No memory is
+ *    allocated until the first call to slab_alloc.
+ * Parameters and preconditions:
+ *    slab != NULL: the slab to initialize
+ *    obj_size > 0: the size of each object in the slab
+ * Return value:  none
+ * Side-effects:
+ *    *slab is initialized to an empty slab
+ */
+void slab_init(slab_t *slab, size_t obj_size);
+
+/* FUNCTION slab_alloc
+ *    Return memory for one object from a slab.  Objects that were freed are
+ *    reused first; otherwise objects are handed out in address order from the
+ *    current chunk, so objects allocated one after the other end up next to
+ *    each other in memory.
+ * Parameters and preconditions:
+ *    slab != NULL: an initialized slab
+ * Return value:
+ *    pointer to uninitialized memory for one object;
+ *    NULL in case of error with memory allocation
+ * Side-effects:
+ *    a new chunk may have been allocated for the slab
+ */
+void *slab_alloc(slab_t *slab);
+
+/* FUNCTION slab_free
+ *    Return one object to its slab so that it can be reused by slab_alloc.
+ * Parameters and preconditions:
+ *    slab != NULL: an initialized slab
+ *    obj != NULL: an object returned by slab_alloc on the same slab and not
+ *                 already freed
+ * Return value:  none
+ * Side-effects:
+ *    obj has been added to the free list of slab (its memory is only released
+ *    by slab_release)
+ */
+void slab_free(slab_t *slab, void *obj);
+
+/* FUNCTION slab_release
+ *    Free all the memory allocated for a slab, including every object in it,
+ *    and leave the slab empty.
+ * Parameters and preconditions:
+ *    slab != NULL: an initialized slab
+ * Return value:  none
+ * Side-effects:
+ *    every chunk of slab has been freed; slab can be used again as if it had
+ *    just been initialized
+ */
+void slab_release(slab_t *slab);
+
+#endif/*SLAB_H*/
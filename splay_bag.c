@@ -0,0 +1,645 @@
+/* FILE splay_bag.c
+ *    Implementation of the bag ADT using a splay tree, with top-down splaying
+ *    on every search, insertion and removal.
+ */
+
+/******************************************************************************
+ *  Types and Constants.                                                      *
+ ******************************************************************************/
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bag_impl.h"
+#include "slab.h"
+
+/* CONSTANT SPLAY_STACK
+ *    The number of entries that the stack of a walk down the tree (to
+ *    traverse it or find its height) starts with.  A splay tree can be as
+ *    tall as it has nodes, so the stack is moved to the heap (and doubled as
+ *    needed) when the tree is taller than this.
+ */
+#define SPLAY_STACK 64
+
+/* TYPE splay_node_t -- A node in a splay tree. */
+typedef struct splay_node {
+    bag_key_t key;            /* the key of elem (0 if bag has no key) */
+    bag_elem_t elem;          /* the element stored in this node       */
+    struct splay_node *left;  /* pointer to this node's left child     */
+    struct splay_node *right; /* pointer to this node's right child    */
+} splay_node_t;
+
+/* TYPE splay_step_t -- A node still to visit in splay_height, and its depth. */
+typedef struct splay_step {
+    const splay_node_t *node; /* the root of a subtree not visited yet */
+    size_t depth;             /* the number of nodes down to node      */
+} splay_step_t;
+
+/* TYPE splay_bag_t
+ *    A bag stored in a splay tree.
+ */
+typedef struct splay_bag {
+    bag_t base; /* the part shared by all bags (must come first) */
+    size_t size; /* number of elements in this bag */
+    splay_node_t *root; /* root of the splay tree storing the elements */
+    int (*cmp)(bag_elem_t, bag_elem_t); /* function to compare elements */
+    bag_key_t (*key)(bag_elem_t); /* key function for cmp, or NULL */
+    slab_t nodes; /* memory for the nodes of the tree */
+#ifdef BAG_STATS
+    bag_counters_t counters; /* work done by this bag so far */
+#endif
+} splay_bag_t;
+
+/******************************************************************************
+ *  Declarations of helper functions -- including full documentation.         *
+ ******************************************************************************/
+
+/* FUNCTION splay_splay
+ *    Splay a tree around an element, top-down: walk down from the root two
+ *    levels at a time, rotating on zig-zig steps and moving the nodes passed
+ *    into a left tree (smaller elements) and a right tree (larger elements),
+ *    then reassemble them around the last node reached.  Every node on the
+ *    search path ends up about half as deep as it was.
+ * Parameters and preconditions:
+ *    bag != NULL: the bag whose tree to splay (bag->root != NULL)
+ *    key: the key of elem
+ *    elem != NULL: the element to splay around
+ *    result != NULL: where to store the comparison of elem with the new root
+ * Return value:  none
+ * Side-effects:
+ *    the tree has been restructured, and bag->root is a node that stores an
+ *    element equal to elem if there is one, otherwise the node where the
+ *    search for elem ended; *result is < 0, == 0 or > 0 depending on how elem
+ *    compares to the element at the new root (elem is only compared once
+ *    with each node on the search path)
+ */
+static
+void splay_splay(splay_bag_t *bag, bag_key_t key, bag_elem_t elem,
+                 int *result);
+
+/* FUNCTION splay_add_root
+ *    Make a new node the root of a tree that was just splayed around the
+ *    node's element, splitting the old root's subtrees between the new root's
+ *    left subtree (elements no larger) and right subtree (larger elements).
+ * Parameters and preconditions:
+ *    bag != NULL: the bag to add to
+ *    node != NULL: a new node, with no children
+ *    result: the comparison of node's element with bag->root's element, from
+ *            splay_splay (ignored if bag->root == NULL)
+ * Return value:  none
+ * Side-effects:
+ *    node is the root of the bag's tree, and bag->size has been increased
+ */
+static
+void splay_add_root(splay_bag_t *bag, splay_node_t *node, int result);
+
+/* FUNCTION splay_max
+ *    Splay a tree around its largest element, top-down.
+ * Parameters and preconditions:
+ *    bag != NULL: the bag the tree belongs to
+ *    root != NULL: the root of the tree to splay
+ * Return value:
+ *    the new root of the tree, which stores its largest element and has no
+ *    right child
+ * Side-effects:
+ *    the tree has been restructured
+ */
+static
+splay_node_t *splay_max(splay_bag_t *bag, splay_node_t *root);
+
+/* FUNCTION splay_height
+ *    Return the height of a BST, given its root.  The walk goes down the left
+ *    links and keeps the right children it passes on an explicit stack, along
+ *    with their depth, so the tree is only read.
+ * Parameters and preconditions:
+ *    root: the root of the BST
+ * Return value:
+ *    the number of nodes on the longest path down from root (0 if root is
+ *    NULL); in case of error with memory allocation (for a tree taller than
+ *    SPLAY_STACK), the longest path found before the stack could not grow
+ * Side-effects:  none
+ */
+static
+size_t splay_height(const splay_node_t *root);
+
+/* FUNCTION splay_grow
+ *    Double the room in the explicit stack of a walk down the tree, moving it
+ *    from the C stack to the heap the first time.
+ * Parameters and preconditions:
+ *    stack != NULL: the stack, full with *cap entries of size bytes each
+ *    local != NULL: the array the stack started out in
+ *    cap != NULL: the number of entries the stack has room for
+ *    size > 0: the size of one entry
+ * Return value:
+ *    the stack, with the same entries and room for twice as many; NULL in
+ *    case of error with memory allocation (the stack is left as it was)
+ * Side-effects:
+ *    *cap has been doubled, unless there was an error
+ */
+static
+void *splay_grow(void *stack, void *local, size_t *cap, size_t size);
+
+/* FUNCTION splay_traverse
+ *    Call a function on every element in a BST, given its root, using an
+ *    explicit stack instead of recursion (the tree is only read).
+ * Parameters and preconditions:
+ *    root: the root of the BST to traverse
+ *    fun != NULL: a pointer to a function to apply to each element in the tree
+ *    ctx: the context to pass to fun along with each element
+ * Return value:
+ *    true if fun was called on every element; false in case of error with
+ *    memory allocation (for a tree taller than SPLAY_STACK)
+ * Side-effect:
+ *    function fun has been called on each element in the tree rooted at root,
+ *    in order (only on the first ones, in case of error)
+ */
+static
+bool splay_traverse(const splay_node_t *root,
+                    void (*fun)(bag_elem_t, void *), void *ctx);
+
+/* FUNCTION splay_node_create
+ *    Create a new splay_node.
+ * Parameters and preconditions:
+ *    key: the key of elem
+ *    elem: the element to store in the new node
+ *    nodes != NULL: the slab from which to allocate the new node
+ * Return value:
+ *    pointer to a new node that stores key and elem and whose children are
+ *    both NULL;
+ *    NULL in case of error with memory allocation
+ * Side-effects:
+ *    memory has been allocated from nodes for the new node
+ */
+static
+splay_node_t *splay_node_create(bag_key_t key, bag_elem_t elem,
+                                slab_t *nodes);
+
+/* FUNCTION splay_build
+ *    Build a perfectly balanced BST from a sorted array of elements: the
+ *    middle element goes at the root, and each half of the array is built
+ *    into one of its subtrees the same way.
+ * Parameters and preconditions:
+ *    bag != NULL: the bag the tree is built for (whose slab the nodes are
+ *          allocated from, and whose key function gives their keys)
+ *    root != NULL: where to store the root of the new tree
+ *    elems != NULL (unless n == 0): the sorted elements to store
+ *    n: the number of elements in elems
+ * Return value:
+ *    true if the tree was built; false in case of error with memory
+ *    allocation (the nodes already allocated are left in the slab)
+ * Side-effects:
+ *    n nodes have been allocated from the bag's slab, in order of their
+ *    elements; *root is the root of the new tree (bag->root and bag->size
+ *    are not changed)
+ */
+static
+bool splay_build(splay_bag_t *bag, splay_node_t **root,
+                 const bag_elem_t elems[], size_t n);
+
+/******************************************************************************
+ *  Declarations of the bag operations -- see bag.h for documentation.        *
+ ******************************************************************************/
+
+static
+bag_t *splay_bag_create(int (*cmp)(bag_elem_t, bag_elem_t),
+                        unsigned long (*hash)(bag_elem_t),
+                        bag_key_t (*key)(bag_elem_t));
+
+static
+bag_t *splay_bag_build(int (*cmp)(bag_elem_t, bag_elem_t),
+                       unsigned long (*hash)(bag_elem_t),
+                       bag_key_t (*key)(bag_elem_t),
+                       const bag_elem_t elems[], size_t n);
+
+static
+void splay_bag_destroy(bag_t *b);
+
+static
+size_t splay_bag_size(const bag_t *b);
+
+static
+bool splay_bag_traverse(const bag_t *b,
+                        void (*fun)(bag_elem_t, void *), void *ctx);
+
+static
+bag_elem_t splay_bag_contains(bag_t *b, bag_elem_t elem);
+
+static
+bag_elem_t splay_bag_insert(bag_t *b, bag_elem_t elem);
+
+static
+bag_elem_t splay_bag_find_or_insert(bag_t *b, bag_elem_t probe,
+                                    bag_elem_t (*make)(bag_elem_t, void *),
+                                    void *ctx);
+
+static
+bag_elem_t splay_bag_remove(bag_t *b, bag_elem_t elem);
+
+static
+void splay_bag_stats(const bag_t *b, bag_stats_t *stats);
+
+/* CONSTANT splay_bag_ops -- See bag_impl.h for documentation. */
+const bag_ops_t splay_bag_ops = {
+    "splay",
+    splay_bag_create,
+    splay_bag_build,
+    splay_bag_destroy,
+    splay_bag_size,
+    splay_bag_traverse,
+    splay_bag_contains,
+    splay_bag_insert,
+    splay_bag_find_or_insert,
+    splay_bag_remove,
+    splay_bag_stats,
+    NULL,
+    NULL,
+    NULL
+};
+
+/******************************************************************************
+ *  Definitions of the bag operations -- see bag.h for documentation.         *
+ ******************************************************************************/
+
+bag_t *splay_bag_create(int (*cmp)(bag_elem_t, bag_elem_t),
+                        unsigned long (*hash)(bag_elem_t),
+                        bag_key_t (*key)(bag_elem_t))
+{
+    splay_bag_t *bag = malloc(sizeof(splay_bag_t));
+
+    /* Search trees only need the comparison function (and the keys). */
+    (void) hash;
+    if (bag) {
+        bag->base.ops = &splay_bag_ops;
+        bag->size = 0;
+        bag->root = NULL;
+        bag->cmp = cmp;
+        bag->key = key;
+        slab_init(&bag->nodes, sizeof(splay_node_t));
+        BAG_COUNTERS_INIT(bag);
+    }
+    return (bag_t *) bag;
+}
+
+bag_t *splay_bag_build(int (*cmp)(bag_elem_t, bag_elem_t),
+                       unsigned long (*hash)(bag_elem_t),
+                       bag_key_t (*key)(bag_elem_t),
+                       const bag_elem_t elems[], size_t n)
+{
+    bag_t *b = splay_bag_create(cmp, hash, key);
+    splay_bag_t *bag = (splay_bag_t *) b;
+
+    if (! bag)  return NULL;
+    if (! splay_build(bag, &bag->root, elems, n)) {
+        splay_bag_destroy(b);
+        return NULL;
+    }
+    bag->size = n;
+    BAG_COUNT(bag, node_allocs, n);
+    return b;
+}
+
+void splay_bag_destroy(bag_t *b)
+{
+    splay_bag_t *bag = (splay_bag_t *) b;
+
+    /* Every node lives in the slab, so there is no need to walk the tree. */
+    slab_release(&bag->nodes);
+    free(bag);
+}
+
+size_t splay_bag_size(const bag_t *b)
+{
+    const splay_bag_t *bag = (const splay_bag_t *) b;
+    return bag->size;
+}
+
+bool splay_bag_traverse(const bag_t *b,
+                        void (*fun)(bag_elem_t, void *), void *ctx)
+{
+    const splay_bag_t *bag = (const splay_bag_t *) b;
+    return splay_traverse(bag->root, fun, ctx);
+}
+
+bag_elem_t splay_bag_contains(bag_t *b, bag_elem_t elem)
+{
+    splay_bag_t *bag = (splay_bag_t *) b;
+    int result;
+
+    if (! bag->root)  return NULL;
+    splay_splay(bag, BAG_KEY(bag, elem), elem, &result);
+    BAG_END_SEARCH(bag);
+    return result == 0 ? bag->root->elem : NULL;
+}
+
+/* The new node becomes the root: the tree is splayed around elem, then split
+ * between the new root's left subtree (elements smaller than elem) and right
+ * subtree (elements larger than elem).  Duplicates go to the left.
+ */
+bag_elem_t splay_bag_insert(bag_t *b, bag_elem_t elem)
+{
+    splay_bag_t *bag = (splay_bag_t *) b;
+    splay_node_t *node = splay_node_create(BAG_KEY(bag, elem), elem,
+                                           &bag->nodes);
+    int result = 0;
+
+    if (! node)  return NULL;
+    BAG_COUNT(bag, node_allocs, 1);
+    if (bag->root) {
+        splay_splay(bag, node->key, elem, &result);
+        BAG_END_SEARCH(bag);
+    }
+    splay_add_root(bag, node, result);
+    return elem;
+}
+
+/* As in splay_bag_insert, the new element becomes the root.  Its node is
+ * allocated before the element is made, so that nothing can fail once make
+ * has been called.
+ */
+bag_elem_t splay_bag_find_or_insert(bag_t *b, bag_elem_t probe,
+                                    bag_elem_t (*make)(bag_elem_t, void *),
+                                    void *ctx)
+{
+    splay_bag_t *bag = (splay_bag_t *) b;
+    bag_key_t key = BAG_KEY(bag, probe);
+    splay_node_t *node;
+    int result = 0;
+
+    if (bag->root) {
+        splay_splay(bag, key, probe, &result);
+        BAG_END_SEARCH(bag);
+        if (result == 0)  return bag->root->elem;
+    }
+
+    if (! (node = splay_node_create(key, NULL, &bag->nodes)))  return NULL;
+    if (! (node->elem = (*make)(probe, ctx))) {
+        slab_free(&bag->nodes, node);
+        return NULL;
+    }
+    BAG_COUNT(bag, node_allocs, 1);
+    splay_add_root(bag, node, result);
+    return node->elem;
+}
+
+/* The tree is splayed around elem, so its node becomes the root; the root is
+ * then replaced by joining its two subtrees: splaying the left subtree around
+ * its largest element leaves a root with no right child, where the right
+ * subtree fits.
+ */
+bag_elem_t splay_bag_remove(bag_t *b, bag_elem_t elem)
+{
+    splay_bag_t *bag = (splay_bag_t *) b;
+    splay_node_t *old;
+    bag_elem_t removed;
+    int result;
+
+    if (! bag->root)  return NULL;
+    splay_splay(bag, BAG_KEY(bag, elem), elem, &result);
+    BAG_END_SEARCH(bag);
+    if (result != 0)  return NULL;
+
+    old = bag->root;
+    removed = old->elem;
+    if (old->left) {
+        bag->root = splay_max(bag, old->left);
+        bag->root->right = old->right;
+    } else {
+        bag->root = old->right;
+    }
+    slab_free(&bag->nodes, old);
+    bag->size--;
+    return removed;
+}
+
+void splay_bag_stats(const bag_t *b, bag_stats_t *stats)
+{
+    const splay_bag_t *bag = (const splay_bag_t *) b;
+    stats->height = splay_height(bag->root);
+    BAG_GET_STATS(bag, stats);
+}
+
+/******************************************************************************
+ *  Definitions of helper functions -- see above for documentation.           *
+ ******************************************************************************/
+
+void splay_splay(splay_bag_t *bag, bag_key_t key, bag_elem_t elem,
+                 int *result)
+{
+    /* header.right is the left tree and header.left is the right tree;
+     * smaller and larger point to their largest and smallest node. */
+    splay_node_t header, *smaller = &header, *larger = &header, *child;
+    splay_node_t *root = bag->root;
+    int here = BAG_KEY_CMP(bag, key, elem, root->key, root->elem), next;
+
+    BAG_VISIT(bag);
+    header.left = header.right = NULL;
+    while (here != 0) {
+        if (here < 0) {
+            if (! root->left)  break;
+            BAG_VISIT(bag);
+            next = BAG_KEY_CMP(bag, key, elem, root->left->key,
+                                   root->left->elem);
+            if (next < 0) {
+                /* Zig-zig: rotate right, then continue from the child. */
+                child = root->left;
+                root->left = child->right;
+                child->right = root;
+                root = child;
+                here = next;
+                BAG_COUNT(bag, rotations, 1);
+                if (! root->left)  break;
+                BAG_VISIT(bag);
+                next = BAG_KEY_CMP(bag, key, elem, root->left->key,
+                                   root->left->elem);
+            }
+            /* Link root into the right tree and move down to the left. */
+            larger->left = root;
+            larger = root;
+            root = root->left;
+        } else {
+            if (! root->right)  break;
+            BAG_VISIT(bag);
+            next = BAG_KEY_CMP(bag, key, elem, root->right->key,
+                                   root->right->elem);
+            if (next > 0) {
+                /* Zig-zig: rotate left, then continue from the child. */
+                child = root->right;
+                root->right = child->left;
+                child->left = root;
+                root = child;
+                here = next;
+                BAG_COUNT(bag, rotations, 1);
+                if (! root->right)  break;
+                BAG_VISIT(bag);
+                next = BAG_KEY_CMP(bag, key, elem, root->right->key,
+                                   root->right->elem);
+            }
+            /* Link root into the left tree and move down to the right. */
+            smaller->right = root;
+            smaller = root;
+            root = root->right;
+        }
+        here = next;
+    }
+
+    /* Reassemble the left tree, root and right tree. */
+    smaller->right = root->left;
+    larger->left = root->right;
+    root->left = header.right;
+    root->right = header.left;
+
+    *result = here;
+    bag->root = root;
+}
+
+void splay_add_root(splay_bag_t *bag, splay_node_t *node, int result)
+{
+    if (bag->root) {
+        if (result < 0) {
+            node->left = bag->root->left;
+            node->right = bag->root;
+            bag->root->left = NULL;
+        } else {
+            node->right = bag->root->right;
+            node->left = bag->root;
+            bag->root->right = NULL;
+        }
+    }
+    bag->root = node;
+    bag->size++;
+}
+
+splay_node_t *splay_max(splay_bag_t *bag, splay_node_t *root)
+{
+    splay_node_t header, *smaller = &header, *child;
+
+    header.right = NULL;
+    while (root->right) {
+        /* Zig-zig: rotate left whenever there are two right links. */
+        if (root->right->right) {
+            child = root->right;
+            root->right = child->left;
+            child->left = root;
+            root = child;
+            BAG_COUNT(bag, rotations, 1);
+        }
+        /* Link root into the left tree and move down to the right. */
+        smaller->right = root;
+        smaller = root;
+        root = root->right;
+    }
+
+    smaller->right = root->left;
+    root->left = header.right;
+    (void) bag;
+    return root;
+}
+
+/* Depth-first, with the right child of each node pushed on the stack along
+ * with its depth: the stack never holds more than one node per level.
+ */
+size_t splay_height(const splay_node_t *root)
+{
+    splay_step_t local[SPLAY_STACK], *stack = local, *grown;
+    size_t top = 0, cap = SPLAY_STACK, depth = 1, height = 0;
+
+    while (root) {
+        if (depth > height)  height = depth;
+        if (root->right) {
+            if (top == cap) {
+                grown = splay_grow(stack, local, &cap, sizeof(*stack));
+                if (! grown)  break;
+                stack = grown;
+            }
+            stack[top].node = root->right;
+            stack[top++].depth = depth + 1;
+        }
+        if (root->left) {
+            root = root->left;
+            depth++;
+        } else if (top > 0) {
+            root = stack[--top].node;
+            depth = stack[top].depth;
+        } else {
+            root = NULL;
+        }
+    }
+
+    if (stack != local)  free(stack);
+    return height;
+}
+
+/* The stack holds the nodes whose left subtree is being visited, as in
+ * avl_traverse; it starts out in local, and is only moved to the heap for a
+ * tree taller than SPLAY_STACK.
+ */
+bool splay_traverse(const splay_node_t *root,
+                    void (*fun)(bag_elem_t, void *), void *ctx)
+{
+    const splay_node_t *local[SPLAY_STACK], **stack = local, **grown;
+    size_t depth = 0, cap = SPLAY_STACK;
+
+    while (root || depth > 0) {
+        if (root && depth == cap) {
+            grown = splay_grow(stack, local, &cap, sizeof(*stack));
+            if (! grown)  break;
+            stack = grown;
+        }
+        if (root) {
+            stack[depth++] = root;
+            root = root->left;
+        } else {
+            root = stack[--depth];
+            (*fun)(root->elem, ctx);
+            root = root->right;
+        }
+    }
+
+    if (stack != local)  free(stack);
+    return ! root && depth == 0;
+}
+
+void *splay_grow(void *stack, void *local, size_t *cap, size_t size)
+{
+    void *grown = stack == local ? malloc(2 * *cap * size)
+                                 : realloc(stack, 2 * *cap * size);
+
+    if (! grown)  return NULL;
+    if (stack == local)  memcpy(grown, local, *cap * size);
+    *cap *= 2;
+    return grown;
+}
+
+/* As in avl_build, the nodes are allocated in order of their elements, and the
+ * recursion is only as deep as the (balanced) tree.
+ */
+bool splay_build(splay_bag_t *bag, splay_node_t **root,
+                 const bag_elem_t elems[], size_t n)
+{
+    size_t mid = n / 2;
+    splay_node_t *left;
+
+    *root = NULL;
+    if (n == 0)  return true;
+
+    if (! splay_build(bag, &left, elems, mid))  return false;
+    if (! (*root = splay_node_create(BAG_KEY(bag, elems[mid]), elems[mid],
+                                     &bag->nodes)))
+        return false;
+    (*root)->left = left;
+    return splay_build(bag, &(*root)->right, elems + mid + 1, n - mid - 1);
+}
+
+splay_node_t *splay_node_create(bag_key_t key, bag_elem_t elem,
+                                slab_t *nodes)
+{
+    splay_node_t *node = slab_alloc(nodes);
+    if (node) {
+        node->key = key;
+        node->elem = elem;
+        node->left = NULL;
+        node->right = NULL;
+    }
+    return node;
+}
@@ -0,0 +1,1521 @@
+/* FILE word_index.c
+ *    Implementation of the word_index functions.
+ * Author: Tommy Pearson and Oliver Liang, March 2012.
+ */
+
+/******************************************************************************
+ *  Types and Constants.                                                      *
+ ******************************************************************************/
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <pthread.h>
+#define HAVE_PTHREADS 1
+#endif
+
+#include "word_index.h"
+#include "page_list.h"
+#include "run_file.h"
+#include "writer.h"
+
+/* CONSTANT ENTRY_MEMORY
+ *    Estimated memory used by one entry of an index apart from its word and
+ *    pages: the entry itself, the node of the bag that holds it and what the
+ *    memory allocator keeps for each block.
+ */
+#define ENTRY_MEMORY (sizeof(entry_t) + 64)
+
+/* TYPE entry_t
+ *    The type of one word in the word index.
+ */
+typedef struct entry
+{
+    char  *entry_word; /* the word (null-terminated in entries of the index) */
+    size_t entry_len;  /* number of characters in the word                  */
+    page_list_t page_index;
+} entry_t;
+
+/* TYPE prefix_scan_t
+ *    A scan for the words of an index that start with a prefix, and where the
+ *    lines of those words go.
+ */
+typedef struct prefix_scan
+{
+    const char *prefix; /* the characters every word must start with */
+    size_t len;         /* number of characters in prefix            */
+    writer_t *writer;   /* where the lines of the words go           */
+} prefix_scan_t;
+
+/* TYPE worker_t
+ *    The work given to one thread: a part of the input file, and the index of
+ *    the words in that part once the thread is done.
+ */
+typedef struct worker
+{
+    tokenizer_t *input; /* the part of the file to index         */
+    int min_word_len;   /* the minimum length of words to index  */
+    const bag_ops_t *backend; /* the kind of bag to use for the index */
+    bag_t *index;       /* the index of the part (set when done) */
+} worker_t;
+
+#ifdef HAVE_PTHREADS
+
+/* CONSTANT SHARD_SAMPLE
+ *    Number of words sampled for each shard of a sharded index to pick the
+ *    bounds of the shards.
+ */
+#define SHARD_SAMPLE 16
+
+/* CONSTANT PRINT_BATCH
+ *    Number of entries formatted by each thread at a time when an index is
+ *    written by several threads.
+ */
+#define PRINT_BATCH 16384
+
+/* TYPE late_page_t
+ *    A page of a word that reached a sharded index after a later page of the
+ *    same word (from another part of the file), to be put in place at the end.
+ */
+typedef struct late_page
+{
+    entry_t *entry;     /* the entry of the word */
+    unsigned page;      /* the page              */
+} late_page_t;
+
+/* TYPE shard_t
+ *    One range of words of a sharded index, with the lock that protects it.
+ */
+typedef struct shard
+{
+    pthread_mutex_t lock; /* held while the shard is used               */
+    bag_t *index;         /* the entries of the words in the range      */
+    late_page_t *late;    /* the pages that came out of order            */
+    size_t late_len;      /* number of pages in late                     */
+    size_t late_cap;      /* number of pages late has room for           */
+    bool failed;          /* true if memory ran out                      */
+} shard_t;
+
+/* TYPE sharded_t
+ *    A sharded index: shard i holds the words from bounds[i - 1] (included)
+ *    up to bounds[i] (excluded), where the first and last shards are open.
+ */
+typedef struct sharded
+{
+    shard_t *shards;      /* the shards, in order                */
+    size_t n;             /* number of shards                    */
+    const word_t *bounds; /* the n - 1 bounds, in increasing order */
+} sharded_t;
+
+/* TYPE shard_worker_t
+ *    The work given to one thread of a sharded build: a part of the input
+ *    file whose words go into the shared index, then the shards to finish.
+ */
+typedef struct shard_worker
+{
+    sharded_t *index;     /* the shared index                          */
+    tokenizer_t *input;   /* the part of the file to index             */
+    int min_word_len;     /* the minimum length of words to index      */
+    word_t *sample;       /* the first words of the part, already read */
+    size_t sample_len;    /* number of words in sample                 */
+    size_t first;         /* the first shard to finish                 */
+    size_t step;          /* the distance to the next shard to finish  */
+} shard_worker_t;
+
+/* TYPE printer_t
+ *    An index being written by several threads: the next batch of entries,
+ *    in order, and the memory writer of each thread.
+ */
+typedef struct printer
+{
+    const entry_t **batch; /* the entries of the batch                   */
+    size_t len;            /* number of entries in batch                 */
+    size_t cap;            /* number of entries batch has room for       */
+    int threads;           /* number of threads (and writers)            */
+    writer_t *writers;     /* the memory writer of each thread           */
+    FILE *out;             /* the file the index is written to           */
+    bool failed;           /* true once a write or an allocation failed  */
+} printer_t;
+
+/* TYPE print_worker_t
+ *    The work given to one thread writing an index: a range of consecutive
+ *    entries of a batch, and the memory writer to format them into.
+ */
+typedef struct print_worker
+{
+    const entry_t **entries; /* the first entry of the range */
+    size_t n;                /* number of entries            */
+    writer_t *writer;        /* where the text goes          */
+} print_worker_t;
+
+#endif/*HAVE_PTHREADS*/
+
+/******************************************************************************
+ *  Declarations of helper functions -- including full documentation.         *
+ ******************************************************************************/
+
+/* FUNCTION generate_index
+ *    Create and return an index of every word whose length is at least
+ *    min_word_len in file input, along with each word's page numbers.
+ * Parameters and preconditions:
+ *    input != NULL: a tokenizer positioned at the start of the file
+ *    min_word_len > 0: the minimum length of words to put in the index
+ *    backend != NULL: the kind of bag to store the index in
+ * Return value:
+ *    a bag that contains every word in file input whose length is at least
+ *    min_word_length, along with the page numbers where the word appears;
+ *    NULL in case of any error with memory allocation
+ * Side-effects:
+ *    memory is allocated for the bag and the file has been read to the end
+ */
+static
+bag_t *generate_index(tokenizer_t *input, int min_word_len,
+                      const bag_ops_t *backend);
+
+/* FUNCTION generate_part
+ *    Add the words of file input to an index, as word_index_extend does, until
+ *    the new words and pages take up about budget bytes of memory.
+ * Parameters and preconditions:
+ *    index != NULL: an empty index
+ *    input != NULL: a tokenizer
+ *    min_word_len > 0: the minimum length of words to put in the index
+ *    budget > 0: the estimated number of bytes for the words and pages
+ * Return value:
+ *    true if the file has been read to the end; false if the budget was
+ *    reached first
+ * Side-effects:
+ *    the words read from input have been added to index
+ */
+static
+bool generate_part(bag_t *index, tokenizer_t *input, int min_word_len,
+                   size_t budget);
+
+/* FUNCTION spill_part
+ *    Write an index to a new temporary file as a sorted run.
+ * Parameters and preconditions:
+ *    index != NULL: an index
+ * Return value:
+ *    the run, open for reading and writing (it is deleted when it is
+ *    closed); NULL if the temporary file could not be created or written
+ * Side-effects:
+ *    a temporary file has been created and every entry of index written to it
+ */
+static
+FILE *spill_part(const bag_t *index);
+
+/* FUNCTION generate_index_parallel
+ *    Create and return the same index as generate_index, by splitting the file
+ *    into parts at line boundaries, indexing each part in its own thread and
+ *    merging the indexes of the parts in file order.  The entries of each
+ *    part come out of its index already sorted, so the merged entries are
+ *    built into the final index in one pass instead of being inserted one at
+ *    a time.
+ * Parameters and preconditions:
+ *    input != NULL: a tokenizer positioned at the start of the file
+ *    min_word_len > 0: the minimum length of words to put in the index
+ *    backend != NULL: the kind of bag to store the index in
+ *    threads > 0: the number of threads to use
+ * Return value:
+ *    a bag that contains every word in file input whose length is at least
+ *    min_word_length, along with the page numbers where the word appears;
+ *    NULL in case of any error with memory allocation
+ * Side-effects:
+ *    memory is allocated for the bag and the file has been read to the end;
+ *    parts are indexed in the calling thread if threads cannot be started
+ */
+static
+bag_t *generate_index_parallel(tokenizer_t *input, int min_word_len,
+                               const bag_ops_t *backend, int threads);
+
+/* FUNCTION worker_run
+ *    Index one part of the file (the start routine of each thread).
+ * Parameters and preconditions:
+ *    w != NULL: a pointer to the worker_t describing the part
+ * Return value:  NULL
+ * Side-effects:
+ *    the index of the part has been stored in the worker (NULL in case of
+ *    error with memory allocation)
+ */
+static
+void *worker_run(void *w);
+
+#ifdef HAVE_PTHREADS
+
+/* FUNCTION generate_index_sharded
+ *    Create and return the index described for word_index_create_sharded.
+ * Parameters and preconditions:  as for word_index_create_sharded
+ * Return value:  as for word_index_create_sharded
+ * Side-effects:
+ *    memory is allocated for the bag and the file has been read to the end;
+ *    parts are indexed and shards finished in the calling thread if threads
+ *    cannot be started
+ */
+static
+bag_t *generate_index_sharded(tokenizer_t *input, int min_word_len,
+                              const bag_ops_t *backend, int threads,
+                              int shards);
+
+/* FUNCTION shard_insert
+ *    Add one occurrence of a word to a sharded index.
+ * Parameters and preconditions:
+ *    index != NULL: a sharded index
+ *    word != NULL: the word and its page
+ * Return value:  none
+ * Side-effects:
+ *    the word has been added to its shard, while holding the shard's lock;
+ *    its page goes in the list of late pages of the shard if a later page of
+ *    the word is already in its entry
+ */
+static
+void shard_insert(sharded_t *index, const word_t *word);
+
+/* FUNCTION shard_finish
+ *    Put the late pages of a shard in the page lists of their entries.
+ * Parameters and preconditions:
+ *    shard != NULL: a shard that no thread adds words to any more
+ * Return value:  none
+ * Side-effects:
+ *    the late pages have been merged into their entries and freed (or
+ *    shard->failed set in case of error with memory allocation)
+ */
+static
+void shard_finish(shard_t *shard);
+
+/* FUNCTION shard_insert_run
+ *    Add the words of one part of the file to a sharded index (the start
+ *    routine of each thread).
+ * Parameters and preconditions:
+ *    w != NULL: a pointer to the shard_worker_t describing the part
+ * Return value:  NULL
+ * Side-effects:
+ *    the sample of the part, then the rest of its words, have been added
+ */
+static
+void *shard_insert_run(void *w);
+
+/* FUNCTION shard_finish_run
+ *    Finish every step-th shard of a sharded index, from the first one given
+ *    (the start routine of each thread once the file has been read).
+ * Parameters and preconditions:
+ *    w != NULL: a pointer to the shard_worker_t describing the shards
+ * Return value:  NULL
+ * Side-effects:
+ *    the shards have been finished
+ */
+static
+void *shard_finish_run(void *w);
+
+/* FUNCTION word_order
+ *    Compare two words (for qsort), in the same order as entry_cmp.
+ * Parameters and preconditions:
+ *    w1 != NULL, w2 != NULL: pointers to the word_t to compare
+ * Return value:
+ *    < 0 if *w1 < *w2; > 0 if *w1 > *w2; == 0 if they are the same word
+ * Side-effects:  none
+ */
+static
+int word_order(const void *w1, const void *w2);
+
+/* FUNCTION late_order
+ *    Compare two late pages (for qsort): by word, then by page.
+ * Parameters and preconditions:
+ *    l1 != NULL, l2 != NULL: pointers to the late_page_t to compare
+ * Return value:
+ *    < 0 if *l1 comes first; > 0 if *l2 comes first; == 0 if they are equal
+ * Side-effects:  none
+ */
+static
+int late_order(const void *l1, const void *l2);
+
+/* FUNCTION print_entry
+ *    Add one entry (passed in as type bag_elem_t) to the batch of an index
+ *    being written by several threads, and write the batch once it is full.
+ * Parameters and preconditions:
+ *    e: the entry, which comes after every entry already in the batch
+ *    printer != NULL: a pointer to the printer_t of the index
+ * Return value:  none
+ * Side-effects:
+ *    e is in the batch, or the batch (with e) has been written and emptied
+ */
+static
+void print_entry(bag_elem_t e, void *printer);
+
+/* FUNCTION print_batch
+ *    Write the batch of an index being written by several threads: each
+ *    thread formats a range of it into its memory writer, then the writers
+ *    are handed to the file in order.
+ * Parameters and preconditions:
+ *    printer != NULL: the printer of the index
+ * Return value:  none
+ * Side-effects:
+ *    the entries of the batch have been written and the batch emptied;
+ *    printer->failed has been set if a write or an allocation failed; ranges
+ *    are formatted in the calling thread if threads cannot be started
+ */
+static
+void print_batch(printer_t *printer);
+
+/* FUNCTION print_run
+ *    Format a range of entries (the start routine of each thread).
+ * Parameters and preconditions:
+ *    w != NULL: a pointer to the print_worker_t describing the range
+ * Return value:  NULL
+ * Side-effects:
+ *    the lines of the entries have been added to the worker's writer
+ */
+static
+void *print_run(void *w);
+
+#endif/*HAVE_PTHREADS*/
+
+/* FUNCTION prefix_write
+ *    Write the line of one entry (passed in as type bag_elem_t) if its word
+ *    starts with the prefix of a scan.
+ * Parameters and preconditions:
+ *    e: the entry
+ *    scan != NULL: a pointer to the prefix_scan_t of the scan
+ * Return value:
+ *    true if the word starts with the prefix; false otherwise (so that a scan
+ *    from the prefix stops at the first entry past the words that start with
+ *    it)
+ * Side-effects:
+ *    the line of e has been written to the scan's writer if its word starts
+ *    with the prefix
+ */
+static
+bool prefix_write(bag_elem_t e, void *scan);
+
+/* FUNCTION prefix_filter
+ *    Write the line of one entry if its word starts with the prefix of a scan,
+ *    like prefix_write, for a traversal of the whole index.
+ * Parameters and preconditions:
+ *    e, scan: as for prefix_write
+ * Return value:  none
+ * Side-effects:  as for prefix_write
+ */
+static
+void prefix_filter(bag_elem_t e, void *scan);
+
+/* FUNCTION entry_collect
+ *    Store one entry (passed in as type bag_elem_t) at the next position of
+ *    an array.
+ * Parameters and preconditions:
+ *    e: the entry to store
+ *    next != NULL: a pointer to the next position of the array (a
+ *                  bag_elem_t **), with room for e
+ * Return value:  none
+ * Side-effects:
+ *    e has been stored at the next position, and the position has been moved
+ *    past it
+ */
+static
+void entry_collect(bag_elem_t e, void *next);
+
+/* FUNCTION entry_merge_runs
+ *    Merge consecutive sorted runs of entries from the parts of a file into a
+ *    single sorted run, with one entry per word.  Neighbouring runs are merged
+ *    two at a time, the earlier one first, so the pages of each word stay in
+ *    increasing order.
+ * Parameters and preconditions:
+ *    entries != NULL: a pointer to the array holding the runs (*entries !=
+ *                     NULL unless the runs are all empty)
+ *    tmp: an array with room for all the entries in the runs
+ *    bounds != NULL: where the runs start in *entries -- run r goes from
+ *                    bounds[r] up to bounds[r + 1], and bounds[0] == 0
+ *    runs > 0: the number of runs
+ * Return value:
+ *    the number of entries in the merged run
+ * Side-effects:
+ *    *entries is set to whichever of the two arrays holds the merged run;
+ *    when the same word is in several runs, the pages of the later entries
+ *    have been added to the earliest one and the later ones destroyed; the
+ *    contents of bounds have been changed
+ */
+static
+size_t entry_merge_runs(bag_elem_t **entries, bag_elem_t *tmp,
+                        size_t bounds[], int runs);
+
+/* FUNCTION entry_merge_two
+ *    Merge two sorted runs of entries into a third one, with one entry per
+ *    word, like one step of entry_merge_runs.
+ * Parameters and preconditions:
+ *    a != NULL (unless na == 0): the earlier run, of na entries
+ *    b != NULL (unless nb == 0): the later run, of nb entries
+ *    out != NULL: an array with room for na + nb entries (not overlapping the
+ *                 runs)
+ * Return value:
+ *    the number of entries stored in out
+ * Side-effects:
+ *    the merged run has been stored in out; an entry of b with the same word
+ *    as one of a has had its pages added to that entry and been destroyed
+ */
+static
+size_t entry_merge_two(bag_elem_t *a, size_t na, bag_elem_t *b, size_t nb,
+                       bag_elem_t *out);
+
+/* FUNCTION entry_create
+ *    Create and return a new index entry given a word and its page number.
+ * Parameters and preconditions:
+ *    word != NULL: pointer to a word from the tokenizer (with page > 0)
+ * Return value:
+ *    a new index entry storing a copy of word and its page number;
+ *    NULL in case of any error with memory allocation
+ * Side-effects:
+ *    memory has been allocated for the new entry and to make a copy of word
+ */
+static
+bag_elem_t entry_create(const word_t *word);
+
+/* FUNCTION entry_make
+ *    Create a new index entry for the word being looked up, for
+ *    bag_find_or_insert.
+ * Parameters and preconditions:
+ *    probe != NULL: the entry that was looked up (unused)
+ *    word != NULL: the word from the tokenizer (a word_t *)
+ * Return value:
+ *    the new entry, as for entry_create
+ * Side-effects:
+ *    as for entry_create
+ */
+static
+bag_elem_t entry_make(bag_elem_t probe, void *word);
+
+/* FUNCTION entry_load
+ *    Create and return a new index entry for a word of an index file.
+ * Parameters and preconditions:
+ *    file != NULL: an opened index file
+ *    i < index_file_size(file): the position of the word
+ * Return value:
+ *    a new index entry storing a copy of word i and its pages;
+ *    NULL in case of any error with memory allocation
+ * Side-effects:
+ *    memory has been allocated for the new entry, its word and its pages
+ */
+static
+bag_elem_t entry_load(const index_file_t *file, size_t i);
+
+/* FUNCTION entry_destroy
+ *    Release the memory allocated for an word index entry (passed in as type
+ *    bag_elem_t).
+ * Parameters and preconditions:
+ *    e != NULL: an index entry
+ *    e is a pointer to the type entry_t
+ * Return value:  none
+ * Side-effects:
+ *    the memory allocated for e is freed
+ */
+static
+void entry_destroy(bag_elem_t e);
+
+/* FUNCTION entry_write
+ *    Write an word index entry (passed in as type bag_elem_t) to a writer.
+ * Parameters and preconditions:
+ *    e != NULL: an word index entry
+ *    e is a pointer to the entry_t type.
+ *    writer != NULL: the writer to add the entry to (a writer_t *)
+ * Return value:  none
+ * Side-effects:
+ *    the entry has been added to the writer, as one line
+ */
+static
+void entry_write(bag_elem_t e, void *writer);
+
+/* FUNCTION entry_save
+ *    Add a word index entry (passed in as type bag_elem_t) to an index file
+ *    builder.
+ * Parameters and preconditions:
+ *    e != NULL: an word index entry
+ *    e is a pointer to the entry_t type.
+ *    builder != NULL: the builder to add the entry to (an
+ *                     index_file_builder_t *)
+ * Return value:  none
+ * Side-effects:
+ *    the entry's word and pages have been added to the builder (which
+ *    remembers if that failed)
+ */
+static
+void entry_save(bag_elem_t e, void *builder);
+
+/* FUNCTION entry_spill
+ *    Add a word index entry (passed in as type bag_elem_t) at the end of a
+ *    run.
+ * Parameters and preconditions:
+ *    e != NULL: an word index entry
+ *    e is a pointer to the entry_t type.
+ *    run != NULL: the writer of the run (a writer_t *)
+ * Return value:  none
+ * Side-effects:
+ *    the entry's word and pages have been added to the run
+ */
+static
+void entry_spill(bag_elem_t e, void *run);
+
+/* FUNCTION entry_cmp
+ *    Compare two word index entries (passed in as type bag_elem_t).
+ * Parameters and preconditions:
+ *    e1 != NULL: the first entry to compare
+ *    e2 != NULL: the second entry to compare
+ * Return value:
+ *    < 0 if e1 < e2; > 0 if e1 > e2; == 0 if e1 == e2
+ * Side-effects:  none
+ */
+static
+int entry_cmp(bag_elem_t e1, bag_elem_t e2);
+
+/* FUNCTION entry_hash
+ *    Compute a hash value for a word index entry (passed in as type
+ *    bag_elem_t), using the FNV-1a hash of the entry's word.
+ * Parameters and preconditions:
+ *    e != NULL: the entry to hash
+ * Return value:
+ *    the hash value of e (equal for any two entries with the same word)
+ * Side-effects:  none
+ */
+static
+unsigned long entry_hash(bag_elem_t e);
+
+/* FUNCTION entry_key
+ *    Compute the key of a word index entry (passed in as type bag_elem_t) for
+ *    entry_cmp: the first 8 characters of its word, as unsigned bytes, packed
+ *    into a number with the first character in the most significant byte and
+ *    0 bytes after the end of a shorter word.  Words never contain a null
+ *    character, so keys compare like the words they start.
+ * Parameters and preconditions:
+ *    e != NULL: the entry to compute the key of
+ * Return value:
+ *    the key of e (see bag_key_t)
+ * Side-effects:  none
+ */
+static
+bag_key_t entry_key(bag_elem_t e);
+
+/* Function entry_add
+ *      add the page number to the entry
+ * Parameters and preconditions:
+ *      entry != NULL: a point the the word entry to be modified
+ *      page > 0: a page number to be added to the entry, no smaller than any
+ *                page already in the entry
+ * Side-effects:
+ *      page is appended to the entry's page list, unless it is already the
+ *      last page there
+ */
+static
+void entry_add(entry_t *entry, unsigned page);
+
+/******************************************************************************
+ *  Definitions of "public" functions -- see header file for documentation.   *
+ ******************************************************************************/
+
+bag_t *word_index_create(tokenizer_t *input, int min_word_len,
+                         const bag_ops_t *backend, int threads)
+{
+    return threads > 1 ?
+           generate_index_parallel(input, min_word_len, backend, threads) :
+           generate_index(input, min_word_len, backend);
+}
+
+bag_t *word_index_create_sharded(tokenizer_t *input, int min_word_len,
+                                 const bag_ops_t *backend, int threads,
+                                 int shards)
+{
+#ifdef HAVE_PTHREADS
+    return generate_index_sharded(input, min_word_len, backend, threads,
+                                  shards);
+#else
+    (void) threads;
+    (void) shards;
+    return generate_index(input, min_word_len, backend);
+#endif
+}
+
+bag_t *word_index_load(const index_file_t *file, const bag_ops_t *backend)
+{
+    size_t n = index_file_size(file), i;
+    bag_elem_t *entries = malloc((n ? n : 1) * sizeof(bag_elem_t));
+    bag_t *index = NULL;
+
+    if (! entries)  return NULL;
+    for (i = 0; i < n; i++)
+        if (! (entries[i] = entry_load(file, i)))  break;
+
+    // The words of an index file are in order already.
+    if (i == n)
+        index = bag_build_sorted_keyed(backend, entry_cmp, entry_hash,
+                                       entry_key, entries, n);
+    if (! index)
+        while (i > 0)  entry_destroy(entries[--i]);
+    free(entries);
+    return index;
+}
+
+void word_index_extend(bag_t *index, tokenizer_t *input, int min_word_len)
+{
+    word_t word;
+    entry_t new_word;
+    bag_elem_t entry;
+
+    while (tokenizer_next(input, &word))
+    {
+        // look the word up straight from the tokenizer's copy of the file;
+        // it only gets copied if it is new
+        new_word.entry_word = (char *) word.text;
+        new_word.entry_len = word.len;
+        // check if the length of the word is long enough
+        if(word.len >= (size_t) min_word_len)
+        {
+            // find the word's entry, creating it in the same search if the
+            // word is new (a new entry already has the page)
+            entry = bag_find_or_insert(index, &new_word, entry_make, &word);
+            if (entry)  entry_add((entry_t *) entry, word.page);
+        }
+    }
+}
+
+void word_index_print(const bag_t *index)
+{
+    word_index_write(index, stdout);
+}
+
+bool word_index_write(const bag_t *index, FILE *out)
+{
+    writer_t writer;
+    bool ordered;
+
+    writer_init(&writer, out);
+    ordered = bag_traverse_with(index, entry_write, &writer);
+    return writer_flush(&writer) && ordered;
+}
+
+bool word_index_write_parallel(const bag_t *index, int threads, FILE *out)
+{
+#ifdef HAVE_PTHREADS
+    printer_t printer;
+    int t;
+
+    if (threads <= 1)  return word_index_write(index, out);
+
+    printer.len = 0;
+    printer.cap = (size_t) threads * PRINT_BATCH;
+    printer.threads = threads;
+    printer.out = out;
+    printer.failed = false;
+    printer.batch = malloc(printer.cap * sizeof(const entry_t *));
+    printer.writers = malloc(threads * sizeof(writer_t));
+    if (! printer.batch || ! printer.writers) {
+        free(printer.batch);
+        free(printer.writers);
+        return false;
+    }
+    for (t = 0; t < threads; t++)
+        writer_init_memory(&printer.writers[t]);
+
+    if (! bag_traverse_with(index, print_entry, &printer))
+        printer.failed = true;
+    if (printer.len > 0)  print_batch(&printer);
+
+    for (t = 0; t < threads; t++)
+        writer_release(&printer.writers[t]);
+    free(printer.writers);
+    free(printer.batch);
+    return ! printer.failed;
+#else
+    (void) threads;
+    return word_index_write(index, out);
+#endif
+}
+
+/* Every word that starts with the prefix comes at or after the prefix itself
+ * (as a word) and before every word that does not, so the scan starts at the
+ * prefix and stops at the first word that does not start with it.
+ */
+bool word_index_write_prefix(bag_t *index, const char *prefix, FILE *out)
+{
+    writer_t writer;
+    prefix_scan_t scan;
+    entry_t probe;
+    bool ordered = true;
+
+    probe.entry_word = (char *) prefix;
+    probe.entry_len = strlen(prefix);
+    scan.prefix = prefix;
+    scan.len = probe.entry_len;
+    scan.writer = &writer;
+
+    writer_init(&writer, out);
+    if (! bag_range(index, &probe, NULL, prefix_write, &scan))
+        ordered = bag_traverse_with(index, prefix_filter, &scan);
+    return writer_flush(&writer) && ordered;
+}
+
+bool word_index_save(const bag_t *index, int min_word_len,
+                     const tokenizer_state_t *state, FILE *out)
+{
+    index_file_builder_t *builder = index_file_builder_create();
+    bool saved;
+
+    if (! builder)  return false;
+    index_file_set_source(builder, min_word_len, state);
+    saved = bag_traverse_with(index, entry_save, builder) &&
+            index_file_save(builder, out);
+    index_file_builder_destroy(builder);
+    return saved;
+}
+
+/* Runs are combined as they come, RUN_MERGE_WAYS at a time, whenever that
+ * many in a row have been combined the same number of times (like the digits
+ * of a counter), so that few runs are ever open at once and each page is
+ * only copied a logarithmic number of times.
+ */
+bool word_index_write_spilled(tokenizer_t *input, int min_word_len,
+                              const bag_ops_t *backend, size_t budget,
+                              FILE *out)
+{
+    FILE **runs = NULL, **more_runs;
+    unsigned *levels = NULL, *more_levels;
+    size_t n = 0, cap = 0;
+    bag_t *index;
+    bool done = false, ok = true;
+
+    while (! done && ok) {
+        index = bag_create_keyed(backend, entry_cmp, entry_hash, entry_key);
+        if (! index) {
+            ok = false;
+            break;
+        }
+        done = generate_part(index, input, min_word_len, budget);
+        if (done && n == 0) {
+            // the whole index fits in the budget: no need for runs
+            ok = word_index_write(index, out);
+        } else {
+            if (n == cap) {
+                cap = cap ? 2 * cap : RUN_MERGE_WAYS;
+                if ((more_runs = realloc(runs, cap * sizeof(FILE *))))
+                    runs = more_runs;
+                if ((more_levels = realloc(levels, cap * sizeof(unsigned))))
+                    levels = more_levels;
+                if (! more_runs || ! more_levels)  ok = false;
+            }
+            if (ok && (runs[n] = spill_part(index))) {
+                levels[n++] = 0;
+            } else {
+                ok = false;
+            }
+        }
+        word_index_destroy(index);
+
+        while (ok && n >= RUN_MERGE_WAYS &&
+               levels[n - RUN_MERGE_WAYS] == levels[n - 1]) {
+            n -= RUN_MERGE_WAYS;
+            if ((runs[n] = run_combine(runs + n, RUN_MERGE_WAYS)))
+                levels[n++]++;
+            else
+                ok = false;
+        }
+    }
+
+    if (ok && n > 0) {
+        ok = run_merge(runs, n, out);
+    } else {
+        while (n > 0)  fclose(runs[--n]);
+    }
+    free(runs);
+    free(levels);
+    return ok;
+}
+
+void word_index_destroy(bag_t *index)
+{
+    // free the memory allocated for each index entry, then the memory for
+    // the index itself (the entries need not come out in order for this)
+    bag_traverse(index, entry_destroy);
+    bag_destroy(index);
+}
+
+/******************************************************************************
+ *  Definitions of helper functions -- see above for documentation.           *
+ ******************************************************************************/
+
+bag_t *generate_index(tokenizer_t *input, int min_word_len,
+                      const bag_ops_t *backend)
+{
+    bag_t *index = bag_create_keyed(backend, entry_cmp, entry_hash,
+                                    entry_key);
+
+    if (index)  word_index_extend(index, input, min_word_len);
+    return index;
+}
+
+bool generate_part(bag_t *index, tokenizer_t *input, int min_word_len,
+                   size_t budget)
+{
+    word_t word;
+    entry_t new_word;
+    bag_elem_t entry;
+    size_t memory = 0, size, pages;
+
+    while (memory < budget) {
+        if (! tokenizer_next(input, &word))  return true;
+        if (word.len < (size_t) min_word_len)  continue;
+
+        new_word.entry_word = (char *) word.text;
+        new_word.entry_len = word.len;
+        size = bag_size(index);
+        entry = bag_find_or_insert(index, &new_word, entry_make, &word);
+        if (! entry)  continue;
+
+        // count a new entry, and what its page list grows by
+        if (bag_size(index) > size)
+            memory += ENTRY_MEMORY + word.len + 1;
+        pages = page_list_memory(&((entry_t *) entry)->page_index);
+        entry_add((entry_t *) entry, word.page);
+        memory += page_list_memory(&((entry_t *) entry)->page_index) - pages;
+    }
+    return false;
+}
+
+FILE *spill_part(const bag_t *index)
+{
+    FILE *run = tmpfile();
+    writer_t writer;
+    bool ordered;
+
+    if (! run)  return NULL;
+    writer_init(&writer, run);
+    ordered = bag_traverse_with(index, entry_spill, &writer);
+    if (! writer_flush(&writer) || ! ordered) {
+        fclose(run);
+        return NULL;
+    }
+    return run;
+}
+
+bag_t *generate_index_parallel(tokenizer_t *input, int min_word_len,
+                               const bag_ops_t *backend, int threads)
+{
+    tokenizer_t *parts[WORD_INDEX_MAX_THREADS];
+    worker_t workers[WORD_INDEX_MAX_THREADS];
+    size_t bounds[WORD_INDEX_MAX_THREADS + 1];
+    bag_elem_t *buffer = NULL, *entries, *next;
+    bag_t *index = NULL;
+    size_t total = 0, n, i;
+    bool failed = false;
+    int t;
+#ifdef HAVE_PTHREADS
+    pthread_t ids[WORD_INDEX_MAX_THREADS];
+    bool started[WORD_INDEX_MAX_THREADS];
+#endif
+
+    if (! tokenizer_split(input, parts, threads))
+        return generate_index(input, min_word_len, backend);
+
+    // index every part; whatever part cannot get its own thread is indexed
+    // right here instead
+    for (t = 0; t < threads; t++) {
+        workers[t].input = parts[t];
+        workers[t].min_word_len = min_word_len;
+        workers[t].backend = backend;
+        workers[t].index = NULL;
+#ifdef HAVE_PTHREADS
+        started[t] = t > 0 && pthread_create(&ids[t], NULL, worker_run,
+                                             &workers[t]) == 0;
+        if (! started[t])
+#endif
+            worker_run(&workers[t]);
+    }
+#ifdef HAVE_PTHREADS
+    for (t = 1; t < threads; t++)
+        if (started[t])  pthread_join(ids[t], NULL);
+#endif
+
+    // room for the entries of every part, twice over for merging
+    for (t = 0; t < threads; t++) {
+        tokenizer_close(parts[t]);
+        if (workers[t].index)
+            total += bag_size(workers[t].index);
+        else
+            failed = true;
+    }
+    if (! failed && total > 0 &&
+        ! (buffer = malloc(2 * total * sizeof(bag_elem_t))))
+        failed = true;
+
+    // take the entries out of the index of each part, in file order (each
+    // part's entries come out sorted); on failure, just destroy them
+    entries = next = buffer;
+    bounds[0] = 0;
+    for (t = 0; t < threads; t++) {
+        if (workers[t].index) {
+            if (failed)
+                bag_traverse(workers[t].index, entry_destroy);
+            else if (! bag_traverse_with(workers[t].index, entry_collect,
+                                         &next))
+                failed = true;
+            bag_destroy(workers[t].index);
+        }
+        bounds[t + 1] = next - buffer;
+    }
+    if (failed && buffer)
+        for (i = 0; buffer + i < next; i++)  entry_destroy(buffer[i]);
+
+    // merge the sorted runs of the parts and build the index from them
+    if (! failed) {
+        n = entry_merge_runs(&entries, buffer + total, bounds, threads);
+        index = bag_build_sorted_keyed(backend, entry_cmp, entry_hash,
+                                       entry_key, entries, n);
+        if (! index)
+            for (i = 0; i < n; i++)  entry_destroy(entries[i]);
+    }
+    free(buffer);
+    return index;
+}
+
+void *worker_run(void *w)
+{
+    worker_t *worker = w;
+    worker->index = generate_index(worker->input, worker->min_word_len,
+                                   worker->backend);
+    return NULL;
+}
+
+#ifdef HAVE_PTHREADS
+
+bag_t *generate_index_sharded(tokenizer_t *input, int min_word_len,
+                              const bag_ops_t *backend, int threads,
+                              int shards)
+{
+    tokenizer_t *parts[WORD_INDEX_MAX_THREADS];
+    shard_worker_t workers[WORD_INDEX_MAX_THREADS];
+    pthread_t ids[WORD_INDEX_MAX_THREADS];
+    bool started[WORD_INDEX_MAX_THREADS];
+    sharded_t index;
+    word_t *sample = NULL, *bounds = NULL, word;
+    bag_elem_t *entries = NULL, *next;
+    bag_t *result = NULL;
+    size_t per_part, total = 0, n = 0, s, i;
+    bool failed = false;
+    int t;
+
+    if (! tokenizer_split(input, parts, threads))
+        return generate_index(input, min_word_len, backend);
+
+    /* First, read the first words of every part, and take the bounds of the
+     * shards from them in order. */
+    per_part = ((size_t) shards * SHARD_SAMPLE + threads - 1) / threads;
+    for (t = 0; t < threads; t++) {
+        workers[t].input = parts[t];
+        workers[t].min_word_len = min_word_len;
+        workers[t].sample_len = 0;
+        if (! (workers[t].sample = malloc(per_part * sizeof(word_t)))) {
+            failed = true;
+            continue;
+        }
+        while (workers[t].sample_len < per_part &&
+               tokenizer_next(parts[t], &word))
+            if (word.len >= (size_t) min_word_len)
+                workers[t].sample[workers[t].sample_len++] = word;
+        total += workers[t].sample_len;
+    }
+    if (! failed && ! (sample = malloc((total ? total : 1) * sizeof(word_t))))
+        failed = true;
+    if (! failed && ! (bounds = malloc(shards * sizeof(word_t))))
+        failed = true;
+    if (! failed) {
+        for (t = i = 0; t < threads; t++) {
+            memcpy(sample + i, workers[t].sample,
+                   workers[t].sample_len * sizeof(word_t));
+            i += workers[t].sample_len;
+        }
+        qsort(sample, total, sizeof(word_t), word_order);
+        for (s = 1; total > 0 && s < (size_t) shards; s++) {
+            word = sample[s * total / shards];
+            if (n == 0 || word_order(&bounds[n - 1], &word) < 0)
+                bounds[n++] = word;
+        }
+    }
+
+    /* Next, create the shards. */
+    index.shards = NULL;
+    index.n = 0;
+    index.bounds = bounds;
+    if (! failed && ! (index.shards = malloc((n + 1) * sizeof(shard_t))))
+        failed = true;
+    for (; ! failed && index.n < n + 1; index.n++) {
+        shard_t *shard = &index.shards[index.n];
+
+        shard->index = bag_create_keyed(backend, entry_cmp, entry_hash,
+                                        entry_key);
+        if (! shard->index || pthread_mutex_init(&shard->lock, NULL) != 0) {
+            if (shard->index)  bag_destroy(shard->index);
+            failed = true;
+            break;
+        }
+        shard->late = NULL;
+        shard->late_len = shard->late_cap = 0;
+        shard->failed = false;
+    }
+
+    /* Next, add the words of every part, each in its own thread, and then
+     * finish the shards, each thread taking every threads-th shard. */
+    for (t = 0; ! failed && t < threads; t++) {
+        workers[t].index = &index;
+        workers[t].first = t;
+        workers[t].step = threads;
+        started[t] = t > 0 && pthread_create(&ids[t], NULL, shard_insert_run,
+                                             &workers[t]) == 0;
+        if (! started[t])  shard_insert_run(&workers[t]);
+    }
+    for (t = 1; ! failed && t < threads; t++)
+        if (started[t])  pthread_join(ids[t], NULL);
+    for (t = 0; ! failed && t < threads; t++) {
+        started[t] = t > 0 && pthread_create(&ids[t], NULL, shard_finish_run,
+                                             &workers[t]) == 0;
+        if (! started[t])  shard_finish_run(&workers[t]);
+    }
+    for (t = 1; ! failed && t < threads; t++)
+        if (started[t])  pthread_join(ids[t], NULL);
+
+    /* Finally, take the entries out of the shards in order (each shard's
+     * entries come out sorted) and build the index from them. */
+    total = 0;
+    for (s = 0; s < index.n; s++) {
+        total += bag_size(index.shards[s].index);
+        if (index.shards[s].failed)  failed = true;
+    }
+    if (! failed && ! (entries = malloc((total ? total : 1) *
+                                        sizeof(bag_elem_t))))
+        failed = true;
+    next = entries;
+    for (s = 0; s < index.n; s++) {
+        if (failed)
+            bag_traverse(index.shards[s].index, entry_destroy);
+        else if (! bag_traverse_with(index.shards[s].index, entry_collect,
+                                     &next))
+            failed = true;
+        bag_destroy(index.shards[s].index);
+        pthread_mutex_destroy(&index.shards[s].lock);
+        free(index.shards[s].late);
+    }
+    if (failed && entries)
+        for (i = 0; entries + i < next; i++)  entry_destroy(entries[i]);
+    if (! failed) {
+        result = bag_build_sorted_keyed(backend, entry_cmp, entry_hash,
+                                        entry_key, entries, total);
+        if (! result)
+            for (i = 0; i < total; i++)  entry_destroy(entries[i]);
+    }
+
+    free(index.shards);
+    for (t = 0; t < threads; t++) {
+        free(workers[t].sample);
+        tokenizer_close(parts[t]);
+    }
+    free(entries);
+    free(bounds);
+    free(sample);
+    return result;
+}
+
+void shard_insert(sharded_t *index, const word_t *word)
+{
+    size_t low = 0, high = index->n - 1, middle;
+    shard_t *shard;
+    entry_t probe;
+    entry_t *entry;
+    late_page_t *late;
+
+    // the shard is the number of bounds at or before the word
+    while (low < high) {
+        middle = low + (high - low) / 2;
+        if (word_order(&index->bounds[middle], word) <= 0)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    shard = &index->shards[low];
+
+    probe.entry_word = (char *) word->text;
+    probe.entry_len = word->len;
+    pthread_mutex_lock(&shard->lock);
+    entry = (entry_t *) bag_find_or_insert(shard->index, &probe, entry_make,
+                                           (void *) word);
+    if (! entry) {
+        shard->failed = true;
+    } else if (word->page >= page_list_last(&entry->page_index)) {
+        if (! page_list_add(&entry->page_index, word->page))
+            shard->failed = true;
+    } else if (shard->late_len == 0 ||
+               shard->late[shard->late_len - 1].entry != entry ||
+               shard->late[shard->late_len - 1].page != word->page) {
+        // the same word is often seen again on the same page right away
+        if (shard->late_len == shard->late_cap) {
+            shard->late_cap = shard->late_cap ? 2 * shard->late_cap : 64;
+            late = realloc(shard->late, shard->late_cap * sizeof(late_page_t));
+            if (late)
+                shard->late = late;
+            else
+                shard->failed = true;
+        }
+        if (shard->late_len < shard->late_cap && ! shard->failed) {
+            shard->late[shard->late_len].entry = entry;
+            shard->late[shard->late_len++].page = word->page;
+        }
+    }
+    pthread_mutex_unlock(&shard->lock);
+}
+
+void shard_finish(shard_t *shard)
+{
+    unsigned *pages;
+    size_t i, j, k;
+
+    if (shard->late_len == 0)  return;
+    if (! (pages = malloc(shard->late_len * sizeof(unsigned)))) {
+        shard->failed = true;
+        return;
+    }
+
+    // the late pages of each word end up next to each other, in order
+    qsort(shard->late, shard->late_len, sizeof(late_page_t), late_order);
+    for (i = 0; i < shard->late_len; i = j) {
+        for (j = i, k = 0; j < shard->late_len &&
+                           shard->late[j].entry == shard->late[i].entry; j++)
+            pages[k++] = shard->late[j].page;
+        if (! page_list_union(&shard->late[i].entry->page_index, pages, k))
+            shard->failed = true;
+    }
+    free(pages);
+    free(shard->late);
+    shard->late = NULL;
+    shard->late_len = shard->late_cap = 0;
+}
+
+void *shard_insert_run(void *w)
+{
+    shard_worker_t *worker = w;
+    word_t word;
+    size_t i;
+
+    for (i = 0; i < worker->sample_len; i++)
+        shard_insert(worker->index, &worker->sample[i]);
+    while (tokenizer_next(worker->input, &word))
+        if (word.len >= (size_t) worker->min_word_len)
+            shard_insert(worker->index, &word);
+    return NULL;
+}
+
+void *shard_finish_run(void *w)
+{
+    shard_worker_t *worker = w;
+    size_t s;
+
+    for (s = worker->first; s < worker->index->n; s += worker->step)
+        shard_finish(&worker->index->shards[s]);
+    return NULL;
+}
+
+int word_order(const void *w1, const void *w2)
+{
+    const word_t *word1 = w1, *word2 = w2;
+    size_t len = word1->len < word2->len ? word1->len : word2->len;
+    int result = memcmp(word1->text, word2->text, len);
+
+    if (result == 0 && word1->len != word2->len)
+        result = word1->len < word2->len ? -1 : 1;
+    return result;
+}
+
+int late_order(const void *l1, const void *l2)
+{
+    const late_page_t *late1 = l1, *late2 = l2;
+    int result = entry_cmp(late1->entry, late2->entry);
+
+    if (result == 0)
+        result = (late1->page > late2->page) - (late1->page < late2->page);
+    return result;
+}
+
+void print_entry(bag_elem_t e, void *printer)
+{
+    printer_t *p = printer;
+
+    p->batch[p->len++] = e;
+    if (p->len == p->cap)  print_batch(p);
+}
+
+/* The batch is cut into ranges that differ by at most one entry; the calling
+ * thread formats the first range itself once the other threads are started.
+ */
+void print_batch(printer_t *printer)
+{
+    print_worker_t workers[WORD_INDEX_MAX_THREADS];
+    pthread_t ids[WORD_INDEX_MAX_THREADS];
+    bool started[WORD_INDEX_MAX_THREADS];
+    size_t start, end;
+    int t;
+
+    for (t = 0; t < printer->threads; t++) {
+        start = printer->len * t / printer->threads;
+        end = printer->len * (t + 1) / printer->threads;
+        workers[t].entries = printer->batch + start;
+        workers[t].n = end - start;
+        workers[t].writer = &printer->writers[t];
+        started[t] = t > 0 && pthread_create(&ids[t], NULL, print_run,
+                                             &workers[t]) == 0;
+    }
+    for (t = 0; t < printer->threads; t++) {
+        if (started[t])
+            pthread_join(ids[t], NULL);
+        else
+            print_run(&workers[t]);
+    }
+
+    for (t = 0; t < printer->threads; t++)
+        if (! writer_transfer(&printer->writers[t], printer->out))
+            printer->failed = true;
+    printer->len = 0;
+}
+
+void *print_run(void *w)
+{
+    print_worker_t *worker = w;
+    size_t i;
+
+    for (i = 0; i < worker->n; i++)
+        entry_write(worker->entries[i], worker->writer);
+    return NULL;
+}
+
+#endif/*HAVE_PTHREADS*/
+
+bool prefix_write(bag_elem_t e, void *scan)
+{
+    const entry_t *entry = e;
+    prefix_scan_t *s = scan;
+
+    if (entry->entry_len < s->len ||
+        memcmp(entry->entry_word, s->prefix, s->len) != 0)
+        return false;
+    entry_write(e, s->writer);
+    return true;
+}
+
+void prefix_filter(bag_elem_t e, void *scan)
+{
+    (void) prefix_write(e, scan);
+}
+
+void entry_collect(bag_elem_t e, void *next)
+{
+    bag_elem_t **position = next;
+    *(*position)++ = e;
+}
+
+/* Each pass halves the number of runs, moving the entries back and forth
+ * between the two arrays.  The new bounds are written over the old ones, but
+ * never before they have been read.
+ */
+size_t entry_merge_runs(bag_elem_t **entries, bag_elem_t *tmp,
+                        size_t bounds[], int runs)
+{
+    bag_elem_t *src = *entries, *dst = tmp, *swap;
+    size_t lo, mid, hi, n;
+    int r;
+
+    while (runs > 1) {
+        n = 0;
+        for (r = 0; r < runs; r += 2) {
+            lo = bounds[r];
+            mid = bounds[r + 1];
+            hi = r + 1 < runs ? bounds[r + 2] : mid;
+            n += entry_merge_two(src + lo, mid - lo, src + mid, hi - mid,
+                                 dst + n);
+            bounds[r / 2 + 1] = n;
+        }
+        runs = (runs + 1) / 2;
+        swap = src;
+        src = dst;
+        dst = swap;
+    }
+    *entries = src;
+    return bounds[1];
+}
+
+size_t entry_merge_two(bag_elem_t *a, size_t na, bag_elem_t *b, size_t nb,
+                       bag_elem_t *out)
+{
+    size_t i = 0, j = 0, n = 0;
+    int result;
+
+    while (i < na && j < nb) {
+        result = entry_cmp(a[i], b[j]);
+        if (result < 0) {
+            out[n++] = a[i++];
+        } else if (result > 0) {
+            out[n++] = b[j++];
+        } else {
+            // same word: its pages in b all come after its pages in a
+            page_list_merge(&((entry_t *) a[i])->page_index,
+                            &((const entry_t *) b[j])->page_index);
+            entry_destroy(b[j++]);
+            out[n++] = a[i++];
+        }
+    }
+    while (i < na)  out[n++] = a[i++];
+    while (j < nb)  out[n++] = b[j++];
+    return n;
+}
+
+bag_elem_t entry_create(const word_t *word)
+{
+    // Allocate the memory for the new entry
+    entry_t *new_entry = malloc(sizeof(entry_t));
+    if (! new_entry)  return NULL;
+
+    // Copy the word into a new string and put it in the entry.
+    new_entry -> entry_word = malloc((word->len + 1) * sizeof(char));
+    if (! new_entry -> entry_word) {
+        free(new_entry);
+        return NULL;
+    }
+    memcpy(new_entry -> entry_word, word->text, word->len);
+    new_entry -> entry_word[word->len] = '\0';
+    new_entry -> entry_len = word->len;
+
+    // Start the page list with the page the word was first seen on (the
+    // first page always fits in the list without allocating memory).
+    page_list_init(&new_entry->page_index);
+    page_list_add(&new_entry->page_index, word->page);
+    return new_entry;
+}
+
+bag_elem_t entry_make(bag_elem_t probe, void *word)
+{
+    (void) probe;
+    return entry_create((const word_t *) word);
+}
+
+bag_elem_t entry_load(const index_file_t *file, size_t i)
+{
+    entry_t *new_entry = malloc(sizeof(entry_t));
+    const char *word;
+    page_iter_t pages;
+    unsigned page;
+    size_t len;
+
+    if (! new_entry)  return NULL;
+    word = index_file_word(file, i, &len);
+    if (! (new_entry->entry_word = malloc(len + 1))) {
+        free(new_entry);
+        return NULL;
+    }
+    memcpy(new_entry->entry_word, word, len);
+    new_entry->entry_word[len] = '\0';
+    new_entry->entry_len = len;
+
+    page_list_init(&new_entry->page_index);
+    index_file_pages(file, i, &pages);
+    while (page_list_next(&pages, &page)) {
+        if (! page_list_add(&new_entry->page_index, page)) {
+            entry_destroy(new_entry);
+            return NULL;
+        }
+    }
+    return new_entry;
+}
+
+void entry_destroy(bag_elem_t e)
+{
+    entry_t *old_entry = (entry_t *) e;
+    free(old_entry -> entry_word);
+
+    // free the page list
+    page_list_destroy(&old_entry->page_index);
+
+    free(old_entry);
+}
+
+void entry_write(bag_elem_t e, void *writer)
+{
+    // Write the word
+    const entry_t *this_entry = e;
+    page_iter_t pages;
+    unsigned page;
+
+    writer_put(writer, this_entry->entry_word, this_entry->entry_len);
+    writer_put(writer, ": ", 2);
+
+    // Decode the page list in one pass, with a comma and space before every
+    // page except the first.
+    page_list_begin(&this_entry->page_index, &pages);
+    if (page_list_next(&pages, &page))
+        writer_put_uint(writer, page);
+    while (page_list_next(&pages, &page)) {
+        writer_put(writer, ", ", 2);
+        writer_put_uint(writer, page);
+    }
+
+    writer_put_char(writer, '\n');
+}
+
+void entry_save(bag_elem_t e, void *builder)
+{
+    const entry_t *entry = e;
+
+    index_file_add(builder, entry->entry_word, entry->entry_len,
+                   &entry->page_index);
+}
+
+void entry_spill(bag_elem_t e, void *run)
+{
+    const entry_t *entry = e;
+
+    run_put(run, entry->entry_word, entry->entry_len, &entry->page_index);
+}
+
+int entry_cmp(bag_elem_t e1, bag_elem_t e2)
+{
+    const entry_t *entry1 = e1, *entry2 = e2;
+    size_t len = entry1->entry_len < entry2->entry_len ?
+                 entry1->entry_len : entry2->entry_len;
+    int result = memcmp(entry1->entry_word, entry2->entry_word, len);
+
+    // Words are not always null-terminated, so compare them by length when
+    // one is a prefix of the other (which gives the same order as strcmp).
+    if (result == 0 && entry1->entry_len != entry2->entry_len)
+        result = entry1->entry_len < entry2->entry_len ? -1 : 1;
+    return result;
+}
+
+unsigned long entry_hash(bag_elem_t e)
+{
+    const entry_t *entry = e;
+    const unsigned char *c = (const unsigned char *) entry->entry_word;
+    const unsigned char *end = c + entry->entry_len;
+    unsigned long hash = 2166136261UL;
+
+    for (; c < end; c++)
+        hash = (hash ^ *c) * 16777619UL;
+    return hash;
+}
+
+bag_key_t entry_key(bag_elem_t e)
+{
+    const entry_t *entry = e;
+    const unsigned char *c = (const unsigned char *) entry->entry_word;
+    bag_key_t key = 0;
+    size_t i;
+
+    for (i = 0; i < 8; i++)
+        key = key << 8 | (i < entry->entry_len ? c[i] : 0);
+    return key;
+}
+
+void entry_add(entry_t *entry, unsigned page)
+{
+    // Pages come in order from the tokenizer, so the page is either already the
+    // last one in the list or it goes at the end.
+    page_list_add(&entry->page_index, page);
+}
@@ -0,0 +1,236 @@
+/* FILE word_index.h
+ *    Declarations of functions to build, print and destroy the index of the
+ *    words (and their page numbers) in a text file.
+ */
+#ifndef WORD_INDEX_H
+#define WORD_INDEX_H
+
+/******************************************************************************
+ *  Types and Constants.                                                      *
+ ******************************************************************************/
+
+#include <stdbool.h> /* for type bool */
+#include <stdio.h>   /* for type FILE */
+
+#include "bag.h"
+#include "file_util.h"
+#include "index_file.h"
+
+/* CONSTANT WORD_INDEX_MAX_THREADS
+ *    Largest number of threads that can be used to build one index.
+ */
+#define WORD_INDEX_MAX_THREADS 64
+
+/* CONSTANT WORD_INDEX_MAX_SHARDS
+ *    Largest number of shards of an index built by word_index_create_sharded.
+ */
+#define WORD_INDEX_MAX_SHARDS 1024
+
+/******************************************************************************
+ *  Function declarations -- with full documentation.                         *
+ ******************************************************************************/
+
+/* FUNCTION word_index_create
+ *    Create and return an index of every word whose length is at least
+ *    min_word_len in file input, along with each word's page numbers.
+ * Parameters and preconditions:
+ *    input != NULL: a tokenizer positioned at the start of the file
+ *    min_word_len > 0: the minimum length of words to put in the index
+ *    backend != NULL: the kind of bag to store the index in
+ *    0 < threads <= WORD_INDEX_MAX_THREADS: the number of threads to use
+ * Return value:
+ *    a bag that contains every word in file input whose length is at least
+ *    min_word_length, along with the page numbers where the word appears;
+ *    NULL in case of any error with memory allocation
+ * Side-effects:
+ *    memory is allocated for the bag and the file has been read to the end
+ */
+bag_t *word_index_create(tokenizer_t *input, int min_word_len,
+                         const bag_ops_t *backend, int threads);
+
+/* FUNCTION word_index_create_sharded
+ *    Create and return the same index as word_index_create, with threads that
+ *    all add their words to one shared index.  The index is split into
+ *    shards by ranges of words, with bounds picked from a sample of the words
+ *    of the file so that the shards are about the same size; each shard is a
+ *    bag of its own with its own lock, so threads only wait for each other
+ *    when they add words of the same range at the same time.  Once the file
+ *    is read, the shards are put together in order into one bag.
+ * Parameters and preconditions:
+ *    input != NULL: a tokenizer positioned at the start of the file
+ *    min_word_len > 0: the minimum length of words to put in the index
+ *    backend != NULL: the kind of bag to store the index in
+ *    0 < threads <= WORD_INDEX_MAX_THREADS: the number of threads to use
+ *    0 < shards <= WORD_INDEX_MAX_SHARDS: the number of shards to split the
+ *                                         index into (fewer are used if the
+ *                                         sample has too few words)
+ * Return value:
+ *    a bag that contains every word in file input whose length is at least
+ *    min_word_length, along with the page numbers where the word appears;
+ *    NULL in case of any error with memory allocation
+ * Side-effects:
+ *    memory is allocated for the bag and the file has been read to the end;
+ *    the index is built by the calling thread alone if threads are not
+ *    available
+ */
+bag_t *word_index_create_sharded(tokenizer_t *input, int min_word_len,
+                                 const bag_ops_t *backend, int threads,
+                                 int shards);
+
+/* FUNCTION word_index_load
+ *    Create and return an index holding the words and pages of an index file,
+ *    to be extended by word_index_extend.  Takes time proportional to the
+ *    size of the index file.
+ * Parameters and preconditions:
+ *    file != NULL: an opened index file
+ *    backend != NULL: the kind of bag to store the index in
+ * Return value:
+ *    a bag that contains every word of file along with its pages, as if it
+ *    had been created by word_index_create; NULL in case of any error with
+ *    memory allocation
+ * Side-effects:
+ *    memory is allocated for the bag
+ */
+bag_t *word_index_load(const index_file_t *file, const bag_ops_t *backend);
+
+/* FUNCTION word_index_extend
+ *    Add every word whose length is at least min_word_len in the rest of file
+ *    input to an index, along with each word's page numbers.  The file is
+ *    indexed by the calling thread.
+ * Parameters and preconditions:
+ *    index != NULL: an index created by word_index_create or word_index_load
+ *    input != NULL: a tokenizer for text that comes after the text of index
+ *                   (no page of it comes before the last page of index)
+ *    min_word_len > 0: the minimum length of words to put in the index
+ * Return value:  none
+ * Side-effects:
+ *    the words of input have been added to index (or had their pages added
+ *    to their entries) and the file has been read to the end
+ */
+void word_index_extend(bag_t *index, tokenizer_t *input, int min_word_len);
+
+/* FUNCTION word_index_print
+ *    Print every word of an index and its page numbers to stdout, in order.
+ * Parameters and preconditions:
+ *    index != NULL: an index created by word_index_create
+ * Return value:  none
+ * Side-effects:
+ *    one line of the form "word: page, page, ..." has been printed to stdout
+ *    for every word in the index
+ */
+void word_index_print(const bag_t *index);
+
+/* FUNCTION word_index_write
+ *    Write every word of an index and its page numbers to a file, in order,
+ *    in the same form as word_index_print.  The text is formatted into a
+ *    buffer on the stack and written out in large blocks, so several indexes
+ *    can be written at the same time.
+ * Parameters and preconditions:
+ *    index != NULL: an index created by word_index_create
+ *    out != NULL: a file open for writing
+ * Return value:
+ *    true if the whole index was handed to out, in order; false if a write
+ *    failed or the index could not be traversed in order (see bag_traverse)
+ * Side-effects:
+ *    one line of the form "word: page, page, ..." has been written to out for
+ *    every word in the index
+ */
+bool word_index_write(const bag_t *index, FILE *out);
+
+/* FUNCTION word_index_write_parallel
+ *    Write the same text as word_index_write, with several threads doing the
+ *    formatting: the entries are taken out of the index in order, a batch at
+ *    a time, and each batch is cut into one range of consecutive entries per
+ *    thread.  The ranges are formatted into memory at the same time, then
+ *    written to out one after the other, so the text is the same byte for
+ *    byte and only one batch of it is ever held in memory.
+ * Parameters and preconditions:
+ *    index != NULL: an index created by word_index_create
+ *    0 < threads <= WORD_INDEX_MAX_THREADS: the number of threads to use
+ *    out != NULL: a file open for writing
+ * Return value:
+ *    true if the whole index was handed to out; false if a write failed or
+ *    in case of error with memory allocation
+ * Side-effects:
+ *    one line of the form "word: page, page, ..." has been written to out for
+ *    every word in the index; the index is written by the calling thread
+ *    alone (as by word_index_write) if threads are not available
+ */
+bool word_index_write_parallel(const bag_t *index, int threads, FILE *out);
+
+/* FUNCTION word_index_write_prefix
+ *    Write the words of an index that start with a prefix and their page
+ *    numbers to a file, in order, in the same form as word_index_print.  For
+ *    indexes stored in a kind of bag that supports bag_range, only the part
+ *    of the index from the prefix on is visited, up to the first word that
+ *    does not start with it; other kinds of bags are traversed in full.
+ * Parameters and preconditions:
+ *    index != NULL: an index created by word_index_create
+ *    prefix != NULL: the characters the words must start with (every word
+ *                    starts with "")
+ *    out != NULL: a file open for writing
+ * Return value:
+ *    true if every line was handed to out, in order; false if a write failed
+ *    or the index could not be traversed in order (see bag_traverse)
+ * Side-effects:
+ *    one line of the form "word: page, page, ..." has been written to out for
+ *    every word in the index that starts with prefix
+ */
+bool word_index_write_prefix(bag_t *index, const char *prefix, FILE *out);
+
+/* FUNCTION word_index_save
+ *    Save an index to a binary index file (see index_file.h), to be looked up
+ *    later without reading the text again, or brought up to date with
+ *    word_index_load and word_index_extend when text is appended.
+ * Parameters and preconditions:
+ *    index != NULL: an index created by word_index_create (or loaded)
+ *    min_word_len > 0: the minimum length of the words in the index
+ *    state != NULL: the state of the text file at the end of the index (see
+ *                   tokenizer_save)
+ *    out != NULL: a file open for writing in binary mode
+ * Return value:
+ *    true if the whole index file was handed to out; false if a write failed
+ *    or in case of error with memory allocation
+ * Side-effects:
+ *    the index file of every word in the index has been written to out
+ */
+bool word_index_save(const bag_t *index, int min_word_len,
+                     const tokenizer_state_t *state, FILE *out);
+
+/* FUNCTION word_index_write_spilled
+ *    Write the same index as word_index_create and word_index_write, while
+ *    keeping at most about budget bytes of words and pages in memory: each
+ *    time the index of the text read so far reaches the budget, it is
+ *    spilled to a temporary file as a sorted run (run_file.h) and a new one
+ *    is started; the runs are merged into the index at the end.  The whole
+ *    index is built by one thread.
+ * Parameters and preconditions:
+ *    input != NULL: a tokenizer positioned at the start of the file
+ *    min_word_len > 0: the minimum length of words to put in the index
+ *    backend != NULL: the kind of bag to hold each part of the index in
+ *    budget > 0: the estimated number of bytes of memory for the words and
+ *                pages of a part
+ *    out != NULL: a file open for writing
+ * Return value:
+ *    true if the whole index was handed to out; false if a temporary file
+ *    could not be created or written, a write to out failed or in case of
+ *    error with memory allocation
+ * Side-effects:
+ *    the file has been read to the end; one line of the form "word: page,
+ *    page, ..." has been written to out for every word in the index
+ */
+bool word_index_write_spilled(tokenizer_t *input, int min_word_len,
+                              const bag_ops_t *backend, size_t budget,
+                              FILE *out);
+
+/* FUNCTION word_index_destroy
+ *    Free all the memory allocated for an index.
+ * Parameters and preconditions:
+ *    index != NULL: an index created by word_index_create
+ * Return value:  none
+ * Side-effects:
+ *    all memory allocated for the index and its entries has been freed
+ */
+void word_index_destroy(bag_t *index);
+
+#endif/*WORD_INDEX_H*/
@@ -0,0 +1,141 @@
+/* FILE writer.c
+ *    Implementation of the writer functions.
+ */
+
+/******************************************************************************
+ *  Types and Constants.                                                      *
+ ******************************************************************************/
+
+#include <string.h>
+
+#include "writer.h"
+
+/* CONSTANT UINT_DIGITS
+ *    Largest number of decimal digits in an unsigned number (3 digits for
+ *    every 10 bits is a safe upper bound, since 2^10 > 10^3).
+ */
+#define UINT_DIGITS ((sizeof(unsigned) * 8 + 9) / 10 * 3 + 1)
+
+/******************************************************************************
+ *  Declarations of helper functions -- including full documentation.         *
+ ******************************************************************************/
+
+/* FUNCTION writer_emit
+ *    Send text out of a writer: to its file, or to the end of its memory for a
+ *    memory writer (which grows by doubling).
+ * Parameters and preconditions:
+ *    w != NULL: a writer
+ *    text != NULL: the text to send (need not be null-terminated)
+ *    len: the number of characters of text
+ * Return value:  none
+ * Side-effects:
+ *    the text has been written or stored; w->failed has been set if the
+ *    write failed or memory ran out
+ */
+static
+void writer_emit(writer_t *w, const char *text, size_t len);
+
+/******************************************************************************
+ *  Function definitions -- see header file for documentation.                *
+ ******************************************************************************/
+
+void writer_init(writer_t *w, FILE *file)
+{
+    w->file = file;
+    w->len = 0;
+    w->failed = false;
+    w->mem = NULL;
+    w->mem_len = w->mem_cap = 0;
+}
+
+void writer_init_memory(writer_t *w)
+{
+    writer_init(w, NULL);
+}
+
+void writer_put(writer_t *w, const char *text, size_t len)
+{
+    if (w->len + len > WRITER_SIZE) {
+        writer_flush(w);
+        /* Text that would not fit even in an empty buffer goes straight to
+         * the file. */
+        if (len > WRITER_SIZE) {
+            writer_emit(w, text, len);
+            return;
+        }
+    }
+    memcpy(w->buf + w->len, text, len);
+    w->len += len;
+}
+
+void writer_put_char(writer_t *w, char c)
+{
+    if (w->len == WRITER_SIZE)  writer_flush(w);
+    w->buf[w->len++] = c;
+}
+
+/* The digits come out lowest first, so they are written from the end of a
+ * small array, then copied over in one go.
+ */
+void writer_put_uint(writer_t *w, unsigned n)
+{
+    char digits[UINT_DIGITS];
+    char *first = digits + UINT_DIGITS;
+
+    do {
+        *--first = (char) ('0' + n % 10);
+        n /= 10;
+    } while (n > 0);
+    writer_put(w, first, digits + UINT_DIGITS - first);
+}
+
+bool writer_flush(writer_t *w)
+{
+    if (w->len > 0)  writer_emit(w, w->buf, w->len);
+    w->len = 0;
+    return ! w->failed;
+}
+
+bool writer_transfer(writer_t *w, FILE *file)
+{
+    bool ok = writer_flush(w);
+
+    if (w->mem_len > 0 && fwrite(w->mem, 1, w->mem_len, file) != w->mem_len)
+        ok = false;
+    w->mem_len = 0;
+    w->failed = false;
+    return ok;
+}
+
+void writer_release(writer_t *w)
+{
+    free(w->mem);
+    writer_init_memory(w);
+}
+
+/******************************************************************************
+ *  Definitions of helper functions -- see above for documentation.           *
+ ******************************************************************************/
+
+void writer_emit(writer_t *w, const char *text, size_t len)
+{
+    size_t cap = w->mem_cap ? w->mem_cap : WRITER_SIZE;
+    char *mem;
+
+    if (w->file) {
+        if (fwrite(text, 1, len, w->file) != len)  w->failed = true;
+        return;
+    }
+
+    if (w->mem_len + len > w->mem_cap) {
+        while (cap < w->mem_len + len)  cap *= 2;
+        if (! (mem = realloc(w->mem, cap))) {
+            w->failed = true;
+            return;
+        }
+        w->mem = mem;
+        w->mem_cap = cap;
+    }
+    memcpy(w->mem + w->mem_len, text, len);
+    w->mem_len += len;
+}
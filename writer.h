@@ -0,0 +1,148 @@
+/* FILE writer.h
+ *    Declarations of types and functions for "writers" -- buffers that collect
+ *    formatted text in memory and write it to a file in large blocks, without
+ *    going through printf for every word and number.  A "memory writer" keeps
+ *    all its text in memory instead, until it is handed to a file in one go,
+ *    so that text can be formatted by several threads and written in order.
+ */
+#ifndef WRITER_H
+#define WRITER_H
+
+/******************************************************************************
+ *  Types and Constants.                                                      *
+ ******************************************************************************/
+
+#include <stdbool.h> /* for type bool   */
+#include <stdio.h>   /* for type FILE   */
+#include <stdlib.h>  /* for type size_t */
+
+/* CONSTANT WRITER_SIZE
+ *    Number of bytes collected by a writer before they are written to its
+ *    file.  Large enough that the cost of each call to fwrite disappears, and
+ *    small enough for a writer to live on the stack.
+ */
+#define WRITER_SIZE 65536U
+
+/* TYPE writer_t
+ *    A buffer of text waiting to be written to a file.  Writers are meant to
+ *    be declared directly by whoever uses them (they need no memory of their
+ *    own), so the definition is public -- but its fields should only be
+ *    accessed through the functions below.
+ */
+typedef struct writer {
+    FILE *file;             /* the file the text goes to (NULL for a
+                               memory writer)                       */
+    size_t len;             /* number of bytes waiting in buf       */
+    bool failed;            /* true once a write to file has failed */
+    char *mem;              /* the text of a memory writer          */
+    size_t mem_len;         /* number of bytes of text in mem       */
+    size_t mem_cap;         /* number of bytes mem has room for     */
+    char buf[WRITER_SIZE];  /* the text waiting to be written       */
+} writer_t;
+
+/******************************************************************************
+ *  Function declarations -- with full documentation.                         *
+ ******************************************************************************/
+
+/* FUNCTION writer_init
+ *    Initialize an empty writer for a file.
+ * Parameters and preconditions:
+ *    w != NULL: the writer to initialize
+ *    file != NULL: a file open for writing
+ * Return value:  none
+ * Side-effects:
+ *    *w is initialized to an empty writer for file
+ */
+void writer_init(writer_t *w, FILE *file);
+
+/* FUNCTION writer_init_memory
+ *    Initialize an empty memory writer: its text is kept in memory, which
+ *    grows as needed, until writer_transfer hands it to a file.
+ * Parameters and preconditions:
+ *    w != NULL: the writer to initialize
+ * Return value:  none
+ * Side-effects:
+ *    *w is initialized to an empty memory writer (release it with
+ *    writer_release)
+ */
+void writer_init_memory(writer_t *w);
+
+/* FUNCTION writer_put
+ *    Add some text at the end of a writer.
+ * Parameters and preconditions:
+ *    w != NULL: a writer
+ *    text != NULL: the text to add (need not be null-terminated)
+ *    len: the number of characters of text to add
+ * Return value:  none
+ * Side-effects:
+ *    the text has been added to w; the text already in w may have been
+ *    written to its file to make room
+ */
+void writer_put(writer_t *w, const char *text, size_t len);
+
+/* FUNCTION writer_put_char
+ *    Add one character at the end of a writer.
+ * Parameters and preconditions:
+ *    w != NULL: a writer
+ *    c: the character to add
+ * Return value:  none
+ * Side-effects:
+ *    c has been added to w; the text already in w may have been written to
+ *    its file to make room
+ */
+void writer_put_char(writer_t *w, char c);
+
+/* FUNCTION writer_put_uint
+ *    Add a number, in decimal, at the end of a writer (the same text as
+ *    printf's "%u").
+ * Parameters and preconditions:
+ *    w != NULL: a writer
+ *    n: the number to add
+ * Return value:  none
+ * Side-effects:
+ *    the digits of n have been added to w; the text already in w may have
+ *    been written to its file to make room
+ */
+void writer_put_uint(writer_t *w, unsigned n);
+
+/* FUNCTION writer_flush
+ *    Write all the text in a writer to its file.
+ * Parameters and preconditions:
+ *    w != NULL: a writer
+ * Return value:
+ *    true if every byte ever added to w has been handed to its file; false if
+ *    any write failed (for a memory writer: true unless memory ran out)
+ * Side-effects:
+ *    the text in w has been written to its file (through the file's own
+ *    buffer, which is not flushed) and w is empty -- or, for a memory writer,
+ *    moved to its memory
+ */
+bool writer_flush(writer_t *w);
+
+/* FUNCTION writer_transfer
+ *    Write all the text of a memory writer to a file, and empty the writer
+ *    (keeping its memory for more text).
+ * Parameters and preconditions:
+ *    w != NULL: a memory writer
+ *    file != NULL: a file open for writing
+ * Return value:
+ *    true if every byte ever added to w has been handed to file; false if
+ *    memory ran out for some of the text or a write failed
+ * Side-effects:
+ *    the text of w has been written to file (through the file's own buffer,
+ *    which is not flushed) and w is empty
+ */
+bool writer_transfer(writer_t *w, FILE *file);
+
+/* FUNCTION writer_release
+ *    Free the memory of a memory writer, throwing away its text.
+ * Parameters and preconditions:
+ *    w != NULL: a memory writer
+ * Return value:  none
+ * Side-effects:
+ *    the memory of w has been freed; w must be initialized again before it
+ *    is used
+ */
+void writer_release(writer_t *w);
+
+#endif/*WRITER_H*/